@@ -35,7 +35,7 @@ extern "C" {
 using namespace std;
 using namespace CRF_LogMath;
 
-enum seqtype {SEQUENTIAL, RANDOM_NO_REPLACE, RANDOM_REPLACE};
+enum seqtype {SEQUENTIAL, RANDOM_NO_REPLACE, RANDOM_REPLACE, SHUFFLED};
 
 enum ftrmaptype {STDSTATE, STDTRANS, STDSPARSE, STDSPARSETRANS, INFILE};
 
@@ -49,6 +49,46 @@ enum nodetype { STD_STATE, STD_NSTATE, STD_STATELOG, STD_NSTATELOG, STD_STATEMAS
 // Added by Ryan
 enum modeltype { STDFRAME, STDSEG, STDSEG_NO_DUR, STDSEG_NO_DUR_NO_TRANSFTR, STDSEG_NO_DUR_NO_SEGTRANSFTR };
 
+// categories of the memory counted by CRF_MemStats
+enum memcategory { MEM_NODES, MEM_FEATURES, MEM_GRADIENT, MEM_HYPS, MEM_FST, MEM_NUM_CATEGORIES };
+
+// maximum number of feature files joined into one stream (see CRF_JoinedFeatureStream)
+#ifndef CRF_MAX_FTR_BLOCKS
+#define CRF_MAX_FTR_BLOCKS 8
+#endif
+
+/*
+ * struct CRF_FtrView
+ *
+ * One frame of a joined feature stream, seen in place.  Block k holds the next width[k]
+ * features of the frame at base[k]; the same block of the following frame starts stride[k]
+ * floats further on.  The blocks are in feature order, so the frame is the concatenation of
+ * the blocks.
+ */
+struct CRF_FtrView {
+	QNUInt32 numBlocks;
+	float* base[CRF_MAX_FTR_BLOCKS];
+	size_t stride[CRF_MAX_FTR_BLOCKS];
+	QNUInt32 width[CRF_MAX_FTR_BLOCKS];
+
+	// the view of the frame i frames further on
+	CRF_FtrView next(size_t i) const {
+		CRF_FtrView fv=*this;
+		for (QNUInt32 k=0; k<this->numBlocks; k++) {
+			fv.base[k]+=i*this->stride[k];
+		}
+		return fv;
+	}
+
+	// copies the frame into buf as one contiguous vector
+	void gather(float* buf) const {
+		for (QNUInt32 k=0; k<this->numBlocks; k++) {
+			memcpy(buf,this->base[k],this->width[k]*sizeof(float));
+			buf+=this->width[k];
+		}
+	}
+};
+
 // Added by Ryan
 #ifndef CRF_UINT32_MAX
 #define CRF_UINT32_MAX (0xffffffff)
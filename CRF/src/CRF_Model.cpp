@@ -27,6 +27,8 @@ CRF_Model::CRF_Model(QNUInt32 num_labs)
 	this->model_type = STDFRAME;
 	this->use_broken_class_label = false;
 	this->init_iter = 0;
+	this->quantWeights = NULL;
+	this->fileQuantBits = 0;
 }
 
 /*
@@ -40,6 +42,7 @@ CRF_Model::~CRF_Model()
 
 	// added by Ryan
 	if (this->gradSqrAcc != NULL ) {delete [] this->gradSqrAcc;}
+	if (this->quantWeights != NULL ) {delete this->quantWeights;}
 }
 
 /*
@@ -278,6 +281,192 @@ bool CRF_Model::writeToFile(const char* fname, double* lam, QNUInt32 ll)
 	}
 }
 
+/*
+ * CRF_Model::writeSparseToFile
+ *
+ * Inputs: fname - filename to write file to
+ *         lam - lambda vector to write to file
+ *         ll - length of lambda vector lam
+ *
+ * Returns: true if file can be written, false otherwise
+ *
+ * Writes only the non-zero weights of lam to the file fname: a header line "#sparse <ll> <nnz>"
+ * followed by one "<index> <value>" line per non-zero weight.  readFromFile and
+ * readAverageFromFile read both this format and the dense one.
+ */
+bool CRF_Model::writeSparseToFile(const char* fname, double* lam, QNUInt32 ll)
+{
+	QNUInt32 nnz=0;
+	for (QNUInt32 i=0; i<ll; i++) {
+		if (lam[i] != 0.0) nnz++;
+	}
+	std::ofstream ofile;
+	ofile.open(fname);
+	if (ofile.is_open()) {
+		ofile << "#sparse " << ll << " " << nnz << std::endl;
+		for (QNUInt32 i=0; i<ll; i++) {
+			if (lam[i] != 0.0) {
+				ofile << i << " " << lam[i] << std::endl;
+			}
+		}
+		if (ofile.bad()) {
+			string errstr="CRF_Model::writeSparseToFile() caught exception: errors when writing the weights to the file:\n";
+			errstr += string(fname) + "\n";
+			errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+			throw runtime_error(errstr);
+		}
+		ofile.close();
+		return true;
+	}
+	else {
+		string errstr="CRF_Model::writeSparseToFile() caught exception: cannot open the file:\n";
+		errstr += string(fname) + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+
+		return false;
+	}
+}
+
+/*
+ * CRF_Model::readSparseWeights
+ *
+ * Inputs: ifile - stream positioned after the first line of a weight file
+ *         header - the first line of the file
+ *         lam - vector of lambda_len weights to fill
+ *         fname - name of the file, for the error messages
+ *
+ * Returns: true if the file is in the sparse format (see writeSparseToFile) and was read
+ *   into lam, false if it is a dense file
+ */
+bool CRF_Model::readSparseWeights(std::istream& ifile, const string& header, double* lam, const char* fname)
+{
+	if (header.compare(0,7,"#sparse") != 0) {
+		return false;
+	}
+	QNUInt32 len=0, nnz=0;
+	std::istringstream hss(header.substr(7));
+	hss >> len >> nnz;
+	if (hss.fail() || len != this->lambda_len) {
+		string errstr="CRF_Model::readSparseWeights() caught exception: the sparse weight file ";
+		errstr += string(fname) + " does not match the number of weights of the model.";
+		throw runtime_error(errstr);
+	}
+	for (QNUInt32 i = 0; i < this->lambda_len; i++) {
+		lam[i]=0.0;
+	}
+	for (QNUInt32 n = 0; n < nnz; n++) {
+		std::string s;
+		getline(ifile,s);
+		std::istringstream iss(s);
+		QNUInt32 idx;
+		double val;
+		iss >> std::dec >> idx >> val;
+		if (iss.fail() || idx >= this->lambda_len) {
+			string errstr="CRF_Model::readSparseWeights() caught exception: bad weight line in the sparse weight file ";
+			errstr += string(fname) + ": " + s;
+			throw runtime_error(errstr);
+		}
+		lam[idx]=val;
+	}
+	return true;
+}
+
+/*
+ * CRF_Model::setSparseScoring
+ *
+ * Returns: true if the feature map now skips the zero weights, false if it does not support it
+ *
+ * To be called once the weights are final (e.g. after readFromFile when decoding); the
+ * feature map lists the non-zero weights of the current lambda vector.
+ */
+bool CRF_Model::setSparseScoring()
+{
+	return this->featureMap->setSparseWeights(this->lambda);
+}
+
+/*
+ * CRF_Model::writeQuantizedToFile
+ *
+ * Inputs: fname - filename to write file to
+ *         bits - 8 or 16, size of a quantized weight
+ *
+ * Returns: true if the file was written, false if the feature map does not support quantized
+ *   weights
+ *
+ * Writes the weights with the feature weights of every label and label pair quantized (see
+ * CRF_QuantizedWeights::writeToFile).  readFromFile reads the file back.
+ */
+bool CRF_Model::writeQuantizedToFile(const char* fname, int bits)
+{
+	CRF_QuantizedWeights* qw=this->featureMap->quantizeWeights(this->lambda,bits);
+	if (qw == NULL) {
+		return false;
+	}
+	bool chkwrite=qw->writeToFile(fname,this->lambda);
+	delete qw;
+	return chkwrite;
+}
+
+/*
+ * CRF_Model::setQuantizedScoring
+ *
+ * Inputs: bits - 8 or 16, size of a quantized weight
+ *
+ * Returns: true if the feature map now scores with the quantized weights, false if it does
+ *   not support them
+ *
+ * To be called once the weights are final (e.g. after readFromFile when decoding); lambda
+ * itself is not changed.
+ */
+bool CRF_Model::setQuantizedScoring(int bits)
+{
+	CRF_QuantizedWeights* qw=this->featureMap->quantizeWeights(this->lambda,bits);
+	if (qw == NULL) {
+		return false;
+	}
+	if (!this->featureMap->setQuantizedWeights(qw)) {
+		delete qw;
+		return false;
+	}
+	if (this->quantWeights != NULL) {delete this->quantWeights;}
+	this->quantWeights=qw;
+	return true;
+}
+
+/*
+ * CRF_Model::clearQuantizedScoring
+ *
+ * Goes back to scoring with the double weights.
+ */
+void CRF_Model::clearQuantizedScoring()
+{
+	this->featureMap->clearQuantizedWeights();
+	if (this->quantWeights != NULL) {delete this->quantWeights;}
+	this->quantWeights=NULL;
+}
+
+/*
+ * CRF_Model::getQuantizedWeights
+ *
+ * Returns: the quantized weights the feature map scores with, NULL if none
+ */
+CRF_QuantizedWeights* CRF_Model::getQuantizedWeights()
+{
+	return this->quantWeights;
+}
+
+/*
+ * CRF_Model::getFileQuantBits
+ *
+ * Returns: the size of the quantized weights of the file last read by readFromFile, 0 if it
+ *   was not a quantized file
+ */
+int CRF_Model::getFileQuantBits()
+{
+	return this->fileQuantBits;
+}
+
 /*
  * CRF_Model::readFromFile
  *
@@ -285,16 +474,34 @@ bool CRF_Model::writeToFile(const char* fname, double* lam, QNUInt32 ll)
  *
  * Returns: true if file can be read, false otherwise
  *
- * Reads values from file fname into lambda vector
+ * Reads values from file fname into lambda vector.  A quantized file (see writeQuantizedToFile)
+ * is read as its dequantized weights; getFileQuantBits() then returns its weight size.
  */
 bool CRF_Model::readFromFile(const char* fname)
 {
 	std::ifstream ifile;
 	ifile.open(fname);
 	if (ifile.is_open()) {
+		std::string s;
+		getline(ifile,s);
+		if (this->readSparseWeights(ifile,s,this->lambda,fname)) {
+			ifile.close();
+			return true;
+		}
+		this->fileQuantBits=0;
+		CRF_QuantizedWeights* qw=CRF_QuantizedWeights::readFromFile(ifile,s,this->lambda,this->lambda_len,fname);
+		if (qw != NULL) {
+			ifile.close();
+			// lambda holds the dequantized weights; scoring with the quantized ones is left to
+			// setQuantizedScoring(), since training must keep scoring with lambda
+			this->fileQuantBits=qw->getBits();
+			delete qw;
+			return true;
+		}
 		for (QNUInt32 i = 0; i < this->lambda_len; i++) {
-			std::string s;
-			getline(ifile,s);
+			if (i > 0) {
+				getline(ifile,s);
+			}
 			std::istringstream iss(s);
 			iss >> std::dec >> lambda[i];
 		//std::cout << lambda[i] << std::endl;
@@ -326,11 +533,24 @@ bool CRF_Model::readAverageFromFile(const char* fname, int present)
 	std::ifstream ifile;
 	ifile.open(fname);
 	if (ifile.is_open()) {
+		std::string s;
+		getline(ifile,s);
+		bool sparse=this->readSparseWeights(ifile,s,this->lambdaAcc,fname);
+		if (!sparse) {
+			CRF_QuantizedWeights* qw=CRF_QuantizedWeights::readFromFile(ifile,s,this->lambdaAcc,this->lambda_len,fname);
+			if (qw != NULL) {
+				delete qw;
+				sparse=true;
+			}
+		}
 		for (QNUInt32 i = 0; i < this->lambda_len; i++) {
-			std::string s;
-			getline(ifile,s);
-			std::istringstream iss(s);
-			iss >> std::dec >> lambdaAcc[i];
+			if (!sparse) {
+				if (i > 0) {
+					getline(ifile,s);
+				}
+				std::istringstream iss(s);
+				iss >> std::dec >> lambdaAcc[i];
+			}
 			if (present > 0) {
 				lambdaAcc[i] = lambdaAcc[i] * present;
 
@@ -581,3 +801,23 @@ void CRF_Model::setNodeType() {
 nodetype CRF_Model::getNodeType() {
 	return this->node_type;
 }
+
+/*
+ * CRF_Model::getLambdaChecksum
+ *
+ * Returns: FNV-1a hash of the bytes of the lambda vector
+ *
+ * Two models have the same checksum only if their weights are bit-identical, so it is logged by
+ * the deterministic training mode to compare runs with different thread counts.
+ */
+QNUInt32 CRF_Model::getLambdaChecksum()
+{
+	QNUInt32 h = 2166136261u;
+	const unsigned char* bytes = (const unsigned char*)this->lambda;
+	size_t len = this->lambda_len * sizeof(double);
+	for (size_t i = 0; i < len; i++) {
+		h ^= bytes[i];
+		h *= 16777619u;
+	}
+	return h;
+}
@@ -40,6 +40,9 @@ protected:
 	bool use_broken_class_label;
 	QNUInt32 init_iter;
 	double* gradSqrAcc;  // Holds the accumulated gradient square sums for AdaGrad
+	CRF_QuantizedWeights* quantWeights;  // Set while scoring with quantized weights
+	int fileQuantBits;  // weight size of the quantized file last read, 0 if none
+	virtual bool readSparseWeights(std::istream& ifile, const string& header, double* lam, const char* fname);
 
 public:
 	CRF_Model(QNUInt32 num_labs);
@@ -62,6 +65,13 @@ public:
 	virtual bool writeToFile(const char* fname, double* lam, QNUInt32 ll);
 	virtual bool readFromFile(const char* fname);
 	virtual bool readAverageFromFile(const char* fname, int present);
+	virtual bool writeSparseToFile(const char* fname, double* lam, QNUInt32 ll);
+	virtual bool setSparseScoring();
+	virtual bool writeQuantizedToFile(const char* fname, int bits);
+	virtual bool setQuantizedScoring(int bits);
+	virtual void clearQuantizedScoring();
+	virtual CRF_QuantizedWeights* getQuantizedWeights();
+	virtual int getFileQuantBits();
 	virtual void setUseLog(bool isLog);
 	virtual void setUseMask(bool isMasked);
 	virtual void setNodeType();
@@ -81,6 +91,7 @@ public:
 	virtual bool readGradSqrAccFromFile(const char* fname);
 	virtual void setGradSqrAcc(double* grad);
 	virtual double* getGradSqrAcc();
+	virtual QNUInt32 getLambdaChecksum();
 };
 
 #endif /*CRF_H_*/
@@ -0,0 +1,133 @@
+/*
+ * CRF_BeamController.cpp
+ *
+ */
+
+#include "CRF_BeamController.h"
+#include <sys/time.h>
+
+/*
+ * CRF_BeamController constructor
+ *
+ * Input: init_beam - beam at the start of every utterance, must be > 0
+ *        target_hyps - target number of active hypotheses per frame, 0 for none
+ *        target_rtf - target real-time factor, 0 for none
+ *        step_in - fraction the beam is changed by at each frame
+ *
+ * The beam is kept between init_beam/10 and init_beam*10 unless setBeamRange() is called.
+ */
+CRF_BeamController::CRF_BeamController(double init_beam, QNUInt32 target_hyps, double target_rtf, double step_in)
+	: initBeam(init_beam),
+	  targetHyps(target_hyps),
+	  targetRtFactor(target_rtf),
+	  step(step_in)
+{
+	if (init_beam <= 0.0) {
+		string errstr="CRF_BeamController() caught exception: the initial beam must be larger than 0.";
+		throw runtime_error(errstr);
+	}
+	if (step_in <= 0.0 || step_in >= 1.0) {
+		string errstr="CRF_BeamController() caught exception: the beam step must be between 0 and 1.";
+		throw runtime_error(errstr);
+	}
+	this->minBeam = init_beam / 10.0;
+	this->maxBeam = init_beam * 10.0;
+	this->reset();
+}
+
+/*
+ * CRF_BeamController destructor
+ */
+CRF_BeamController::~CRF_BeamController()
+{
+}
+
+/*
+ * CRF_BeamController::getTime
+ *
+ * Returns: wall clock time in seconds
+ */
+double CRF_BeamController::getTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * CRF_BeamController::reset
+ *
+ * Restores the initial beam and restarts the real-time clock.  Called at the start of
+ * every utterance.
+ */
+void CRF_BeamController::reset()
+{
+	this->beam = this->initBeam;
+	this->numFrames = 0;
+	this->rtFactor = 0.0;
+	this->startTime = this->getTime();
+}
+
+/*
+ * CRF_BeamController::update
+ *
+ * Input: num_hyps - number of hypotheses kept at the frame just decoded
+ *
+ * Returns: beam to use for the next frame
+ */
+double CRF_BeamController::update(QNUInt32 num_hyps)
+{
+	this->numFrames++;
+	// 100 frames per second of audio
+	this->rtFactor = (this->getTime() - this->startTime) / (this->numFrames * 0.01);
+
+	bool over = false;
+	bool under = true;
+	if (this->targetHyps > 0) {
+		if (num_hyps > this->targetHyps) { over = true; }
+		if (num_hyps >= 0.8 * this->targetHyps) { under = false; }
+	}
+	if (this->targetRtFactor > 0.0) {
+		if (this->rtFactor > this->targetRtFactor) { over = true; }
+		if (this->rtFactor >= 0.8 * this->targetRtFactor) { under = false; }
+	}
+	if (over) {
+		this->beam *= (1.0 - this->step);
+	}
+	else if (under) {
+		this->beam *= (1.0 + this->step);
+	}
+	if (this->beam < this->minBeam) { this->beam = this->minBeam; }
+	if (this->beam > this->maxBeam) { this->beam = this->maxBeam; }
+	return this->beam;
+}
+
+double CRF_BeamController::getBeam()
+{
+	return this->beam;
+}
+
+/*
+ * CRF_BeamController::getRtFactor
+ *
+ * Returns: real-time factor measured since the last reset()
+ */
+double CRF_BeamController::getRtFactor()
+{
+	return this->rtFactor;
+}
+
+/*
+ * CRF_BeamController::setBeamRange
+ *
+ * Input: min_beam, max_beam - bounds of the beam
+ */
+void CRF_BeamController::setBeamRange(double min_beam, double max_beam)
+{
+	if (min_beam <= 0.0 || min_beam > max_beam) {
+		string errstr="CRF_BeamController::setBeamRange() caught exception: invalid beam range.";
+		throw runtime_error(errstr);
+	}
+	this->minBeam = min_beam;
+	this->maxBeam = max_beam;
+}
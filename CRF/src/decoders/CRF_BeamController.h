@@ -0,0 +1,49 @@
+#ifndef CRF_BEAMCONTROLLER_H_
+#define CRF_BEAMCONTROLLER_H_
+/*
+ * CRF_BeamController.h
+ *
+ * Contains the class definition for CRF_BeamController
+ */
+
+#include "../CRF.h"
+
+/*
+ * class CRF_BeamController
+ *
+ * Adjusts the pruning beam of a decoder from one frame to the next so that the decoder holds
+ * a target number of active hypotheses, a target real-time factor, or both.
+ *
+ * After each frame the decoder reports the number of hypotheses it kept and update() returns
+ * the beam for the next frame.  The beam shrinks by the fraction step when the hypothesis count
+ * is above its target or the real-time factor measured since reset() is above its target, and
+ * grows by the same fraction when both are comfortably below (less than 80% of) their targets.
+ * The beam always stays within [minBeam, maxBeam].  A target of 0 disables that target.
+ *
+ * The real-time factor assumes 100 frames per second of audio.
+ */
+class CRF_BeamController
+{
+protected:
+	double initBeam;
+	double minBeam;
+	double maxBeam;
+	double beam;
+	QNUInt32 targetHyps;
+	double targetRtFactor;
+	double step;
+	QNUInt32 numFrames;
+	double startTime;
+	double rtFactor;
+	virtual double getTime();
+public:
+	CRF_BeamController(double init_beam, QNUInt32 target_hyps, double target_rtf, double step_in=0.05);
+	virtual ~CRF_BeamController();
+	virtual void reset();
+	virtual double update(QNUInt32 num_hyps);
+	virtual double getBeam();
+	virtual double getRtFactor();
+	virtual void setBeamRange(double min_beam, double max_beam);
+};
+
+#endif /*CRF_BEAMCONTROLLER_H_*/
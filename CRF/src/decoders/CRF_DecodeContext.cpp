@@ -0,0 +1,169 @@
+/*
+ * CRF_DecodeContext.cpp
+ *
+ */
+
+#include "CRF_DecodeContext.h"
+#include "../utils/CRF_MemStats.h"
+
+/*
+ * CRF_DecodeContext constructor
+ */
+CRF_DecodeContext::CRF_DecodeContext()
+	: numResets(0),
+	  allocsAtReset(0),
+	  steadyStateAllocs(0),
+	  latMemBytes(0)
+{
+	this->nodeList = new CRF_StateVector();
+	this->bestLat = new VectorFst<StdArc>();
+	this->fullLat = new VectorFst<StdArc>();
+	this->shortestLat = new VectorFst<StdArc>();
+}
+
+/*
+ * CRF_DecodeContext destructor
+ */
+CRF_DecodeContext::~CRF_DecodeContext()
+{
+	delete this->nodeList;
+	delete this->bestLat;
+	delete this->fullLat;
+	delete this->shortestLat;
+	CRF_MemStats::release(MEM_FST,this->latMemBytes);
+}
+
+/*
+ * CRF_DecodeContext::reset
+ *
+ * Prepares the context for the next utterance: empties the output lattices and marks the
+ * allocation counters.  The nodes and buffers of the node list are kept.
+ */
+void CRF_DecodeContext::reset()
+{
+	QNUInt32 total = this->nodeList->getTotalAllocs();
+	if (this->numResets > 1) {
+		this->steadyStateAllocs += total - this->allocsAtReset;
+	}
+	this->allocsAtReset = total;
+	this->numResets++;
+
+	this->bestLat->DeleteStates();
+	this->fullLat->DeleteStates();
+	this->shortestLat->DeleteStates();
+	this->nodeList->setNodeCount(0);
+	this->trackLatticeMem();
+}
+
+/*
+ * CRF_DecodeContext::getNodeList
+ *
+ * Returns: the node list shared by the decoders and builders using this context
+ */
+CRF_StateVector* CRF_DecodeContext::getNodeList()
+{
+	return this->nodeList;
+}
+
+/*
+ * CRF_DecodeContext::getBestLat
+ *
+ * Returns: lattice for the best path output of the decoder, emptied by reset()
+ */
+VectorFst<StdArc>* CRF_DecodeContext::getBestLat()
+{
+	return this->bestLat;
+}
+
+/*
+ * CRF_DecodeContext::getFullLat
+ *
+ * Returns: lattice for the fully composed output of the decoder, emptied by reset()
+ */
+VectorFst<StdArc>* CRF_DecodeContext::getFullLat()
+{
+	return this->fullLat;
+}
+
+/*
+ * CRF_DecodeContext::getShortestLat
+ *
+ * Returns: lattice for the shortest path of the best lattice, emptied by reset()
+ */
+VectorFst<StdArc>* CRF_DecodeContext::getShortestLat()
+{
+	return this->shortestLat;
+}
+
+/*
+ * CRF_DecodeContext::getAllocStats
+ *
+ * Returns: the allocation counters of the node list
+ */
+CRF_AllocStats* CRF_DecodeContext::getAllocStats()
+{
+	return this->nodeList->getAllocStats();
+}
+
+/*
+ * CRF_DecodeContext::getAllocsSinceReset
+ *
+ * Returns: number of node list allocations counted since the last call to reset()
+ */
+QNUInt32 CRF_DecodeContext::getAllocsSinceReset()
+{
+	return this->nodeList->getTotalAllocs() - this->allocsAtReset;
+}
+
+/*
+ * CRF_DecodeContext::getSteadyStateAllocs
+ *
+ * Returns: number of node list allocations counted in all the utterances after the first
+ *   one, including the current one
+ */
+QNUInt32 CRF_DecodeContext::getSteadyStateAllocs()
+{
+	if (this->numResets > 1) {
+		return this->steadyStateAllocs + this->getAllocsSinceReset();
+	}
+	return 0;
+}
+
+/*
+ * CRF_DecodeContext::getNumResets
+ *
+ * Returns: number of utterances the context has been reset for
+ */
+QNUInt32 CRF_DecodeContext::getNumResets()
+{
+	return this->numResets;
+}
+
+/*
+ * CRF_DecodeContext::trackLatticeMem
+ *
+ * Reports the current size of the best, full and shortest path lattices to CRF_MemStats.
+ */
+void CRF_DecodeContext::trackLatticeMem()
+{
+	size_t bytes=fstBytes(this->bestLat)+fstBytes(this->fullLat)+fstBytes(this->shortestLat);
+	CRF_MemStats::update(MEM_FST,this->latMemBytes,bytes);
+	this->latMemBytes=bytes;
+}
+
+/*
+ * CRF_DecodeContext::fstBytes
+ *
+ * Input: fst - lattice to measure
+ *
+ * Returns: approximate heap size of fst, its arcs plus a fixed cost per state for the final
+ *   weight, the arc vector and the epsilon counts
+ */
+size_t CRF_DecodeContext::fstBytes(const VectorFst<StdArc>* fst)
+{
+	size_t bytes=0;
+	for (StateIterator< VectorFst<StdArc> > siter(*fst); !siter.Done(); siter.Next()) {
+		bytes+=64+fst->NumArcs(siter.Value())*sizeof(StdArc);
+	}
+	return bytes;
+}
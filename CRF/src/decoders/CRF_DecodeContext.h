@@ -0,0 +1,64 @@
+#ifndef CRF_DECODECONTEXT_H_
+#define CRF_DECODECONTEXT_H_
+/*
+ * CRF_DecodeContext.h
+ *
+ * Contains the class definition for CRF_DecodeContext
+ */
+
+#include "fst/fstlib.h"
+#include "../CRF.h"
+#include "../nodes/CRF_StateVector.h"
+
+using namespace fst;
+
+/*
+ * class CRF_DecodeContext
+ *
+ * Per-thread state shared by the decoders, lattice builders and posterior builders so
+ * that their buffers keep their capacity from one utterance to the next.  Holds the node
+ * list and the output lattices of one decoding thread; a decoder or builder constructed
+ * with a context uses its node list instead of creating its own.
+ *
+ * reset() is called once before every utterance.  It empties the lattices and marks the
+ * allocation counters of the node list, so getAllocsSinceReset() gives the number of heap
+ * allocations made by the node list for the current utterance: nodes, node feature buffers,
+ * link arrays and the scratch buffers of its users (see CRF_AllocStats).  Once the context
+ * has seen its longest utterance this count stays at 0; getSteadyStateAllocs() sums it over
+ * every utterance after the first one.  The lattices (allocated inside OpenFst), the Viterbi
+ * backtrack tables of the nodes and the std::map bookkeeping of the Viterbi decoder are not
+ * counted; their size is reported to CRF_MemStats instead.
+ *
+ * trackLatticeMem() reports the approximate size of the lattices to CRF_MemStats; it is
+ * called once the lattices of an utterance are built, and reset() releases them again.
+ *
+ * A context must not be shared between threads.
+ */
+class CRF_DecodeContext
+{
+protected:
+	CRF_StateVector* nodeList;
+	VectorFst<StdArc>* bestLat;
+	VectorFst<StdArc>* fullLat;
+	VectorFst<StdArc>* shortestLat;
+	QNUInt32 numResets;
+	QNUInt32 allocsAtReset;
+	QNUInt32 steadyStateAllocs;
+	size_t latMemBytes;
+public:
+	CRF_DecodeContext();
+	virtual ~CRF_DecodeContext();
+	virtual void reset();
+	virtual CRF_StateVector* getNodeList();
+	virtual VectorFst<StdArc>* getBestLat();
+	virtual VectorFst<StdArc>* getFullLat();
+	virtual VectorFst<StdArc>* getShortestLat();
+	virtual CRF_AllocStats* getAllocStats();
+	virtual QNUInt32 getAllocsSinceReset();
+	virtual QNUInt32 getSteadyStateAllocs();
+	virtual QNUInt32 getNumResets();
+	virtual void trackLatticeMem();
+	static size_t fstBytes(const VectorFst<StdArc>* fst);
+};
+
+#endif /*CRF_DECODECONTEXT_H_*/
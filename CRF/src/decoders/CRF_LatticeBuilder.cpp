@@ -6,21 +6,33 @@
  *
  */
 #include "CRF_LatticeBuilder.h"
+#include "CRF_LatticeBuilder_StdSeg.h"
+#include "CRF_LatticeBuilder_StdSeg_WithoutDurLab.h"
+#include "CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr.h"
 
 /*
  * CRF_LatticeBuilder constructor
  *
  * Input: *ftr_stream_in - pointer to input stream of features
  *        *crf_in - pointer to the CRF model to be used for building lattices
+ *        *ctx - per-thread decode context whose node list is used by the builder.
+ *               If NULL, the builder creates and owns its own node list.
  *
  */
 
 
-CRF_LatticeBuilder::CRF_LatticeBuilder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in)
+CRF_LatticeBuilder::CRF_LatticeBuilder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx)
 	: crf(crf_in),
 	  ftr_strm(ftr_strm_in)
 {
-	this->nodeList= new CRF_StateVector();
+	if (ctx == NULL) {
+		this->nodeList= new CRF_StateVector();
+		this->ownsNodeList=true;
+	}
+	else {
+		this->nodeList=ctx->getNodeList();
+		this->ownsNodeList=false;
+	}
 
 	// Commented by Ryan, bunch_size can be only equal to 1 for
 	// CRF_InFtrStream_SeqMultiWindow and CRF_InLabStream_SeqMultiWindow
@@ -67,7 +79,9 @@ CRF_LatticeBuilder::~CRF_LatticeBuilder()
 	delete [] this->ftr_buf;
 	delete [] this->lab_buf;
 	delete [] this->alpha_base;
-	delete this->nodeList;
+	if (this->ownsNodeList) {
+		delete this->nodeList;
+	}
 
 	// Added by Ryan
 //#ifdef SEGMENTAL_CRF
@@ -358,6 +372,144 @@ void CRF_LatticeBuilder::_computeGamma(vector<double> *stateGamma, vector<double
 
 }
 
+/*
+ * CRF_LatticeBuilder::getAlignmentGammas
+ *
+ * Input: *denominatorGamma - sparse gammas of the whole lattice, or NULL
+ *        *numeratorGamma - sparse gammas of the lattice aligned with the labels, or NULL
+ *        trans - true if transition gammas are needed as well as state gammas
+ *
+ * Returns: number of states in the denominator lattice.
+ *
+ * Same computation as the dense getAlignmentGammas above, but only the labels and label pairs
+ * that have an arc in the lattice are stored (see CRF_SparseGamma).
+ */
+
+int CRF_LatticeBuilder::getAlignmentGammas(CRF_SparseGamma *denominatorGamma,
+											CRF_SparseGamma *numeratorGamma,
+											bool trans) {
+	VectorFst<LogArc> denominator;
+	VectorFst<LogArc> aligner;
+
+	int nstates=this->buildLattice(&denominator,(numeratorGamma!=NULL),&aligner);
+
+	if (denominatorGamma != NULL) {
+		_computeSparseGamma(denominatorGamma,trans,denominator,nstates);
+	}
+
+	if (numeratorGamma != NULL) {
+		ComposeFst<LogArc> numerator(denominator,aligner);
+		_computeSparseGamma(numeratorGamma,trans,numerator,nstates);
+	}
+
+	return nstates;
+}
+
+/*
+ * CRF_LatticeBuilder::getAlignmentGammasNState
+ *
+ * Input: *denominatorGamma - sparse gammas of the whole lattice, or NULL
+ *        *numeratorGamma - sparse gammas of the lattice aligned with the labels, or NULL
+ *        trans - true if transition gammas are needed as well as state gammas
+ *
+ * Returns: number of states in the denominator lattice.
+ *
+ * Sparse version of the dense getAlignmentGammasNState above.
+ */
+
+int CRF_LatticeBuilder::getAlignmentGammasNState(CRF_SparseGamma *denominatorGamma,
+											CRF_SparseGamma *numeratorGamma,
+											bool trans) {
+	VectorFst<LogArc> denominator;
+	VectorFst<LogArc> aligner;
+
+	int nstates=this->nStateBuildLattice(&denominator,(numeratorGamma!=NULL),&aligner);
+
+	if (denominatorGamma != NULL) {
+		_computeSparseGamma(denominatorGamma,trans,denominator,nstates);
+	}
+
+	if (numeratorGamma != NULL) {
+		ComposeFst<LogArc> numerator(denominator,aligner);
+		_computeSparseGamma(numeratorGamma,trans,numerator,nstates);
+	}
+
+	return nstates;
+}
+
+/*
+ * CRF_LatticeBuilder::_computeSparseGamma
+ *
+ * Input: *gamma - sparse gammas to fill
+ *        trans - true if transition gammas are needed
+ *        &fst - lattice
+ *        nstates - number of CRF states (frames) in the lattice
+ *
+ * Walks the lattice as _computeGamma does, but collects one entry per arc (and per pair of arcs
+ * for the transition gammas) instead of adding into dense vectors.  The entries are summed and
+ * normalized per frame by CRF_SparseGamma::build().
+ */
+
+void CRF_LatticeBuilder::_computeSparseGamma(CRF_SparseGamma *gamma, bool trans, Fst<LogArc> &fst, int nstates) {
+	vector<LogWeight> alpha;
+	vector<LogWeight> beta;
+
+	ShortestDistance(fst,&alpha,false);
+	ShortestDistance(fst,&beta,true);
+
+	this->stateGammaEntries.clear();
+	this->transGammaEntries.clear();
+
+	vector<int> positions(alpha.size(),0);
+
+	for (StateIterator<Fst<LogArc> > siter(fst);!siter.Done(); siter.Next()) {
+
+		LogArc::StateId s=siter.Value();
+		int crfstate=positions[s];
+
+		// see _computeGamma: skips the null transition on the last arc
+		if (crfstate>=nstates)
+			continue;
+
+		for (ArcIterator< Fst<LogArc> > aiter(fst,s);!aiter.Done(); aiter.Next()) {
+			const LogArc &arc = aiter.Value();
+
+			positions[arc.nextstate]=crfstate+1;
+			double alpha_s=(double)(alpha[s].Value());
+			double beta_next=(double)(beta[arc.nextstate].Value());
+
+			double gammaarc=-1*(alpha_s+arc.weight.Value()+beta_next);
+			int label=arc.olabel-1;
+
+			if (label<0)
+				continue;
+
+			this->stateGammaEntries.push_back(CRF_GammaEntry(crfstate,label,gammaarc));
+
+			if (trans) {
+				for (ArcIterator< Fst<LogArc> >  aiter2(fst,arc.nextstate);
+					 !aiter2.Done();
+					 aiter2.Next()) {
+					const LogArc &arc2 = aiter2.Value();
+					positions[arc2.nextstate]=crfstate+1;
+					double gammatransarc=-1*(alpha_s+
+											 arc.weight.Value()+
+											 arc2.weight.Value()+
+											 beta[arc2.nextstate].Value());
+					int label2=arc2.olabel-1;
+					if (label2<0)
+						continue;
+					this->transGammaEntries.push_back(
+							CRF_GammaEntry(crfstate,label*this->num_labs+label2,gammatransarc));
+				}
+			}
+		}
+	}
+
+	gamma->build(nstates,this->num_labs,this->stateGammaEntries,
+			trans ? &(this->transGammaEntries) : NULL);
+}
+
 /*
  * CRF_LatticeBuilder::getNodeList
  *
@@ -435,3 +587,75 @@ void CRF_LatticeBuilder::computeAlignedAlphaBeta(Fst<LogArc>& fst, int nstates)
 	}
 }
 
+/*
+ * CRF_LatticeBuilder::createLatticeBuilder
+ *
+ * Input: mtype - model type of crf_in
+ *        *ftr_strm_in - pointer to input stream of features
+ *        *crf_in - pointer to the CRF model to be used for building lattices
+ *        *ctx - per-thread decode context, see the constructor
+ *
+ * Returns: a new lattice builder of the class for mtype, NULL if the type is unknown
+ *
+ * Static factory function, update it whenever a new lattice builder is derived.
+ */
+CRF_LatticeBuilder* CRF_LatticeBuilder::createLatticeBuilder(modeltype mtype, CRF_FeatureStream* ftr_strm_in,
+		CRF_Model* crf_in, CRF_DecodeContext* ctx)
+{
+	if (mtype == STDFRAME)
+	{
+		return new CRF_LatticeBuilder(ftr_strm_in,crf_in,ctx);
+	}
+	else if (mtype == STDSEG)
+	{
+		return new CRF_LatticeBuilder_StdSeg(ftr_strm_in,crf_in,ctx);
+	}
+	else if (mtype == STDSEG_NO_DUR)
+	{
+		return new CRF_LatticeBuilder_StdSeg_WithoutDurLab(ftr_strm_in,crf_in,ctx);
+	}
+	else if (mtype == STDSEG_NO_DUR_NO_TRANSFTR || mtype == STDSEG_NO_DUR_NO_SEGTRANSFTR)
+	{
+		return new CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(ftr_strm_in,crf_in,ctx);
+	}
+	return NULL;
+}
+
+/*
+ * CRF_LatticeBuilder::buildStdLattice
+ *
+ * Input: *lb - lattice builder, as returned by createLatticeBuilder()
+ *        *fst - pointer to VectorFst where result should be stored
+ *        nStates - number of states per label of the model
+ *        align, *alignFst, norm - see buildLattice()
+ *
+ * Returns: number of observation nodes in the sequence from the input stream
+ *
+ * buildLattice() and nStateBuildLattice() are templates and cannot be virtual, so this calls
+ * the ones of the actual class of lb.
+ */
+int CRF_LatticeBuilder::buildStdLattice(CRF_LatticeBuilder* lb, VectorFst<StdArc>* fst, QNUInt32 nStates,
+		bool align, VectorFst<StdArc>* alignFst, bool norm)
+{
+	if (nStates == 1) {
+		// the order of the following "if else" cannot be changed due to the inheritance
+		if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*>(lb))
+		{
+			return ((CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*)lb)->buildLattice(fst,align,alignFst,norm);
+		}
+		else if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab*>(lb))
+		{
+			return ((CRF_LatticeBuilder_StdSeg_WithoutDurLab*)lb)->buildLattice(fst,align,alignFst,norm);
+		}
+		else if (dynamic_cast<CRF_LatticeBuilder_StdSeg*>(lb))
+		{
+			return ((CRF_LatticeBuilder_StdSeg*)lb)->buildLattice(fst,align,alignFst,norm);
+		}
+		return lb->buildLattice(fst,align,alignFst,norm);
+	}
+	if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*>(lb))
+	{
+		return ((CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*)lb)->nStateBuildLattice(fst,align,alignFst,norm);
+	}
+	return lb->nStateBuildLattice(fst,align,alignFst,norm);
+}
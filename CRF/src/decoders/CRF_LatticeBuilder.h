@@ -12,6 +12,8 @@
 #include "../CRF_Model.h"
 #include "../io/CRF_FeatureStream.h"
 #include "../nodes/CRF_StateVector.h"
+#include "CRF_DecodeContext.h"
+#include "CRF_SparseGamma.h"
 
 using namespace fst;
 
@@ -29,6 +31,7 @@ class CRF_LatticeBuilder
 {
 protected:
 	CRF_StateVector* nodeList;
+	bool ownsNodeList;
 	CRF_Model* crf;
 	CRF_FeatureStream* ftr_strm;
 	float* ftr_buf;
@@ -38,6 +41,9 @@ protected:
 	QNUInt32 num_labs;
 	double* alpha_base;
 	virtual void _computeGamma(vector<double> *stategamma,vector<double> *transgamma,Fst<LogArc>& fst,int nstates);
+	virtual void _computeSparseGamma(CRF_SparseGamma *gamma,bool trans,Fst<LogArc>& fst,int nstates);
+	vector<CRF_GammaEntry> stateGammaEntries;
+	vector<CRF_GammaEntry> transGammaEntries;
 
 	// Added by Ryan
 	size_t labs_width;
@@ -48,7 +54,7 @@ protected:
 	vector<QNUInt32>* nodeStartStates;
 
 public:
-	CRF_LatticeBuilder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in);
+	CRF_LatticeBuilder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx=NULL);
 	virtual ~CRF_LatticeBuilder();
 
 	// Ryan: can these template functions be virtual?
@@ -69,8 +75,19 @@ public:
 									vector<double> *numeratorStateGamma,
 									vector<double> *denominatorTransGamma,
 									vector<double> *numeratorTransGamma);
+	int getAlignmentGammas(CRF_SparseGamma *denominatorGamma,
+									CRF_SparseGamma *numeratorGamma,
+									bool trans);
+	int getAlignmentGammasNState(CRF_SparseGamma *denominatorGamma,
+									CRF_SparseGamma *numeratorGamma,
+									bool trans);
 	CRF_StateVector* getNodeList();
 	void computeAlignedAlphaBeta(Fst<LogArc>& fst, int nstates);
+
+	static CRF_LatticeBuilder* createLatticeBuilder(modeltype mtype, CRF_FeatureStream* ftr_strm_in,
+									CRF_Model* crf_in, CRF_DecodeContext* ctx=NULL);
+	static int buildStdLattice(CRF_LatticeBuilder* lb, VectorFst<StdArc>* fst, QNUInt32 nStates,
+									bool align=false, VectorFst<StdArc>* alignFst=NULL, bool norm=true);
 };
 
 // These template functions are included here for compile-time generation
@@ -130,12 +147,7 @@ template <class Arc> int CRF_LatticeBuilder::buildLattice(VectorFst<Arc>* fst,
 		ftr_count=ftr_strm->read(this->bunch_size,ftr_buf,lab_buf);
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
-			float* new_buf = new float[this->num_ftrs];
-			for (QNUInt32 j=0; j<this->num_ftrs; j++) {
-				int idx=i*this->num_ftrs+j;
-				new_buf[j]=ftr_buf[idx];
-			}
-			this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			this->nodeList->setCopy(nodeCnt,&(ftr_buf[i*this->num_ftrs]),num_ftrs,this->lab_buf[i],this->crf);
 
 			float value=this->nodeList->at(nodeCnt)->computeTransMatrix();
 
@@ -748,12 +760,7 @@ template <class Arc> int CRF_LatticeBuilder::nStateBuildLattice(VectorFst<Arc>*
 		ftr_count=ftr_strm->read(this->bunch_size,ftr_buf,lab_buf);
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
-			float* new_buf = new float[this->num_ftrs];
-			for (QNUInt32 j=0; j<this->num_ftrs; j++) {
-				int idx=i*this->num_ftrs+j;
-				new_buf[j]=ftr_buf[idx];
-			}
-			this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			this->nodeList->setCopy(nodeCnt,&(ftr_buf[i*this->num_ftrs]),num_ftrs,this->lab_buf[i],this->crf);
 			seq_len++;
 			float value=this->nodeList->at(nodeCnt)->computeTransMatrix();
 
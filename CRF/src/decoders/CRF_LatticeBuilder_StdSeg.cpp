@@ -6,8 +6,8 @@
  */
 
 #include "CRF_LatticeBuilder_StdSeg.h"
-CRF_LatticeBuilder_StdSeg::CRF_LatticeBuilder_StdSeg(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in)
-	: CRF_LatticeBuilder(ftr_strm_in, crf_in)
+CRF_LatticeBuilder_StdSeg::CRF_LatticeBuilder_StdSeg(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx)
+	: CRF_LatticeBuilder(ftr_strm_in, crf_in, ctx)
 {
 
 //	this->nodeList= new CRF_StateVector();
@@ -7,8 +7,8 @@
 
 #include "CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr.h"
 
-CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr::CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in)
-	: CRF_LatticeBuilder_StdSeg_WithoutDurLab(ftr_strm_in, crf_in) {
+CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr::CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx)
+	: CRF_LatticeBuilder_StdSeg_WithoutDurLab(ftr_strm_in, crf_in, ctx) {
 }
 
 CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr::~CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr() {
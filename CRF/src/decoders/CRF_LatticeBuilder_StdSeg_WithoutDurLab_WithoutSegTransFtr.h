@@ -19,7 +19,7 @@ using namespace fst;
 
 class CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr : public CRF_LatticeBuilder_StdSeg_WithoutDurLab {
 public:
-	CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in);
+	CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx=NULL);
 	virtual ~CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr();
 
 	// Ryan: can these template functions be virtual?
@@ -150,11 +150,6 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 
 		if (ftr_count > 0) {
 			QNUInt32 cur_ftr_buf_size = this->num_ftrs * ftr_count;
-			float* new_buf = new float[cur_ftr_buf_size];
-			for (QNUInt32 j=0; j<cur_ftr_buf_size; j++) {
-				new_buf[j]=this->ftr_buf[j];
-				//cout << " " << new_buf[j];
-			}
 
 			QNUInt32 label = CRF_LAB_BAD;
 			//TODO: use this->labs_width>0 or this->lab_buf != NULL ?
@@ -209,7 +204,7 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 			// TODO: For segmental CRFs which have the different structures for different nodes, these parameters need to be changed.
 			QNUInt32 prevNode_nLabs = this->crf->getNLabs();
 			QNUInt32 nextNode_nActualLabs = this->nActualLabs;
-			this->nodeList->set(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+			this->nodeList->setCopy(nodeCnt,this->ftr_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
 
 			QNUInt32 numPrevNodes;
 			if (nodeCnt + 1 <= this->lab_max_dur)
@@ -221,17 +216,7 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 				numPrevNodes = this->lab_max_dur;
 			}
 			assert(numPrevNodes + 1 == nodeMaxDur || numPrevNodes == nodeMaxDur);
-			CRF_StateNode** prevNodes = NULL;
-			if (numPrevNodes > 0)
-			{
-				prevNodes = new CRF_StateNode*[numPrevNodes];
-				for (QNUInt32 i = 0; i < numPrevNodes; i++)
-				{
-					QNUInt32 ni = nodeCnt - numPrevNodes + i;
-					prevNodes[i] = this->nodeList->at(ni);
-				}
-			}
-			this->nodeList->at(nodeCnt)->setPrevNodes(prevNodes, numPrevNodes);
+			this->nodeList->linkPrevNodes(nodeCnt, numPrevNodes);
 
 			float value = this->nodeList->at(nodeCnt)->computeTransMatrix();
 			double scale;
@@ -349,8 +334,6 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 				}
 			}
 
-			if (prevNodes != NULL)
-				delete [] prevNodes;
 			nodeCnt++;
 		}
 
@@ -441,10 +424,6 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 
 			QNUInt32 cur_ftr_buf_size = this->num_ftrs * ftr_count;
 
-			float* new_buf = new float[cur_ftr_buf_size];
-			for (QNUInt32 j=0; j<cur_ftr_buf_size; j++) {
-				new_buf[j]=this->ftr_buf[j];
-			}
 
 			QNUInt32 label = CRF_LAB_BAD;
 			//TODO: use this->labs_width>0 or this->lab_buf != NULL ?
@@ -484,7 +463,7 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 			// TODO: For segmental CRFs which have the different structures for different nodes, these parameters need to be changed.
 			QNUInt32 prevNode_nLabs = this->crf->getNLabs();
 			QNUInt32 nextNode_nActualLabs = this->nActualLabs;
-			this->nodeList->set(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+			this->nodeList->setCopy(nodeCnt,this->ftr_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
 
 			QNUInt32 numPrevNodes;
 			if (nodeCnt + 1 <= this->lab_max_dur)
@@ -496,17 +475,7 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 				numPrevNodes = this->lab_max_dur;
 			}
 			assert(numPrevNodes + 1 == nodeMaxDur || numPrevNodes == nodeMaxDur);
-			CRF_StateNode** prevNodes = NULL;
-			if (numPrevNodes > 0)
-			{
-				prevNodes = new CRF_StateNode*[numPrevNodes];
-				for (QNUInt32 i = 0; i < numPrevNodes; i++)
-				{
-					QNUInt32 ni = nodeCnt - numPrevNodes + i;
-					prevNodes[i] = this->nodeList->at(ni);
-				}
-			}
-			this->nodeList->at(nodeCnt)->setPrevNodes(prevNodes, numPrevNodes);
+			this->nodeList->linkPrevNodes(nodeCnt, numPrevNodes);
 
 			float value = this->nodeList->at(nodeCnt)->computeTransMatrix();
 			double scale;
@@ -654,8 +623,6 @@ template <class Arc> int CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTrans
 				}
 			}
 
-			if (prevNodes != NULL)
-				delete [] prevNodes;
 			nodeCnt++;
 		}
 
@@ -14,9 +14,11 @@
  *
  * Input: *crf_in - pointer to the CRF model to be used for building lattices
  * 	      norm - boolean flag to control normalization of output posteriors (defaults to true)
+ *        *ctx - per-thread decode context whose node list is used by the builder.
+ *               If NULL, the builder creates and owns its own node list.
  *
  */
-CRF_NewLocalPosteriorBuilder::CRF_NewLocalPosteriorBuilder(CRF_Model* crf_in, bool norm)
+CRF_NewLocalPosteriorBuilder::CRF_NewLocalPosteriorBuilder(CRF_Model* crf_in, bool norm, CRF_DecodeContext* ctx)
 	: crf(crf_in),
 	  normalize(norm)
 {
@@ -27,8 +29,14 @@ CRF_NewLocalPosteriorBuilder::CRF_NewLocalPosteriorBuilder(CRF_Model* crf_in, bo
 	for (QNUInt32 i=0; i<this->crf->getNLabs(); i++) {
 		this->alpha_base[i]=0.0;
 	}
-	this->nodeList = new CRF_StateVector();
-	this->ownsNodeList=true;
+	if (ctx == NULL) {
+		this->nodeList = new CRF_StateVector();
+		this->ownsNodeList=true;
+	}
+	else {
+		this->nodeList = ctx->getNodeList();
+		this->ownsNodeList=false;
+	}
 }
 
 /*
@@ -41,7 +49,7 @@ CRF_NewLocalPosteriorBuilder::~CRF_NewLocalPosteriorBuilder()
 	if (this->ftr_buf != NULL) { delete [] ftr_buf;}
 	if (this->lab_buf != NULL) { delete [] lab_buf;}
 	if (this->alpha_base != NULL) { delete [] alpha_base;}
-	// should delete nodeList?
+	if (this->ownsNodeList) { delete this->nodeList;}
 }
 
 /*
@@ -81,18 +89,13 @@ CRF_StateVector* CRF_NewLocalPosteriorBuilder::buildFtrSeq(CRF_FeatureStream* ft
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
 			// Now, separate the bunch into individual frames
-			float* new_buf = new float[num_ftrs];
-			for (QNUInt32 j=0; j<num_ftrs; j++) {
-				int idx=i*num_ftrs+j;
-				new_buf[j]=ftr_buf[idx];
-				//cout << " " << new_buf[j];
-			}
 			//cout << endl;
 			// Store the current frame/label information in a sequence node
 			//	* sequence nodes create a doubly-linked list, with the previous node known at creation time
-			//  * new_buf will be deleted when this sequence object gets deleted
+			//  * the frame is copied into the buffer the node already owns, so nodes reused
+			//    from an earlier sequence do not allocate
 			//next_seq = new CRF_Seq(new_buf,num_ftrs,lab_buf[i],this->num_labs,cur_seq);
-			nodeList->set(nodeCnt,new_buf,lab_buf[i],this->crf->getNLabs(),this->crf);
+			nodeList->setCopy(nodeCnt,&(ftr_buf[i*num_ftrs]),num_ftrs,lab_buf[i],this->crf);
 
 			//double value=this->computeTransMatrix(cur_seq,crf);
 			//double value=this->computeTransMatrixLog(cur_seq); // logspace computation
@@ -223,18 +226,13 @@ CRF_StateVector* CRF_NewLocalPosteriorBuilder::buildFtrSeqNState(CRF_FeatureStre
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
 			// Now, separate the bunch into individual frames
-			float* new_buf = new float[num_ftrs];
-			for (QNUInt32 j=0; j<num_ftrs; j++) {
-				int idx=i*num_ftrs+j;
-				new_buf[j]=ftr_buf[idx];
-				//cout << " " << new_buf[j];
-			}
 			//cout << endl;
 			// Store the current frame/label information in a sequence node
 			//	* sequence nodes create a doubly-linked list, with the previous node known at creation time
-			//  * new_buf will be deleted when this sequence object gets deleted
+			//  * the frame is copied into the buffer the node already owns, so nodes reused
+			//    from an earlier sequence do not allocate
 			//next_seq = new CRF_Seq(new_buf,num_ftrs,lab_buf[i],this->num_labs,cur_seq);
-			nodeList->set(nodeCnt,new_buf,lab_buf[i],this->crf->getNLabs(),this->crf);
+			nodeList->setCopy(nodeCnt,&(ftr_buf[i*num_ftrs]),num_ftrs,lab_buf[i],this->crf);
 
 			//double value=this->computeTransMatrix(cur_seq,crf);
 			//double value=this->computeTransMatrixLog(cur_seq); // logspace computation
@@ -12,6 +12,7 @@
 #include "../CRF_Model.h"
 #include "../nodes/CRF_StateVector.h"
 #include "../io/CRF_FeatureStream.h"
+#include "CRF_DecodeContext.h"
 
 /*
  * class CRF_NewLocalPosteriorBuilder
@@ -45,7 +46,7 @@ protected:
 	double* alpha_base;
 	bool normalize;
 public:
-	CRF_NewLocalPosteriorBuilder(CRF_Model* crf_in, bool norm=true);
+	CRF_NewLocalPosteriorBuilder(CRF_Model* crf_in, bool norm=true, CRF_DecodeContext* ctx=NULL);
 	virtual ~CRF_NewLocalPosteriorBuilder();
 	virtual CRF_StateVector* buildFtrSeq(CRF_FeatureStream* ftr_strm);
 	//virtual void computeAlphaBeta(CRF_StateVector *nodeList);
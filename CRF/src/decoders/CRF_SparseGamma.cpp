@@ -0,0 +1,195 @@
+/*
+ * CRF_SparseGamma.cpp
+ *
+ */
+
+#include "CRF_SparseGamma.h"
+#include <algorithm>
+
+/*
+ * CRF_SparseGamma constructor
+ */
+CRF_SparseGamma::CRF_SparseGamma()
+	: numLabs(0),
+	  hasTrans(false)
+{
+	this->stateOffsets.assign(1,0);
+	this->transOffsets.assign(1,0);
+}
+
+/*
+ * CRF_SparseGamma destructor
+ */
+CRF_SparseGamma::~CRF_SparseGamma()
+{
+}
+
+/*
+ * CRF_SparseGamma::clear
+ *
+ * Empties the gammas but keeps the allocated storage for the next sequence.
+ */
+void CRF_SparseGamma::clear()
+{
+	this->stateOffsets.assign(1,0);
+	this->stateLabs.clear();
+	this->stateGammas.clear();
+	this->transOffsets.assign(1,0);
+	this->transKeys.clear();
+	this->transGammas.clear();
+	this->hasTrans=false;
+}
+
+/*
+ * CRF_SparseGamma::compress
+ *
+ * Input: nframes - number of frames
+ *        entries - gamma contributions, sorted in place
+ *        offsets, keys, gammas - CSR arrays to fill
+ *
+ * Sums the contributions with the same frame and key, then normalizes each frame so that its
+ * gammas sum to one.  The sort is stable, so contributions to one entry are added in the order
+ * they were collected, as in the dense computation.
+ */
+void CRF_SparseGamma::compress(QNUInt32 nframes, vector<CRF_GammaEntry>& entries, vector<QNUInt32>& offsets,
+		vector<QNUInt32>& keys, vector<double>& gammas)
+{
+	stable_sort(entries.begin(), entries.end());
+	offsets.assign(nframes+1,0);
+	keys.clear();
+	gammas.clear();
+	size_t i=0;
+	for (QNUInt32 frame=0; frame<nframes; frame++) {
+		offsets[frame]=keys.size();
+		while (i<entries.size() && entries[i].frame<frame) {
+			i++;
+		}
+		while (i<entries.size() && entries[i].frame==frame) {
+			if (keys.size()>offsets[frame] && keys.back()==entries[i].key) {
+				gammas.back()=logAdd(gammas.back(),entries[i].gamma);
+			}
+			else {
+				keys.push_back(entries[i].key);
+				gammas.push_back(entries[i].gamma);
+			}
+			i++;
+		}
+		double total=CRF_LogMath::LOG0;
+		for (size_t j=offsets[frame]; j<keys.size(); j++) {
+			total=logAdd(total,gammas[j]);
+		}
+		for (size_t j=offsets[frame]; j<keys.size(); j++) {
+			gammas[j]-=total;
+		}
+	}
+	offsets[nframes]=keys.size();
+}
+
+/*
+ * CRF_SparseGamma::build
+ *
+ * Input: nframes - number of frames in the sequence
+ *        num_labs - number of labels
+ *        state_entries - state gamma contributions (key is the label)
+ *        trans_entries - transition gamma contributions (key is from*num_labs+to), or NULL
+ *
+ * Both entry vectors are sorted in place.
+ */
+void CRF_SparseGamma::build(QNUInt32 nframes, QNUInt32 num_labs, vector<CRF_GammaEntry>& state_entries,
+		vector<CRF_GammaEntry>* trans_entries)
+{
+	this->numLabs=num_labs;
+	this->compress(nframes,state_entries,this->stateOffsets,this->stateLabs,this->stateGammas);
+	this->hasTrans=(trans_entries != NULL);
+	if (this->hasTrans) {
+		this->compress(nframes,*trans_entries,this->transOffsets,this->transKeys,this->transGammas);
+	}
+	else {
+		this->transOffsets.assign(nframes+1,0);
+		this->transKeys.clear();
+		this->transGammas.clear();
+	}
+}
+
+/*
+ * CRF_SparseGamma::getNumFrames
+ *
+ * Returns: number of frames in the sequence
+ */
+QNUInt32 CRF_SparseGamma::getNumFrames()
+{
+	return this->stateOffsets.size()-1;
+}
+
+/*
+ * CRF_SparseGamma::getNumLabs
+ *
+ * Returns: number of labels
+ */
+QNUInt32 CRF_SparseGamma::getNumLabs()
+{
+	return this->numLabs;
+}
+
+/*
+ * CRF_SparseGamma::hasTransGammas
+ *
+ * Returns: true if transition gammas were computed
+ */
+bool CRF_SparseGamma::hasTransGammas()
+{
+	return this->hasTrans;
+}
+
+/*
+ * CRF_SparseGamma::toDense
+ *
+ * Input: *stateGamma - vector to fill with nframes*num_labs state gammas
+ *        *transGamma - vector to fill with nframes*num_labs*num_labs transition gammas, or NULL
+ *
+ * Expands the gammas into the layout of CRF_LatticeBuilder::getAlignmentGammas(), with LOG0 for
+ * the labels that are not in the lattice.
+ */
+void CRF_SparseGamma::toDense(vector<double>* stateGamma, vector<double>* transGamma)
+{
+	QNUInt32 nframes=this->getNumFrames();
+	stateGamma->assign(nframes*this->numLabs,CRF_LogMath::LOG0);
+	for (QNUInt32 frame=0; frame<nframes; frame++) {
+		for (QNUInt32 i=this->getStateBegin(frame); i<this->getStateEnd(frame); i++) {
+			stateGamma->at(frame*this->numLabs+this->stateLabs[i])=this->stateGammas[i];
+		}
+	}
+	if (transGamma != NULL) {
+		transGamma->assign(nframes*this->numLabs*this->numLabs,CRF_LogMath::LOG0);
+		for (QNUInt32 frame=0; frame<nframes; frame++) {
+			for (QNUInt32 i=this->getTransBegin(frame); i<this->getTransEnd(frame); i++) {
+				transGamma->at(frame*this->numLabs*this->numLabs+this->transKeys[i])=this->transGammas[i];
+			}
+		}
+	}
+}
+
+/*
+ * CRF_SparseGamma::getBytes
+ *
+ * Returns: bytes used by the stored gammas
+ */
+size_t CRF_SparseGamma::getBytes()
+{
+	return (this->stateOffsets.size()+this->stateLabs.size()+this->transOffsets.size()+this->transKeys.size())*sizeof(QNUInt32)
+			+(this->stateGammas.size()+this->transGammas.size())*sizeof(double);
+}
+
+/*
+ * CRF_SparseGamma::getDenseBytes
+ *
+ * Returns: bytes the same gammas take in the dense vectors of getAlignmentGammas()
+ */
+size_t CRF_SparseGamma::getDenseBytes()
+{
+	size_t per_frame=this->numLabs;
+	if (this->hasTrans) {
+		per_frame+=(size_t)this->numLabs*this->numLabs;
+	}
+	return (size_t)this->getNumFrames()*per_frame*sizeof(double);
+}
@@ -0,0 +1,75 @@
+#ifndef CRF_SPARSEGAMMA_H_
+#define CRF_SPARSEGAMMA_H_
+/*
+ * CRF_SparseGamma.h
+ *
+ * Contains the class definition for CRF_SparseGamma
+ */
+
+#include "../CRF.h"
+#include <vector>
+
+/*
+ * struct CRF_GammaEntry
+ *
+ * One unnormalized log gamma contribution collected from a lattice arc.  key is the label for state
+ * gammas and from*num_labs+to for transition gammas.
+ */
+struct CRF_GammaEntry {
+	QNUInt32 frame;
+	QNUInt32 key;
+	double gamma;
+	CRF_GammaEntry(QNUInt32 f, QNUInt32 k, double g) : frame(f), key(k), gamma(g) {}
+	bool operator<(const CRF_GammaEntry& other) const {
+		return (this->frame < other.frame) || (this->frame == other.frame && this->key < other.key);
+	}
+};
+
+/*
+ * class CRF_SparseGamma
+ *
+ * Per-frame normalized log gammas of a lattice, stored in compressed sparse rows by frame.  Only
+ * the labels (and label pairs) that have an arc in the lattice are kept; the dense vectors filled
+ * by CRF_LatticeBuilder::getAlignmentGammas() hold LOG0 for everything else, which is nearly all
+ * of the nstates*num_labs*num_labs transition gammas.
+ *
+ * The entries of frame f are [getStateBegin(f), getStateEnd(f)) in label order, and likewise for
+ * the transition entries, which are indexed by the frame of the first label of the pair.
+ */
+class CRF_SparseGamma
+{
+protected:
+	QNUInt32 numLabs;
+	bool hasTrans;
+	vector<QNUInt32> stateOffsets;
+	vector<QNUInt32> stateLabs;
+	vector<double> stateGammas;
+	vector<QNUInt32> transOffsets;
+	vector<QNUInt32> transKeys;
+	vector<double> transGammas;
+	virtual void compress(QNUInt32 nframes, vector<CRF_GammaEntry>& entries, vector<QNUInt32>& offsets,
+			vector<QNUInt32>& keys, vector<double>& gammas);
+public:
+	CRF_SparseGamma();
+	virtual ~CRF_SparseGamma();
+	virtual void clear();
+	virtual void build(QNUInt32 nframes, QNUInt32 num_labs, vector<CRF_GammaEntry>& state_entries,
+			vector<CRF_GammaEntry>* trans_entries);
+	virtual QNUInt32 getNumFrames();
+	virtual QNUInt32 getNumLabs();
+	virtual bool hasTransGammas();
+	inline QNUInt32 getStateBegin(QNUInt32 frame) { return this->stateOffsets[frame]; }
+	inline QNUInt32 getStateEnd(QNUInt32 frame) { return this->stateOffsets[frame+1]; }
+	inline QNUInt32 getStateLab(QNUInt32 i) { return this->stateLabs[i]; }
+	inline double getStateGamma(QNUInt32 i) { return this->stateGammas[i]; }
+	inline QNUInt32 getTransBegin(QNUInt32 frame) { return this->transOffsets[frame]; }
+	inline QNUInt32 getTransEnd(QNUInt32 frame) { return this->transOffsets[frame+1]; }
+	inline QNUInt32 getTransFromLab(QNUInt32 i) { return this->transKeys[i] / this->numLabs; }
+	inline QNUInt32 getTransToLab(QNUInt32 i) { return this->transKeys[i] % this->numLabs; }
+	inline double getTransGamma(QNUInt32 i) { return this->transGammas[i]; }
+	virtual void toDense(vector<double>* stateGamma, vector<double>* transGamma);
+	virtual size_t getBytes();
+	virtual size_t getDenseBytes();
+};
+
+#endif /*CRF_SPARSEGAMMA_H_*/
@@ -0,0 +1,304 @@
+/*
+ * CRF_StaticGraph.cpp
+ *
+ */
+
+#include "CRF_StaticGraph.h"
+#include "../utils/CRF_Utils.h"
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+/*
+ * Ordering used to sort the folded arcs of a state: by ilabel first, so that a decoder can
+ * stop scanning early for a label, then by destination and output label so that duplicates
+ * are adjacent.
+ */
+static bool CRF_GraphArc_less(const CRF_GraphArc& a, const CRF_GraphArc& b)
+{
+	if (a.ilabel != b.ilabel) return a.ilabel < b.ilabel;
+	if (a.nextstate != b.nextstate) return a.nextstate < b.nextstate;
+	if (a.olabel != b.olabel) return a.olabel < b.olabel;
+	return a.weight < b.weight;
+}
+
+/*
+ * CRF_StaticGraph constructor
+ */
+CRF_StaticGraph::CRF_StaticGraph()
+	: numStates(0),
+	  startState(0)
+{
+}
+
+/*
+ * CRF_StaticGraph destructor
+ */
+CRF_StaticGraph::~CRF_StaticGraph()
+{
+}
+
+/*
+ * CRF_StaticGraph::compile
+ *
+ * Input: fst - composed decoding graph on the tropical semiring, with CRF labels (1-based) as
+ *              input labels and words as output labels
+ *
+ * Builds the flat arc array from fst, folding the epsilon closure of every state into its arcs.
+ * Any previous contents of the graph are replaced.
+ */
+void CRF_StaticGraph::compile(const ExpandedFst<StdArc>& fst)
+{
+	if (fst.Start() == kNoStateId) {
+		string errstr="CRF_StaticGraph::compile() caught exception: the input graph has no start state.";
+		throw runtime_error(errstr);
+	}
+	const float inf = numeric_limits<float>::infinity();
+	this->numStates = fst.NumStates();
+	this->startState = fst.Start();
+	this->arcStart.assign(this->numStates + 1, 0);
+	this->arcs.clear();
+	this->finalWeight.assign(this->numStates, inf);
+	this->finalOlabel.assign(this->numStates, 0);
+
+	// closure bookkeeping, indexed by state and reset through closStates after each state
+	vector<float> closWt(this->numStates, inf);
+	vector<QNUInt32> closOlabel(this->numStates, 0);
+	vector<bool> closQueued(this->numStates, false);
+	vector<QNUInt32> closStates;
+	deque<QNUInt32> queue;
+	vector<CRF_GraphArc> stateArcs;
+
+	for (QNUInt32 s = 0; s < this->numStates; s++)
+	{
+		// shortest epsilon-input distance from s to every state of its closure
+		closWt[s] = 0.0;
+		closOlabel[s] = 0;
+		closStates.push_back(s);
+		queue.push_back(s);
+		closQueued[s] = true;
+		while (!queue.empty()) {
+			QNUInt32 q = queue.front(); queue.pop_front();
+			closQueued[q] = false;
+			for (ArcIterator< ExpandedFst<StdArc> > aiter(fst, q); !aiter.Done(); aiter.Next()) {
+				const StdArc& arc = aiter.Value();
+				if (arc.ilabel != 0) continue;
+				QNUInt32 olab = closOlabel[q];
+				if (arc.olabel != 0) {
+					if (olab != 0) {
+						string errstr="CRF_StaticGraph::compile() caught exception: two output labels on an "
+								"epsilon path from state " + stringify(s) + ".";
+						throw runtime_error(errstr);
+					}
+					olab = arc.olabel;
+				}
+				float wt = closWt[q] + arc.weight.Value();
+				if (wt < closWt[arc.nextstate]) {
+					if (closWt[arc.nextstate] == inf) {
+						closStates.push_back(arc.nextstate);
+					}
+					closWt[arc.nextstate] = wt;
+					closOlabel[arc.nextstate] = olab;
+					if (!closQueued[arc.nextstate]) {
+						queue.push_back(arc.nextstate);
+						closQueued[arc.nextstate] = true;
+					}
+				}
+			}
+		}
+
+		// fold the non-epsilon arcs and the final weights of the closure into s
+		stateArcs.clear();
+		for (QNUInt32 i = 0; i < closStates.size(); i++) {
+			QNUInt32 q = closStates[i];
+			float fw = fst.Final(q).Value();
+			if (fw != inf && closWt[q] + fw < this->finalWeight[s]) {
+				this->finalWeight[s] = closWt[q] + fw;
+				this->finalOlabel[s] = closOlabel[q];
+			}
+			for (ArcIterator< ExpandedFst<StdArc> > aiter(fst, q); !aiter.Done(); aiter.Next()) {
+				const StdArc& arc = aiter.Value();
+				if (arc.ilabel == 0) continue;
+				if (arc.olabel != 0 && closOlabel[q] != 0) {
+					string errstr="CRF_StaticGraph::compile() caught exception: two output labels on an "
+							"epsilon path from state " + stringify(s) + ".";
+					throw runtime_error(errstr);
+				}
+				CRF_GraphArc garc;
+				garc.ilabel = arc.ilabel;
+				garc.olabel = (arc.olabel != 0) ? arc.olabel : closOlabel[q];
+				garc.nextstate = arc.nextstate;
+				garc.weight = closWt[q] + arc.weight.Value();
+				stateArcs.push_back(garc);
+			}
+		}
+		for (QNUInt32 i = 0; i < closStates.size(); i++) {
+			closWt[closStates[i]] = inf;
+			closOlabel[closStates[i]] = 0;
+		}
+		closStates.clear();
+
+		// sorted so that duplicates of the same arc are adjacent, the first is the best
+		sort(stateArcs.begin(), stateArcs.end(), CRF_GraphArc_less);
+		this->arcStart[s] = this->arcs.size();
+		for (QNUInt32 i = 0; i < stateArcs.size(); i++) {
+			if (i > 0 && stateArcs[i].ilabel == stateArcs[i-1].ilabel &&
+					stateArcs[i].nextstate == stateArcs[i-1].nextstate &&
+					stateArcs[i].olabel == stateArcs[i-1].olabel) {
+				continue;
+			}
+			this->arcs.push_back(stateArcs[i]);
+		}
+	}
+	this->arcStart[this->numStates] = this->arcs.size();
+
+	if (this->arcs.empty()) {
+		string errstr="CRF_StaticGraph::compile() caught exception: the input graph has no non-epsilon arcs.";
+		throw runtime_error(errstr);
+	}
+}
+
+/*
+ * CRF_StaticGraph::Write
+ *
+ * Input: fname - file to write the graph to
+ *
+ * Returns: true if the graph was written
+ *
+ * Writes the graph in a native binary format: a header of magic number, version, number of
+ * states, number of arcs and start state, followed by the arrays.
+ */
+bool CRF_StaticGraph::Write(const char* fname)
+{
+	ofstream ofile(fname, ios::out | ios::binary);
+	if (!ofile.is_open()) {
+		string errstr="CRF_StaticGraph::Write() caught exception: cannot open the file:\n";
+		errstr += string(fname) + "\n";
+		throw runtime_error(errstr);
+	}
+	QNUInt32 header[5];
+	header[0] = CRF_STATICGRAPH_MAGIC;
+	header[1] = CRF_STATICGRAPH_VERSION;
+	header[2] = this->numStates;
+	header[3] = this->arcs.size();
+	header[4] = this->startState;
+	ofile.write((const char*)header, sizeof(header));
+	ofile.write((const char*)&(this->arcStart[0]), sizeof(QNUInt32) * (this->numStates + 1));
+	ofile.write((const char*)&(this->arcs[0]), sizeof(CRF_GraphArc) * this->arcs.size());
+	ofile.write((const char*)&(this->finalWeight[0]), sizeof(float) * this->numStates);
+	ofile.write((const char*)&(this->finalOlabel[0]), sizeof(QNUInt32) * this->numStates);
+	if (ofile.bad() || ofile.fail()) {
+		string errstr="CRF_StaticGraph::Write() caught exception: errors when writing the graph to the file:\n";
+		errstr += string(fname) + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+	}
+	ofile.close();
+	return true;
+}
+
+/*
+ * CRF_StaticGraph::Read
+ *
+ * Input: fname - file written by CRF_StaticGraph::Write
+ *
+ * Returns: true if the graph was read, false if the file could not be opened
+ *
+ * Throws if the file is not a graph, is truncated, or has arc offsets, next states or input
+ * labels out of range.
+ */
+bool CRF_StaticGraph::Read(const char* fname)
+{
+	ifstream ifile(fname, ios::in | ios::binary);
+	if (!ifile.is_open()) {
+		return false;
+	}
+	QNUInt32 header[5];
+	ifile.read((char*)header, sizeof(header));
+	if (ifile.fail() || header[0] != CRF_STATICGRAPH_MAGIC || header[1] != CRF_STATICGRAPH_VERSION) {
+		string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) +
+				" is not a compiled decoding graph of version " + stringify(CRF_STATICGRAPH_VERSION) + ".";
+		throw runtime_error(errstr);
+	}
+	this->numStates = header[2];
+	this->startState = header[4];
+	QNUInt32 num_arcs = header[3];
+	if (this->numStates == 0 || num_arcs == 0 || this->startState >= this->numStates) {
+		string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) + " has an empty graph.";
+		throw runtime_error(errstr);
+	}
+	this->arcStart.resize(this->numStates + 1);
+	this->arcs.resize(num_arcs);
+	this->finalWeight.resize(this->numStates);
+	this->finalOlabel.resize(this->numStates);
+	ifile.read((char*)&(this->arcStart[0]), sizeof(QNUInt32) * (this->numStates + 1));
+	ifile.read((char*)&(this->arcs[0]), sizeof(CRF_GraphArc) * num_arcs);
+	ifile.read((char*)&(this->finalWeight[0]), sizeof(float) * this->numStates);
+	ifile.read((char*)&(this->finalOlabel[0]), sizeof(QNUInt32) * this->numStates);
+	if (ifile.fail() || this->arcStart[this->numStates] != num_arcs) {
+		string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) + " is truncated.";
+		throw runtime_error(errstr);
+	}
+	// the decoder indexes with these without checking them
+	if (this->arcStart[0] != 0) {
+		string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) +
+				" is corrupt: the arcs of state 0 do not start at arc 0.";
+		throw runtime_error(errstr);
+	}
+	for (QNUInt32 s = 0; s < this->numStates; s++) {
+		if (this->arcStart[s + 1] < this->arcStart[s] || this->arcStart[s + 1] > num_arcs) {
+			string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) +
+					" is corrupt: bad arc offset of state " + stringify(s + 1) + ".";
+			throw runtime_error(errstr);
+		}
+	}
+	for (QNUInt32 a = 0; a < num_arcs; a++) {
+		if (this->arcs[a].nextstate >= this->numStates || this->arcs[a].ilabel == 0) {
+			string errstr="CRF_StaticGraph::Read() caught exception: " + string(fname) +
+					" is corrupt: arc " + stringify(a) + " has a bad next state or input label.";
+			throw runtime_error(errstr);
+		}
+	}
+	ifile.close();
+	return true;
+}
+
+QNUInt32 CRF_StaticGraph::getNumStates()
+{
+	return this->numStates;
+}
+
+QNUInt32 CRF_StaticGraph::getNumArcs()
+{
+	return this->arcs.size();
+}
+
+QNUInt32 CRF_StaticGraph::getStart()
+{
+	return this->startState;
+}
+
+/*
+ * CRF_StaticGraph::getFinalWeight
+ *
+ * Returns: the final weight of state, infinity if the state is not final
+ */
+float CRF_StaticGraph::getFinalWeight(QNUInt32 state)
+{
+	return this->finalWeight[state];
+}
+
+/*
+ * CRF_StaticGraph::getFinalOlabel
+ *
+ * Returns: the output label on the epsilon path to the best final weight of state, 0 for none
+ */
+QNUInt32 CRF_StaticGraph::getFinalOlabel(QNUInt32 state)
+{
+	return this->finalOlabel[state];
+}
+
+bool CRF_StaticGraph::isFinal(QNUInt32 state)
+{
+	return this->finalWeight[state] != numeric_limits<float>::infinity();
+}
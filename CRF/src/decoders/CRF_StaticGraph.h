@@ -0,0 +1,83 @@
+#ifndef CRF_STATICGRAPH_H_
+#define CRF_STATICGRAPH_H_
+/*
+ * CRF_StaticGraph.h
+ *
+ * Contains the class definition for CRF_StaticGraph
+ */
+
+#include "fst/fstlib.h"
+#include "../CRF.h"
+#include <vector>
+
+using namespace fst;
+
+#define CRF_STATICGRAPH_MAGIC 0x47465243
+#define CRF_STATICGRAPH_VERSION 1
+
+/*
+ * struct CRF_GraphArc
+ *
+ * One arc of a CRF_StaticGraph.  ilabel is the 1-based CRF label, olabel the word (0 for none)
+ * and weight the tropical weight of the epsilon path folded into the arc plus the arc itself.
+ */
+struct CRF_GraphArc
+{
+	QNUInt32 ilabel;
+	QNUInt32 olabel;
+	QNUInt32 nextstate;
+	float weight;
+};
+
+/*
+ * class CRF_StaticGraph
+ *
+ * Decoding graph in a flat, read-only layout for CRF_TokenPassDecoder.  The arcs leaving state s
+ * are arcs[arcStart[s]] to arcs[arcStart[s+1]-1], sorted by ilabel, so expanding a token is a
+ * linear scan of contiguous memory.
+ *
+ * compile() takes the composed phone/dictionary/LM graph and removes every epsilon-input arc by
+ * folding the epsilon closure of each state into its arcs: a state gets one arc for every
+ * non-epsilon arc reachable from it through epsilon-input arcs, weighted by the best such path.
+ * The final weight of a state is likewise the best final weight over its closure.  An output
+ * label on an epsilon-input arc is moved onto the folded arc (or onto finalOlabel for a path that
+ * ends in a final state); a closure path carrying two output labels cannot be folded and is
+ * reported as an error.
+ *
+ * Graphs are written by CRFGraphCompile and read back by the decoders with Read().
+ */
+class CRF_StaticGraph
+{
+protected:
+	QNUInt32 numStates;
+	QNUInt32 startState;
+	vector<QNUInt32> arcStart;
+	vector<CRF_GraphArc> arcs;
+	vector<float> finalWeight;
+	vector<QNUInt32> finalOlabel;
+public:
+	CRF_StaticGraph();
+	virtual ~CRF_StaticGraph();
+	virtual void compile(const ExpandedFst<StdArc>& fst);
+	virtual bool Write(const char* fname);
+	virtual bool Read(const char* fname);
+	virtual QNUInt32 getNumStates();
+	virtual QNUInt32 getNumArcs();
+	virtual QNUInt32 getStart();
+	virtual float getFinalWeight(QNUInt32 state);
+	virtual QNUInt32 getFinalOlabel(QNUInt32 state);
+	virtual bool isFinal(QNUInt32 state);
+
+	/*
+	 * CRF_StaticGraph::arcsBegin / arcsEnd
+	 *
+	 * Input: state - graph state
+	 *
+	 * Returns: pointers to the first and one past the last arc leaving state.  Kept inline
+	 *   since they are called for every active token on every frame.
+	 */
+	inline const CRF_GraphArc* arcsBegin(QNUInt32 state) const { return &(this->arcs[0]) + this->arcStart[state]; }
+	inline const CRF_GraphArc* arcsEnd(QNUInt32 state) const { return &(this->arcs[0]) + this->arcStart[state+1]; }
+};
+
+#endif /*CRF_STATICGRAPH_H_*/
@@ -0,0 +1,519 @@
+/*
+ * CRF_TokenPassDecoder.cpp
+ *
+ */
+
+#include "CRF_TokenPassDecoder.h"
+#include "../utils/CRF_Utils.h"
+#include <limits>
+#include <algorithm>
+
+/*
+ * Slot of the token table for a (graph state, label) pair.
+ */
+static inline QNUInt32 CRF_TokenHash(QNUInt32 state, QNUInt32 phn)
+{
+	return (state * 2654435761u) ^ (phn * 40503u);
+}
+
+/*
+ * CRF_TokenPassDecoder constructor
+ *
+ * Input: *ftr_strm_in - pointer to input stream of features
+ *        *crf_in - pointer to the CRF model to be used for decoding
+ *        *graph_in - compiled decoding graph
+ *        *ctx - per-thread decode context whose node list is used by the decoder.
+ *               If NULL, the decoder creates and owns its own node list.
+ */
+CRF_TokenPassDecoder::CRF_TokenPassDecoder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in,
+		CRF_StaticGraph* graph_in, CRF_DecodeContext* ctx)
+	: ftr_strm(ftr_strm_in),
+	  crf(crf_in),
+	  graph(graph_in)
+{
+	if (this->crf->getModelType() != STDSEG_NO_DUR_NO_SEGTRANSFTR) {
+		string errstr="CRF_TokenPassDecoder() caught exception: only stdseg_no_dur_no_segtransftr models "
+				"can be decoded over a static graph.";
+		throw runtime_error(errstr);
+	}
+	if (this->crf->getFeatureMap()->getNumStates() != 1) {
+		string errstr="CRF_TokenPassDecoder() caught exception: only single-state models (crf_states=1) "
+				"can be decoded over a static graph.";
+		throw runtime_error(errstr);
+	}
+	if (ctx == NULL) {
+		this->nodeList = new CRF_StateVector();
+		this->ownsNodeList = true;
+	}
+	else {
+		this->nodeList = ctx->getNodeList();
+		this->ownsNodeList = false;
+	}
+	this->bunch_size = 1;
+	this->num_ftrs = this->ftr_strm->num_ftrs();
+	this->lab_max_dur = this->crf->getLabMaxDur();
+	this->nActualLabs = this->crf->getNActualLabs();
+	this->ftr_buf_size = this->num_ftrs * this->lab_max_dur;
+	this->ftr_buf = new float[this->ftr_buf_size];
+	this->labs_width = this->ftr_strm->num_labs();
+	if (this->labs_width == 0) {
+		this->lab_buf = NULL;
+	}
+	else {
+		this->lab_buf = new QNUInt32[this->labs_width];
+	}
+	this->openHyps.resize(this->lab_max_dur);
+	this->tokenSlots.assign(1024, -1);
+	this->tokenSlotMask = 1023;
+	this->curMinCost = numeric_limits<float>::infinity();
+	this->numTokens = 0;
+	this->maxTokens = 0;
+	this->bestFinalOlabel = 0;
+	this->traceGCSize = CRF_TOKEN_TRACE_GC_MIN;
+}
+
+/*
+ * CRF_TokenPassDecoder destructor
+ */
+CRF_TokenPassDecoder::~CRF_TokenPassDecoder()
+{
+	delete [] this->ftr_buf;
+	delete [] this->lab_buf;
+	if (this->ownsNodeList) {
+		delete this->nodeList;
+	}
+}
+
+/*
+ * CRF_TokenPassDecoder::getNodeList
+ *
+ * Accessor function for nodeList created during decode, if further processing
+ * is desired.
+ */
+CRF_StateVector* CRF_TokenPassDecoder::getNodeList()
+{
+	return this->nodeList;
+}
+
+/*
+ * CRF_TokenPassDecoder::getNumTokens
+ *
+ * Returns: number of tokens kept after pruning in the last call to decode(), summed over its
+ *   frames (divide by the number of frames for the average number of tokens per frame)
+ */
+QNUInt32 CRF_TokenPassDecoder::getNumTokens()
+{
+	return this->numTokens;
+}
+
+/*
+ * CRF_TokenPassDecoder::setMaxTokens
+ *
+ * Input: max_tokens - largest number of tokens kept at a segment boundary, 0 for no limit
+ *
+ * Without a limit the number of tokens is only bounded by the beam.  With one, pruneTokens()
+ * also drops every token costlier than the max_tokens-th cheapest one (tokens of the same
+ * cost as that one are all kept).
+ */
+void CRF_TokenPassDecoder::setMaxTokens(QNUInt32 max_tokens)
+{
+	this->maxTokens = max_tokens;
+}
+
+/*
+ * CRF_TokenPassDecoder::getBestPath
+ *
+ * Returns: the segments of the best path found by the last call to decode(), first to last,
+ *   with their first and last frame.  Empty if no path reached the end of the utterance.
+ */
+const vector<CRF_TokenTrace>& CRF_TokenPassDecoder::getBestPath()
+{
+	return this->bestPath;
+}
+
+/*
+ * CRF_TokenPassDecoder::getBestFinalOlabel
+ *
+ * Returns: output label on the final weight of the best path (see
+ *   CRF_StaticGraph::getFinalOlabel()), 0 for none
+ */
+QNUInt32 CRF_TokenPassDecoder::getBestFinalOlabel()
+{
+	return this->bestFinalOlabel;
+}
+
+/*
+ * CRF_TokenPassDecoder::growTokenSlots
+ *
+ * Doubles the token table and reinserts the current tokens.
+ */
+void CRF_TokenPassDecoder::growTokenSlots()
+{
+	this->tokenSlots.assign(this->tokenSlots.size() * 2, -1);
+	this->tokenSlotMask = this->tokenSlots.size() - 1;
+	for (QNUInt32 i = 0; i < this->curTokens.size(); i++) {
+		CRF_Token& tok = this->curTokens[i];
+		QNUInt32 slot = CRF_TokenHash(tok.state, tok.phn) & this->tokenSlotMask;
+		while (this->tokenSlots[slot] != -1) {
+			slot = (slot + 1) & this->tokenSlotMask;
+		}
+		this->tokenSlots[slot] = i;
+		tok.slot = slot;
+	}
+}
+
+/*
+ * CRF_TokenPassDecoder::addToken
+ *
+ * Input: state - graph state reached
+ *        phn - 1-based label of the segment
+ *        wrd - output label of the segment, 0 for none
+ *        start - first frame of the segment
+ *        cost - path cost up to the end of the segment
+ *        trace - trace entry of the token the segment was expanded from
+ *
+ * Adds a token to the boundary being built, or replaces the token for the same
+ * (state, label) pair if the new one is cheaper.
+ */
+void CRF_TokenPassDecoder::addToken(QNUInt32 state, QNUInt32 phn, QNUInt32 wrd, QNUInt32 start,
+		float cost, int trace)
+{
+	QNUInt32 slot = CRF_TokenHash(state, phn) & this->tokenSlotMask;
+	while (this->tokenSlots[slot] != -1) {
+		CRF_Token& tok = this->curTokens[this->tokenSlots[slot]];
+		if (tok.state == state && tok.phn == phn) {
+			if (cost < tok.cost) {
+				tok.wrd = wrd;
+				tok.start = start;
+				tok.cost = cost;
+				tok.trace = trace;
+				if (cost < this->curMinCost) { this->curMinCost = cost; }
+			}
+			return;
+		}
+		slot = (slot + 1) & this->tokenSlotMask;
+	}
+	CRF_Token tok;
+	tok.state = state;
+	tok.phn = phn;
+	tok.wrd = wrd;
+	tok.start = start;
+	tok.cost = cost;
+	tok.trace = trace;
+	tok.slot = slot;
+	this->tokenSlots[slot] = this->curTokens.size();
+	this->curTokens.push_back(tok);
+	if (cost < this->curMinCost) { this->curMinCost = cost; }
+	// keep the table at most half full
+	if (this->curTokens.size() * 2 > this->tokenSlots.size()) {
+		this->growTokenSlots();
+	}
+}
+
+/*
+ * CRF_TokenPassDecoder::expandTokens
+ *
+ * Input: nodeCnt - frame the new segments start at
+ *
+ * Expands every token of the boundary before frame nodeCnt through the arcs of its graph
+ * state, adding the arc weight and the label transition at nodeCnt.
+ */
+void CRF_TokenPassDecoder::expandTokens(QNUInt32 nodeCnt)
+{
+	vector<CRF_SegHyp>& hyps = this->openHyps[nodeCnt % this->lab_max_dur];
+	hyps.clear();
+	CRF_StateNode* node = this->nodeList->at(nodeCnt);
+	for (QNUInt32 i = 0; i < this->prevTokens.size(); i++) {
+		const CRF_Token& tok = this->prevTokens[i];
+		const CRF_GraphArc* end = this->graph->arcsEnd(tok.state);
+		for (const CRF_GraphArc* arc = this->graph->arcsBegin(tok.state); arc != end; arc++) {
+			if (arc->ilabel > this->nActualLabs) {
+				string errstr="CRF_TokenPassDecoder::expandTokens() caught exception: graph input label " +
+						stringify(arc->ilabel) + " is larger than the number of labels.";
+				throw runtime_error(errstr);
+			}
+			CRF_SegHyp hyp;
+			hyp.state = arc->nextstate;
+			hyp.phn = arc->ilabel;
+			hyp.wrd = arc->olabel;
+			hyp.cost = tok.cost + arc->weight;
+			hyp.trace = tok.trace;
+			if (nodeCnt > 0) {
+				// for the start node, there is not any label transition
+				hyp.cost -= node->getTransValue(tok.phn - 1, arc->ilabel - 1);
+			}
+			hyps.push_back(hyp);
+		}
+	}
+}
+
+/*
+ * CRF_TokenPassDecoder::pruneTokens
+ *
+ * Input: nodeCnt - last frame of the segments ending at the boundary
+ *        beam - pruning beam, no pruning if <= 0
+ *
+ * Drops the tokens of the boundary being built that are outside the beam or beyond the token
+ * limit (see setMaxTokens), empties the token table and writes a trace entry for each
+ * surviving token.
+ */
+void CRF_TokenPassDecoder::pruneTokens(QNUInt32 nodeCnt, double beam)
+{
+	bool prune = (beam > 0.0);
+	float threshold = prune ? this->curMinCost + beam : numeric_limits<float>::infinity();
+	if (this->maxTokens > 0 && this->curTokens.size() > this->maxTokens) {
+		this->tokenCosts.resize(this->curTokens.size());
+		for (QNUInt32 i = 0; i < this->curTokens.size(); i++) {
+			this->tokenCosts[i] = this->curTokens[i].cost;
+		}
+		nth_element(this->tokenCosts.begin(), this->tokenCosts.begin() + (this->maxTokens - 1),
+				this->tokenCosts.end());
+		threshold = min(threshold, this->tokenCosts[this->maxTokens - 1]);
+		prune = true;
+	}
+	QNUInt32 kept = 0;
+	for (QNUInt32 i = 0; i < this->curTokens.size(); i++) {
+		CRF_Token tok = this->curTokens[i];
+		this->tokenSlots[tok.slot] = -1;
+		if (prune && tok.cost > threshold) {
+			continue;
+		}
+		CRF_TokenTrace tr;
+		tr.prev = tok.trace;
+		tr.phn = tok.phn;
+		tr.wrd = tok.wrd;
+		tr.start = tok.start;
+		tr.end = nodeCnt;
+		tr.cost = tok.cost;
+		this->traces.push_back(tr);
+		tok.trace = this->traces.size() - 1;
+		this->curTokens[kept++] = tok;
+	}
+	this->curTokens.resize(kept);
+	this->numTokens += kept;
+}
+
+/*
+ * CRF_TokenPassDecoder::collectTraces
+ *
+ * Drops the trace entries no live hypothesis can reach and compacts the others.  The live
+ * hypotheses are the tokens of the last boundary and the open segments; their trace indices
+ * are updated.  A trace entry always follows the entry it points back to, so one pass in
+ * index order renumbers them.
+ */
+void CRF_TokenPassDecoder::collectTraces()
+{
+	this->traceMap.assign(this->traces.size(), -1);
+	for (QNUInt32 i = 0; i < this->prevTokens.size(); i++) {
+		for (int tr = this->prevTokens[i].trace; tr >= 0 && this->traceMap[tr] == -1; tr = this->traces[tr].prev) {
+			this->traceMap[tr] = 0;
+		}
+	}
+	for (QNUInt32 d = 0; d < this->lab_max_dur; d++) {
+		const vector<CRF_SegHyp>& hyps = this->openHyps[d];
+		for (QNUInt32 i = 0; i < hyps.size(); i++) {
+			for (int tr = hyps[i].trace; tr >= 0 && this->traceMap[tr] == -1; tr = this->traces[tr].prev) {
+				this->traceMap[tr] = 0;
+			}
+		}
+	}
+
+	QNUInt32 kept = 0;
+	for (QNUInt32 i = 0; i < this->traces.size(); i++) {
+		if (this->traceMap[i] == -1) {
+			continue;
+		}
+		CRF_TokenTrace tr = this->traces[i];
+		if (tr.prev >= 0) {
+			tr.prev = this->traceMap[tr.prev];
+		}
+		this->traceMap[i] = kept;
+		this->traces[kept++] = tr;
+	}
+	this->traces.resize(kept);
+
+	for (QNUInt32 i = 0; i < this->prevTokens.size(); i++) {
+		CRF_Token& tok = this->prevTokens[i];
+		if (tok.trace >= 0) {
+			tok.trace = this->traceMap[tok.trace];
+		}
+	}
+	for (QNUInt32 d = 0; d < this->lab_max_dur; d++) {
+		vector<CRF_SegHyp>& hyps = this->openHyps[d];
+		for (QNUInt32 i = 0; i < hyps.size(); i++) {
+			if (hyps[i].trace >= 0) {
+				hyps[i].trace = this->traceMap[hyps[i].trace];
+			}
+		}
+	}
+}
+
+/*
+ * CRF_TokenPassDecoder::decode
+ *
+ * Input: *result_fst - empty fst to store the result
+ *        beam - pruning beam, no pruning if <= 0
+ *
+ * Returns: number of frames decoded
+ *
+ * Decodes the current utterance of the feature stream.  result_fst gets the best path as a
+ * linear fst with one arc per segment, labelled with the 1-based CRF label on the input side
+ * and the word on the output side, the same labels as the result of nStateDecode().
+ */
+int CRF_TokenPassDecoder::decode(VectorFst<StdArc>* result_fst, double beam)
+{
+	const float inf = numeric_limits<float>::infinity();
+	this->prevTokens.clear();
+	this->curTokens.clear();
+	this->traces.clear();
+	this->traceGCSize = CRF_TOKEN_TRACE_GC_MIN;
+	this->bestPath.clear();
+	this->bestFinalOlabel = 0;
+	this->numTokens = 0;
+	for (QNUInt32 i = 0; i < this->lab_max_dur; i++) {
+		this->openHyps[i].clear();
+	}
+
+	CRF_Token start_tok;
+	start_tok.state = this->graph->getStart();
+	start_tok.phn = 0;
+	start_tok.wrd = 0;
+	start_tok.start = 0;
+	start_tok.cost = 0.0;
+	start_tok.trace = -1;
+	start_tok.slot = -1;
+	this->prevTokens.push_back(start_tok);
+
+	QNUInt32 ftr_count;
+	QNUInt32 nodeCnt = 0;
+	time_t decodestart = time(NULL);
+
+	// bunch_size (number of windows ending at next frame) starts from 1 and is added by 1 in
+	// each iteration, until being equal to lab_max_dur.
+	this->bunch_size = 1;
+	do {
+		ftr_count = this->ftr_strm->read(this->bunch_size, this->ftr_buf, this->lab_buf);
+		if (ftr_count > 0) {
+			QNUInt32 cur_ftr_buf_size = this->num_ftrs * ftr_count;
+			QNUInt32 nodeMaxDur = (nodeCnt + 1 <= this->lab_max_dur) ? nodeCnt + 1 : this->lab_max_dur;
+			QNUInt32 numPrevNodes = (nodeCnt + 1 <= this->lab_max_dur) ? nodeCnt : this->lab_max_dur;
+			this->nodeList->setCopy(nodeCnt, this->ftr_buf, cur_ftr_buf_size, CRF_LAB_BAD, this->crf,
+					nodeMaxDur, this->crf->getNLabs(), this->nActualLabs);
+			this->nodeList->linkPrevNodes(nodeCnt, numPrevNodes);
+			CRF_StateNode* node = this->nodeList->at(nodeCnt);
+			node->computeTransMatrix();
+			if (nodeCnt == 0) {
+				node->computeFirstAlpha();
+			}
+			else {
+				node->computeAlpha();
+			}
+
+			this->expandTokens(nodeCnt);
+
+			// close every open segment at this frame
+			this->curTokens.clear();
+			this->curMinCost = inf;
+			for (QNUInt32 dur = 1; dur <= nodeMaxDur; dur++) {
+				QNUInt32 seg_start = nodeCnt + 1 - dur;
+				const vector<CRF_SegHyp>& hyps = this->openHyps[seg_start % this->lab_max_dur];
+				for (QNUInt32 i = 0; i < hyps.size(); i++) {
+					const CRF_SegHyp& hyp = hyps[i];
+					float cost = hyp.cost - node->getStateValue(hyp.phn - 1, dur);
+					if (beam > 0.0 && cost > this->curMinCost + beam) {
+						continue;
+					}
+					this->addToken(hyp.state, hyp.phn, hyp.wrd, seg_start, cost, hyp.trace);
+				}
+			}
+			this->pruneTokens(nodeCnt, beam);
+			this->prevTokens.swap(this->curTokens);
+			// the trace keeps one entry per token and frame; once it has doubled, drop the
+			// entries of the pruned paths
+			if (this->traces.size() >= this->traceGCSize) {
+				this->collectTraces();
+				this->traceGCSize = max((QNUInt32)(2 * this->traces.size()), (QNUInt32)CRF_TOKEN_TRACE_GC_MIN);
+			}
+
+			if (nodeCnt % 100 == 0) {
+				cout << "time: " << nodeCnt << " " << this->prevTokens.size() << " tokens, minimum weight = "
+						<< this->curMinCost << endl;
+			}
+			nodeCnt++;
+		}
+		if (this->bunch_size < this->lab_max_dur)
+			this->bunch_size++;
+	} while (ftr_count > 0);
+	this->nodeList->setNodeCount(nodeCnt);
+
+	StdArc::StateId startState = result_fst->AddState();
+	result_fst->SetStart(startState);
+	if (nodeCnt == 0) {
+		return 0;
+	}
+	double Zx = this->nodeList->at(nodeCnt - 1)->computeAlphaSum();
+
+	// best token ending in a final state of the graph
+	int best_idx = -1;
+	float best_cost = inf;
+	for (QNUInt32 i = 0; i < this->prevTokens.size(); i++) {
+		const CRF_Token& tok = this->prevTokens[i];
+		if (this->graph->isFinal(tok.state) && tok.cost + this->graph->getFinalWeight(tok.state) < best_cost) {
+			best_cost = tok.cost + this->graph->getFinalWeight(tok.state);
+			best_idx = i;
+		}
+	}
+	float final_wt = 0.0;
+	QNUInt32 final_olabel = 0;
+	if (best_idx < 0) {
+		// Failsafe - no token reached a final state, take the best token
+		cout << "ERROR: Could not reach a final state at the end of utterance" << endl;
+		for (QNUInt32 i = 0; i < this->prevTokens.size(); i++) {
+			if (this->prevTokens[i].cost < best_cost) {
+				best_cost = this->prevTokens[i].cost;
+				best_idx = i;
+			}
+		}
+	}
+	else {
+		final_wt = this->graph->getFinalWeight(this->prevTokens[best_idx].state);
+		final_olabel = this->graph->getFinalOlabel(this->prevTokens[best_idx].state);
+	}
+	if (best_idx < 0) {
+		cout << "ERROR: Could not reach end of utterance" << endl;
+		StdArc::StateId final_state = result_fst->AddState();
+		result_fst->SetFinal(final_state, Zx);
+		result_fst->AddArc(startState, StdArc(0, 0, 8, final_state));
+		return nodeCnt;
+	}
+	cout << "Found " << this->prevTokens.size() << " tokens at the end of utterance, best weight "
+			<< best_cost << ", -Z(X) = " << -1 * Zx << endl;
+
+	// Backtrack through the trace, then build the path from the first segment on
+	vector<int> path;
+	for (int tr = this->prevTokens[best_idx].trace; tr >= 0; tr = this->traces[tr].prev) {
+		path.push_back(tr);
+	}
+	StdArc::StateId cur_state = startState;
+	float prev_cost = 0.0;
+	for (int i = path.size() - 1; i >= 0; i--) {
+		const CRF_TokenTrace& tr = this->traces[path[i]];
+		this->bestPath.push_back(tr);
+		StdArc::StateId next_state = result_fst->AddState();
+		result_fst->AddArc(cur_state, StdArc(tr.phn, tr.wrd, tr.cost - prev_cost, next_state));
+		prev_cost = tr.cost;
+		cur_state = next_state;
+	}
+	this->bestFinalOlabel = final_olabel;
+	if (final_olabel != 0) {
+		StdArc::StateId next_state = result_fst->AddState();
+		result_fst->AddArc(cur_state, StdArc(0, final_olabel, 0.0, next_state));
+		cur_state = next_state;
+	}
+	result_fst->SetFinal(cur_state, Zx + final_wt);
+
+	time_t decodeend = time(NULL);
+	cout << "Token passing: " << nodeCnt << " frames, " << (float)this->numTokens / nodeCnt
+			<< " tokens per frame, " << (decodeend - decodestart) << " seconds" << endl;
+	return nodeCnt;
+}
@@ -0,0 +1,139 @@
+#ifndef CRF_TOKENPASSDECODER_H_
+#define CRF_TOKENPASSDECODER_H_
+/*
+ * CRF_TokenPassDecoder.h
+ *
+ * Contains the class definition for CRF_TokenPassDecoder
+ */
+
+#include "fst/fstlib.h"
+#include "../CRF.h"
+#include "../CRF_Model.h"
+#include "../io/CRF_FeatureStream.h"
+#include "../nodes/CRF_StateVector.h"
+#include "CRF_DecodeContext.h"
+#include "CRF_StaticGraph.h"
+#include <vector>
+
+using namespace fst;
+
+// trace entries kept before the first garbage collection of the trace
+#define CRF_TOKEN_TRACE_GC_MIN 65536
+
+/*
+ * struct CRF_Token
+ *
+ * A hypothesis at a segment boundary: the graph state reached, the 1-based label of the
+ * segment that reached it (0 before the first segment), its cost and its entry in the trace.
+ */
+struct CRF_Token
+{
+	QNUInt32 state;
+	QNUInt32 phn;
+	QNUInt32 wrd;
+	QNUInt32 start;
+	float cost;
+	int trace;
+	int slot;
+};
+
+/*
+ * struct CRF_SegHyp
+ *
+ * An open segment: a token expanded through one graph arc at the frame the segment starts.
+ * cost includes the arc weight and the label transition into the segment; the state value
+ * is added once the segment end (and so its duration) is known.
+ */
+struct CRF_SegHyp
+{
+	QNUInt32 state;
+	QNUInt32 phn;
+	QNUInt32 wrd;
+	float cost;
+	int trace;
+};
+
+/*
+ * struct CRF_TokenTrace
+ *
+ * Back pointer entry written for every token that survives pruning.  Entries that no live
+ * token or open segment leads back to are dropped as the decoder goes (see collectTraces).
+ */
+struct CRF_TokenTrace
+{
+	int prev;
+	QNUInt32 phn;
+	QNUInt32 wrd;
+	QNUInt32 start;
+	QNUInt32 end;
+	float cost;
+};
+
+/*
+ * class CRF_TokenPassDecoder
+ *
+ * Frame-synchronous token passing decoder over a CRF_StaticGraph.  Does the same search as
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::nStateDecode() with a dictionary/LM network, but
+ * since the graph has no epsilon arcs left, expanding a token is a scan of the contiguous arcs
+ * of its state and needs no epsilon queue or std::map bookkeeping.
+ *
+ * At every frame the tokens of the boundary before the frame are expanded into open segments,
+ * then every open segment that started within the last lab_max_dur frames is closed at the
+ * frame with its state value.  Tokens are merged on (graph state, label) in an open-addressing
+ * table and pruned with a beam around the best token and, if setMaxTokens() was called, to
+ * the cheapest tokens of the boundary.
+ *
+ * Supports single-state stdseg_no_dur_no_segtransftr models (crf_states=1), for which the
+ * graph input labels are the CRF labels plus 1; the constructor throws for any other model.  All buffers keep their capacity
+ * from one utterance to the next.
+ */
+class CRF_TokenPassDecoder
+{
+protected:
+	CRF_FeatureStream* ftr_strm;
+	CRF_Model* crf;
+	CRF_StaticGraph* graph;
+	CRF_StateVector* nodeList;
+	bool ownsNodeList;
+	QNUInt32 num_ftrs;
+	QNUInt32 lab_max_dur;
+	QNUInt32 nActualLabs;
+	QNUInt32 bunch_size;
+	float* ftr_buf;
+	QNUInt32 ftr_buf_size;
+	QNUInt32* lab_buf;
+	QNUInt32 labs_width;
+
+	vector<CRF_Token> prevTokens;
+	vector<CRF_Token> curTokens;
+	vector< vector<CRF_SegHyp> > openHyps;
+	vector<CRF_TokenTrace> traces;
+	vector<int> traceMap;
+	QNUInt32 traceGCSize;
+	vector<CRF_TokenTrace> bestPath;
+	QNUInt32 bestFinalOlabel;
+	vector<int> tokenSlots;
+	QNUInt32 tokenSlotMask;
+	float curMinCost;
+	QNUInt32 numTokens;
+	QNUInt32 maxTokens;
+	vector<float> tokenCosts;
+
+	virtual void expandTokens(QNUInt32 nodeCnt);
+	virtual void addToken(QNUInt32 state, QNUInt32 phn, QNUInt32 wrd, QNUInt32 start, float cost, int trace);
+	virtual void pruneTokens(QNUInt32 nodeCnt, double beam);
+	virtual void growTokenSlots();
+	virtual void collectTraces();
+public:
+	CRF_TokenPassDecoder(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_StaticGraph* graph_in,
+			CRF_DecodeContext* ctx=NULL);
+	virtual ~CRF_TokenPassDecoder();
+	virtual int decode(VectorFst<StdArc>* result_fst, double beam);
+	virtual CRF_StateVector* getNodeList();
+	virtual QNUInt32 getNumTokens();
+	virtual void setMaxTokens(QNUInt32 max_tokens);
+	virtual const vector<CRF_TokenTrace>& getBestPath();
+	virtual QNUInt32 getBestFinalOlabel();
+};
+
+#endif /*CRF_TOKENPASSDECODER_H_*/
@@ -496,17 +496,27 @@ int CRF_ViterbiDecoder::nStateDecode(VectorFst<StdArc>* result_fst, VectorFst<St
 	crossUpdateSameStateCounter = 0;
 	crossUpdateDiffStateCounter = 0;
 
+	// A joined stream already holds the sequence in place, one block per feature file
+	bool use_view=ftr_strm->has_view();
+	CRF_FtrView fv;
+
 	time_t loopstart = time(NULL);
 	do {
-		ftr_count=ftr_strm->read(this->bunch_size,ftr_buf,lab_buf);
+		if (use_view) {
+			ftr_count=ftr_strm->read_view(this->bunch_size,&fv,lab_buf);
+		}
+		else {
+			ftr_count=ftr_strm->read(this->bunch_size,ftr_buf,lab_buf);
+		}
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
-			float* new_buf = new float[this->num_ftrs];
-			for (QNUInt32 j=0; j<this->num_ftrs; j++) {
-				int idx=i*this->num_ftrs+j;
-				new_buf[j]=ftr_buf[idx];
+			if (use_view) {
+				CRF_FtrView frame_fv=fv.next(i);
+				this->nodeList->setFtrView(nodeCnt,&frame_fv,num_ftrs,this->lab_buf[i],this->crf);
+			}
+			else {
+				this->nodeList->setCopy(nodeCnt,&(ftr_buf[i*this->num_ftrs]),num_ftrs,this->lab_buf[i],this->crf);
 			}
-			this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
 			float value=this->nodeList->at(nodeCnt)->computeTransMatrix();
 			double scale;
 			double* prev_alpha;
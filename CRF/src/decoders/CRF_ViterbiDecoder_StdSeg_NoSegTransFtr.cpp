@@ -11,14 +11,34 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <cfloat>
 #include "CRF_ViterbiNode_PruneTrans.h"
 #include <sys/time.h>
 
-template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::CRF_ViterbiDecoder_StdSeg_NoSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in)
+/*
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr constructor
+ *
+ * Input: *ftr_strm_in - pointer to input stream of features
+ *        *crf_in - pointer to the CRF model to be used for decoding
+ *        *ctx - per-thread decode context whose node list is used by the decoder.
+ *               If NULL, the decoder creates and owns its own node list.
+ *
+ * The decoder can be reused for all the utterances of ftr_strm_in; nStateDecode() resets
+ * its state at the start of every call.
+ */
+template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::CRF_ViterbiDecoder_StdSeg_NoSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx)
 	: crf(crf_in),
 	  ftr_strm(ftr_strm_in)
 {
-	this->nodeList= new CRF_StateVector();
+	if (ctx == NULL) {
+		this->nodeList= new CRF_StateVector();
+		this->ownsNodeList=true;
+	}
+	else {
+		this->nodeList=ctx->getNodeList();
+		this->ownsNodeList=false;
+	}
 
 	// bunch_size (number of windows ending at next frame) for CRF_InFtrStream_SeqMultiWindow,
 	// starts from 1, and is added by 1 in each iteration, until being equal to lab_max_dur.
@@ -69,6 +89,17 @@ template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode
 	this->prevViterbiLmWts_nStates = new vector<float>();
 
 	this->if_output_full_fst = false;
+
+	this->scratchWts_nStates = new float[this->nStates];
+	this->scratchPtrs_nStates = new int[this->nStates];
+	this->scratchAcouWts_nStates = new float[this->nStates];
+	this->scratchLmWts_nStates = new float[this->nStates];
+	this->searchFst = new VectorFst<StdArc>();
+	this->freePhoneLmFst = NULL;
+	this->minHyps = 0;
+	this->maxHyps = 0;
+	this->beamController = NULL;
+	this->transBeam = 0.0;
 }
 
 template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::~CRF_ViterbiDecoder_StdSeg_NoSegTransFtr()
@@ -76,7 +107,9 @@ template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode
 	delete [] this->ftr_buf;
 	delete [] this->lab_buf;
 	delete [] this->alpha_base;
-	delete this->nodeList;
+	if (this->ownsNodeList) {
+		delete this->nodeList;
+	}
 
 	// the size of nextViterbiNodes_unPruned should be lab_max_dur-1 instead of lab_max_dur.
 	for (QNUInt32 i = 0; i < this->lab_max_dur - 1; i++) {
@@ -95,6 +128,13 @@ template <class CRF_VtbNode> CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode
 	delete this->prevViterbiWts_nStates;
 	delete this->prevViterbiAcouWts_nStates;
 	delete this->prevViterbiLmWts_nStates;
+
+	delete [] this->scratchWts_nStates;
+	delete [] this->scratchPtrs_nStates;
+	delete [] this->scratchAcouWts_nStates;
+	delete [] this->scratchLmWts_nStates;
+	delete this->searchFst;
+	delete this->freePhoneLmFst;
 }
 
 template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::setIfOutputFullFst(bool ifFull)
@@ -113,6 +153,71 @@ template <class CRF_VtbNode> CRF_StateVector * CRF_ViterbiDecoder_StdSeg_NoSegTr
 	return this->nodeList;
 }
 
+/*
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::setBeamController
+ *
+ * Input: *controller - adaptive beam controller, or NULL for a fixed beam
+ *
+ * When a controller is set, nStateDecode() starts every utterance with the controller's
+ * initial beam and takes the beam for each frame from it.  The controller is not owned
+ * by the decoder.
+ */
+template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::setBeamController(CRF_BeamController* controller)
+{
+	this->beamController = controller;
+}
+
+/*
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::getFrameStats
+ *
+ * Returns: the pruning statistics of every frame of the last decoded utterance
+ */
+template <class CRF_VtbNode> const vector<CRF_FrameStats>& CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::getFrameStats()
+{
+	return this->frameStats;
+}
+
+/*
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::setTransBeam
+ *
+ * Input: trans_beam - beam applied to transition arcs before the state values of the node
+ *                     are added to them, 0 for no transition pruning
+ *
+ * Only has an effect with CRF_ViterbiNode_PruneTrans as the node class.
+ */
+template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::setTransBeam(double trans_beam)
+{
+	this->transBeam = trans_beam;
+}
+
+/*
+ * CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::computePhoneLookAhead
+ *
+ * Input: nodeCnt - index of the current node, whose state values have been computed
+ *
+ * Fills phnLookAhead with, for each phone, the lowest weight (negated state value) any of
+ * its nStates internal states gets in a one-frame segment ending at nodeCnt.  Arcs entering
+ * a phone at this node cannot do better than their transition weight plus this value.
+ */
+template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::computePhoneLookAhead(uint nodeCnt)
+{
+	uint nPhones = this->nActualLabs / this->nStates;
+	this->phnLookAhead.resize(nPhones);
+	for (uint phn_lab = 0; phn_lab < nPhones; phn_lab++)
+	{
+		float best_wt = 99999.0;
+		for (uint st = 0; st < this->nStates; st++)
+		{
+			float wt = -1 * this->nodeList->at(nodeCnt)->getStateValue(phn_lab * this->nStates + st, 1);
+			if (wt < best_wt)
+			{
+				best_wt = wt;
+			}
+		}
+		this->phnLookAhead[phn_lab] = best_wt;
+	}
+}
+
 template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_VtbNode>::stateValueUpdate(uint nodeCnt)
 {
 	// update the state value for each arc in curViterbiNode_unPruned
@@ -255,13 +360,13 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 	int phn_lab = phn_id - 1;
 	// should never be less than 0 - if there is this is a problem
 	assert(phn_lab >= 0);
-	float* wts_nStates = new float[this->nStates];
-	int* ptrs_nStates = new int[this->nStates];
+	float* wts_nStates = this->scratchWts_nStates;
+	int* ptrs_nStates = this->scratchPtrs_nStates;
 	float min_wt = 99999.0;
 	bool isPhoneStartBoundary = false;
 
-	float* acou_wts_nStates = new float[this->nStates];
-	float* lm_wts_nStates = new float[this->nStates];
+	float* acou_wts_nStates = this->scratchAcouWts_nStates;
+	float* lm_wts_nStates = this->scratchLmWts_nStates;
 
 	// Computing the transition weights between multi-states for the same phone label (phn_lab).
 	// Only two types of transitions are allowed:
@@ -391,7 +496,8 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 		}
 	}
 
-	this->curViterbiNode_unPruned->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt, wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, beam);
+	float look_ahead = (this->transBeam > 0.0) ? this->phnLookAhead[phn_lab] : 0.0;
+	this->curViterbiNode_unPruned->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt, wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, this->transBeam, look_ahead);
 	// for a segmental model that does not use segmental transition features, transition value
 	// would be the same for the segment states in succeeding nodes if those segments share the
 	// same start frame and share the same phone/word the transition is coming from and share
@@ -400,14 +506,9 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 	{
 		dur++; // this guarantees all the states being added share the same start frame
 
-		this->nextViterbiNodes_unPruned[i]->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt, wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, beam);
+		this->nextViterbiNodes_unPruned[i]->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt, wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, this->transBeam, look_ahead);
 	}
 
-	delete [] wts_nStates;
-	delete [] ptrs_nStates;
-	delete [] acou_wts_nStates;
-	delete [] lm_wts_nStates;
-
 	time_t time2 = time(NULL);
 	int_time += time2 - time1;
 
@@ -470,13 +571,13 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 
 	float cur_path_acou_wt = prev_path_acou_wt + trans_wt;
 
-	float* wts_nStates = new float[this->nStates];
-	int* ptrs_nStates = new int[this->nStates];
+	float* wts_nStates = this->scratchWts_nStates;
+	int* ptrs_nStates = this->scratchPtrs_nStates;
 	float min_wt = expand_wt;
 	bool isPhoneStartBoundary = true;
 
-	float* acou_wts_nStates = new float[this->nStates];
-	float* lm_wts_nStates = new float[this->nStates];
+	float* acou_wts_nStates = this->scratchAcouWts_nStates;
+	float* lm_wts_nStates = this->scratchLmWts_nStates;
 
 	wts_nStates[0] = expand_wt;
 	ptrs_nStates[0] = prevPhn_EndStateIdx_InPrunedVtbList;
@@ -502,8 +603,9 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 		throw runtime_error(errstr);
 	}
 
+	float look_ahead = (this->transBeam > 0.0) ? this->phnLookAhead[phn_id - 1] : 0.0;
 	this->curViterbiNode_unPruned->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt,
-			wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, beam);
+			wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, this->transBeam, look_ahead);
 	// for a segmental model that does not use segmental transition features, transition value
 	// would be the same for the segment states in succeeding nodes if those segments share the
 	// same start frame and share the same phone/word the transition is coming from and share
@@ -513,7 +615,7 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 		dur++; // this guarantees all the states being added share the same start frame
 
 		this->nextViterbiNodes_unPruned[i]->addNonEpsVtbState(state_id, phn_id, wrd_id, dur, min_wt,
-				wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, beam);
+				wts_nStates, ptrs_nStates, isPhoneStartBoundary, acou_wts_nStates, lm_wts_nStates, this->transBeam, look_ahead);
 	}
 
 
@@ -530,11 +632,6 @@ template <class CRF_VtbNode> float CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_V
 	}
 
 
-	delete [] wts_nStates;
-	delete [] ptrs_nStates;
-	delete [] acou_wts_nStates;
-	delete [] lm_wts_nStates;
-
 	//cout << "Expansion ended" << endl;
 	//cout << "Ending crossStateTransUpdate" << endl;
 	//cout << "Counter: " << counter << endl;
@@ -1011,6 +1108,38 @@ template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vt
 	this->curViterbiNode_unPruned->findMinWeight();
 	float min_weight = this->curViterbiNode_unPruned->min_weight;
 
+	// Histogram pruning: if the beam keeps more than maxHyps (or fewer than minHyps)
+	// hypotheses, the cutoff becomes the weight of the maxHyps-th (minHyps-th) best
+	// hypothesis, found by selection in linear time instead of re-scanning with an
+	// adjusted beam.  Hypotheses tied with the cutoff are all kept.
+	vector<float>& segWts = this->curViterbiNode_unPruned->bestSegWts;
+	uint num_active = segWts.size();
+	float threshold = min_weight + beam;
+	bool inclusive = false;
+	if (!prune) {
+		inclusive = true;
+		threshold = FLT_MAX;
+	}
+	if (this->maxHyps > 0 || this->minHyps > 0) {
+		uint num_in_beam = 0;
+		for (uint idx = 0; idx < num_active; idx++) {
+			if (segWts[idx] < threshold || (inclusive && segWts[idx] <= threshold)) { num_in_beam++; }
+		}
+		uint nth = 0;
+		if (this->maxHyps > 0 && num_in_beam > this->maxHyps) {
+			nth = this->maxHyps;
+		}
+		else if (this->minHyps > 0 && num_in_beam < this->minHyps && num_active > num_in_beam) {
+			nth = (this->minHyps < num_active) ? this->minHyps : num_active;
+		}
+		if (nth > 0) {
+			this->pruneScratch.assign(segWts.begin(), segWts.end());
+			nth_element(this->pruneScratch.begin(), this->pruneScratch.begin() + (nth - 1), this->pruneScratch.end());
+			threshold = this->pruneScratch[nth - 1];
+			inclusive = true;
+		}
+	}
+
 //	for (uint idx = 0; idx < this->curViterbiNode_unPruned->viterbiStateIds.size(); idx++)
 //	{
 //		// First, check to see if we want to keep this state at all
@@ -1054,7 +1183,7 @@ template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vt
 	for (uint idx = 0; idx < this->curViterbiNode_unPruned->bestSegWts.size(); idx++)
 	{
 		// First, check to see if we want to keep this state at all
-		if (this->curViterbiNode_unPruned->bestSegWts[idx] < min_weight + beam || !prune)
+		if (segWts[idx] < threshold || (inclusive && segWts[idx] <= threshold))
 		{
 			// We'll keep this for the next iteration
 
@@ -1100,6 +1229,17 @@ template <class CRF_VtbNode> void CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vt
 		}
 	}
 
+	CRF_FrameStats stats;
+	stats.nodeCnt = nodeCnt;
+	stats.numActive = num_active;
+	stats.numKept = num_active - num_pruned;
+	stats.beam = beam;
+	stats.minWeight = min_weight;
+	stats.threshold = threshold;
+	stats.numTransPruned = this->curViterbiNode_unPruned->trans_prunedCounter;
+	this->frameStats.push_back(stats);
+	this->nodeList->at(nodeCnt)->trackViterbiMem();
+
 	time_t time2 = time(NULL);
 	merge_time += time2 - time1;
 	//cout << "Final move ends" << endl;
@@ -1382,20 +1522,29 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 	this->fullFstStateId_to_timedLmState_vector.clear();
 
 	QNUInt32 ftr_count;
-	VectorFst<StdArc>* fst = new VectorFst<StdArc>();
+	VectorFst<StdArc>* fst = this->searchFst;
+	fst->DeleteStates();
 	StateId startState=fst->AddState();   // 1st state will be state 0 (returned by AddState)
 	fst->SetStart(startState);  // arg is state ID
 	bool prune = true;
 	if (input_beam<=0.0) { prune=false;}
+	this->minHyps = min_hyps;
+	this->maxHyps = max_hyps;
+	this->frameStats.clear();
 
 	// if input lm fst is null, we need to build a free phone lm fst
 	bool input_lm_fst_is_null = false;
 	if (lm_fst == NULL)
 	{
 		input_lm_fst_is_null = true;
-		lm_fst = new VectorFst<StdArc>();
-		//createFreePhoneLmFst(dynamic_cast<VectorFst<StdArc>*>(lm_fst));
-		createFreePhoneLmFst(lm_fst);
+		// the free phone lm fst only depends on the model, so it is built once and reused.
+		if (this->freePhoneLmFst == NULL)
+		{
+			this->freePhoneLmFst = new VectorFst<StdArc>();
+			//createFreePhoneLmFst(dynamic_cast<VectorFst<StdArc>*>(lm_fst));
+			createFreePhoneLmFst(this->freePhoneLmFst);
+		}
+		lm_fst = this->freePhoneLmFst;
 	}
 
 	// first we need to set up our hypothesis list
@@ -1499,6 +1648,10 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 	int seq_len = 0;
 	int nodeCnt = 0;
 	double beam = input_beam;
+	if (this->beamController != NULL) {
+		this->beamController->reset();
+		beam = this->beamController->getBeam();
+	}
 	int totalStates = 0;
 	double avgNumHypsPerFrame = 0.0;
 	num_pruned = 0;
@@ -1547,11 +1700,6 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 
 			QNUInt32 cur_ftr_buf_size = this->num_ftrs * ftr_count;
 
-			float* new_buf = new float[cur_ftr_buf_size];
-			for (QNUInt32 j = 0; j < cur_ftr_buf_size; j++) {
-				new_buf[j] = this->ftr_buf[j];
-				//cout << " " << new_buf[j];
-			}
 
 			QNUInt32 label = CRF_LAB_BAD;
 			//TODO: use this->labs_width>0 or this->lab_buf != NULL ?
@@ -1619,7 +1767,7 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 //			}
 //			else
 //			{
-				this->nodeList->set(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+				this->nodeList->setCopy(nodeCnt,this->ftr_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
 //			}
 
 			QNUInt32 numPrevNodes;
@@ -1632,17 +1780,7 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 				numPrevNodes = this->lab_max_dur;
 			}
 			assert(numPrevNodes + 1 == nodeMaxDur || numPrevNodes == nodeMaxDur);
-			CRF_StateNode** prevNodes = NULL;
-			if (numPrevNodes > 0)
-			{
-				prevNodes = new CRF_StateNode*[numPrevNodes];
-				for (QNUInt32 i = 0; i < numPrevNodes; i++)
-				{
-					QNUInt32 ni = nodeCnt - numPrevNodes + i;
-					prevNodes[i] = this->nodeList->at(ni);
-				}
-			}
-			this->nodeList->at(nodeCnt)->setPrevNodes(prevNodes, numPrevNodes);
+			this->nodeList->linkPrevNodes(nodeCnt, numPrevNodes);
 
 			float value = this->nodeList->at(nodeCnt)->computeTransMatrix();
 
@@ -1672,6 +1810,13 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 				}
 //			}
 
+			// the best state score of each phone at this node, used by CRF_ViterbiNode_PruneTrans
+			// to cut transition arcs before they are expanded.
+			if (this->transBeam > 0.0)
+			{
+				computePhoneLookAhead(nodeCnt);
+			}
+
 			seq_len++;
 
 			// Now we do our forward viterbi processing
@@ -1736,6 +1881,11 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 			// Pruning
 			pruning(nodeCnt, beam);
 
+			// Adaptive beam for the next frame
+			if (this->beamController != NULL) {
+				beam = this->beamController->update(this->frameStats.back().numKept);
+			}
+
 			// Printing
 
 			totalStates += this->curViterbiStateIds->size();
@@ -1758,7 +1908,8 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 				cout << " added: " << this->curViterbiNode_unPruned->addedCounter;
 				cout << " updated: " << this->curViterbiNode_unPruned->updateCounter << endl;
 				cout << "       checkUpdate: " << this->curViterbiNode_unPruned->updateCheckCounter;
-				cout << " epsilons: " << epsilonCounter << endl;
+				cout << " epsilons: " << epsilonCounter;
+				cout << " trans pruned: " << this->curViterbiNode_unPruned->trans_prunedCounter << endl;
 				cout << "      Average hyps per timestep: " << avgNumHypsPerFrame;
 				cout << "      Current pruning beam: " << beam << endl;
 				cout << " epsAdded: " << epsAdded << "  epsModified: " << epsModified << endl;
@@ -1884,8 +2035,6 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 				this->curViterbiNode_unPruned->clear();
 			}
 
-			if (prevNodes != NULL)
-				delete [] prevNodes;
 			nodeCnt++;
 		}
 
@@ -1905,6 +2054,10 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 	cout << " Cross update time: " << cross_time;
 	cout << " Merge time: " << merge_time << endl;
 	cout << " Total loop time: " << (loopend - loopstart) << endl;
+	if (this->beamController != NULL) {
+		cout << "Adaptive beam: final beam " << beam << ", real-time factor "
+				<< this->beamController->getRtFactor() << endl;
+	}
 	this->nodeList->setNodeCount(nodeCnt);
 
 	// output weights associated with N-best paths
@@ -2383,11 +2536,7 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 	this->prev_min_weight = 99999.0;
 
 
-	delete fst;
-
-	// delete the free phone lm fst if created
-	if (input_lm_fst_is_null)
-		delete lm_fst;
+	// fst (searchFst) and the free phone lm fst are kept for the next utterance.
 
 //	delete this->fullfst_timedState_id_map;
 	this->timedLmState_to_fullFstStateId_map.clear();
@@ -2400,4 +2549,4 @@ template <class CRF_VtbNode> int CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_Vtb
 // These statements are very important. They explicitly instantiate all the relevant templates.
 // Without these lines, all the template functions have to be moved to the header file.
 template class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>;
-//template class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode_PruneTrans>;
+template class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode_PruneTrans>;
@@ -13,6 +13,8 @@
 #include "../CRF_Model.h"
 #include "../io/CRF_FeatureStream.h"
 #include "../nodes/CRF_StateVector.h"
+#include "CRF_DecodeContext.h"
+#include "CRF_BeamController.h"
 #include "CRF_ViterbiDecoder.h"  // for the definition of class CRF_ViterbiState
 #include <vector>
 #include <map>
@@ -31,6 +33,19 @@ const int BEFORE_START_TIME_STAMP = -1;  // the starting point before the first
 
 template <class CRF_VtbNode> class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr;  // forward declaration
 
+/*
+ * Pruning statistics of one frame, recorded by CRF_ViterbiDecoder_StdSeg_NoSegTransFtr::pruning()
+ */
+struct CRF_FrameStats {
+	uint nodeCnt;		// frame index
+	uint numActive;		// hypotheses before pruning
+	uint numKept;		// hypotheses kept after pruning
+	float beam;			// beam used at the frame
+	float minWeight;	// weight of the best hypothesis
+	float threshold;	// weight cutoff actually applied (beam or histogram)
+	uint numTransPruned;	// transition arcs cut by the transition beam before expansion
+};
+
 class CRF_TimedState {
 public:
 	int time_stamp;  // time stamp of the utterance. -1 means starting point before the first frame.
@@ -139,6 +154,7 @@ protected:
 	uint trans_addedCounter;
 	uint trans_updateCheckCounter;
 	uint trans_updateCounter;
+	uint trans_prunedCounter;	// always 0, transition arcs are only pruned by CRF_ViterbiNode_PruneTrans
 	uint addedCounter;
 	uint updateCheckCounter;
 	uint updateCounter;
@@ -155,13 +171,14 @@ public:
 		trans_addedCounter = 0;
 		trans_updateCheckCounter = 0;
 		trans_updateCounter = 0;
+		trans_prunedCounter = 0;
 		addedCounter = 0;
 		updateCheckCounter = 0;
 		updateCounter = 0;
 	}
 	virtual ~CRF_ViterbiNode(){}
 
-	void clear(){
+	virtual void clear(){
 		viterbiStateIds.clear();
 		viterbiPhnIds.clear();
 		viterbiWrdIds.clear();
@@ -185,14 +202,18 @@ public:
 		trans_addedCounter = 0;
 		trans_updateCheckCounter = 0;
 		trans_updateCounter = 0;
+		trans_prunedCounter = 0;
 		addedCounter = 0;
 		updateCheckCounter = 0;
 		updateCounter = 0;
 	}
 
-	void addNonEpsVtbState(uint stateId, uint phnId, uint wrdId, uint dur,
+	// beam and look_ahead are only used by CRF_ViterbiNode_PruneTrans, which prunes the arc
+	// before adding it here.
+	virtual void addNonEpsVtbState(uint stateId, uint phnId, uint wrdId, uint dur,
 			float min_wt, float* wts_nStates, int* ptrs_nStates, bool isStartBound,
-			float* acou_wts_nStates, float* lm_wts_nStates, double beam=0.0)
+			float* acou_wts_nStates, float* lm_wts_nStates, double beam=0.0,
+			float look_ahead=0.0)
 	{
 
 		// for debugging
@@ -478,10 +499,30 @@ public:
 	}
 };
 
-template <class CRF_VtbNode> class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr
+/*
+ * class CRF_StdSegViterbiDecoder
+ *
+ * Interface of CRF_ViterbiDecoder_StdSeg_NoSegTransFtr that does not depend on the node
+ * class, so that callers can hold the decoder through one pointer whichever node class
+ * (CRF_ViterbiNode or CRF_ViterbiNode_PruneTrans) was chosen at run time.
+ */
+class CRF_StdSegViterbiDecoder
+{
+public:
+	virtual ~CRF_StdSegViterbiDecoder() {}
+	virtual void setIfOutputFullFst(bool ifFull)=0;
+	virtual int nStateDecode(VectorFst<StdArc>* fst, VectorFst<StdArc>* lm_fst, VectorFst<StdArc>* out_full_fst, double beam=0.0, uint min_hyps=0, uint max_hyps=0, float beam_inc=0.05)=0;
+	virtual CRF_StateVector* getNodeList()=0;
+	virtual void setBeamController(CRF_BeamController* controller)=0;
+	virtual const vector<CRF_FrameStats>& getFrameStats()=0;
+	virtual void setTransBeam(double trans_beam)=0;
+};
+
+template <class CRF_VtbNode> class CRF_ViterbiDecoder_StdSeg_NoSegTransFtr : public CRF_StdSegViterbiDecoder
 {
 protected:
 	CRF_StateVector* nodeList;
+	bool ownsNodeList;
 	CRF_Model* crf;
 	CRF_FeatureStream* ftr_strm;
 	float* ftr_buf;
@@ -553,8 +594,36 @@ protected:
 	// the set of final FST states that are reached at the end of the utterance
 	set<CRF_ViterbiState> finalStateSet;
 
+	// Per-utterance buffers kept across calls to nStateDecode() so that a decoder reused
+	// for many utterances does not allocate them again.
+	// scratch weights and pointers for the nStates internal states of one phone,
+	// used by internalStateTransUpdate() and crossStateTransUpdate().
+	float* scratchWts_nStates;
+	int* scratchPtrs_nStates;
+	float* scratchAcouWts_nStates;
+	float* scratchLmWts_nStates;
+	// the acoustic fst built during the search, emptied at the start of each utterance.
+	VectorFst<StdArc>* searchFst;
+	// the free phone lm fst, built the first time nStateDecode() is called without lm fst.
+	VectorFst<StdArc>* freePhoneLmFst;
+
+	// histogram pruning limits of the current nStateDecode() call, 0 for no limit.
+	uint minHyps;
+	uint maxHyps;
+	// copy of the hypothesis weights used to select the histogram cutoff.
+	vector<float> pruneScratch;
+	// optional adaptive beam, not owned by the decoder.
+	CRF_BeamController* beamController;
+	// per-frame pruning statistics of the last utterance.
+	vector<CRF_FrameStats> frameStats;
+	// transition beam applied by the node class when arcs are added, 0 for none.
+	// Only CRF_ViterbiNode_PruneTrans uses it.
+	double transBeam;
+	// per phone, the best state score the phone can reach at the current frame, as a weight.
+	vector<float> phnLookAhead;
+
 public:
-	CRF_ViterbiDecoder_StdSeg_NoSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in);
+	CRF_ViterbiDecoder_StdSeg_NoSegTransFtr(CRF_FeatureStream* ftr_strm_in, CRF_Model* crf_in, CRF_DecodeContext* ctx=NULL);
 	virtual ~CRF_ViterbiDecoder_StdSeg_NoSegTransFtr();
 	virtual void setIfOutputFullFst(bool ifFull);
 	virtual void stateValueUpdate(uint nodeCnt);
@@ -570,6 +639,10 @@ public:
 	virtual int nStateDecode(VectorFst<StdArc>* fst, VectorFst<StdArc>* lm_fst, VectorFst<StdArc>* out_full_fst, double beam=0.0, uint min_hyps=0, uint max_hyps=0, float beam_inc=0.05);
 
 	virtual CRF_StateVector* getNodeList();
+	virtual void setBeamController(CRF_BeamController* controller);
+	virtual const vector<CRF_FrameStats>& getFrameStats();
+	virtual void setTransBeam(double trans_beam);
+	virtual void computePhoneLookAhead(uint nodeCnt);
 	virtual void createFreePhoneLmFst(VectorFst<StdArc>* new_lm_fst);
 	virtual StateId getOutputFullFstStateIdByTimedLmStateId(int nodeCnt, int lm_stateId);
 	virtual StateId findOrInsertLmStateToOutputFullFst(int nodeCnt, int lm_stateId);
@@ -8,6 +8,7 @@
 #include "CRF_FeatureMap.h"
 #include "CRF_StdFeatureMap.h"
 #include "CRF_StdSparseFeatureMap.h"
+#include <vector>
 
 /*
  * CRF_FeatureMap constructor
@@ -151,6 +152,87 @@ double CRF_FeatureMap::computeTransExpF(float* ftr_buf, double* lambda, double*
 	return 0.0;
 }
 
+/*
+ * CRF_FeatureMap::gatherFtrView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        &buf - vector to fill
+ *
+ * Copies the frame into buf as one contiguous vector.  Used by the default implementations
+ * of the CRF_FtrView functions below, so that a subclass only needs to implement the
+ * versions that take a feature buffer.
+ */
+void CRF_FeatureMap::gatherFtrView(const CRF_FtrView* fv, vector<float>& buf)
+{
+	QNUInt32 size=0;
+	for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+		size+=fv->width[k];
+	}
+	buf.resize(size);
+	fv->gather(&(buf[0]));
+}
+
+/*
+ * CRF_FeatureMap::computeStateArrayValueView
+ *
+ * Input: *fv - frame of a joined feature stream, see CRF_JoinedFeatureStream
+ *        *lambda, clab - see above
+ *
+ * As computeStateArrayValue above, on the features seen through fv.  This default version
+ * copies the frame into a contiguous buffer; subclasses index the blocks directly.
+ */
+double CRF_FeatureMap::computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab)
+{
+	vector<float> buf;
+	this->gatherFtrView(fv,buf);
+	return this->computeStateArrayValue(&(buf[0]),lambda,clab);
+}
+
+/*
+ * CRF_FeatureMap::computeTransMatrixValueView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        *lambda, plab, clab - see above
+ *
+ * As computeTransMatrixValue above, on the features seen through fv.
+ */
+double CRF_FeatureMap::computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab)
+{
+	vector<float> buf;
+	this->gatherFtrView(fv,buf);
+	return this->computeTransMatrixValue(&(buf[0]),lambda,plab,clab);
+}
+
+/*
+ * CRF_FeatureMap::computeStateExpFView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        other parameters - see above
+ *
+ * As computeStateExpF above, on the features seen through fv.
+ */
+double CRF_FeatureMap::computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad)
+{
+	vector<float> buf;
+	this->gatherFtrView(fv,buf);
+	return this->computeStateExpF(&(buf[0]),lambda,ExpF,grad,alpha_beta,t_clab,clab,compute_grad);
+}
+
+/*
+ * CRF_FeatureMap::computeTransExpFView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        other parameters - see above
+ *
+ * As computeTransExpF above, on the features seen through fv.
+ */
+double CRF_FeatureMap::computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad)
+{
+	vector<float> buf;
+	this->gatherFtrView(fv,buf);
+	return this->computeTransExpF(&(buf[0]),lambda,ExpF,grad,alpha_beta,t_plab,t_clab,plab,clab,compute_grad);
+}
+
 /*
  * CRF_FeatureMap::getNumStateFuncs
  *
@@ -302,6 +384,15 @@ void CRF_FeatureMap::accumulateFeatures(float *ftr_buf,double *accumulator,QNUIn
 	return;
 }
 
+/*
+ * CRF_FeatureMap::getConfig
+ *
+ * Returns: the configuration struct used to build this feature map
+ */
+CRF_FeatureMap_config* CRF_FeatureMap::getConfig() {
+	return this->config;
+}
+
 /*
  * Added by Ryan
  *
@@ -329,3 +420,82 @@ void CRF_FeatureMap::tieGradForSingleParam(double* grad, QNUInt32 numParam, QNUI
 {
 	return;
 }
+
+/*
+ * CRF_FeatureMap::supportsSegKernel
+ *
+ * Returns: true if the segmental nodes may score with a CRF_SegNodeKernel built from this
+ *   map, false if they must call the map's value functions (the default)
+ *
+ * The kernel reads the dense feature buffer and lambda directly, using the index caches of
+ * CRF_StdFeatureMap, so only maps that score exactly that way can return true.
+ */
+bool CRF_FeatureMap::supportsSegKernel()
+{
+	return false;
+}
+
+/*
+ * CRF_FeatureMap::setSparseWeights
+ *
+ * Input: *lambda - lambda vector from the CRF, fixed from now on
+ *
+ * Returns: true if the map skips the zero weights of lambda when computing state and
+ *   transition values, false if it does not support it (the default)
+ *
+ * Meant for decoding with a model trained with an L1 penalty.  The zero weights are found
+ * once, so lambda must not change while the sparse weights are set.
+ */
+bool CRF_FeatureMap::setSparseWeights(double* lambda)
+{
+	return false;
+}
+
+/*
+ * CRF_FeatureMap::clearSparseWeights
+ *
+ * Goes back to computing the values over all the weights.
+ */
+void CRF_FeatureMap::clearSparseWeights()
+{
+}
+
+/*
+ * CRF_FeatureMap::quantizeWeights
+ *
+ * Input: *lambda - lambda vector from the CRF
+ *        bits - 8 or 16, size of a quantized weight
+ *
+ * Returns: the feature weights of lambda quantized in the blocks the map scores with (see
+ *   setQuantizedWeights), NULL if the map does not support quantized weights (the default).
+ *   The caller owns the result.
+ */
+CRF_QuantizedWeights* CRF_FeatureMap::quantizeWeights(double* lambda, int bits)
+{
+	return NULL;
+}
+
+/*
+ * CRF_FeatureMap::setQuantizedWeights
+ *
+ * Input: *qw - quantized weights, from quantizeWeights() or read from a file; the caller
+ *   keeps them alive while they are set
+ *
+ * Returns: true if the map now computes the state and transition values with the quantized
+ *   weights, false if it does not support them (the default) or qw does not match the map
+ *
+ * Meant for decoding only; the training functions (computeStateExpF, ...) always use lambda.
+ */
+bool CRF_FeatureMap::setQuantizedWeights(CRF_QuantizedWeights* qw)
+{
+	return false;
+}
+
+/*
+ * CRF_FeatureMap::clearQuantizedWeights
+ *
+ * Goes back to computing the values with the double weights.
+ */
+void CRF_FeatureMap::clearQuantizedWeights()
+{
+}
@@ -10,6 +10,8 @@
  */
 
 #include "../CRF.h"
+#include "CRF_QuantizedWeights.h"
+#include <vector>
 
 #ifndef QN_UINT32_MAX
 #define QN_UINT32_MAX (0xffffffff)
@@ -67,6 +69,8 @@ protected:
 	//Added by Ryan
 	virtual void tieGradForSingleParam(double* grad, QNUInt32 numParam, QNUInt32 start, QNUInt32 step);
 
+	void gatherFtrView(const CRF_FtrView* fv, vector<float>& buf);
+
 public:
 	CRF_FeatureMap(QNUInt32 nlabs, QNUInt32 nfeas);
 	CRF_FeatureMap(CRF_FeatureMap_config* cnf);
@@ -77,6 +81,10 @@ public:
 	virtual double computeTransMatrixValue(float* ftr_buf, double* lambda, QNUInt32 plab, QNUInt32 clab);
 	virtual double computeStateExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
 	virtual double computeTransExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab);
+	virtual double computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab);
+	virtual double computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
 	virtual QNUInt32 getNumFtrFuncs();
 	virtual QNUInt32 getNumStates();
 	virtual QNUInt32 getNumStateFuncs(QNUInt32 clab);
@@ -89,6 +97,13 @@ public:
 	virtual QNUInt32 recalc();
 	virtual string getMapDescriptor(QNUInt32 lambdaNum);
 	virtual void accumulateFeatures(float *ftr_buf, double *accumulator, QNUInt32 lab);
+	virtual CRF_FeatureMap_config* getConfig();
+	virtual bool supportsSegKernel();
+	virtual bool setSparseWeights(double* lambda);
+	virtual void clearSparseWeights();
+	virtual CRF_QuantizedWeights* quantizeWeights(double* lambda, int bits);
+	virtual bool setQuantizedWeights(CRF_QuantizedWeights* qw);
+	virtual void clearQuantizedWeights();
 
 	//Added by Ryan
 	//virtual void tieGradient(double* grad, QNUInt32 maxDur, QNUInt32 durFtrStart);
@@ -0,0 +1,439 @@
+/*
+ * CRF_QuantizedWeights.cpp
+ *
+ */
+
+#include "CRF_QuantizedWeights.h"
+
+// The AVX2/FMA kernels are built with a target attribute and picked at run time, so a build
+// without -mavx2 still uses them on CPUs that have AVX2 and FMA.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRF_QUANT_AVX2 1
+#include <immintrin.h>
+#define CRF_QUANT_TARGET __attribute__((target("avx2,fma")))
+
+/*
+ * Returns: true if the CPU supports AVX2 and FMA
+ */
+static bool crf_quant_cpu_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+static const bool crf_quant_use_avx2 = crf_quant_cpu_avx2();
+
+/*
+ * Returns: the sum of the 8 lanes of a
+ */
+CRF_QUANT_TARGET static inline double hsum256(__m256 a)
+{
+	float part[8];
+	_mm256_storeu_ps(part,a);
+	return ((double)part[0]+part[1]+part[2]+part[3])+((double)part[4]+part[5]+part[6]+part[7]);
+}
+
+/*
+ * Returns: the dot product of the first n - n % 16 elements of x and w; the weights are
+ *   widened to floats 16 at a time and multiplied with the features in two accumulators
+ */
+CRF_QUANT_TARGET static double dot8_avx2(const float* x, const int8_t* w, QNUInt32 n)
+{
+	__m256 acc0=_mm256_setzero_ps();
+	__m256 acc1=_mm256_setzero_ps();
+	for (QNUInt32 i=0; i+16<=n; i+=16) {
+		__m128i wq=_mm_loadu_si128((const __m128i*)(w+i));
+		__m256 w0=_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(wq));
+		__m256 w1=_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(wq,8)));
+		acc0=_mm256_fmadd_ps(_mm256_loadu_ps(x+i),w0,acc0);
+		acc1=_mm256_fmadd_ps(_mm256_loadu_ps(x+i+8),w1,acc1);
+	}
+	return hsum256(_mm256_add_ps(acc0,acc1));
+}
+
+/*
+ * Returns: as dot8_avx2, for 16 bit weights
+ */
+CRF_QUANT_TARGET static double dot16_avx2(const float* x, const int16_t* w, QNUInt32 n)
+{
+	__m256 acc0=_mm256_setzero_ps();
+	__m256 acc1=_mm256_setzero_ps();
+	for (QNUInt32 i=0; i+16<=n; i+=16) {
+		__m256 w0=_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(w+i))));
+		__m256 w1=_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(w+i+8))));
+		acc0=_mm256_fmadd_ps(_mm256_loadu_ps(x+i),w0,acc0);
+		acc1=_mm256_fmadd_ps(_mm256_loadu_ps(x+i+8),w1,acc1);
+	}
+	return hsum256(_mm256_add_ps(acc0,acc1));
+}
+#endif
+
+/*
+ * CRF_QuantizedWeights constructor
+ *
+ * Input: bits_in - 8 or 16, size of a quantized weight
+ *        lambda_len - length of the lambda vector the blocks come from
+ */
+CRF_QuantizedWeights::CRF_QuantizedWeights(int bits_in, QNUInt32 lambda_len)
+	: bits(bits_in),
+	  lambdaLen(lambda_len)
+{
+	if (bits_in != 8 && bits_in != 16) {
+		char errstr[1024];
+		sprintf(errstr, "CRF_QuantizedWeights constructor caught exception: %d bit weights are not supported, use 8 or 16.",
+				bits_in);
+		throw runtime_error(errstr);
+	}
+}
+
+/*
+ * CRF_QuantizedWeights destructor
+ */
+CRF_QuantizedWeights::~CRF_QuantizedWeights()
+{
+}
+
+/*
+ * CRF_QuantizedWeights::addBlock
+ *
+ * Input: *lambda - lambda vector from the CRF
+ *        start - index in lambda of the first weight of the block
+ *        len - number of weights in the block
+ *
+ * Returns: the number of the new block
+ */
+QNUInt32 CRF_QuantizedWeights::addBlock(const double* lambda, QNUInt32 start, QNUInt32 len)
+{
+	double qmax=(this->bits == 8)?127.0:32767.0;
+	double maxabs=0.0;
+	for (QNUInt32 i=0; i<len; i++) {
+		double a=fabs(lambda[start+i]);
+		if (a > maxabs) maxabs=a;
+	}
+	float scale=(maxabs > 0.0)?(float)(maxabs/qmax):0.0f;
+	this->blockStart.push_back(start);
+	this->blockLen.push_back(len);
+	this->blockScale.push_back(scale);
+	if (this->bits == 8) {
+		this->blockOffset.push_back(this->weights8.size());
+	}
+	else {
+		this->blockOffset.push_back(this->weights16.size());
+	}
+	for (QNUInt32 i=0; i<len; i++) {
+		double q=(scale > 0.0f)?floor(lambda[start+i]/scale+0.5):0.0;
+		if (q > qmax) q=qmax;
+		if (q < -qmax) q=-qmax;
+		if (this->bits == 8) {
+			this->weights8.push_back((int8_t)q);
+		}
+		else {
+			this->weights16.push_back((int16_t)q);
+		}
+	}
+	return this->blockStart.size()-1;
+}
+
+/*
+ * CRF_QuantizedWeights::dequantize
+ *
+ * Input: *lambda - lambda vector to overwrite
+ *
+ * Sets the weights of every block in lambda to their quantized values; the other weights are
+ * not changed.
+ */
+void CRF_QuantizedWeights::dequantize(double* lambda)
+{
+	for (QNUInt32 b=0; b<this->blockStart.size(); b++) {
+		QNUInt32 pos=this->blockOffset[b];
+		double scale=this->blockScale[b];
+		for (QNUInt32 i=0; i<this->blockLen[b]; i++) {
+			double q=(this->bits == 8)?this->weights8[pos+i]:this->weights16[pos+i];
+			lambda[this->blockStart[b]+i]=q*scale;
+		}
+	}
+}
+
+/*
+ * CRF_QuantizedWeights::getMaxError
+ *
+ * Input: *lambda - the lambda vector the blocks were quantized from
+ *
+ * Returns: the largest difference between a weight and its quantized value
+ */
+double CRF_QuantizedWeights::getMaxError(const double* lambda)
+{
+	double maxerr=0.0;
+	for (QNUInt32 b=0; b<this->blockStart.size(); b++) {
+		QNUInt32 pos=this->blockOffset[b];
+		double scale=this->blockScale[b];
+		for (QNUInt32 i=0; i<this->blockLen[b]; i++) {
+			double q=(this->bits == 8)?this->weights8[pos+i]:this->weights16[pos+i];
+			double err=fabs(lambda[this->blockStart[b]+i]-q*scale);
+			if (err > maxerr) maxerr=err;
+		}
+	}
+	return maxerr;
+}
+
+/*
+ * CRF_QuantizedWeights::writeToFile
+ *
+ * Input: fname - file to write
+ *        *lambda - the lambda vector the blocks were quantized from
+ *
+ * Returns: true if the file was written
+ *
+ * The file starts with the text line "#quant <bits> <lambda length> <blocks>", followed (in
+ * the byte order of the machine) by the start, length and scale of every block, the
+ * quantized weights of all the blocks, and the weights of lambda that are in no block, as
+ * doubles in index order.
+ */
+bool CRF_QuantizedWeights::writeToFile(const char* fname, const double* lambda)
+{
+	std::ofstream ofile;
+	ofile.open(fname, std::ios::out | std::ios::binary);
+	if (!ofile.is_open()) {
+		string errstr="CRF_QuantizedWeights::writeToFile() caught exception: cannot open the file:\n";
+		errstr += string(fname) + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+	}
+	QNUInt32 nblocks=this->blockStart.size();
+	ofile << "#quant " << this->bits << " " << this->lambdaLen << " " << nblocks << std::endl;
+	vector<bool> inBlock(this->lambdaLen,false);
+	for (QNUInt32 b=0; b<nblocks; b++) {
+		ofile.write((const char*)&(this->blockStart[b]),sizeof(QNUInt32));
+		ofile.write((const char*)&(this->blockLen[b]),sizeof(QNUInt32));
+		ofile.write((const char*)&(this->blockScale[b]),sizeof(float));
+		for (QNUInt32 i=0; i<this->blockLen[b]; i++) {
+			inBlock[this->blockStart[b]+i]=true;
+		}
+	}
+	if (this->bits == 8 && this->weights8.size() > 0) {
+		ofile.write((const char*)&(this->weights8[0]),this->weights8.size()*sizeof(int8_t));
+	}
+	if (this->bits == 16 && this->weights16.size() > 0) {
+		ofile.write((const char*)&(this->weights16[0]),this->weights16.size()*sizeof(int16_t));
+	}
+	for (QNUInt32 i=0; i<this->lambdaLen; i++) {
+		if (!inBlock[i]) {
+			ofile.write((const char*)&(lambda[i]),sizeof(double));
+		}
+	}
+	if (ofile.bad() || ofile.fail()) {
+		string errstr="CRF_QuantizedWeights::writeToFile() caught exception: errors when writing the weights to the file:\n";
+		errstr += string(fname) + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+	}
+	ofile.close();
+	return true;
+}
+
+/*
+ * CRF_QuantizedWeights::readFromFile
+ *
+ * Input: ifile - stream positioned after the first line of a weight file
+ *        header - the first line of the file
+ *        *lambda - vector of lambda_len weights to fill
+ *        lambda_len - length of the lambda vector of the model
+ *        fname - name of the file, for the error messages
+ *
+ * Returns: the blocks read, NULL if the file is not a quantized file (see writeToFile)
+ *
+ * Fills lambda with the dequantized weights of the blocks and the other weights.
+ */
+CRF_QuantizedWeights* CRF_QuantizedWeights::readFromFile(std::istream& ifile, const string& header,
+		double* lambda, QNUInt32 lambda_len, const char* fname)
+{
+	if (header.compare(0,6,"#quant") != 0) {
+		return NULL;
+	}
+	int bits=0;
+	QNUInt32 len=0, nblocks=0;
+	std::istringstream hss(header.substr(6));
+	hss >> bits >> len >> nblocks;
+	if (hss.fail() || len != lambda_len) {
+		string errstr="CRF_QuantizedWeights::readFromFile() caught exception: the quantized weight file ";
+		errstr += string(fname) + " does not match the number of weights of the model.";
+		throw runtime_error(errstr);
+	}
+	CRF_QuantizedWeights* qw=new CRF_QuantizedWeights(bits,len);
+	QNUInt32 total=0;
+	for (QNUInt32 b=0; b<nblocks; b++) {
+		QNUInt32 start, blen;
+		float scale;
+		ifile.read((char*)&start,sizeof(QNUInt32));
+		ifile.read((char*)&blen,sizeof(QNUInt32));
+		ifile.read((char*)&scale,sizeof(float));
+		if (ifile.fail() || start > len || blen > len-start) {
+			delete qw;
+			string errstr="CRF_QuantizedWeights::readFromFile() caught exception: bad block in the quantized weight file ";
+			errstr += string(fname);
+			throw runtime_error(errstr);
+		}
+		qw->blockStart.push_back(start);
+		qw->blockLen.push_back(blen);
+		qw->blockScale.push_back(scale);
+		qw->blockOffset.push_back(total);
+		total+=blen;
+	}
+	if (bits == 8) {
+		qw->weights8.resize(total);
+		if (total > 0) ifile.read((char*)&(qw->weights8[0]),total*sizeof(int8_t));
+	}
+	else {
+		qw->weights16.resize(total);
+		if (total > 0) ifile.read((char*)&(qw->weights16[0]),total*sizeof(int16_t));
+	}
+	vector<bool> inBlock(len,false);
+	for (QNUInt32 b=0; b<nblocks; b++) {
+		for (QNUInt32 i=0; i<qw->blockLen[b]; i++) {
+			inBlock[qw->blockStart[b]+i]=true;
+		}
+	}
+	for (QNUInt32 i=0; i<len; i++) {
+		if (!inBlock[i]) {
+			ifile.read((char*)&(lambda[i]),sizeof(double));
+		}
+	}
+	if (ifile.fail()) {
+		delete qw;
+		string errstr="CRF_QuantizedWeights::readFromFile() caught exception: the quantized weight file ";
+		errstr += string(fname) + " is truncated.";
+		throw runtime_error(errstr);
+	}
+	qw->dequantize(lambda);
+	return qw;
+}
+
+/*
+ * CRF_QuantizedWeights::getBits
+ *
+ * Returns: size of a quantized weight, 8 or 16
+ */
+int CRF_QuantizedWeights::getBits()
+{
+	return this->bits;
+}
+
+/*
+ * CRF_QuantizedWeights::getNumBlocks
+ *
+ * Returns: number of blocks
+ */
+QNUInt32 CRF_QuantizedWeights::getNumBlocks()
+{
+	return this->blockStart.size();
+}
+
+/*
+ * CRF_QuantizedWeights::getBlockStart
+ *
+ * Returns: index in lambda of the first weight of block b
+ */
+QNUInt32 CRF_QuantizedWeights::getBlockStart(QNUInt32 b)
+{
+	return this->blockStart[b];
+}
+
+/*
+ * CRF_QuantizedWeights::getBlockLen
+ *
+ * Returns: number of weights in block b
+ */
+QNUInt32 CRF_QuantizedWeights::getBlockLen(QNUInt32 b)
+{
+	return this->blockLen[b];
+}
+
+/*
+ * CRF_QuantizedWeights::getBytes
+ *
+ * Returns: bytes of the model in the quantized format: the quantized weights and block
+ *   scales, plus the weights in no block as doubles
+ */
+size_t CRF_QuantizedWeights::getBytes()
+{
+	size_t quantized=(this->bits == 8)?this->weights8.size():this->weights16.size();
+	vector<bool> inBlock(this->lambdaLen,false);
+	for (QNUInt32 b=0; b<this->blockStart.size(); b++) {
+		for (QNUInt32 i=0; i<this->blockLen[b]; i++) {
+			inBlock[this->blockStart[b]+i]=true;
+		}
+	}
+	size_t rest=0;
+	for (QNUInt32 i=0; i<this->lambdaLen; i++) {
+		if (!inBlock[i]) rest++;
+	}
+	return quantized*(this->bits/8)+this->blockStart.size()*(2*sizeof(QNUInt32)+sizeof(float))
+			+rest*sizeof(double);
+}
+
+/*
+ * CRF_QuantizedWeights::dot8
+ *
+ * Input: x - features
+ *        w - 8 bit weights
+ *        n - number of features
+ *
+ * Returns: the unscaled dot product of x and w
+ *
+ * Uses the AVX2 kernel for the multiples of 16 if the CPU supports it (see getKernel).
+ */
+double CRF_QuantizedWeights::dot8(const float* x, const int8_t* w, QNUInt32 n)
+{
+	double value=0.0;
+	QNUInt32 i=0;
+#ifdef CRF_QUANT_AVX2
+	if (crf_quant_use_avx2) {
+		i=n-n%16;
+		value=dot8_avx2(x,w,i);
+	}
+#endif
+	for (; i<n; i++) {
+		value+=x[i]*w[i];
+	}
+	return value;
+}
+
+/*
+ * CRF_QuantizedWeights::dot16
+ *
+ * Input: x - features
+ *        w - 16 bit weights
+ *        n - number of features
+ *
+ * Returns: the unscaled dot product of x and w
+ */
+double CRF_QuantizedWeights::dot16(const float* x, const int16_t* w, QNUInt32 n)
+{
+	double value=0.0;
+	QNUInt32 i=0;
+#ifdef CRF_QUANT_AVX2
+	if (crf_quant_use_avx2) {
+		i=n-n%16;
+		value=dot16_avx2(x,w,i);
+	}
+#endif
+	for (; i<n; i++) {
+		value+=x[i]*w[i];
+	}
+	return value;
+}
+
+/*
+ * CRF_QuantizedWeights::getKernel
+ *
+ * Returns: the name of the dot product kernel used on this CPU, "avx2" or "scalar"
+ */
+const char* CRF_QuantizedWeights::getKernel()
+{
+#ifdef CRF_QUANT_AVX2
+	if (crf_quant_use_avx2) {
+		return "avx2";
+	}
+#endif
+	return "scalar";
+}
@@ -0,0 +1,76 @@
+#ifndef CRF_QUANTIZEDWEIGHTS_H_
+#define CRF_QUANTIZEDWEIGHTS_H_
+/*
+ * CRF_QuantizedWeights.h
+ *
+ * Contains the class definition for CRF_QuantizedWeights
+ */
+
+#include "../CRF.h"
+#include <vector>
+#include <stdint.h>
+
+/*
+ * class CRF_QuantizedWeights
+ *
+ * Decode-time copy of blocks of the lambda vector, stored as 8 or 16 bit integers with one
+ * scale per block.  A feature map adds one block per label (and per label pair) holding the
+ * weights of its feature functions, and scores a frame with dot() instead of reading the
+ * double weights.  The features stay floats: the integer weights are widened in the dot
+ * product, so the saving is in the memory read per frame (1/8 or 1/4 of the double weights).
+ *
+ * Each block is quantized symmetrically, with scale = max |weight| / 127 (or 32767), so the
+ * largest weight of the block is exact and the others are off by at most half a scale.
+ *
+ * The weights not in any block (the biases) are kept as doubles when written to a file, so
+ * a model read back from a quantized file has all its weights (see CRF_Model::readFromFile).
+ */
+class CRF_QuantizedWeights
+{
+protected:
+	int bits;
+	QNUInt32 lambdaLen;
+	vector<QNUInt32> blockStart;
+	vector<QNUInt32> blockLen;
+	vector<QNUInt32> blockOffset;
+	vector<float> blockScale;
+	vector<int8_t> weights8;
+	vector<int16_t> weights16;
+	static double dot8(const float* x, const int8_t* w, QNUInt32 n);
+	static double dot16(const float* x, const int16_t* w, QNUInt32 n);
+public:
+	CRF_QuantizedWeights(int bits_in, QNUInt32 lambda_len);
+	virtual ~CRF_QuantizedWeights();
+	virtual QNUInt32 addBlock(const double* lambda, QNUInt32 start, QNUInt32 len);
+	virtual void dequantize(double* lambda);
+	virtual bool writeToFile(const char* fname, const double* lambda);
+	static CRF_QuantizedWeights* readFromFile(std::istream& ifile, const string& header, double* lambda,
+			QNUInt32 lambda_len, const char* fname);
+	virtual int getBits();
+	virtual QNUInt32 getNumBlocks();
+	virtual QNUInt32 getBlockStart(QNUInt32 b);
+	virtual QNUInt32 getBlockLen(QNUInt32 b);
+	virtual size_t getBytes();
+	virtual double getMaxError(const double* lambda);
+	static const char* getKernel();
+
+	/*
+	 * CRF_QuantizedWeights::dot
+	 *
+	 * Input: b - block
+	 *        first - first weight of the block to use
+	 *        x - features, n of them
+	 *
+	 * Returns: the sum of x[i] times weight first+i of block b, for i < n
+	 */
+	inline double dot(QNUInt32 b, QNUInt32 first, const float* x, QNUInt32 n) {
+		if (n == 0) return 0.0;
+		QNUInt32 pos=this->blockOffset[b]+first;
+		if (this->bits == 8) {
+			return this->blockScale[b]*dot8(x,&(this->weights8[pos]),n);
+		}
+		return this->blockScale[b]*dot16(x,&(this->weights16[pos]),n);
+	}
+};
+
+#endif /* CRF_QUANTIZEDWEIGHTS_H_ */
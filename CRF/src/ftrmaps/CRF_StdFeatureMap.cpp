@@ -19,6 +19,8 @@ CRF_StdFeatureMap::CRF_StdFeatureMap(QNUInt32 nlabs, QNUInt32 nfeas)
 {
 	this->stateFeatureIdxCache = new QNUInt32[nlabs];
 	this->transFeatureIdxCache = new QNUInt32[nlabs*nlabs];
+	this->useSparseWeights = false;
+	this->quantWeights = NULL;
 
 	this->recalc();
 
@@ -37,6 +39,8 @@ CRF_StdFeatureMap::CRF_StdFeatureMap(CRF_FeatureMap_config* cnf)
 {
 	this->stateFeatureIdxCache = new QNUInt32[config->numLabs];
 	this->transFeatureIdxCache = new QNUInt32[config->numLabs*config->numLabs];
+	this->useSparseWeights = false;
+	this->quantWeights = NULL;
 
 	this->recalc();
 }
@@ -66,7 +70,19 @@ double CRF_StdFeatureMap::computeStateArrayValue(float* ftr_buf, double* lambda,
 {
 	double stateValue=0.0;
 	QNUInt32 lc = this->stateFeatureIdxCache[clab];
-	if (config->useStateFtrs) {
+	if (this->quantWeights != NULL) {
+		if (config->useStateFtrs) {
+			stateValue=this->quantWeights->dot(this->stateQuantBlock[clab],0,ftr_buf+config->stateFidxStart,
+					config->stateFidxEnd-config->stateFidxStart+1);
+		}
+		lc+=this->numStateFuncs-(config->useStateBias?1:0);
+	}
+	else if (this->useSparseWeights) {
+		stateValue=this->sparseFtrValue(ftr_buf,lambda,this->sparseStateStart[clab],this->sparseStateStart[clab+1],
+				this->sparseStateFtr,this->sparseStateIdx);
+		lc+=this->numStateFuncs-(config->useStateBias?1:0);
+	}
+	else if (config->useStateFtrs) {
 		for (QNUInt32 fidx=config->stateFidxStart; fidx<=config->stateFidxEnd; fidx++)
 		{
 			stateValue+=ftr_buf[fidx]*lambda[lc];
@@ -95,7 +111,20 @@ double CRF_StdFeatureMap::computeTransMatrixValue(float* ftr_buf, double* lambda
 {
 	double transMatrixValue=0.0;
 	QNUInt32 lc = this->transFeatureIdxCache[plab*config->numLabs+clab];
-	if (config->useTransFtrs) {
+	if (this->quantWeights != NULL) {
+		if (config->useTransFtrs) {
+			transMatrixValue=this->quantWeights->dot(this->transQuantBlock[plab*config->numLabs+clab],0,
+					ftr_buf+config->transFidxStart,config->transFidxEnd-config->transFidxStart+1);
+		}
+		lc+=this->numTransFuncs-(config->useTransBias?1:0);
+	}
+	else if (this->useSparseWeights) {
+		QNUInt32 pair=plab*config->numLabs+clab;
+		transMatrixValue=this->sparseFtrValue(ftr_buf,lambda,this->sparseTransStart[pair],this->sparseTransStart[pair+1],
+				this->sparseTransFtr,this->sparseTransIdx);
+		lc+=this->numTransFuncs-(config->useTransBias?1:0);
+	}
+	else if (config->useTransFtrs) {
 		for (QNUInt32 fidx=config->transFidxStart; fidx<=config->transFidxEnd; fidx++)
 		{
 			transMatrixValue+=ftr_buf[fidx]*lambda[lc];
@@ -222,6 +251,199 @@ double CRF_StdFeatureMap::computeTransExpF(float* ftr_buf, double* lambda, doubl
 	return logLi;
 }
 
+/*
+ * CRF_StdFeatureMap::viewRange
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        k - block of fv
+ *        off - feature index of the first feature of block k
+ *        start, end - feature range used by the map (inclusive)
+ *        *lo, *hi - return the part of [start, end] in block k, as feature indices [lo, hi)
+ *
+ * Used by the CRF_FtrView functions below to walk the blocks of a frame in feature order, so
+ * that the sums are taken in the same order as on a contiguous buffer.
+ */
+void CRF_StdFeatureMap::viewRange(const CRF_FtrView* fv, QNUInt32 k, QNUInt32 off,
+		QNUInt32 start, QNUInt32 end, QNUInt32* lo, QNUInt32* hi)
+{
+	*lo=(start>off)?start:off;
+	*hi=(end+1<off+fv->width[k])?end+1:off+fv->width[k];
+}
+
+/*
+ * CRF_StdFeatureMap::computeStateArrayValueView
+ *
+ * Input: *fv - frame of a joined feature stream, see CRF_JoinedFeatureStream
+ *        *lambda, clab - see computeStateArrayValue
+ *
+ * Same as computeStateArrayValue, reading the features from the blocks of fv in place.
+ */
+double CRF_StdFeatureMap::computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab)
+{
+	double stateValue=0.0;
+	QNUInt32 lc = this->stateFeatureIdxCache[clab];
+	if (this->quantWeights != NULL) {
+		if (config->useStateFtrs) {
+			stateValue=this->quantFtrValueView(fv,this->stateQuantBlock[clab],config->stateFidxStart,config->stateFidxEnd);
+		}
+		lc+=this->numStateFuncs-(config->useStateBias?1:0);
+	}
+	else if (this->useSparseWeights) {
+		stateValue=this->sparseFtrValueView(fv,lambda,this->sparseStateStart[clab],this->sparseStateStart[clab+1],
+				this->sparseStateFtr,this->sparseStateIdx);
+		lc+=this->numStateFuncs-(config->useStateBias?1:0);
+	}
+	else if (config->useStateFtrs) {
+		QNUInt32 off=0, lo, hi;
+		for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+			const float* blk=fv->base[k];
+			this->viewRange(fv,k,off,config->stateFidxStart,config->stateFidxEnd,&lo,&hi);
+			for (QNUInt32 fidx=lo; fidx<hi; fidx++)
+			{
+				stateValue+=blk[fidx-off]*lambda[lc];
+				lc++;
+			}
+			off+=fv->width[k];
+		}
+	}
+	if (config->useStateBias) {
+		stateValue+=lambda[lc]*config->stateBiasVal;
+		lc++;
+	}
+	return stateValue;
+}
+
+/*
+ * CRF_StdFeatureMap::computeTransMatrixValueView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        *lambda, plab, clab - see computeTransMatrixValue
+ *
+ * Same as computeTransMatrixValue, reading the features from the blocks of fv in place.
+ */
+double CRF_StdFeatureMap::computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab)
+{
+	double transMatrixValue=0.0;
+	QNUInt32 lc = this->transFeatureIdxCache[plab*config->numLabs+clab];
+	if (this->quantWeights != NULL) {
+		if (config->useTransFtrs) {
+			transMatrixValue=this->quantFtrValueView(fv,this->transQuantBlock[plab*config->numLabs+clab],
+					config->transFidxStart,config->transFidxEnd);
+		}
+		lc+=this->numTransFuncs-(config->useTransBias?1:0);
+	}
+	else if (this->useSparseWeights) {
+		QNUInt32 pair=plab*config->numLabs+clab;
+		transMatrixValue=this->sparseFtrValueView(fv,lambda,this->sparseTransStart[pair],this->sparseTransStart[pair+1],
+				this->sparseTransFtr,this->sparseTransIdx);
+		lc+=this->numTransFuncs-(config->useTransBias?1:0);
+	}
+	else if (config->useTransFtrs) {
+		QNUInt32 off=0, lo, hi;
+		for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+			const float* blk=fv->base[k];
+			this->viewRange(fv,k,off,config->transFidxStart,config->transFidxEnd,&lo,&hi);
+			for (QNUInt32 fidx=lo; fidx<hi; fidx++)
+			{
+				transMatrixValue+=blk[fidx-off]*lambda[lc];
+				lc++;
+			}
+			off+=fv->width[k];
+		}
+	}
+	if (config->useTransBias) {
+		transMatrixValue+=lambda[lc]*config->transBiasVal;
+		lc++;
+	}
+	return transMatrixValue;
+}
+
+/*
+ * CRF_StdFeatureMap::computeStateExpFView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        other parameters - see computeStateExpF
+ *
+ * Returns: log likelihood of the state features
+ *
+ * Same as computeStateExpF, reading the features from the blocks of fv in place.
+ */
+double CRF_StdFeatureMap::computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad)
+{
+	double logLi=0.0;
+	QNUInt32 lc = this->stateFeatureIdxCache[clab];
+	if (config->useStateFtrs) {
+		QNUInt32 off=0, lo, hi;
+		for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+			const float* blk=fv->base[k];
+			this->viewRange(fv,k,off,config->stateFidxStart,config->stateFidxEnd,&lo,&hi);
+			for (QNUInt32 fidx=lo; fidx<hi; fidx++)
+			{
+				ExpF[lc]+=alpha_beta*blk[fidx-off];
+				if (compute_grad && (t_clab == clab)) {
+					grad[lc]+=blk[fidx-off];
+					logLi += lambda[lc]*blk[fidx-off];
+				}
+				lc++;
+			}
+			off+=fv->width[k];
+		}
+	}
+	if (config->useStateBias) {
+		ExpF[lc]+=alpha_beta*config->stateBiasVal;
+		if (compute_grad && (t_clab == clab)) {
+			grad[lc]+=config->stateBiasVal;
+			logLi += lambda[lc]*config->stateBiasVal;
+		}
+		lc++;
+	}
+	return logLi;
+}
+
+/*
+ * CRF_StdFeatureMap::computeTransExpFView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        other parameters - see computeTransExpF
+ *
+ * Returns: log likelihood of the transition features
+ *
+ * Same as computeTransExpF, reading the features from the blocks of fv in place.
+ */
+double CRF_StdFeatureMap::computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad)
+{
+	double logLi=0.0;
+	QNUInt32 lc = this->transFeatureIdxCache[plab*config->numLabs+clab];
+
+	if (config->useTransFtrs) {
+		QNUInt32 off=0, lo, hi;
+		for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+			const float* blk=fv->base[k];
+			this->viewRange(fv,k,off,config->transFidxStart,config->transFidxEnd,&lo,&hi);
+			for (QNUInt32 fidx=lo; fidx<hi; fidx++)
+			{
+				ExpF[lc]+=alpha_beta*blk[fidx-off];
+				if (compute_grad && (clab==t_clab) && (plab==t_plab)) {
+					grad[lc]+=blk[fidx-off];
+					logLi += lambda[lc]*blk[fidx-off];
+				}
+				lc++;
+			}
+			off+=fv->width[k];
+		}
+	}
+	if (config->useTransBias) {
+		ExpF[lc] += alpha_beta*config->transBiasVal;
+		if (compute_grad && (clab==t_clab) && (plab==t_plab)) {
+			grad[lc]+=config->transBiasVal;
+			logLi+=lambda[lc]*config->transBiasVal;
+		}
+		lc++;
+	}
+
+	return logLi;
+}
+
 
 QNUInt32 CRF_StdFeatureMap::getNumStates()
 {
@@ -512,6 +734,17 @@ QNUInt32 CRF_StdFeatureMap::recalc()
 			this->transFeatureIdxCache[plab*config->numLabs+clab]=this->computeTransFeatureIdx(clab,plab);
 		}
 	}
+	// The state functions form a matrix in lambda if every label starts a fixed distance after the previous one
+	this->stateFeatureStride=(config->numLabs == 1)?this->numStateFuncs:0;
+	if (config->numLabs > 1 && this->numStateFuncs > 0) {
+		this->stateFeatureStride=this->stateFeatureIdxCache[1]-this->stateFeatureIdxCache[0];
+		for (QNUInt32 clab=1; clab<config->numLabs; clab++) {
+			if (this->stateFeatureIdxCache[clab] != this->stateFeatureIdxCache[0]+clab*this->stateFeatureStride) {
+				this->stateFeatureStride=0;
+				break;
+			}
+		}
+	}
 
 	return this->numFtrFuncs;
 }
@@ -578,6 +811,26 @@ void CRF_StdFeatureMap::accumulateFeatures(float *ftr_buf,double *accumulator,QN
 }
 
 
+/*
+ * CRF_StdFeatureMap::getStateFeatureIdxCache
+ *
+ * Returns: the cached lambda index of the first state feature for every label.
+ *   Used by CRF_SegNodeKernel to score labels without a virtual call per label.
+ */
+QNUInt32* CRF_StdFeatureMap::getStateFeatureIdxCache() {
+	return this->stateFeatureIdxCache;
+}
+
+/*
+ * CRF_StdFeatureMap::getTransFeatureIdxCache
+ *
+ * Returns: the cached lambda index of the first transition feature for every
+ *   transition plab->clab, indexed as plab*numLabs+clab.
+ */
+QNUInt32* CRF_StdFeatureMap::getTransFeatureIdxCache() {
+	return this->transFeatureIdxCache;
+}
+
 /*
  * Added by Ryan
  *
@@ -720,3 +973,301 @@ void CRF_StdFeatureMap::tieGradForSingleParam(double* grad, QNUInt32 start, QNUI
 		gradID += step;
 	}
 }
+
+/*
+ * CRF_StdFeatureMap::getStateFeatureStride
+ *
+ * Returns: the distance in the lambda vector between the first state functions of consecutive
+ *   labels, or 0 if the labels are not evenly spaced.  When it is non-zero the state functions
+ *   are a numLabs x numStateFuncs matrix starting at getStateFeatureIdx(0) with this leading
+ *   dimension, which lets gradient builders accumulate them with a single GEMM.
+ */
+QNUInt32 CRF_StdFeatureMap::getStateFeatureStride() {
+	return this->stateFeatureStride;
+}
+
+/*
+ * CRF_StdFeatureMap::supportsSegKernel
+ *
+ * Returns: true if the values are dot products of the dense feature buffer with lambda,
+ *   false while sparse or quantized weights are set (the kernel reads the double lambda)
+ */
+bool CRF_StdFeatureMap::supportsSegKernel() {
+	return (!this->useSparseWeights && this->quantWeights == NULL);
+}
+
+/*
+ * CRF_StdFeatureMap::copyStateFeatures
+ *
+ * Input: *ftr_buf - vector of observed feature values
+ *        *row - vector of numStateFuncs values to fill
+ *
+ * Copies the values the state functions of any label take on ftr_buf (the state features
+ *   followed by the state bias) into row, in lambda order.
+ */
+void CRF_StdFeatureMap::copyStateFeatures(float* ftr_buf, double* row) {
+	QNUInt32 lc=0;
+	if (config->useStateFtrs) {
+		for (QNUInt32 fidx=config->stateFidxStart; fidx<=config->stateFidxEnd; fidx++) {
+			row[lc++]=ftr_buf[fidx];
+		}
+	}
+	if (config->useStateBias) {
+		row[lc++]=config->stateBiasVal;
+	}
+}
+
+/*
+ * CRF_StdFeatureMap::copyStateFeaturesView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        *row - vector of numStateFuncs values to fill
+ *
+ * Same as copyStateFeatures, reading the features from the blocks of fv in place.
+ */
+void CRF_StdFeatureMap::copyStateFeaturesView(const CRF_FtrView* fv, double* row) {
+	QNUInt32 lc=0;
+	if (config->useStateFtrs) {
+		QNUInt32 off=0, lo, hi;
+		for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+			const float* blk=fv->base[k];
+			this->viewRange(fv,k,off,config->stateFidxStart,config->stateFidxEnd,&lo,&hi);
+			for (QNUInt32 fidx=lo; fidx<hi; fidx++) {
+				row[lc++]=blk[fidx-off];
+			}
+			off+=fv->width[k];
+		}
+	}
+	if (config->useStateBias) {
+		row[lc++]=config->stateBiasVal;
+	}
+}
+
+/*
+ * CRF_StdFeatureMap::addSparseWeights
+ *
+ * Input: *lambda - lambda vector from the CRF
+ *        lc - index in lambda of the first feature function of a label or label pair
+ *        start, end - first and last feature used by the feature functions
+ *        &ftrs, &idxs - lists to append the feature number and lambda index of every non-zero
+ *                       weight to
+ */
+void CRF_StdFeatureMap::addSparseWeights(double* lambda, QNUInt32 lc, QNUInt32 start, QNUInt32 end,
+		vector<QNUInt32>& ftrs, vector<QNUInt32>& idxs)
+{
+	for (QNUInt32 fidx=start; fidx<=end; fidx++)
+	{
+		if (lambda[lc] != 0.0) {
+			ftrs.push_back(fidx);
+			idxs.push_back(lc);
+		}
+		lc++;
+	}
+}
+
+/*
+ * CRF_StdFeatureMap::setSparseWeights
+ *
+ * Input: *lambda - lambda vector from the CRF, fixed from now on
+ *
+ * Returns: true
+ *
+ * Lists the non-zero feature weights of every label and label pair, so that
+ * computeStateArrayValue and computeTransMatrixValue (and their View versions) only visit
+ * those.  The bias weights are always used.  The training functions (computeStateExpF, ...)
+ * are not affected.
+ */
+bool CRF_StdFeatureMap::setSparseWeights(double* lambda)
+{
+	QNUInt32 nlabs=config->numLabs;
+	this->clearSparseWeights();
+	this->sparseStateStart.push_back(0);
+	for (QNUInt32 clab=0; clab<nlabs; clab++) {
+		if (config->useStateFtrs) {
+			this->addSparseWeights(lambda,this->stateFeatureIdxCache[clab],config->stateFidxStart,config->stateFidxEnd,
+					this->sparseStateFtr,this->sparseStateIdx);
+		}
+		this->sparseStateStart.push_back(this->sparseStateFtr.size());
+	}
+	this->sparseTransStart.push_back(0);
+	for (QNUInt32 pair=0; pair<nlabs*nlabs; pair++) {
+		// pairs without a transition (see computeTransFeatureIdx) keep an empty list
+		if (config->useTransFtrs && this->transFeatureIdxCache[pair] != QN_UINT32_MAX) {
+			this->addSparseWeights(lambda,this->transFeatureIdxCache[pair],config->transFidxStart,config->transFidxEnd,
+					this->sparseTransFtr,this->sparseTransIdx);
+		}
+		this->sparseTransStart.push_back(this->sparseTransFtr.size());
+	}
+	this->useSparseWeights=true;
+	return true;
+}
+
+/*
+ * CRF_StdFeatureMap::clearSparseWeights
+ *
+ * Goes back to computing the values over all the weights.
+ */
+void CRF_StdFeatureMap::clearSparseWeights()
+{
+	this->useSparseWeights=false;
+	this->sparseStateStart.clear();
+	this->sparseStateFtr.clear();
+	this->sparseStateIdx.clear();
+	this->sparseTransStart.clear();
+	this->sparseTransFtr.clear();
+	this->sparseTransIdx.clear();
+}
+
+/*
+ * CRF_StdFeatureMap::sparseFtrValue
+ *
+ * Input: *ftr_buf - vector of observed feature values for computation
+ *        *lambda - lambda vector from the CRF
+ *        first, last - range of entries of ftrs and idxs to use
+ *        &ftrs, &idxs - feature numbers and lambda indices of the non-zero weights
+ *
+ * Returns: the sum of the features times their weights over the entries
+ */
+double CRF_StdFeatureMap::sparseFtrValue(float* ftr_buf, double* lambda, QNUInt32 first, QNUInt32 last,
+		const vector<QNUInt32>& ftrs, const vector<QNUInt32>& idxs)
+{
+	double value=0.0;
+	for (QNUInt32 e=first; e<last; e++) {
+		value+=ftr_buf[ftrs[e]]*lambda[idxs[e]];
+	}
+	return value;
+}
+
+/*
+ * CRF_StdFeatureMap::sparseFtrValueView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        other parameters - see sparseFtrValue
+ *
+ * Same as sparseFtrValue, reading the features from the blocks of fv in place.  The entries
+ * are in increasing feature order, so the blocks are walked once.
+ */
+double CRF_StdFeatureMap::sparseFtrValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 first, QNUInt32 last,
+		const vector<QNUInt32>& ftrs, const vector<QNUInt32>& idxs)
+{
+	double value=0.0;
+	QNUInt32 k=0, off=0;
+	for (QNUInt32 e=first; e<last; e++) {
+		QNUInt32 fidx=ftrs[e];
+		while (fidx >= off+fv->width[k]) {
+			off+=fv->width[k];
+			k++;
+		}
+		value+=fv->base[k][fidx-off]*lambda[idxs[e]];
+	}
+	return value;
+}
+
+/*
+ * CRF_StdFeatureMap::quantizeWeights
+ *
+ * Input: *lambda - lambda vector from the CRF
+ *        bits - 8 or 16, size of a quantized weight
+ *
+ * Returns: one block per label with the weights of its state features, then one block per
+ *   label pair with the weights of its transition features (pairs without a transition are
+ *   left out).  The bias weights are not quantized.
+ */
+CRF_QuantizedWeights* CRF_StdFeatureMap::quantizeWeights(double* lambda, int bits)
+{
+	QNUInt32 nlabs=config->numLabs;
+	CRF_QuantizedWeights* qw=new CRF_QuantizedWeights(bits,this->numFtrFuncs);
+	if (config->useStateFtrs) {
+		for (QNUInt32 clab=0; clab<nlabs; clab++) {
+			qw->addBlock(lambda,this->stateFeatureIdxCache[clab],config->stateFidxEnd-config->stateFidxStart+1);
+		}
+	}
+	if (config->useTransFtrs) {
+		for (QNUInt32 pair=0; pair<nlabs*nlabs; pair++) {
+			if (this->transFeatureIdxCache[pair] != QN_UINT32_MAX) {
+				qw->addBlock(lambda,this->transFeatureIdxCache[pair],config->transFidxEnd-config->transFidxStart+1);
+			}
+		}
+	}
+	return qw;
+}
+
+/*
+ * CRF_StdFeatureMap::setQuantizedWeights
+ *
+ * Input: *qw - quantized weights, with the blocks in the order quantizeWeights() adds them
+ *
+ * Returns: true if the blocks of qw match the labels and label pairs of the map
+ *
+ * The quantized weights take precedence over the sparse weights (see setSparseWeights).
+ */
+bool CRF_StdFeatureMap::setQuantizedWeights(CRF_QuantizedWeights* qw)
+{
+	QNUInt32 nlabs=config->numLabs;
+	QNUInt32 b=0;
+	this->clearQuantizedWeights();
+	this->stateQuantBlock.assign(nlabs,QN_UINT32_MAX);
+	this->transQuantBlock.assign(nlabs*nlabs,QN_UINT32_MAX);
+	if (config->useStateFtrs) {
+		QNUInt32 len=config->stateFidxEnd-config->stateFidxStart+1;
+		for (QNUInt32 clab=0; clab<nlabs; clab++, b++) {
+			if (b >= qw->getNumBlocks() || qw->getBlockStart(b) != this->stateFeatureIdxCache[clab]
+					|| qw->getBlockLen(b) != len) {
+				return false;
+			}
+			this->stateQuantBlock[clab]=b;
+		}
+	}
+	if (config->useTransFtrs) {
+		QNUInt32 len=config->transFidxEnd-config->transFidxStart+1;
+		for (QNUInt32 pair=0; pair<nlabs*nlabs; pair++) {
+			if (this->transFeatureIdxCache[pair] == QN_UINT32_MAX) continue;
+			if (b >= qw->getNumBlocks() || qw->getBlockStart(b) != this->transFeatureIdxCache[pair]
+					|| qw->getBlockLen(b) != len) {
+				return false;
+			}
+			this->transQuantBlock[pair]=b;
+			b++;
+		}
+	}
+	if (b != qw->getNumBlocks()) {
+		return false;
+	}
+	this->quantWeights=qw;
+	return true;
+}
+
+/*
+ * CRF_StdFeatureMap::clearQuantizedWeights
+ *
+ * Goes back to computing the values with the double weights.
+ */
+void CRF_StdFeatureMap::clearQuantizedWeights()
+{
+	this->quantWeights=NULL;
+	this->stateQuantBlock.clear();
+	this->transQuantBlock.clear();
+}
+
+/*
+ * CRF_StdFeatureMap::quantFtrValueView
+ *
+ * Input: *fv - frame of a joined feature stream
+ *        blk - block of the quantized weights
+ *        start, end - first and last feature the block's weights apply to
+ *
+ * Returns: the sum of the features times their quantized weights, block by block of fv
+ */
+double CRF_StdFeatureMap::quantFtrValueView(const CRF_FtrView* fv, QNUInt32 blk, QNUInt32 start, QNUInt32 end)
+{
+	double value=0.0;
+	QNUInt32 off=0, lo, hi;
+	for (QNUInt32 k=0; k<fv->numBlocks; k++) {
+		this->viewRange(fv,k,off,start,end,&lo,&hi);
+		if (hi > lo) {
+			value+=this->quantWeights->dot(blk,lo-start,fv->base[k]+(lo-off),hi-lo);
+		}
+		off+=fv->width[k];
+	}
+	return value;
+}
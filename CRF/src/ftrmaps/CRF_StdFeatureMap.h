@@ -38,6 +38,7 @@ protected:
 	QNUInt32 transMult;
 	QNUInt32* stateFeatureIdxCache;
 	QNUInt32* transFeatureIdxCache;
+	QNUInt32 stateFeatureStride;
 
 	virtual QNUInt32 computeStateFeatureIdx(QNUInt32 clab, QNUInt32 fno=0);
 	virtual QNUInt32 computeTransFeatureIdx(QNUInt32 clab, QNUInt32 plab, QNUInt32 fno=0);
@@ -45,6 +46,30 @@ protected:
 	//Added by Ryan
 	virtual void tieGradForSingleParam(double* grad, QNUInt32 numParam, QNUInt32 start, QNUInt32 step);
 
+	void viewRange(const CRF_FtrView* fv, QNUInt32 k, QNUInt32 off, QNUInt32 start, QNUInt32 end,
+			QNUInt32* lo, QNUInt32* hi);
+
+	// the non-zero feature weights of each label and label pair, see setSparseWeights()
+	bool useSparseWeights;
+	vector<QNUInt32> sparseStateStart;
+	vector<QNUInt32> sparseStateFtr;
+	vector<QNUInt32> sparseStateIdx;
+	vector<QNUInt32> sparseTransStart;
+	vector<QNUInt32> sparseTransFtr;
+	vector<QNUInt32> sparseTransIdx;
+	void addSparseWeights(double* lambda, QNUInt32 lc, QNUInt32 start, QNUInt32 end,
+			vector<QNUInt32>& ftrs, vector<QNUInt32>& idxs);
+	double sparseFtrValue(float* ftr_buf, double* lambda, QNUInt32 first, QNUInt32 last,
+			const vector<QNUInt32>& ftrs, const vector<QNUInt32>& idxs);
+	double sparseFtrValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 first, QNUInt32 last,
+			const vector<QNUInt32>& ftrs, const vector<QNUInt32>& idxs);
+
+	// quantized weights and the block of each label and label pair, see setQuantizedWeights()
+	CRF_QuantizedWeights* quantWeights;
+	vector<QNUInt32> stateQuantBlock;
+	vector<QNUInt32> transQuantBlock;
+	double quantFtrValueView(const CRF_FtrView* fv, QNUInt32 blk, QNUInt32 start, QNUInt32 end);
+
 public:
 	CRF_StdFeatureMap(QNUInt32 nlabs, QNUInt32 nfeas);
 	CRF_StdFeatureMap(CRF_FeatureMap_config* cnf);
@@ -54,6 +79,10 @@ public:
 	virtual double computeTransMatrixValue(float* ftr_buf, double* lambda, QNUInt32 plab, QNUInt32 clab);
 	virtual double computeStateExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
 	virtual double computeTransExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab);
+	virtual double computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab);
+	virtual double computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
 
 	virtual QNUInt32 getNumStateFuncs(QNUInt32 clab);
 	virtual QNUInt32 getNumTransFuncs(QNUInt32 plab, QNUInt32 clab);
@@ -65,6 +94,17 @@ public:
 	virtual QNUInt32 recalc();
 	virtual string getMapDescriptor(QNUInt32 lambdaNum);
 	virtual void accumulateFeatures(float *ftr_buf, double *accumulator, QNUInt32 lab);
+	virtual QNUInt32* getStateFeatureIdxCache();
+	virtual QNUInt32* getTransFeatureIdxCache();
+	virtual QNUInt32 getStateFeatureStride();
+	virtual bool supportsSegKernel();
+	virtual void copyStateFeatures(float* ftr_buf, double* row);
+	virtual void copyStateFeaturesView(const CRF_FtrView* fv, double* row);
+	virtual bool setSparseWeights(double* lambda);
+	virtual void clearSparseWeights();
+	virtual CRF_QuantizedWeights* quantizeWeights(double* lambda, int bits);
+	virtual bool setQuantizedWeights(CRF_QuantizedWeights* qw);
+	virtual void clearQuantizedWeights();
 
 	//Added by Ryan
 	//virtual void tieGradient(double* grad, QNUInt32 maxDur, QNUInt32 durFtrStart);
@@ -222,6 +222,47 @@ double CRF_StdSparseFeatureMap::computeTransExpF(float* ftr_buf, double* lambda,
 	return logLi;
 }
 
+/*
+ * CRF_StdSparseFeatureMap::computeStateArrayValueView
+ *
+ * The features of a sparse stream are (id, value) pairs, so the dense block indexing of
+ * CRF_StdFeatureMap does not apply; the frame is copied into a contiguous buffer instead.
+ */
+double CRF_StdSparseFeatureMap::computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab)
+{
+	return CRF_FeatureMap::computeStateArrayValueView(fv,lambda,clab);
+}
+
+/*
+ * CRF_StdSparseFeatureMap::computeTransMatrixValueView
+ *
+ * See computeStateArrayValueView.
+ */
+double CRF_StdSparseFeatureMap::computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab)
+{
+	return CRF_FeatureMap::computeTransMatrixValueView(fv,lambda,plab,clab);
+}
+
+/*
+ * CRF_StdSparseFeatureMap::computeStateExpFView
+ *
+ * See computeStateArrayValueView.
+ */
+double CRF_StdSparseFeatureMap::computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad)
+{
+	return CRF_FeatureMap::computeStateExpFView(fv,lambda,ExpF,grad,alpha_beta,t_clab,clab,compute_grad);
+}
+
+/*
+ * CRF_StdSparseFeatureMap::computeTransExpFView
+ *
+ * See computeStateArrayValueView.
+ */
+double CRF_StdSparseFeatureMap::computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad)
+{
+	return CRF_FeatureMap::computeTransExpFView(fv,lambda,ExpF,grad,alpha_beta,t_plab,t_clab,plab,clab,compute_grad);
+}
+
 /*
  * CRF_StdSparseFeatureMap::accumulateFeatures
  *
@@ -239,3 +280,55 @@ void CRF_StdSparseFeatureMap::accumulateFeatures(float *ftr_buf,double *accumula
 		}
 	}
 }
+
+/*
+ * CRF_StdSparseFeatureMap::getStateFeatureStride
+ *
+ * Returns: 0, the state functions cannot be accumulated as a dense matrix because the
+ *   feature buffer holds (id, value) pairs (see CRF_NewGradBuilder::useGemmStateExpF)
+ */
+QNUInt32 CRF_StdSparseFeatureMap::getStateFeatureStride()
+{
+	return 0;
+}
+
+/*
+ * CRF_StdSparseFeatureMap::supportsSegKernel
+ *
+ * Returns: false, the feature buffer holds (id, value) pairs rather than dense features
+ */
+bool CRF_StdSparseFeatureMap::supportsSegKernel()
+{
+	return false;
+}
+
+/*
+ * CRF_StdSparseFeatureMap::setSparseWeights
+ *
+ * Returns: false, the values are computed over the (id, value) pairs of the input, which
+ *   already skips the zero features
+ */
+bool CRF_StdSparseFeatureMap::setSparseWeights(double* lambda)
+{
+	return false;
+}
+
+/*
+ * CRF_StdSparseFeatureMap::quantizeWeights
+ *
+ * Returns: NULL, the values are computed over the (id, value) pairs of the input
+ */
+CRF_QuantizedWeights* CRF_StdSparseFeatureMap::quantizeWeights(double* lambda, int bits)
+{
+	return NULL;
+}
+
+/*
+ * CRF_StdSparseFeatureMap::setQuantizedWeights
+ *
+ * Returns: false, see quantizeWeights
+ */
+bool CRF_StdSparseFeatureMap::setQuantizedWeights(CRF_QuantizedWeights* qw)
+{
+	return false;
+}
@@ -42,7 +42,16 @@ public:
 	virtual double computeTransMatrixValue(float* ftr_buf, double* lambda, QNUInt32 plab, QNUInt32 clab);
 	virtual double computeStateExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
 	virtual double computeTransExpF(float* ftr_buf, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeStateArrayValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 clab);
+	virtual double computeTransMatrixValueView(const CRF_FtrView* fv, double* lambda, QNUInt32 plab, QNUInt32 clab);
+	virtual double computeStateExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab, bool compute_grad=true);
+	virtual double computeTransExpFView(const CRF_FtrView* fv, double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab, bool compute_grad=true);
 	virtual void accumulateFeatures(float *ftr_buf, double *accumulator, QNUInt32 lab);
+	virtual QNUInt32 getStateFeatureStride();
+	virtual bool supportsSegKernel();
+	virtual bool setSparseWeights(double* lambda);
+	virtual CRF_QuantizedWeights* quantizeWeights(double* lambda, int bits);
+	virtual bool setQuantizedWeights(CRF_QuantizedWeights* qw);
 };
 
 #endif /*CRF_STDFEATUREMAP_H_*/
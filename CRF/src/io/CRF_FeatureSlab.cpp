@@ -0,0 +1,112 @@
+/*
+ * CRF_FeatureSlab.cpp
+ *
+ */
+
+#include "CRF_FeatureSlab.h"
+#include "../utils/CRF_MemStats.h"
+
+/*
+ * CRF_FeatureSlab constructor
+ *
+ * Input: block_size - number of floats in each block of the slab
+ */
+CRF_FeatureSlab::CRF_FeatureSlab(size_t block_size)
+	: blockSize(block_size),
+	  curBlock(0),
+	  curPos(0),
+	  reserved(0),
+	  blockAllocs(0)
+{
+}
+
+/*
+ * CRF_FeatureSlab destructor
+ */
+CRF_FeatureSlab::~CRF_FeatureSlab()
+{
+	for (size_t i=0; i<this->blocks.size(); i++) {
+		delete [] this->blocks[i];
+	}
+	CRF_MemStats::release(MEM_FEATURES,this->getCapacity()*sizeof(float));
+}
+
+/*
+ * CRF_FeatureSlab::rewind
+ *
+ * Makes the whole slab available for the next sequence.  Pointers returned by reserve()
+ * before the rewind must no longer be used.
+ */
+void CRF_FeatureSlab::rewind()
+{
+	this->curBlock=0;
+	this->curPos=0;
+	this->reserved=0;
+}
+
+/*
+ * CRF_FeatureSlab::reserve
+ *
+ * Input: n - number of floats needed
+ *
+ * Returns: pointer to n contiguous floats in the slab
+ *
+ * The space is only kept if it is claimed with commit(), so callers can reserve the largest
+ * bunch a stream may return, read into it and commit the part actually read.
+ */
+float* CRF_FeatureSlab::reserve(size_t n)
+{
+	while (this->curBlock < this->blocks.size() &&
+			this->curPos + n > this->blockSizes[this->curBlock]) {
+		this->curBlock++;
+		this->curPos=0;
+	}
+	if (this->curBlock == this->blocks.size()) {
+		size_t size=(n > this->blockSize)?n:this->blockSize;
+		this->blocks.push_back(new float[size]);
+		this->blockSizes.push_back(size);
+		this->blockAllocs++;
+		CRF_MemStats::add(MEM_FEATURES,size*sizeof(float));
+	}
+	this->reserved=n;
+	return this->blocks[this->curBlock]+this->curPos;
+}
+
+/*
+ * CRF_FeatureSlab::commit
+ *
+ * Input: n - number of floats of the last reservation to keep
+ */
+void CRF_FeatureSlab::commit(size_t n)
+{
+	if (n > this->reserved) {
+		string errstr="CRF_FeatureSlab::commit() caught exception: committing more than was reserved";
+		throw runtime_error(errstr);
+	}
+	this->curPos+=n;
+	this->reserved=0;
+}
+
+/*
+ * CRF_FeatureSlab::getCapacity
+ *
+ * Returns: total number of floats held by the slab
+ */
+size_t CRF_FeatureSlab::getCapacity()
+{
+	size_t total=0;
+	for (size_t i=0; i<this->blockSizes.size(); i++) {
+		total+=this->blockSizes[i];
+	}
+	return total;
+}
+
+/*
+ * CRF_FeatureSlab::getBlockAllocs
+ *
+ * Returns: number of blocks allocated since the slab was created
+ */
+QNUInt32 CRF_FeatureSlab::getBlockAllocs()
+{
+	return this->blockAllocs;
+}
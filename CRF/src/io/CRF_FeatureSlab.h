@@ -0,0 +1,43 @@
+#ifndef CRF_FEATURESLAB_H_
+#define CRF_FEATURESLAB_H_
+/*
+ * CRF_FeatureSlab.h
+ *
+ * Contains the class definition for CRF_FeatureSlab
+ */
+
+#include "../CRF.h"
+#include <vector>
+
+/*
+ * class CRF_FeatureSlab
+ *
+ * Reusable storage for the features of a whole sequence.  Feature streams are read straight
+ * into space reserved in the slab, and the state nodes point into it (see
+ * CRF_StateVector::setView) instead of each holding its own heap copy.
+ *
+ * The slab is a list of large blocks.  Blocks never move once allocated, so a pointer handed
+ * out stays valid until the next rewind(), and the blocks are kept from one sequence to the
+ * next: once the slab has seen its longest sequence it stops allocating.
+ */
+class CRF_FeatureSlab
+{
+protected:
+	vector<float*> blocks;
+	vector<size_t> blockSizes;
+	size_t blockSize;
+	size_t curBlock;
+	size_t curPos;
+	size_t reserved;
+	QNUInt32 blockAllocs;
+public:
+	CRF_FeatureSlab(size_t block_size=262144);
+	virtual ~CRF_FeatureSlab();
+	virtual void rewind();
+	virtual float* reserve(size_t n);
+	virtual void commit(size_t n);
+	virtual size_t getCapacity();
+	virtual QNUInt32 getBlockAllocs();
+};
+
+#endif /*CRF_FEATURESLAB_H_*/
@@ -6,6 +6,7 @@
  *
  */
 #include "CRF_FeatureStream.h"
+#include "CRF_JoinedFeatureStream.h"
 
 // The following is to correct for the fact that QN_ALL ends up being defined as
 // larger than a 32bit integer can handle on 64bit machines.  CRF_ALL is always the
@@ -158,7 +159,7 @@ int CRF_FeatureStream::get_pos(size_t* segno, size_t* frameno)
 }
 
 /*
- * CRF_FeatureStream::nextseg
+ * CRF_FeatureStream::join
  *
  * Input: in_stream - second independent feature stream object
  *
@@ -168,19 +169,61 @@ int CRF_FeatureStream::get_pos(size_t* segno, size_t* frameno)
  * Used to build larger feature streams from multiple smaller files.  The streams must
  * match segment-wise and frame-wise for this function to work without error.
  *
+ * The result is a CRF_JoinedFeatureStream over the sources of both streams, so joining a
+ * joined stream again adds a block to it instead of stacking another join.
  */
 CRF_FeatureStream* CRF_FeatureStream::join(CRF_FeatureStream* in_stream)
 {
-	QN_InFtrStream* new_stream;
-	new_stream = new QN_InFtrStream_JoinFtrs(this->debug, "join_ftrfile",
-									*(this->ftr_stream), *(in_stream->ftr_stream));
+	vector<QN_InFtrStream*> srcs;
+	this->get_sources(srcs);
+	in_stream->get_sources(srcs);
 
 	// Modified by Ryan
 	// We need to keep the original start_offset, numsegs and segid so that
 	// the multi-threaded version is not screwed.
 	//
 	//return new CRF_FeatureStream(new_stream, this->lab_stream);
-	return new CRF_FeatureStream(new_stream, this->lab_stream, this->debug, this->start_offset, this->numsegs);
+	return new CRF_JoinedFeatureStream(srcs, this->lab_stream, this->debug, this->start_offset, this->numsegs);
+}
+
+/*
+ * CRF_FeatureStream::get_sources
+ *
+ * Input: srcs - list to append to
+ *
+ * Appends the underlying QN_InFtrStream objects whose features make up this stream, in
+ * feature order.
+ */
+void CRF_FeatureStream::get_sources(vector<QN_InFtrStream*>& srcs)
+{
+	srcs.push_back(this->ftr_stream);
+}
+
+/*
+ * CRF_FeatureStream::has_view
+ *
+ * Returns: true if the stream supports read_view()
+ */
+bool CRF_FeatureStream::has_view()
+{
+	return false;
+}
+
+/*
+ * CRF_FeatureStream::read_view
+ *
+ * Input:  bs - bunch size - number of frames to read
+ *         fv - view to fill with the location of the first frame read
+ *         lb - frame buffer to store read labels
+ * Returns: number of frames read
+ *
+ * Like read(), but leaves the features where the stream holds them.  Only implemented by
+ * streams for which has_view() is true.
+ */
+size_t CRF_FeatureStream::read_view(size_t bs, CRF_FtrView* fv, QNUInt32* lb)
+{
+	string errstr="CRF_FeatureStream::read_view() caught exception: the stream does not hold its features in place";
+	throw runtime_error(errstr);
 }
 
 /*
@@ -205,13 +248,7 @@ void CRF_FeatureStream::rewind()
 			this->lab_stream->rewind();
 		}
 	} else {
-		QN_SegID ftrid= this->ftr_stream->set_pos(this->start_offset-1,0);
-		if (ftrid==QN_SEGID_BAD) {
-			// do it the hard way
-			this->ftr_stream->rewind();
-			for(QNUInt32 i=0;i<start_offset;i++)
-				this->ftr_stream->nextseg();
-		}
+		this->rewindFtrStream(this->ftr_stream);
 		if (this->lab_stream != NULL) {
 			QN_SegID labid=this->lab_stream->set_pos(this->start_offset-1,0);
 			if (labid==QN_SEGID_BAD) {
@@ -226,6 +263,28 @@ void CRF_FeatureStream::rewind()
 
 }
 
+/*
+ * CRF_FeatureStream::rewindFtrStream
+ *
+ * Input: str - feature stream of this object
+ *
+ * Positions str just before the segment determined by start_offset.
+ */
+void CRF_FeatureStream::rewindFtrStream(QN_InFtrStream* str)
+{
+	if (this->start_offset==0) {
+		str->rewind();
+		return;
+	}
+	QN_SegID ftrid= str->set_pos(this->start_offset-1,0);
+	if (ftrid==QN_SEGID_BAD) {
+		// do it the hard way
+		str->rewind();
+		for(QNUInt32 i=0;i<start_offset;i++)
+			str->nextseg();
+	}
+}
+
 /*
  * CRF_FeatureStream::num_ftrs
  *
@@ -276,6 +335,19 @@ QNUInt32 CRF_FeatureStream::num_segs()
 	}
 }
 
+/*
+ * CRF_FeatureStream::num_frames
+ *
+ * Input: segno - segment number, relative to the start of the view
+ *
+ * Returns: number of frames in segment segno, or QN_SIZET_BAD if the underlying stream
+ *   cannot tell without reading it
+ */
+size_t CRF_FeatureStream::num_frames(QNUInt32 segno)
+{
+	return this->ftr_stream->num_frames(segno+this->start_offset);
+}
+
 /*
  * CRF_FeatureStream::display
  *
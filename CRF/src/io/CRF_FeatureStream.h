@@ -21,6 +21,7 @@
 #include "quicknet3/QN_seqgen.h"
 
 #include "../CRF.h"
+#include <vector>
 
 /*
  * class CRF_FeatureStream
@@ -43,6 +44,7 @@ protected:
 	QNUInt32 numsegs;
 	//unsigned long numsegs;
 	QN_SegID segid;
+	virtual void rewindFtrStream(QN_InFtrStream* str);
 
 public:
 	// Modified by Ryan
@@ -59,8 +61,12 @@ public:
 	virtual QNUInt32 num_ftrs();
 	virtual void set_pos(QNUInt32 segno, QNUInt32 frmno);
 	virtual QNUInt32 num_segs();
+	virtual size_t num_frames(QNUInt32 segno);
 	virtual void display();
 	virtual void view(QNUInt32 startseg,QNUInt32 nsegs);
+	virtual void get_sources(vector<QN_InFtrStream*>& srcs);
+	virtual bool has_view();
+	virtual size_t read_view(size_t bs, CRF_FtrView* fv, QNUInt32* lb);
 
 	// Added by Ryan
 	virtual QNUInt32 num_labs();
@@ -25,6 +25,8 @@
  *        win_ext - size of window of feature vectors to use
  *        win_off - offset into window to consider "center" feature
  *        win_len - size of window of feature vectors to use
+ *        use_kl_ftr - add the KL divergence features of posterior frames to the windows
+ *                     (see CRF_InFtrStream_SeqMultiWindow)
  *        delta_o - delta order to apply to feature file (not yet implemented)
  *        delta_w - window size to compute deltas (not yet implemented)
  *        trn_rng - range of feature vectors to use for training
@@ -33,10 +35,11 @@
  *        n_mode - normalization mode (not yet implemented)
  *        n_am - (not yet implemented)
  *        n_av - (not yet implemented)
- *        train-seq_type - type of training to perform (sequential, random no replace, random replace)
+ *        train-seq_type - type of training to perform (sequential, random no replace, random replace, shuffled)
  *        rseed - random seed
  *        nthreads - number of threads (used to split the training file over multiple views for multi-
  *                    threaded training aglorithms)
+ *        shuf_buf - number of segments held in memory for the shuffled presentation order
  *
  *  Normalization and delta parameters are included for future expansion for compatability with Quicknet
  *  feature streams, but are not implemented at this time.
@@ -48,11 +51,11 @@ CRF_FeatureStreamManager::CRF_FeatureStreamManager(int dbg, const char* dname,
 									size_t width, size_t first_ftr, size_t num_ftrs,
 									size_t win_ext, size_t win_off, size_t win_len,
 									size_t left_ctx_len, size_t right_ctx_len, bool extract_seg_ftr,
-									bool use_bdy_delta_ftr,
+									bool use_bdy_delta_ftr, bool use_kl_ftr,
 									int delta_o, int delta_w,
 									char* trn_rng, char* cv_rng,
 									FILE* nfile, int n_mode, double n_am, double n_av, seqtype ts,
-									QNUInt32 rseed, size_t n_threads)
+									QNUInt32 rseed, size_t n_threads, size_t shuf_buf)
 	:debug(dbg),
 	 dbgname(dname),
 	 filename(fname),
@@ -71,6 +74,7 @@ CRF_FeatureStreamManager::CRF_FeatureStreamManager(int dbg, const char* dname,
 	 right_context_len(right_ctx_len),
 	 extract_segment_features(extract_seg_ftr),
 	 use_boundary_delta_ftrs(use_bdy_delta_ftr),
+	 use_kl_ftrs(use_kl_ftr),
 
 	 delta_order(delta_o),
 	 delta_win(delta_w),
@@ -82,7 +86,10 @@ CRF_FeatureStreamManager::CRF_FeatureStreamManager(int dbg, const char* dname,
 	 norm_av(n_av),
 	 train_seq_type(ts),
 	 rseed(rseed),
-	 nthreads(n_threads)
+	 nthreads(n_threads),
+	 shuffle_buffer_segs(shuf_buf),
+	 trn_shuf_ftr_str(NULL),
+	 trn_shuf_lab_str(NULL)
 {
 	childnum=0;
 	this->create();
@@ -185,6 +192,7 @@ void CRF_FeatureStreamManager::create()
     CRF_InFtrStream_SeqMultiWindow* train_winftr_str;
 
     CRF_InFtrStream_RandPresent* train_randftr_str = NULL;
+    CRF_InFtrStream_ShuffleBuffer* train_shufftr_str = NULL;
 
 	switch ( this->train_seq_type )
 	{
@@ -203,7 +211,7 @@ void CRF_FeatureStreamManager::create()
 						*train_randftr_str, this->window_len,
 						 this->window_offset, bot_margin,
 						 this->left_context_len, this->right_context_len,
-						 this->extract_segment_features, this->use_boundary_delta_ftrs);
+						 this->extract_segment_features, this->use_boundary_delta_ftrs, this->use_kl_ftrs);
 			break;
 		case RANDOM_REPLACE:
 			train_randftr_str =
@@ -220,7 +228,18 @@ void CRF_FeatureStreamManager::create()
 						*train_randftr_str, this->window_len,
 						 this->window_offset, bot_margin,
 						 this->left_context_len, this->right_context_len,
-						 this->extract_segment_features, this->use_boundary_delta_ftrs);
+						 this->extract_segment_features, this->use_boundary_delta_ftrs, this->use_kl_ftrs);
+			break;
+		case SHUFFLED:
+			train_shufftr_str =
+				new CRF_InFtrStream_ShuffleBuffer(this->debug, this->dbgname, this->dbgname,*train_ftr_str,
+						this->shuffle_buffer_segs,this->rseed);
+			train_winftr_str =
+				new CRF_InFtrStream_SeqMultiWindow(this->debug, this->dbgname,
+						*train_shufftr_str, this->window_len,
+						 this->window_offset, bot_margin,
+						 this->left_context_len, this->right_context_len,
+						 this->extract_segment_features, this->use_boundary_delta_ftrs, this->use_kl_ftrs);
 			break;
 		case SEQUENTIAL:
 			//changed by Ryan
@@ -234,7 +253,7 @@ void CRF_FeatureStreamManager::create()
 						*train_ftr_str, this->window_len,
 						 this->window_offset, bot_margin,
 						 this->left_context_len, this->right_context_len,
-						 this->extract_segment_features, this->use_boundary_delta_ftrs);
+						 this->extract_segment_features, this->use_boundary_delta_ftrs, this->use_kl_ftrs);
    			break;
    		default:
    			cerr << "Invalid training sequence type! ABORT!" << endl;
@@ -258,7 +277,7 @@ void CRF_FeatureStreamManager::create()
 										*cv_ftr_str, this->window_len,
 										 this->window_offset, bot_margin,
 										 this->left_context_len, this->right_context_len,
-										 this->extract_segment_features, this->use_boundary_delta_ftrs);
+										 this->extract_segment_features, this->use_boundary_delta_ftrs, this->use_kl_ftrs);
 	}
 	else {
 		cv_winftr_str=NULL;
@@ -311,6 +330,7 @@ void CRF_FeatureStreamManager::create()
 
 	    // Create training and CV windows.
 	    CRF_InLabStream_RandPresent* train_randlab_str =NULL;
+	    CRF_InLabStream_ShuffleBuffer* train_shuflab_str =NULL;
 
 	    // Changed by Ryan
 //	    const size_t window_len = 1;
@@ -363,6 +383,16 @@ void CRF_FeatureStreamManager::create()
 										  *train_randlab_str, this->window_len,
 										  this->hardtarget_window_offset, bot_margin);
 				break;
+			case SHUFFLED:
+				train_shuflab_str =
+					new CRF_InLabStream_ShuffleBuffer(this->debug, this->dbgname, this->dbgname,*train_lab_str,
+							this->shuffle_buffer_segs, this->rseed );
+				this->trn_shuf_lab_str = train_shuflab_str;
+				train_winlab_str =
+					new CRF_InLabStream_SeqMultiWindow(this->debug, this->dbgname,
+										  *train_shuflab_str, this->window_len,
+										  this->hardtarget_window_offset, bot_margin);
+				break;
 			case SEQUENTIAL:
 				//train_winlab_str =
 				//	new QN_InLabStream_SeqWindow(this->debug, this->dbgname,
@@ -412,6 +442,7 @@ void CRF_FeatureStreamManager::create()
 		train_winlab_str=NULL;
 	}
 
+	this->trn_shuf_ftr_str = train_shufftr_str;
 	this->trn_stream = new CRF_FeatureStream(train_winftr_str, train_winlab_str,this->debug);
 	if (cv_winftr_str != NULL) {
 		this->cv_stream = new CRF_FeatureStream(cv_winftr_str, cv_winlab_str,this->debug);
@@ -438,12 +469,12 @@ void CRF_FeatureStreamManager::create()
 													 this->width, this->first_ftr, this->num_ftrs,
 													 this->window_extent,this->window_offset, this->window_len,
 													 this->left_context_len,this->right_context_len,this->extract_segment_features,
-													 this->use_boundary_delta_ftrs,
+													 this->use_boundary_delta_ftrs, this->use_kl_ftrs,
 													 this->delta_order, this->delta_win, this->train_sent_range,
 													 this->cv_sent_range,
 													 this->normfile, // WARNING needs rewinding
 													 this->norm_mode,this->norm_am, this->norm_av,
-													 this->train_seq_type, this->rseed, 1);
+													 this->train_seq_type, this->rseed, 1, this->shuffle_buffer_segs);
 			children[i]->childnum=i;
 
 			// the stuff below doesn't work because the streams aren't indexed
@@ -461,7 +492,15 @@ void CRF_FeatureStreamManager::create()
 
 			// make each child cover a portion of the stream
 			//cout << "stream " << i << " view " << (i*nseg_per_child) << " " << ((i==nthreads-1)?QN_ALL:nseg_per_child) << endl;
-			children[i]->trn_stream->view(i*nseg_per_child,(i==nthreads-1)?QN_ALL:nseg_per_child);
+			if (this->train_seq_type == SHUFFLED) {
+				// a shuffled child shuffles its own portion, so it never buffers the segments
+				// before it (see CRF_InFtrStream_ShuffleBuffer::set_range)
+				children[i]->setShuffleRange(i*nseg_per_child,(i==nthreads-1)?QN_ALL:nseg_per_child);
+				children[i]->trn_stream->view(0,(i==nthreads-1)?QN_ALL:nseg_per_child);
+			}
+			else {
+				children[i]->trn_stream->view(i*nseg_per_child,(i==nthreads-1)?QN_ALL:nseg_per_child);
+			}
 
 		}
 
@@ -516,6 +555,27 @@ void CRF_FeatureStreamManager::rewindAllChildrenTrn()
 	}
 }
 
+/*
+ * CRF_FeatureStreamManager::setShuffleRange
+ *
+ * Input: first - first segment of the training stream to present
+ *        count - number of segments to present, QN_ALL for all the segments from first on
+ *
+ * Restricts the shuffled training streams to a range of segments (see
+ * CRF_InFtrStream_ShuffleBuffer::set_range).  Only meaningful for the SHUFFLED order.
+ */
+void CRF_FeatureStreamManager::setShuffleRange(size_t first, size_t count)
+{
+	if (this->trn_shuf_ftr_str == NULL) {
+		string errstr="CRF_FeatureStreamManager::setShuffleRange() caught exception: the training stream is not shuffled";
+		throw runtime_error(errstr);
+	}
+	this->trn_shuf_ftr_str->set_range(first,count);
+	if (this->trn_shuf_lab_str != NULL) {
+		this->trn_shuf_lab_str->set_range(first,count);
+	}
+}
+
 /*
  * CRF_FeatureStreamManager::join
  *
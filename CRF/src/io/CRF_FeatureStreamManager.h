@@ -18,6 +18,8 @@
 #include "../CRF.h"
 #include "CRF_InFtrStream_RandPresent.h"
 #include "CRF_InLabStream_RandPresent.h"
+#include "CRF_InFtrStream_ShuffleBuffer.h"
+#include "CRF_InLabStream_ShuffleBuffer.h"
 #include "CRF_FeatureStream.h"
 //added by Ryan
 #include "CRF_InFtrStream_SeqMultiWindow.h"
@@ -55,6 +57,7 @@ private:
 	size_t right_context_len;
 	bool extract_segment_features;
 	bool use_boundary_delta_ftrs;
+	bool use_kl_ftrs;
 
 	int delta_order;
 	int delta_win;
@@ -69,6 +72,9 @@ private:
 	seqtype train_seq_type;
 	QNUInt32 rseed;
 	size_t nthreads;
+	size_t shuffle_buffer_segs;
+	CRF_InFtrStream_ShuffleBuffer* trn_shuf_ftr_str;	// Shuffle wrappers of the training streams, if SHUFFLED
+	CRF_InLabStream_ShuffleBuffer* trn_shuf_lab_str;
 	CRF_FeatureStreamManager **children;
 protected:
 	int childnum;
@@ -79,11 +85,11 @@ public:
 									size_t ftr_width, size_t first_ftr, size_t num_ftrs,
 									size_t win_ext, size_t win_off, size_t win_len,
 									size_t left_ctx_len, size_t right_ctx_len, bool extract_seg_ftr,
-									bool use_bdy_delta_ftr,
+									bool use_bdy_delta_ftr, bool use_kl_ftr,
 									int delta_o, int delta_w,
 									char* trn_rng, char* cv_rng,
 									FILE* nfile, int n_mode, double n_am, double n_av, seqtype ts,
-									QNUInt32 rseed=0, size_t n_threads=1);
+									QNUInt32 rseed=0, size_t n_threads=1, size_t shuf_buf=1000);
 
 	virtual ~CRF_FeatureStreamManager();
 	void create();
@@ -104,6 +110,7 @@ public:
 
 	// Added by Ryan
 	void rewindAllChildrenTrn();
+	void setShuffleRange(size_t first, size_t count);
 
 	CRF_FeatureStream* trn_stream;
 	CRF_FeatureStream* cv_stream;
@@ -13,7 +13,7 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 		size_t a_max_win_len, size_t a_top_margin,
 		size_t a_bot_margin, size_t a_left_ctx_len,
 		size_t a_right_ctx_len, bool a_seg_ftr,
-		bool a_use_boundary_delta_ftr,
+		bool a_use_boundary_delta_ftr, bool a_use_kl_ftr,
 		size_t a_bunch_frames)
 	: log(a_debug, "CRF_InFtrStream_SeqMultiWindow", a_dbgname),
 	  in_str(a_str),
@@ -36,13 +36,19 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 			  right_context_len + bot_margin-1),
 	  extract_segment_features(a_seg_ftr),
 	  use_boundary_delta_ftrs(a_use_boundary_delta_ftr),
+	  use_kl_ftrs(a_use_kl_ftr),
 
 	  max_win_buf(new float[max_buf_lines*in_width]),
 
 	  // modified for context features
 	  first_line_ptr(&max_win_buf[(top_margin+left_context_len)*in_width]),
 
-	  segno(-1)
+	  segno(-1),
+
+	  acc_sum_buf(new float[in_width]),
+	  acc_max_buf(new float[in_width]),
+	  acc_min_buf(new float[in_width]),
+	  kl_cache(NULL)
 {
 	if (max_win_len == 0)
 		log.error("Window size must be larger than 0.");
@@ -76,6 +82,10 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 //					(left_context_len + right_context_len) * in_width;  //e.g. sample-avg-max-min-avg_kl TODO: Currently hard-coded. Need to be parameterized.
 			out_width = 8 * in_width + max_win_len +
 					(left_context_len + right_context_len) * in_width;  //e.g. sample-avg-max-min-dur TODO: Currently hard-coded. Need to be parameterized.
+			if (use_kl_ftrs)
+			{
+				out_width += 3;   // avg_kl-max_kl-min_kl, see kl_ftrs()
+			}
 //			out_width = 8 * in_width +
 //					(left_context_len + right_context_len) * in_width;  //e.g. sample-avg-max-min TODO: Currently hard-coded. Need to be parameterized.
 //			out_width = 7 * in_width + max_win_len +
@@ -112,6 +122,16 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 			else
 			{
 				out_width = (left_context_len + 1 + right_context_len) * in_width;
+				if (use_kl_ftrs)
+				{
+					// one KL divergence per pair of frames across the boundary, see boundary_kl_ftrs()
+					QNUInt32 both_context_len = left_context_len;
+					if (both_context_len > right_context_len + 1)
+					{
+						both_context_len = right_context_len + 1;
+					}
+					out_width += both_context_len;
+				}
 
 				// add KL divergence to the boundary features
 //				QNUInt32 both_context_len = left_context_len;
@@ -128,6 +148,16 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 	{
 		log.error("extract_segment_features must be false to use boundary_delta_ftrs.");
 	}
+	if (this->use_kl_ftrs && this->use_boundary_delta_ftrs)
+	{
+		log.error("use_kl_ftrs cannot be used with boundary_delta_ftrs.");
+	}
+
+	// the KL features are only computed for windows longer than one frame
+	if (this->use_kl_ftrs && max_win_len > 1)
+	{
+		kl_cache = new CRF_KLFeatureCache(max_buf_lines, in_width);
+	}
 
 	// modified for context features
 //	if (bunch_frames<(top_margin+bot_margin+max_win_len))
@@ -153,6 +183,10 @@ CRF_InFtrStream_SeqMultiWindow::CRF_InFtrStream_SeqMultiWindow(int a_debug, cons
 
 CRF_InFtrStream_SeqMultiWindow::~CRF_InFtrStream_SeqMultiWindow() {
 	delete [] max_win_buf;
+	delete [] acc_sum_buf;
+	delete [] acc_max_buf;
+	delete [] acc_min_buf;
+	delete kl_cache;
 }
 
 size_t CRF_InFtrStream_SeqMultiWindow::num_ftrs()
@@ -169,6 +203,8 @@ QN_SegID CRF_InFtrStream_SeqMultiWindow::nextseg()
 	{
 	    // Try and read in a buffer full of frames.
 	    buf_lines = in_str.read_ftrs(bunch_frames, max_win_buf);
+	    if (kl_cache != NULL)
+	    	kl_cache->invalidate(0, max_buf_lines);
 
 	    //modified for context features
 	    cur_line = top_margin + left_context_len;
@@ -390,6 +426,8 @@ size_t CRF_InFtrStream_SeqMultiWindow::read_ftrs(size_t cnt, float* ftrs, size_t
 			//modified for context features
 //				cur_line = 0;
 //				cur_line_ptr = &max_win_buf[0];
+			if (kl_cache != NULL)
+				kl_cache->shift(cur_line - left_context_len, old_lines);
 			cur_line = left_context_len;
 			cur_line_ptr = &max_win_buf[left_context_len * in_width];
 
@@ -432,15 +470,22 @@ size_t CRF_InFtrStream_SeqMultiWindow::read_ftrs(size_t cnt, float* ftrs, size_t
 				// various feature combinations with context features
 //				numWrittenFtrPerWin += sum_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
 				numWrittenFtrPerWin += sample_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
-				numWrittenFtrPerWin += avg_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
-				numWrittenFtrPerWin += max_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
-				numWrittenFtrPerWin += min_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
-//				numWrittenFtrPerWin += kl_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
+				// avg, max and min features in one pass, same output as
+				// avg_ftrs(), max_ftrs() and min_ftrs() one after another
+				numWrittenFtrPerWin += window_stat_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride,
+						false, true, true, true);
+				if (use_kl_ftrs)
+				{
+					numWrittenFtrPerWin += kl_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
+				}
 				numWrittenFtrPerWin += dur_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
 			} else {
 				numWrittenFtrPerWin += first_frame_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
 				// use KL divergence between boundary frames as a feature
-//				numWrittenFtrPerWin += boundary_kl_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
+				if (use_kl_ftrs)
+				{
+					numWrittenFtrPerWin += boundary_kl_ftrs(ftrs + numWrittenFtrPerWin, multi_win_count, real_stride);
+				}
 			}
 		}
 
@@ -747,6 +792,101 @@ size_t CRF_InFtrStream_SeqMultiWindow::min_ftrs(float* out_ftr_buf, size_t avail
 	return in_width;      //TODO: Currently hard-coded. Need to be parameterized.
 }
 
+/*
+ *  CRF_InFtrStream_SeqMultiWindow::window_stat_ftrs
+ *
+ *  Input: out_multi_win_buf: output multiple windows feature buffer
+ *         avail_max_win_len: available maximum window length
+ *         emit_sum, emit_avg, emit_max, emit_min: which statistics to write
+ *
+ *  Return: the number of features that have been written in each output window
+ *
+ *  Fused form of sum_ftrs, avg_ftrs, max_ftrs and min_ftrs: a single pass back over the
+ *  longest window keeps the running sum, maximum and minimum of every input feature and
+ *  writes the requested statistics of each window next to each other, in the order sum,
+ *  avg, max, min.  Each statistic goes through the same float operations in the same order
+ *  as in the separate functions (and _mm_max_ps/_mm_min_ps keep the accumulator on ties,
+ *  like their comparisons), so the output is identical to calling them one after another.
+ *
+ *  Every window length is written for every frame, so each input value read here feeds one
+ *  output value per statistic; updating the windows of the previous frame instead would do
+ *  the same amount of work and would change the order of the float additions.
+ */
+size_t CRF_InFtrStream_SeqMultiWindow::window_stat_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride,
+		bool emit_sum, bool emit_avg, bool emit_max, bool emit_min)
+{
+	//for win_len=1
+	float* cur_win_in_buf = cur_line_ptr + (avail_max_win_len - 1) * in_width;
+	float* cur_win_out_buf = out_ftr_buf;
+
+	size_t offset = 0;
+	size_t sum_offset = offset;
+	if (emit_sum) offset += in_width;
+	size_t avg_offset = offset;
+	if (emit_avg) offset += in_width;
+	size_t max_offset = offset;
+	if (emit_max) offset += in_width;
+	size_t min_offset = offset;
+	if (emit_min) offset += in_width;
+
+	float* acc_sum = this->acc_sum_buf;
+	float* acc_max = this->acc_max_buf;
+	float* acc_min = this->acc_min_buf;
+	for (size_t acc_i = 0; acc_i < in_width; acc_i++)
+	{
+		acc_sum[acc_i] = 0.0f;
+		acc_max[acc_i] = cur_win_in_buf[acc_i];
+		acc_min[acc_i] = cur_win_in_buf[acc_i];
+	}
+
+	for (QNUInt32 cur_win_len = 1; cur_win_len <= avail_max_win_len; cur_win_len++)
+	{
+		float* sum_out = cur_win_out_buf + sum_offset;
+		float* avg_out = cur_win_out_buf + avg_offset;
+		float* max_out = cur_win_out_buf + max_offset;
+		float* min_out = cur_win_out_buf + min_offset;
+		size_t ftr_i = 0;
+#ifdef __SSE__
+		const __m128 len_v = _mm_set1_ps((float) cur_win_len);
+		for (; ftr_i + 4 <= in_width; ftr_i += 4)
+		{
+			__m128 in_v = _mm_loadu_ps(cur_win_in_buf + ftr_i);
+			__m128 sum_v = _mm_add_ps(_mm_loadu_ps(acc_sum + ftr_i), in_v);
+			__m128 max_v = _mm_max_ps(in_v, _mm_loadu_ps(acc_max + ftr_i));
+			__m128 min_v = _mm_min_ps(in_v, _mm_loadu_ps(acc_min + ftr_i));
+			_mm_storeu_ps(acc_sum + ftr_i, sum_v);
+			_mm_storeu_ps(acc_max + ftr_i, max_v);
+			_mm_storeu_ps(acc_min + ftr_i, min_v);
+			if (emit_sum) _mm_storeu_ps(sum_out + ftr_i, sum_v);
+			if (emit_avg) _mm_storeu_ps(avg_out + ftr_i, _mm_div_ps(sum_v, len_v));
+			if (emit_max) _mm_storeu_ps(max_out + ftr_i, max_v);
+			if (emit_min) _mm_storeu_ps(min_out + ftr_i, min_v);
+		}
+#endif
+		for (; ftr_i < in_width; ftr_i++)
+		{
+			float in = cur_win_in_buf[ftr_i];
+			acc_sum[ftr_i] += in;
+			if (in > acc_max[ftr_i])
+			{
+				acc_max[ftr_i] = in;
+			}
+			if (in < acc_min[ftr_i])
+			{
+				acc_min[ftr_i] = in;
+			}
+			if (emit_sum) sum_out[ftr_i] = acc_sum[ftr_i];
+			if (emit_avg) avg_out[ftr_i] = acc_sum[ftr_i] / cur_win_len;
+			if (emit_max) max_out[ftr_i] = acc_max[ftr_i];
+			if (emit_min) min_out[ftr_i] = acc_min[ftr_i];
+		}
+		cur_win_in_buf -= in_width;
+		cur_win_out_buf += stride;
+	}
+
+	return offset;
+}
+
 /*
  *  CRF_InFtrStream_SeqMultiWindow::kl_ftrs
  *
@@ -775,7 +915,16 @@ size_t CRF_InFtrStream_SeqMultiWindow::kl_ftrs(float* out_ftr_buf, size_t avail_
 		} else {
 			float* cur_frame = cur_win_in_buf;
 			float* next_frame = cur_frame + in_width;
-			float cur_kl_div = get_kl_div(cur_frame, next_frame, in_width);
+			// the same frame pair comes back for every longer window and every later
+			// frame, the cache computes it once
+			size_t cur_frame_line = (cur_frame - max_win_buf) / in_width;
+			float cur_kl_div;
+			if (kl_cache->hasZero(max_win_buf, cur_frame_line) || kl_cache->hasZero(max_win_buf, cur_frame_line + 1))
+			{
+				cur_kl_div = get_kl_div(cur_frame, next_frame, in_width);
+			} else {
+				cur_kl_div = kl_cache->getNextKL(max_win_buf, cur_frame_line);
+			}
 			acc_kl_div += cur_kl_div;
 			if (cur_kl_div > max_kl_div)
 			{
@@ -808,6 +957,27 @@ size_t CRF_InFtrStream_SeqMultiWindow::kl_ftrs(float* out_ftr_buf, size_t avail_
 	return 3;        //TODO: Currently hard-coded. Need to be parameterized.
 }
 
+/*
+ *  CRF_InFtrStream_SeqMultiWindow::frame_kl_div
+ *
+ *  Input: P: frame in max_win_buf for P(x)
+ *         Q: frame in max_win_buf for Q(x)
+ *
+ *  Return: KL-divergence: KL(P(x)||Q(x)), from the logs cached in kl_cache,
+ *          or from get_kl_div() if either frame has a zero probability
+ *
+ */
+float CRF_InFtrStream_SeqMultiWindow::frame_kl_div(float* P, float* Q)
+{
+	size_t p_line = (P - max_win_buf) / in_width;
+	size_t q_line = (Q - max_win_buf) / in_width;
+	if (kl_cache->hasZero(max_win_buf, p_line) || kl_cache->hasZero(max_win_buf, q_line))
+	{
+		return get_kl_div(P, Q, in_width);
+	}
+	return kl_cache->getKL(max_win_buf, p_line, q_line);
+}
+
 /*
  *  CRF_InFtrStream_SeqMultiWindow::get_kl_div
  *
@@ -1136,8 +1306,8 @@ size_t CRF_InFtrStream_SeqMultiWindow::boundary_kl_ftrs(float* out_ftr_buf, size
 		float* cur_frames_kl_out_buf = cur_win_out_buf;
 		for (size_t side_frame_idx = 0; side_frame_idx < both_context_len; side_frame_idx++)
 		{
-			cur_frames_kl_out_buf[0] = get_kl_div(cur_left_side_frame_in_buf,
-					cur_left_side_frame_in_buf, in_width);
+			cur_frames_kl_out_buf[0] = frame_kl_div(cur_left_side_frame_in_buf,
+					cur_right_side_frame_in_buf);
 			cur_left_side_frame_in_buf -= in_width;
 			cur_right_side_frame_in_buf += in_width;
 			cur_frames_kl_out_buf += 1;
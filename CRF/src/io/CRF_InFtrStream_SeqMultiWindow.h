@@ -9,6 +9,10 @@
 #define CRF_INFTRSTREAM_SEQMULTIWINDOW_H_
 
 #include "../CRF.h"
+#include "CRF_KLFeatureCache.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 class CRF_InFtrStream_SeqMultiWindow : public QN_InFtrStream {
 
@@ -24,6 +28,9 @@ protected:
 	// true: use boundary-delta-ftr; false: use segment-level features or frame-level context features
 	// if this is true, extract_segment_features must be false.
 	const bool use_boundary_delta_ftrs;
+	// true: add KL divergence features of the posterior frames, avg/max/min KL of adjacent frames
+	// for segment-level features, KL across the segment boundary for frame-level features.
+	const bool use_kl_ftrs;
 
 	// Logging object.
     QN_ClassLogger log;
@@ -67,11 +74,23 @@ protected:
     // The number of the current segment (for debugging).
     long segno;
 
+    // Running sum, maximum and minimum of each input feature for window_stat_ftrs(),
+    // allocated once so that no accumulator is allocated per frame.
+    float* acc_sum_buf;
+    float* acc_max_buf;
+    float* acc_min_buf;
+
+    // Logs and KL divergences of the lines of max_win_buf for kl_ftrs() and boundary_kl_ftrs(),
+    // NULL unless use_kl_ftrs is set.
+    CRF_KLFeatureCache* kl_cache;
+
     size_t sum_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
     size_t sample_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
     size_t avg_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
     size_t max_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
     size_t min_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
+    size_t window_stat_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride,
+    		bool emit_sum, bool emit_avg, bool emit_max, bool emit_min);
     size_t kl_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
     size_t dur_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
 
@@ -84,6 +103,7 @@ protected:
     size_t boundary_kl_ftrs(float* out_ftr_buf, size_t avail_max_win_len, size_t stride);
 
     float get_kl_div(float* P, float* Q, size_t n);
+    float frame_kl_div(float* P, float* Q);
 
 public:
     // modified for context features
@@ -92,7 +112,7 @@ public:
 	            size_t a_max_win_len, size_t a_top_margin,
 	            size_t a_bot_margin, size_t a_left_ctx_len,
 	            size_t a_right_ctx_len, bool a_seg_ftr,
-	            bool a_use_boundary_delta_ftr,
+	            bool a_use_boundary_delta_ftr, bool a_use_kl_ftr,
 	            size_t a_bunch_frames = QN_SIZET_BAD);
 
 	virtual ~CRF_InFtrStream_SeqMultiWindow();
@@ -0,0 +1,66 @@
+#ifndef CRF_INFTRSTREAM_SHUFFLEBUFFER_H_
+#define CRF_INFTRSTREAM_SHUFFLEBUFFER_H_
+/*
+ * CRF_InFtrStream_ShuffleBuffer.h
+ *
+ * Contains the class definitions for CRF_InFtrStream_ShuffleBuffer
+ * Uses the feature stream model/classes defined for the ICSI Quicknet neural networks
+ * package for compatibility with ICSI Quicknet.
+ */
+
+#include "../CRF.h"
+#include "CRF_FeatureStream.h"
+#include "CRF_ShuffleOrder.h"
+#include <vector>
+
+/*
+ * class CRF_InFtrStream_ShuffleBuffer
+ *
+ * Presents the segments of a feature stream in a random order without seeking in it.  The
+ * underlying stream is read strictly sequentially into an in-memory buffer of whole segments,
+ * and segments are presented from the buffer in the order given by CRF_ShuffleOrder.  The order
+ * is reproducible from the seed and changes with each epoch, as for CRF_InFtrStream_RandPresent.
+ *
+ * The segments of one stream are read in large contiguous runs, so this is the presentation order
+ * to use when the features come through windowed, delta-ed or normalized streams where every
+ * set_pos() is expensive.
+ *
+ * set_range() restricts the wrapper to a contiguous range of segments of the underlying stream,
+ * which is how each thread of a multi-threaded trainer shuffles its own share of the corpus.
+ */
+class CRF_InFtrStream_ShuffleBuffer : public QN_InFtrStream
+{
+protected:
+	QN_ClassLogger log;         // Logging object.
+	QN_InFtrStream& str;        // The stream we filtering.
+	CRF_ShuffleOrder order;		// Presentation order of the current epoch
+	QNUInt32 seed;				// Random number seed
+	size_t epoch;
+	size_t width;
+	size_t first_seg;			// First segment of str in the shuffled range
+	size_t max_segs;			// Number of segments in the shuffled range
+	size_t cur_seg;				// Presentation index of the current segment
+	size_t real_seg;			// Segment number of the current segment
+	size_t next_read;			// Next segment to read from str
+	size_t cur_slot;
+	size_t cur_frame;
+	vector< vector<float> > slots;	// Buffered segments
+	vector<size_t> freeSlots;
+	vector<size_t> segSlot;			// Slot of each buffered segment, QN_SIZET_BAD if not buffered
+	virtual void readNext();
+public:
+	CRF_InFtrStream_ShuffleBuffer(int a_debug, const char* a_classname, const char* a_dbgname,
+									QN_InFtrStream& a_str, size_t buf_segs, QNUInt32 seed=0);
+	virtual ~CRF_InFtrStream_ShuffleBuffer();
+	virtual void set_range(size_t first, size_t count);
+	size_t num_ftrs();
+	QN_SegID nextseg();
+	size_t read_ftrs(size_t cnt, float* ftrs);
+	int rewind();
+	size_t num_segs();
+	size_t num_frames(size_t segno = QN_ALL);
+	int get_pos(size_t* segno, size_t* frameno);
+	QN_SegID set_pos(size_t segno, size_t frameno);
+};
+
+#endif /*CRF_INFTRSTREAM_SHUFFLEBUFFER_H_*/
@@ -0,0 +1,290 @@
+/*
+ * CRF_InLabStream_ShuffleBuffer.cpp
+ *
+ */
+#include "CRF_InLabStream_ShuffleBuffer.h"
+
+// frames read from the underlying stream per call when buffering a segment
+#define CRF_SHUFFLE_READ_FRAMES 256
+
+/*
+ * CRF_InLabStream_ShuffleBuffer constructor
+ *
+ * Input: a_debug - debug flag
+ *        a_classname - debug class name
+ *        a_dbgname - debug filename
+ *        a_str - input label stream
+ *        buf_segs - number of segments held in the shuffle buffer
+ *        seed - random seed for the presentation order
+ *
+ */
+CRF_InLabStream_ShuffleBuffer::CRF_InLabStream_ShuffleBuffer(int a_debug,
+														const char* a_classname,
+														const char* a_dbgname,
+														QN_InLabStream& a_str,
+														size_t buf_segs,
+														QNUInt32 seed)
+		: log(a_debug, a_classname, a_dbgname),
+		  str(a_str),
+		  order(buf_segs),
+		  seed(seed),
+		  epoch(0),
+		  width(a_str.num_labs()),
+		  first_seg(0)
+{
+	this->max_segs=a_str.num_segs();
+	if (this->max_segs == QN_SIZET_BAD) {
+		string errstr="CRF_InLabStream_ShuffleBuffer::CRF_InLabStream_ShuffleBuffer() caught exception: the shuffled order needs a stream with a known number of segments";
+		throw runtime_error(errstr);
+	}
+	size_t nslots=(buf_segs < this->max_segs)?buf_segs:this->max_segs;
+	this->slots.resize(nslots);
+	this->rewind();
+}
+
+/*
+ *  CRF_InLabStream_ShuffleBuffer destructor
+ */
+CRF_InLabStream_ShuffleBuffer::~CRF_InLabStream_ShuffleBuffer()
+{
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::set_range
+ *
+ * Input: first - first segment of the underlying stream to present
+ *        count - number of segments to present, QN_ALL for all the segments from first on
+ *
+ * Restricts the wrapper to segments [first, first+count) of the underlying stream, which are
+ * then presented as segments 0 to count-1 in a shuffled order, and rewinds.  The underlying
+ * stream is positioned at first with set_pos() on each rewind, or skipped forward to it with
+ * nextseg() if it cannot seek; the segments before first are never read into the buffer.
+ */
+void CRF_InLabStream_ShuffleBuffer::set_range(size_t first, size_t count)
+{
+	size_t total=str.num_segs();
+	if (first > total || (count != QN_ALL && first+count > total)) {
+		string errstr="CRF_InLabStream_ShuffleBuffer::set_range() caught exception: range out of bounds";
+		throw runtime_error(errstr);
+	}
+	this->first_seg=first;
+	this->max_segs=(count == QN_ALL)?(total-first):count;
+	size_t buf_segs=this->order.getBufSegs();
+	size_t nslots=(buf_segs < this->max_segs)?buf_segs:this->max_segs;
+	this->slots.resize(nslots);
+	this->rewind();
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::readNext
+ *
+ * Reads the next segment of the underlying stream into a free slot of the buffer.
+ */
+void CRF_InLabStream_ShuffleBuffer::readNext()
+{
+	if (str.nextseg() == QN_SEGID_BAD) {
+		string errstr="CRF_InLabStream_ShuffleBuffer::readNext() caught exception: segment " + stringify(this->next_read) + " could not be read";
+		throw runtime_error(errstr);
+	}
+	if (this->freeSlots.empty()) {
+		string errstr="CRF_InLabStream_ShuffleBuffer::readNext() caught exception: shuffle buffer overflow";
+		throw runtime_error(errstr);
+	}
+	size_t slot=this->freeSlots.back();
+	this->freeSlots.pop_back();
+	vector<QNUInt32>& buf=this->slots[slot];
+	buf.clear();
+	size_t cnt;
+	do {
+		size_t old_size=buf.size();
+		buf.resize(old_size+CRF_SHUFFLE_READ_FRAMES*this->width);
+		cnt=str.read_labs(CRF_SHUFFLE_READ_FRAMES, &buf[old_size]);
+		if (cnt == QN_SIZET_BAD) {
+			cnt=0;
+		}
+		buf.resize(old_size+cnt*this->width);
+	} while (cnt == CRF_SHUFFLE_READ_FRAMES);
+	this->segSlot[this->next_read]=slot;
+	this->next_read++;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::num_labs
+ *
+ * Returns: number of labels in label stream
+ *
+ */
+size_t CRF_InLabStream_ShuffleBuffer::num_labs()
+{
+	return this->width;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::nextseg
+ *
+ * Returns: segment id of the current segment
+ *
+ * Moves to the next segment of the presentation order, reading the underlying stream forward
+ * until that segment is in the buffer.  The slot of the previous segment is given back to the
+ * buffer.
+ *
+ */
+QN_SegID CRF_InLabStream_ShuffleBuffer::nextseg()
+{
+	if (this->cur_slot != QN_SIZET_BAD) {
+		this->segSlot[this->real_seg]=QN_SIZET_BAD;
+		this->freeSlots.push_back(this->cur_slot);
+		this->cur_slot=QN_SIZET_BAD;
+	}
+	if (this->cur_seg >= this->order.size()) {
+		return QN_SEGID_BAD;
+	}
+	this->real_seg=this->order.at(this->cur_seg);
+	this->cur_seg++;
+	while (this->segSlot[this->real_seg] == QN_SIZET_BAD) {
+		this->readNext();
+	}
+	this->cur_slot=this->segSlot[this->real_seg];
+	this->cur_frame=0;
+	return this->real_seg;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::read_labs
+ *
+ * Input: cnt - number of frames of labels to read
+ *        *labs - buffer to store read labels in
+ *
+ * Returns: number of frames read from the current segment
+ *
+ */
+size_t CRF_InLabStream_ShuffleBuffer::read_labs(size_t cnt, QNUInt32* labs)
+{
+	return this->read_labs(cnt, labs, this->width);
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::read_labs
+ *
+ * Input: cnt - number of frames of labels to read
+ *        *labs - buffer to store read labels in
+ *        stride - distance between the labels of consecutive frames in *labs
+ *
+ * Returns: number of frames read from the current segment
+ *
+ */
+size_t CRF_InLabStream_ShuffleBuffer::read_labs(size_t cnt, QNUInt32* labs, size_t stride)
+{
+	if (this->cur_slot == QN_SIZET_BAD || this->width == 0) {
+		return 0;
+	}
+	const vector<QNUInt32>& buf=this->slots[this->cur_slot];
+	size_t avail=buf.size()/this->width-this->cur_frame;
+	size_t n=(cnt < avail)?cnt:avail;
+	if (labs != NULL) {
+		for (size_t i=0; i<n; i++) {
+			memcpy(labs+i*stride, &buf[(this->cur_frame+i)*this->width], this->width*sizeof(QNUInt32));
+		}
+	}
+	this->cur_frame+=n;
+	return n;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::rewind
+ *
+ * Rewinds the underlying stream back to the first segment of the range and empties the buffer.  The order of
+ * presentation changes with each epoch; the seed makes it reproducible.
+ */
+int CRF_InLabStream_ShuffleBuffer::rewind()
+{
+	this->cur_seg=0;
+	this->epoch++;
+	this->order.generate(this->max_segs, 12345*this->epoch+this->seed);
+	this->next_read=0;
+	this->cur_slot=QN_SIZET_BAD;
+	this->cur_frame=0;
+	this->freeSlots.clear();
+	for (size_t i=0; i<this->slots.size(); i++) {
+		this->freeSlots.push_back(i);
+	}
+	this->segSlot.assign(this->max_segs, QN_SIZET_BAD);
+	int ec=str.rewind();
+	if (ec == QN_OK && this->first_seg > 0 && str.set_pos(this->first_seg-1,0) == QN_SEGID_BAD) {
+		ec=str.rewind();
+		for (size_t i=0; i<this->first_seg; i++) {
+			str.nextseg();
+		}
+	}
+	return ec;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::num_segs
+ *
+ * Returns number of segments in the stream
+ */
+size_t CRF_InLabStream_ShuffleBuffer::num_segs()
+{
+	return this->max_segs;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::num_frames
+ *
+ * Input: segno - segment number to be quered, relative to the range (see set_range)
+ *
+ * Returns: number of frames of labels in segment segno
+ *
+ */
+size_t CRF_InLabStream_ShuffleBuffer::num_frames(size_t segno)
+{
+	if (segno != QN_ALL) {
+		return str.num_frames(this->first_seg+segno);
+	}
+	if (this->first_seg == 0 && this->max_segs == str.num_segs()) {
+		return str.num_frames(QN_ALL);
+	}
+	size_t frames=0;
+	for (size_t i=0; i<this->max_segs; i++) {
+		size_t n=str.num_frames(this->first_seg+i);
+		if (n == QN_SIZET_BAD) {
+			return QN_SIZET_BAD;
+		}
+		frames+=n;
+	}
+	return frames;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::get_pos
+ *
+ * Input: *segno - paramter to store segment number
+ *        *frameno - parameter to store frame number
+ *
+ * Returns: QN_OK, or QN_BAD before the first segment
+ *
+ */
+int CRF_InLabStream_ShuffleBuffer::get_pos(size_t* segno, size_t* frameno)
+{
+	if (this->cur_slot == QN_SIZET_BAD) {
+		return QN_BAD;
+	}
+	*segno=this->real_seg;
+	*frameno=this->cur_frame;
+	return QN_OK;
+}
+
+/*
+ * CRF_InLabStream_ShuffleBuffer::set_pos
+ *
+ * Returns: QN_SEGID_BAD
+ *
+ * The buffered stream cannot seek; callers fall back to skipping segments with nextseg()
+ * (see CRF_FeatureStream::rewind()).  To present only part of the underlying stream, use
+ * set_range(), which seeks in the underlying stream instead.
+ */
+QN_SegID CRF_InLabStream_ShuffleBuffer::set_pos(size_t segno, size_t frameno)
+{
+	return QN_SEGID_BAD;
+}
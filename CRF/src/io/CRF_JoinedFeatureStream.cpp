@@ -0,0 +1,283 @@
+/*
+ * CRF_JoinedFeatureStream.cpp
+ *
+ */
+
+#include "CRF_JoinedFeatureStream.h"
+#include "../utils/CRF_MemStats.h"
+
+/*
+ * CRF_JoinedFeatureStream constructor
+ *
+ * Input: srcs - feature streams to join, in feature order
+ *        lab - label stream pre-created as a QN_InLabStream object (NULL when decoding)
+ *        dbg, offset, segs - see CRF_FeatureStream constructor
+ */
+CRF_JoinedFeatureStream::CRF_JoinedFeatureStream(vector<QN_InFtrStream*>& srcs, QN_InLabStream* lab,
+		int dbg, QNUInt32 offset, QNUInt32 segs)
+	: CRF_FeatureStream(srcs.at(0), lab, dbg, offset, segs),
+	  sources(srcs),
+	  blocks(srcs.size(),(float*)NULL),
+	  blockFrames(srcs.size(),0),
+	  totalWidth(0),
+	  segFrames(0),
+	  curFrame(0)
+{
+	if (srcs.size() > CRF_MAX_FTR_BLOCKS) {
+		char errstr[1024];
+		sprintf(errstr, "CRF_JoinedFeatureStream constructor caught exception: %lu feature streams joined, at most %d are supported.",
+				(unsigned long)srcs.size(), CRF_MAX_FTR_BLOCKS);
+		throw runtime_error(errstr);
+	}
+	for (QNUInt32 k=0; k<this->sources.size(); k++) {
+		this->widths.push_back(this->sources[k]->num_ftrs());
+		this->totalWidth+=this->widths[k];
+	}
+}
+
+/*
+ * CRF_JoinedFeatureStream destructor
+ *
+ * Frees the blocks.  The source streams belong to the caller.
+ */
+CRF_JoinedFeatureStream::~CRF_JoinedFeatureStream()
+{
+	for (QNUInt32 k=0; k<this->blocks.size(); k++) {
+		delete [] this->blocks[k];
+		CRF_MemStats::release(MEM_FEATURES,this->blockFrames[k]*this->widths[k]*sizeof(float));
+	}
+}
+
+/*
+ * CRF_JoinedFeatureStream::clearSegment
+ *
+ * Forgets the frames of the current segment; the blocks are kept for the next one.
+ */
+void CRF_JoinedFeatureStream::clearSegment()
+{
+	this->segFrames=0;
+	this->curFrame=0;
+}
+
+/*
+ * CRF_JoinedFeatureStream::loadSegment
+ *
+ * Reads the rest of the current segment of every source into its block, growing the
+ * block if needed.  All sources must return the same number of frames.
+ */
+void CRF_JoinedFeatureStream::loadSegment()
+{
+	this->clearSegment();
+	for (QNUInt32 k=0; k<this->sources.size(); k++) {
+		QNUInt32 width=this->widths[k];
+		size_t frames=0;
+		while (1) {
+			if (frames == this->blockFrames[k]) {
+				size_t new_frames=(this->blockFrames[k]<128)?256:2*this->blockFrames[k];
+				float* new_block=new float[new_frames*width];
+				if (frames > 0) {
+					memcpy(new_block,this->blocks[k],frames*width*sizeof(float));
+				}
+				delete [] this->blocks[k];
+				CRF_MemStats::update(MEM_FEATURES,this->blockFrames[k]*width*sizeof(float),
+						new_frames*width*sizeof(float));
+				this->blocks[k]=new_block;
+				this->blockFrames[k]=new_frames;
+			}
+			size_t wanted=this->blockFrames[k]-frames;
+			size_t cnt=this->sources[k]->read_ftrs(wanted,this->blocks[k]+frames*width);
+			if (cnt == QN_SIZET_BAD) {
+				cnt=0;
+			}
+			// some streams return short counts before the end of the segment, so only
+			// an empty read ends it
+			if (cnt == 0) break;
+			frames+=cnt;
+		}
+		if (k == 0) {
+			this->segFrames=frames;
+		}
+		else if (frames != this->segFrames) {
+			cerr << "CRF_JoinedFeatureStream: feature stream " << k << " has " << frames
+					<< " frames in segment " << this->segid << ", feature stream 0 has "
+					<< this->segFrames << endl;
+			exit(1);
+		}
+	}
+}
+
+/*
+ * CRF_JoinedFeatureStream::nextseg
+ *
+ * Returns: Segment id of the current segment being addressed by the feature stream
+ *
+ * Advances all the sources (and the label stream) to the next segment and reads the
+ * features of the segment into the blocks.
+ */
+QN_SegID CRF_JoinedFeatureStream::nextseg()
+{
+	QN_SegID id=CRF_FeatureStream::nextseg();
+	this->clearSegment();
+	if (id == QN_SEGID_BAD) {
+		return id;
+	}
+	for (QNUInt32 k=1; k<this->sources.size(); k++) {
+		if (this->sources[k]->nextseg() == QN_SEGID_BAD) {
+			cerr << "CRF_JoinedFeatureStream: feature stream " << k << " ended before segment "
+					<< id << endl;
+			exit(1);
+		}
+	}
+	this->loadSegment();
+	return id;
+}
+
+/*
+ * CRF_JoinedFeatureStream::read
+ *
+ * Input:  bs - bunch size - number of frames of features and labels to read
+ *         fb - frame buffer to store read features, bs x num_ftrs()
+ *         lb - frame buffer to store read labels
+ * Returns: number of frames read
+ *
+ * Copies the next frames out of the blocks as contiguous vectors.
+ */
+size_t CRF_JoinedFeatureStream::read(size_t bs, float* fb, QNUInt32* lb)
+{
+	size_t cnt=this->segFrames-this->curFrame;
+	if (cnt > bs) {
+		cnt=bs;
+	}
+	for (size_t i=0; i<cnt; i++) {
+		for (QNUInt32 k=0; k<this->sources.size(); k++) {
+			QNUInt32 width=this->widths[k];
+			memcpy(fb,this->blocks[k]+(this->curFrame+i)*width,width*sizeof(float));
+			fb+=width;
+		}
+	}
+	if (this->lab_stream != NULL) {
+		this->lab_stream->read_labs(bs,lb);
+	}
+	this->curFrame+=cnt;
+	return cnt;
+}
+
+/*
+ * CRF_JoinedFeatureStream::read_view
+ *
+ * Input:  bs - bunch size - number of frames of features and labels to read
+ *         fv - view to fill with the location of the first frame read; the others follow
+ *              at the strides of the view (see CRF_FtrView::next)
+ *         lb - frame buffer to store read labels
+ * Returns: number of frames read
+ */
+size_t CRF_JoinedFeatureStream::read_view(size_t bs, CRF_FtrView* fv, QNUInt32* lb)
+{
+	size_t cnt=this->segFrames-this->curFrame;
+	if (cnt > bs) {
+		cnt=bs;
+	}
+	fv->numBlocks=this->sources.size();
+	for (QNUInt32 k=0; k<this->sources.size(); k++) {
+		fv->base[k]=this->blocks[k]+this->curFrame*this->widths[k];
+		fv->stride[k]=this->widths[k];
+		fv->width[k]=this->widths[k];
+	}
+	if (this->lab_stream != NULL) {
+		this->lab_stream->read_labs(bs,lb);
+	}
+	this->curFrame+=cnt;
+	return cnt;
+}
+
+/*
+ * CRF_JoinedFeatureStream::has_view
+ *
+ * Returns: true, the features can be read in place with read_view()
+ */
+bool CRF_JoinedFeatureStream::has_view()
+{
+	return true;
+}
+
+/*
+ * CRF_JoinedFeatureStream::get_pos
+ *
+ * Input: segno - parameter to store the current segment number
+ *        frameno - parameter to store the current frame number
+ *
+ * Returns: QN_OK, or QN_SIZET_BAD before the first segment
+ */
+int CRF_JoinedFeatureStream::get_pos(size_t* segno, size_t* frameno)
+{
+	*segno=this->segid;
+	if (this->segid==QN_SEGID_BAD) {
+		*frameno=0;
+		return QN_SIZET_BAD;
+	}
+	*frameno=this->curFrame;
+	return QN_OK;
+}
+
+/*
+ * CRF_JoinedFeatureStream::rewind
+ *
+ * Resets all the sources back to the beginning of the view.
+ */
+void CRF_JoinedFeatureStream::rewind()
+{
+	CRF_FeatureStream::rewind();
+	for (QNUInt32 k=1; k<this->sources.size(); k++) {
+		this->rewindFtrStream(this->sources[k]);
+	}
+	this->clearSegment();
+}
+
+/*
+ * CRF_JoinedFeatureStream::num_ftrs
+ *
+ * Returns: Number of features in a joined frame, the sum over the sources
+ */
+QNUInt32 CRF_JoinedFeatureStream::num_ftrs()
+{
+	return this->totalWidth;
+}
+
+/*
+ * CRF_JoinedFeatureStream::set_pos
+ *
+ * Input: segno - segment number to jump to
+ *        frmno - frame number to jump to
+ *
+ * Moves all the sources to segment segno and reads the segment from frame frmno on.
+ */
+void CRF_JoinedFeatureStream::set_pos(QNUInt32 segno, QNUInt32 frmno)
+{
+	CRF_FeatureStream::set_pos(segno,frmno);
+	for (QNUInt32 k=1; k<this->sources.size(); k++) {
+		this->sources[k]->set_pos(segno+this->start_offset,frmno);
+	}
+	this->loadSegment();
+}
+
+/*
+ * CRF_JoinedFeatureStream::get_sources
+ *
+ * Input: srcs - list to append to
+ *
+ * Appends all the joined streams, so a join of a joined stream stays flat.
+ */
+void CRF_JoinedFeatureStream::get_sources(vector<QN_InFtrStream*>& srcs)
+{
+	srcs.insert(srcs.end(),this->sources.begin(),this->sources.end());
+}
+
+/*
+ * CRF_JoinedFeatureStream::num_sources
+ *
+ * Returns: number of joined streams, i.e. of blocks in a view
+ */
+QNUInt32 CRF_JoinedFeatureStream::num_sources()
+{
+	return this->sources.size();
+}
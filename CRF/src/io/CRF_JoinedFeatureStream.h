@@ -0,0 +1,57 @@
+#ifndef CRF_JOINEDFEATURESTREAM_H_
+#define CRF_JOINEDFEATURESTREAM_H_
+/*
+ * CRF_JoinedFeatureStream.h
+ *
+ * Contains the class definition for CRF_JoinedFeatureStream
+ */
+
+#include "CRF_FeatureStream.h"
+
+/*
+ * class CRF_JoinedFeatureStream
+ * subclass of CRF_FeatureStream
+ *
+ * Concatenation of the features of several streams (ftr1_file, ftr2_file, ...), frame by
+ * frame.  Replaces a stack of QN_InFtrStream_JoinFtrs, which copies every frame of every
+ * source through a temporary buffer on each read.
+ *
+ * nextseg() reads the whole segment of each source, once, into a block of its own (frames x
+ * source width).  read_view() then hands out the frames in place as a CRF_FtrView, one block
+ * pointer and stride per source, which the feature maps and the frame-level state nodes use
+ * without copying.  read() still returns interleaved frames for the callers that need one
+ * contiguous vector.
+ *
+ * The blocks are kept from one segment to the next and only grow, so the stream stops
+ * allocating once it has seen its longest segment.  Views stay valid until the next call to
+ * nextseg(), rewind() or set_pos().
+ */
+class CRF_JoinedFeatureStream : public CRF_FeatureStream
+{
+protected:
+	vector<QN_InFtrStream*> sources;
+	vector<float*> blocks;
+	vector<size_t> blockFrames;
+	vector<QNUInt32> widths;
+	QNUInt32 totalWidth;
+	size_t segFrames;
+	size_t curFrame;
+	virtual void loadSegment();
+	virtual void clearSegment();
+public:
+	CRF_JoinedFeatureStream(vector<QN_InFtrStream*>& srcs, QN_InLabStream* lab, int dbg=0,
+			QNUInt32 offset=0, QNUInt32 segs=QN_ALL);
+	virtual ~CRF_JoinedFeatureStream();
+	virtual QN_SegID nextseg();
+	virtual size_t read(size_t bs, float* fb, QNUInt32* lb);
+	virtual size_t read_view(size_t bs, CRF_FtrView* fv, QNUInt32* lb);
+	virtual bool has_view();
+	virtual int get_pos(size_t* segno, size_t* frameno);
+	virtual void rewind();
+	virtual QNUInt32 num_ftrs();
+	virtual void set_pos(QNUInt32 segno, QNUInt32 frmno);
+	virtual void get_sources(vector<QN_InFtrStream*>& srcs);
+	virtual QNUInt32 num_sources();
+};
+
+#endif /*CRF_JOINEDFEATURESTREAM_H_*/
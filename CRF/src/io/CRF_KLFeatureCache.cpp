@@ -0,0 +1,182 @@
+/*
+ * CRF_KLFeatureCache.cpp
+ *
+ */
+
+#include "CRF_KLFeatureCache.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * CRF_KLFeatureCache constructor
+ *
+ * Input: max_lines - number of lines in the window buffer
+ *        width_in - number of features in one line
+ */
+CRF_KLFeatureCache::CRF_KLFeatureCache(size_t max_lines, size_t width_in)
+	: maxLines(max_lines),
+	  width(width_in),
+	  logBuf(new float[max_lines*width_in]),
+	  nextKL(max_lines, 0.0f),
+	  logValid(max_lines, 0),
+	  nextValid(max_lines, 0),
+	  zeroFlag(max_lines, 0)
+{
+}
+
+/*
+ * CRF_KLFeatureCache destructor
+ */
+CRF_KLFeatureCache::~CRF_KLFeatureCache()
+{
+	delete [] this->logBuf;
+}
+
+/*
+ * CRF_KLFeatureCache::invalidate
+ *
+ * Input: first_line - first line of the buffer that was overwritten
+ *        nlines - number of lines overwritten
+ *
+ * Drops the cached values of the lines, and the KL between the line before first_line and
+ * first_line.
+ */
+void CRF_KLFeatureCache::invalidate(size_t first_line, size_t nlines)
+{
+	size_t end = first_line + nlines;
+	if (end > this->maxLines) {
+		end = this->maxLines;
+	}
+	for (size_t line = first_line; line < end; line++) {
+		this->logValid[line] = 0;
+		this->nextValid[line] = 0;
+	}
+	if (first_line > 0 && first_line <= this->maxLines) {
+		this->nextValid[first_line - 1] = 0;
+	}
+}
+
+/*
+ * CRF_KLFeatureCache::shift
+ *
+ * Input: from_line - first line moved
+ *        nlines - number of lines moved
+ *
+ * Follows the window buffer moving lines from_line .. from_line+nlines-1 to lines
+ * 0 .. nlines-1.  The rest of the lines are invalidated.
+ */
+void CRF_KLFeatureCache::shift(size_t from_line, size_t nlines)
+{
+	if (from_line > 0) {
+		memmove(this->logBuf, this->logBuf + from_line * this->width, nlines * this->width * sizeof(float));
+		for (size_t line = 0; line < nlines; line++) {
+			this->nextKL[line] = this->nextKL[from_line + line];
+			this->logValid[line] = this->logValid[from_line + line];
+			this->nextValid[line] = this->nextValid[from_line + line];
+			this->zeroFlag[line] = this->zeroFlag[from_line + line];
+		}
+	}
+	this->invalidate(nlines, this->maxLines - nlines);
+}
+
+/*
+ * CRF_KLFeatureCache::computeLine
+ *
+ * Input: buf - window buffer
+ *        line - line of buf
+ *
+ * Takes the logs of a line.  Zero probabilities get a log of 0 and flag the line, see
+ * hasZero().
+ */
+void CRF_KLFeatureCache::computeLine(const float* buf, size_t line)
+{
+	const float* P = buf + line * this->width;
+	float* logP = this->logBuf + line * this->width;
+	char zero = 0;
+	for (size_t i = 0; i < this->width; i++) {
+		if (P[i] != 0.0f) {
+			logP[i] = logE(P[i]);
+		}
+		else {
+			logP[i] = 0.0f;
+			zero = 1;
+		}
+	}
+	this->zeroFlag[line] = zero;
+	this->logValid[line] = 1;
+}
+
+/*
+ * CRF_KLFeatureCache::hasZero
+ *
+ * Returns: true if a feature of the line is 0
+ */
+bool CRF_KLFeatureCache::hasZero(const float* buf, size_t line)
+{
+	if (!this->logValid[line]) {
+		this->computeLine(buf, line);
+	}
+	return this->zeroFlag[line] != 0;
+}
+
+/*
+ * CRF_KLFeatureCache::getKL
+ *
+ * Input: buf - window buffer
+ *        p_line, q_line - lines of buf holding P(x) and Q(x)
+ *
+ * Returns: KL(P(x)||Q(x)), for lines without zero probabilities
+ *
+ * Sums P(x) (log P(x) - log Q(x)) in double, so that frames that are nearly the same give a
+ * small KL rather than the rounding error of two nearly equal sums, and clamps it at 0.
+ */
+float CRF_KLFeatureCache::getKL(const float* buf, size_t p_line, size_t q_line)
+{
+	if (!this->logValid[p_line]) {
+		this->computeLine(buf, p_line);
+	}
+	if (!this->logValid[q_line]) {
+		this->computeLine(buf, q_line);
+	}
+	const float* P = buf + p_line * this->width;
+	const float* logP = this->logBuf + p_line * this->width;
+	const float* logQ = this->logBuf + q_line * this->width;
+	double kl = 0.0;
+	size_t i = 0;
+#ifdef __SSE2__
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	for (; i + 4 <= this->width; i += 4) {
+		__m128 p = _mm_loadu_ps(P + i);
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(logP + i), _mm_loadu_ps(logQ + i));
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_cvtps_pd(p), _mm_cvtps_pd(d)));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(p, p)), _mm_cvtps_pd(_mm_movehl_ps(d, d))));
+	}
+	double part[2];
+	_mm_storeu_pd(part, _mm_add_pd(acc0, acc1));
+	kl = part[0] + part[1];
+#endif
+	for (; i < this->width; i++) {
+		kl += (double)P[i] * (logP[i] - logQ[i]);
+	}
+	return (kl > 0.0) ? (float)kl : 0.0f;
+}
+
+/*
+ * CRF_KLFeatureCache::getNextKL
+ *
+ * Input: buf - window buffer
+ *        line - line of buf
+ *
+ * Returns: KL between line and line+1, computed once while both stay in the buffer
+ */
+float CRF_KLFeatureCache::getNextKL(const float* buf, size_t line)
+{
+	if (!this->nextValid[line]) {
+		this->nextKL[line] = this->getKL(buf, line, line + 1);
+		this->nextValid[line] = 1;
+	}
+	return this->nextKL[line];
+}
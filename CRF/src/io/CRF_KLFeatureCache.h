@@ -0,0 +1,49 @@
+#ifndef CRF_KLFEATURECACHE_H_
+#define CRF_KLFEATURECACHE_H_
+/*
+ * CRF_KLFeatureCache.h
+ *
+ * Contains the class definition for CRF_KLFeatureCache
+ */
+
+#include "../CRF.h"
+#include <vector>
+
+/*
+ * class CRF_KLFeatureCache
+ *
+ * Cache for the KL-divergence window features of CRF_InFtrStream_SeqMultiWindow.  The lines
+ * of the stream's window buffer are posterior frames; for every line the cache keeps log P(x)
+ * of the frame, so that KL(P||Q) = sum_x P(x) (log P(x) - log Q(x)) needs no logs, and the
+ * KL between a line and the next one, which every window of every following frame asks for
+ * again, is kept as well.  Values are computed on first use, so the logs of a frame are taken once per
+ * utterance however many windows and durations cover it.
+ *
+ * The cache mirrors the window buffer line for line: the stream calls invalidate() for the
+ * lines it reads in and shift() when it moves lines to the start of the buffer.
+ *
+ * Frames with a zero probability are flagged by hasZero(); for those the caller falls back
+ * to the element-wise computation, which skips the zero terms.
+ */
+class CRF_KLFeatureCache
+{
+protected:
+	size_t maxLines;
+	size_t width;
+	float* logBuf;
+	vector<float> nextKL;
+	vector<char> logValid;
+	vector<char> nextValid;
+	vector<char> zeroFlag;
+	void computeLine(const float* buf, size_t line);
+public:
+	CRF_KLFeatureCache(size_t max_lines, size_t width_in);
+	virtual ~CRF_KLFeatureCache();
+	virtual void invalidate(size_t first_line, size_t nlines);
+	virtual void shift(size_t from_line, size_t nlines);
+	virtual bool hasZero(const float* buf, size_t line);
+	virtual float getKL(const float* buf, size_t p_line, size_t q_line);
+	virtual float getNextKL(const float* buf, size_t line);
+};
+
+#endif /*CRF_KLFEATURECACHE_H_*/
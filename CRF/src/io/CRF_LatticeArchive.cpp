@@ -0,0 +1,533 @@
+/*
+ * CRF_LatticeArchive.cpp
+ *
+ */
+
+#include "CRF_LatticeArchive.h"
+#include <sstream>
+#include <cstring>
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/*
+ * CRF_LatticeArchiveWriter constructor
+ *
+ * Input: buf_size - size of the write buffer in bytes
+ */
+CRF_LatticeArchiveWriter::CRF_LatticeArchiveWriter(size_t buf_size)
+	: compress(false),
+	  buffer(buf_size),
+	  bufUsed(0),
+	  filePos(0)
+{
+}
+
+/*
+ * CRF_LatticeArchiveWriter destructor
+ *
+ * Writes the index if the archive has not been closed yet.  A write error is only reported,
+ * since it cannot be thrown out of a destructor; call close() to get it as an exception.
+ */
+CRF_LatticeArchiveWriter::~CRF_LatticeArchiveWriter()
+{
+	try {
+		this->close();
+	}
+	catch (exception &e) {
+		cerr << "ERROR: " << e.what() << endl;
+	}
+}
+
+/*
+ * CRF_LatticeArchiveWriter::open
+ *
+ * Input: fname - archive file
+ *        compress - store the entries added from now on compressed
+ *        append - continue the archive if fname already exists
+ */
+void CRF_LatticeArchiveWriter::open(const char* fname, bool compress, bool append)
+{
+	this->close();
+#if !HAVE_LIBZ
+	if (compress) {
+		string errstr="CRF_LatticeArchiveWriter::open() caught exception: compressed archives need a build with zlib";
+		throw runtime_error(errstr);
+	}
+#endif
+	this->fname = fname;
+	this->compress = compress;
+	this->bufUsed = 0;
+	this->entries.clear();
+	this->keyMap.clear();
+
+	bool exists = false;
+	if (append) {
+		ifstream ifile(fname, ios::in | ios::binary);
+		if (ifile.is_open()) {
+			exists = true;
+			uint64_t index_offset;
+			if (!CRF_LatticeArchiveReader::readIndex(ifile, this->entries, index_offset)) {
+				string errstr="CRF_LatticeArchiveWriter::open() caught exception: " + string(fname) +
+						" is not a complete lattice archive, cannot append to it";
+				throw runtime_error(errstr);
+			}
+			for (QNUInt32 i = 0; i < this->entries.size(); i++) {
+				this->keyMap[this->entries[i].key] = i;
+			}
+			this->filePos = index_offset;
+		}
+	}
+	if (exists) {
+		// new records are written over the old index
+		this->ofile.open(fname, ios::in | ios::out | ios::binary);
+		this->ofile.seekp(this->filePos);
+	}
+	else {
+		this->ofile.open(fname, ios::out | ios::trunc | ios::binary);
+	}
+	if (!this->ofile.is_open()) {
+		string errstr="CRF_LatticeArchiveWriter::open() caught exception: cannot open the file:\n";
+		errstr += string(fname) + "\n";
+		throw runtime_error(errstr);
+	}
+	if (!exists) {
+		QNUInt32 header[2];
+		header[0] = CRF_LATTICEARCHIVE_MAGIC;
+		header[1] = CRF_LATTICEARCHIVE_VERSION;
+		this->filePos = 0;
+		this->put((const char*)header, sizeof(header));
+	}
+}
+
+/*
+ * CRF_LatticeArchiveWriter::put
+ *
+ * Input: data - bytes to append to the archive
+ *        len - number of bytes
+ */
+void CRF_LatticeArchiveWriter::put(const char* data, size_t len)
+{
+	if (this->bufUsed + len > this->buffer.size()) {
+		this->flush();
+	}
+	if (len > this->buffer.size()) {
+		this->ofile.write(data, len);
+	}
+	else {
+		memcpy(&(this->buffer[this->bufUsed]), data, len);
+		this->bufUsed += len;
+	}
+	this->filePos += len;
+}
+
+/*
+ * CRF_LatticeArchiveWriter::flush
+ *
+ * Writes the buffered bytes to the archive file.
+ */
+void CRF_LatticeArchiveWriter::flush()
+{
+	if (this->bufUsed > 0) {
+		this->ofile.write(&(this->buffer[0]), this->bufUsed);
+		this->bufUsed = 0;
+	}
+	if (this->ofile.bad() || this->ofile.fail()) {
+		string errstr="CRF_LatticeArchiveWriter::flush() caught exception: errors when writing the archive:\n";
+		errstr += this->fname + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+	}
+}
+
+/*
+ * CRF_LatticeArchiveWriter::encode
+ *
+ * Input: key - utterance name, for the error message
+ *        data - bytes of the entry
+ *        len - number of bytes
+ *        compress - compress the entry
+ *        stored - set to the bytes to store in the archive
+ *        flags - set to the flags of the entry
+ *
+ * Does not touch any writer, so callers can encode entries in parallel and hand the result to
+ * addEncoded() under their own lock.
+ */
+void CRF_LatticeArchiveWriter::encode(const string& key, const char* data, size_t len, bool compress,
+		string& stored, QNUInt32& flags)
+{
+	flags = 0;
+#if HAVE_LIBZ
+	if (compress) {
+		uLongf zlen = compressBound(len);
+		vector<Bytef> zbuf(zlen);
+		if (compress2(&(zbuf[0]), &zlen, (const Bytef*)data, len, Z_DEFAULT_COMPRESSION) != Z_OK) {
+			string errstr="CRF_LatticeArchiveWriter::encode() caught exception: cannot compress the entry " + key;
+			throw runtime_error(errstr);
+		}
+		stored.assign((const char*)&(zbuf[0]), zlen);
+		flags |= CRF_LATTICEARCHIVE_COMPRESSED;
+		return;
+	}
+#else
+	if (compress) {
+		string errstr="CRF_LatticeArchiveWriter::encode() caught exception: compressed archives need a build with zlib";
+		throw runtime_error(errstr);
+	}
+#endif
+	stored.assign(data, len);
+}
+
+/*
+ * CRF_LatticeArchiveWriter::serializeFst
+ *
+ * Input: key - utterance name
+ *        fst - lattice
+ *        data - set to the lattice in OpenFst binary format
+ */
+void CRF_LatticeArchiveWriter::serializeFst(const string& key, const Fst<StdArc>& fst, string& data)
+{
+	ostringstream ostrm;
+	if (!fst.Write(ostrm, FstWriteOptions(key))) {
+		string errstr="CRF_LatticeArchiveWriter::serializeFst() caught exception: cannot serialize the lattice " + key;
+		throw runtime_error(errstr);
+	}
+	data = ostrm.str();
+}
+
+/*
+ * CRF_LatticeArchiveWriter::addEncoded
+ *
+ * Input: key - utterance name, must not be in the archive yet
+ *        stored - bytes to store, as returned by encode()
+ *        stored_len - number of bytes
+ *        raw_size - size of the entry before compression
+ *        flags - flags of the entry, as returned by encode()
+ */
+void CRF_LatticeArchiveWriter::addEncoded(const string& key, const char* stored, size_t stored_len,
+		uint64_t raw_size, QNUInt32 flags)
+{
+	if (!this->ofile.is_open()) {
+		string errstr="CRF_LatticeArchiveWriter::addEncoded() caught exception: the archive is not open";
+		throw runtime_error(errstr);
+	}
+	if (this->keyMap.find(key) != this->keyMap.end()) {
+		string errstr="CRF_LatticeArchiveWriter::addEncoded() caught exception: key " + key +
+				" is already in the archive " + this->fname;
+		throw runtime_error(errstr);
+	}
+	CRF_LatticeArchiveEntry entry;
+	entry.key = key;
+	entry.rawSize = raw_size;
+	entry.storedSize = stored_len;
+	entry.flags = flags;
+
+	QNUInt32 key_len = key.size();
+	this->put((const char*)&key_len, sizeof(key_len));
+	this->put(key.data(), key_len);
+	this->put((const char*)&(entry.flags), sizeof(entry.flags));
+	this->put((const char*)&(entry.rawSize), sizeof(entry.rawSize));
+	this->put((const char*)&(entry.storedSize), sizeof(entry.storedSize));
+	entry.offset = this->filePos;
+	this->put(stored, entry.storedSize);
+
+	this->keyMap[key] = this->entries.size();
+	this->entries.push_back(entry);
+}
+
+/*
+ * CRF_LatticeArchiveWriter::add
+ *
+ * Input: key - utterance name, must not be in the archive yet
+ *        data - bytes of the entry
+ *        len - number of bytes
+ */
+void CRF_LatticeArchiveWriter::add(const string& key, const char* data, size_t len)
+{
+	if (!this->compress) {
+		this->addEncoded(key, data, len, len, 0);
+		return;
+	}
+	string stored;
+	QNUInt32 flags;
+	encode(key, data, len, true, stored, flags);
+	this->addEncoded(key, stored.data(), stored.size(), len, flags);
+}
+
+/*
+ * CRF_LatticeArchiveWriter::addFst
+ *
+ * Input: key - utterance name
+ *        fst - lattice, stored in OpenFst binary format
+ */
+void CRF_LatticeArchiveWriter::addFst(const string& key, const Fst<StdArc>& fst)
+{
+	string data;
+	serializeFst(key, fst, data);
+	this->add(key, data.data(), data.size());
+}
+
+/*
+ * CRF_LatticeArchiveWriter::close
+ *
+ * Writes the index and the footer and closes the archive file.
+ */
+void CRF_LatticeArchiveWriter::close()
+{
+	if (!this->ofile.is_open()) {
+		return;
+	}
+	uint64_t index_offset = this->filePos;
+	for (QNUInt32 i = 0; i < this->entries.size(); i++) {
+		CRF_LatticeArchiveEntry& entry = this->entries[i];
+		QNUInt32 key_len = entry.key.size();
+		this->put((const char*)&key_len, sizeof(key_len));
+		this->put(entry.key.data(), key_len);
+		this->put((const char*)&(entry.offset), sizeof(entry.offset));
+		this->put((const char*)&(entry.rawSize), sizeof(entry.rawSize));
+		this->put((const char*)&(entry.storedSize), sizeof(entry.storedSize));
+		this->put((const char*)&(entry.flags), sizeof(entry.flags));
+	}
+	QNUInt32 footer[2];
+	footer[0] = this->entries.size();
+	footer[1] = CRF_LATTICEARCHIVE_MAGIC;
+	this->put((const char*)&index_offset, sizeof(index_offset));
+	this->put((const char*)footer, sizeof(footer));
+	this->flush();
+	this->ofile.close();
+}
+
+bool CRF_LatticeArchiveWriter::getCompress()
+{
+	return this->compress;
+}
+
+QNUInt32 CRF_LatticeArchiveWriter::getNumEntries()
+{
+	return this->entries.size();
+}
+
+/*
+ * CRF_LatticeArchiveWriter::getBytesWritten
+ *
+ * Returns: size of the archive so far, without the index
+ */
+uint64_t CRF_LatticeArchiveWriter::getBytesWritten()
+{
+	return this->filePos;
+}
+
+/*
+ * CRF_LatticeArchiveReader constructor
+ */
+CRF_LatticeArchiveReader::CRF_LatticeArchiveReader()
+{
+}
+
+/*
+ * CRF_LatticeArchiveReader destructor
+ */
+CRF_LatticeArchiveReader::~CRF_LatticeArchiveReader()
+{
+	this->close();
+}
+
+/*
+ * CRF_LatticeArchiveReader::readIndex
+ *
+ * Input: ifile - open archive file
+ *
+ * Returns: true if ifile is a complete archive; entries is then filled from its index
+ *   and index_offset set to the position of the index
+ */
+bool CRF_LatticeArchiveReader::readIndex(ifstream& ifile, vector<CRF_LatticeArchiveEntry>& entries,
+		uint64_t& index_offset)
+{
+	entries.clear();
+	QNUInt32 header[2];
+	ifile.seekg(0, ios::end);
+	uint64_t file_size = ifile.tellg();
+	if (file_size < sizeof(header) + sizeof(uint64_t) + 2 * sizeof(QNUInt32)) {
+		return false;
+	}
+	ifile.seekg(0, ios::beg);
+	ifile.read((char*)header, sizeof(header));
+	if (ifile.fail() || header[0] != CRF_LATTICEARCHIVE_MAGIC || header[1] != CRF_LATTICEARCHIVE_VERSION) {
+		return false;
+	}
+	QNUInt32 footer[2];
+	ifile.seekg(file_size - sizeof(index_offset) - sizeof(footer), ios::beg);
+	ifile.read((char*)&index_offset, sizeof(index_offset));
+	ifile.read((char*)footer, sizeof(footer));
+	if (ifile.fail() || footer[1] != CRF_LATTICEARCHIVE_MAGIC || index_offset > file_size) {
+		return false;
+	}
+	ifile.seekg(index_offset, ios::beg);
+	entries.resize(footer[0]);
+	for (QNUInt32 i = 0; i < footer[0]; i++) {
+		CRF_LatticeArchiveEntry& entry = entries[i];
+		QNUInt32 key_len = 0;
+		ifile.read((char*)&key_len, sizeof(key_len));
+		if (ifile.fail() || key_len > file_size) {
+			return false;
+		}
+		entry.key.resize(key_len);
+		if (key_len > 0) {
+			ifile.read(&(entry.key[0]), key_len);
+		}
+		ifile.read((char*)&(entry.offset), sizeof(entry.offset));
+		ifile.read((char*)&(entry.rawSize), sizeof(entry.rawSize));
+		ifile.read((char*)&(entry.storedSize), sizeof(entry.storedSize));
+		ifile.read((char*)&(entry.flags), sizeof(entry.flags));
+		if (ifile.fail() || entry.offset + entry.storedSize > index_offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * CRF_LatticeArchiveReader::open
+ *
+ * Input: fname - archive file
+ */
+void CRF_LatticeArchiveReader::open(const char* fname)
+{
+	this->close();
+	this->fname = fname;
+	this->ifile.open(fname, ios::in | ios::binary);
+	if (!this->ifile.is_open()) {
+		string errstr="CRF_LatticeArchiveReader::open() caught exception: cannot open the file " + string(fname);
+		throw runtime_error(errstr);
+	}
+	uint64_t index_offset;
+	if (!readIndex(this->ifile, this->entries, index_offset)) {
+		this->close();
+		string errstr="CRF_LatticeArchiveReader::open() caught exception: " + string(fname) +
+				" is not a complete lattice archive of the current version";
+		throw runtime_error(errstr);
+	}
+	for (QNUInt32 i = 0; i < this->entries.size(); i++) {
+		this->keyMap[this->entries[i].key] = i;
+	}
+}
+
+/*
+ * CRF_LatticeArchiveReader::close
+ */
+void CRF_LatticeArchiveReader::close()
+{
+	if (this->ifile.is_open()) {
+		this->ifile.close();
+	}
+	this->ifile.clear();
+	this->entries.clear();
+	this->keyMap.clear();
+}
+
+QNUInt32 CRF_LatticeArchiveReader::getNumEntries()
+{
+	return this->entries.size();
+}
+
+const CRF_LatticeArchiveEntry& CRF_LatticeArchiveReader::getEntry(QNUInt32 idx)
+{
+	return this->entries.at(idx);
+}
+
+/*
+ * CRF_LatticeArchiveReader::find
+ *
+ * Input: key - utterance name
+ *
+ * Returns: position of the entry in the index, -1 if the key is not in the archive
+ */
+int CRF_LatticeArchiveReader::find(const string& key)
+{
+	map<string,QNUInt32>::iterator it = this->keyMap.find(key);
+	if (it == this->keyMap.end()) {
+		return -1;
+	}
+	return it->second;
+}
+
+/*
+ * CRF_LatticeArchiveReader::read
+ *
+ * Input: idx - position of the entry in the index
+ *        data - filled with the (uncompressed) bytes of the entry
+ */
+void CRF_LatticeArchiveReader::read(QNUInt32 idx, string& data)
+{
+	const CRF_LatticeArchiveEntry& entry = this->entries.at(idx);
+	string stored(entry.storedSize, '\0');
+	this->ifile.clear();
+	this->ifile.seekg(entry.offset, ios::beg);
+	if (entry.storedSize > 0) {
+		this->ifile.read(&(stored[0]), entry.storedSize);
+	}
+	if (this->ifile.fail()) {
+		string errstr="CRF_LatticeArchiveReader::read() caught exception: cannot read the entry " +
+				entry.key + " from " + this->fname;
+		throw runtime_error(errstr);
+	}
+	if ((entry.flags & CRF_LATTICEARCHIVE_COMPRESSED) == 0) {
+		data.swap(stored);
+		return;
+	}
+#if HAVE_LIBZ
+	data.resize(entry.rawSize);
+	uLongf raw_len = entry.rawSize;
+	if (entry.rawSize > 0 &&
+			(uncompress((Bytef*)&(data[0]), &raw_len, (const Bytef*)stored.data(), entry.storedSize) != Z_OK ||
+			raw_len != entry.rawSize)) {
+		string errstr="CRF_LatticeArchiveReader::read() caught exception: cannot uncompress the entry " + entry.key;
+		throw runtime_error(errstr);
+	}
+#else
+	string errstr="CRF_LatticeArchiveReader::read() caught exception: the entry " + entry.key +
+			" is compressed, reading it needs a build with zlib";
+	throw runtime_error(errstr);
+#endif
+}
+
+/*
+ * CRF_LatticeArchiveReader::read
+ *
+ * Input: key - utterance name
+ *        data - filled with the bytes of the entry
+ *
+ * Returns: false if the key is not in the archive
+ */
+bool CRF_LatticeArchiveReader::read(const string& key, string& data)
+{
+	int idx = this->find(key);
+	if (idx < 0) {
+		return false;
+	}
+	this->read((QNUInt32)idx, data);
+	return true;
+}
+
+/*
+ * CRF_LatticeArchiveReader::readFst
+ *
+ * Input: key - utterance name of an entry added with CRF_LatticeArchiveWriter::addFst()
+ *
+ * Returns: the lattice, owned by the caller, NULL if the key is not in the archive
+ */
+VectorFst<StdArc>* CRF_LatticeArchiveReader::readFst(const string& key)
+{
+	string data;
+	if (!this->read(key, data)) {
+		return NULL;
+	}
+	istringstream istrm(data);
+	VectorFst<StdArc>* fst = VectorFst<StdArc>::Read(istrm, FstReadOptions(key));
+	if (fst == NULL) {
+		string errstr="CRF_LatticeArchiveReader::readFst() caught exception: the entry " + key +
+				" is not an fst";
+		throw runtime_error(errstr);
+	}
+	return fst;
+}
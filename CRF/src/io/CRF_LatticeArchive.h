@@ -0,0 +1,116 @@
+/*
+ * CRF_LatticeArchive.h
+ *
+ * Contains the class definitions for CRF_LatticeArchiveWriter and CRF_LatticeArchiveReader
+ * Single-file container for the lattices of a whole test set.
+ */
+#ifndef CRF_LATTICEARCHIVE_H_
+#define CRF_LATTICEARCHIVE_H_
+#include "fst/fstlib.h"
+#include "../CRF.h"
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+using namespace fst;
+using namespace std;
+
+#define CRF_LATTICEARCHIVE_MAGIC 0x41544c43
+#define CRF_LATTICEARCHIVE_VERSION 1
+
+// flags of an archive entry
+#define CRF_LATTICEARCHIVE_COMPRESSED 0x1
+
+/*
+ * struct CRF_LatticeArchiveEntry
+ *
+ * Index entry of one utterance in a lattice archive.
+ */
+struct CRF_LatticeArchiveEntry {
+	string key;			// utterance name
+	uint64_t offset;	// position of the stored bytes in the archive file
+	uint64_t rawSize;	// size of the entry before compression
+	uint64_t storedSize;	// size of the entry in the archive
+	QNUInt32 flags;
+};
+
+/*
+ * Archive layout:
+ *
+ *   header  - magic, version (2 x QNUInt32)
+ *   records - for each entry, in the order added: key length (QNUInt32), key, flags (QNUInt32),
+ *             raw size and stored size (2 x uint64_t), then the stored bytes.  The record headers
+ *             make the entries recoverable if the index was never written.
+ *   index   - for each entry: key length, key, offset of the stored bytes, raw size, stored size
+ *             and flags
+ *   footer  - offset of the index (uint64_t), number of entries, magic (2 x QNUInt32)
+ *
+ * Entries are usually OpenFst binary fsts (addFst()) or HTK SLF text (add()); the archive does
+ * not care what they hold.  Compressed entries are zlib streams and need a build with zlib.
+ */
+
+/*
+ * class CRF_LatticeArchiveWriter
+ *
+ * Appends entries to an archive through a write buffer, and writes the index on close().
+ * Opening an existing archive with append=true continues it: new records overwrite the old
+ * index, which is written again with the new entries on close().  Not thread safe, but the
+ * static encode() and serializeFst() are, so threads can prepare their entries in parallel and
+ * only serialize the addEncoded() calls.
+ */
+class CRF_LatticeArchiveWriter {
+protected:
+	ofstream ofile;
+	string fname;
+	bool compress;
+	vector<char> buffer;
+	size_t bufUsed;
+	uint64_t filePos;		// archive position of the next byte written, including buffered bytes
+	vector<CRF_LatticeArchiveEntry> entries;
+	map<string,QNUInt32> keyMap;
+	virtual void put(const char* data, size_t len);
+	virtual void flush();
+public:
+	CRF_LatticeArchiveWriter(size_t buf_size=1048576);
+	virtual ~CRF_LatticeArchiveWriter();
+	virtual void open(const char* fname, bool compress=false, bool append=false);
+	virtual void add(const string& key, const char* data, size_t len);
+	virtual void addFst(const string& key, const Fst<StdArc>& fst);
+	virtual void addEncoded(const string& key, const char* stored, size_t stored_len, uint64_t raw_size,
+			QNUInt32 flags);
+	virtual void close();
+	virtual bool getCompress();
+	virtual QNUInt32 getNumEntries();
+	virtual uint64_t getBytesWritten();
+	static void encode(const string& key, const char* data, size_t len, bool compress, string& stored,
+			QNUInt32& flags);
+	static void serializeFst(const string& key, const Fst<StdArc>& fst, string& data);
+};
+
+/*
+ * class CRF_LatticeArchiveReader
+ *
+ * Reads the index of an archive on open() and gives random access to its entries by key or
+ * by position in the index.
+ */
+class CRF_LatticeArchiveReader {
+protected:
+	ifstream ifile;
+	string fname;
+	vector<CRF_LatticeArchiveEntry> entries;
+	map<string,QNUInt32> keyMap;
+public:
+	CRF_LatticeArchiveReader();
+	virtual ~CRF_LatticeArchiveReader();
+	virtual void open(const char* fname);
+	virtual void close();
+	virtual QNUInt32 getNumEntries();
+	virtual const CRF_LatticeArchiveEntry& getEntry(QNUInt32 idx);
+	virtual int find(const string& key);
+	virtual void read(QNUInt32 idx, string& data);
+	virtual bool read(const string& key, string& data);
+	virtual VectorFst<StdArc>* readFst(const string& key);
+	static bool readIndex(ifstream& ifile, vector<CRF_LatticeArchiveEntry>& entries, uint64_t& index_offset);
+};
+
+#endif /* CRF_LATTICEARCHIVE_H_ */
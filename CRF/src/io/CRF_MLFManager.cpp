@@ -17,10 +17,18 @@ using namespace fst;
  *        olist - text file containing output tokens in OpenFst format
  *        symtab - OpenFst symbol table of output tokens
  *
+ * If mlffile is a compiled transcript store it is mapped into memory, otherwise it is parsed
+ * as a text MLF.
  */
 CRF_MLFManager::CRF_MLFManager(char* mlffile, char* olist, SymbolTable* symTab)
-	: symTab(symTab){
-	this->readMLF(mlffile);
+	: symTab(symTab), store(NULL) {
+	if (CRF_TranscriptStore::isStoreFile(mlffile)) {
+		this->store = new CRF_TranscriptStore();
+		this->store->open(mlffile);
+	}
+	else {
+		this->readMLF(mlffile);
+	}
 }
 
 /*
@@ -28,6 +36,13 @@ CRF_MLFManager::CRF_MLFManager(char* mlffile, char* olist, SymbolTable* symTab)
  */
 CRF_MLFManager::~CRF_MLFManager() {
 	//cout << "in CRF_MLFManager destructor" << endl;
+	for (QNUInt32 i = 0; i < this->transcripts.size(); i++) {
+		delete this->transcripts[i];
+	}
+	for (QNUInt32 i = 0; i < this->fstCache.size(); i++) {
+		delete this->fstCache[i];
+	}
+	delete this->store;
 }
 
 /*
@@ -44,6 +59,36 @@ string CRF_MLFManager::getKey(string fname) {
 	return(fname.substr(firstc+1,lastc-firstc-1));
 }
 
+/*
+ * CRF_MLFManager::findKey
+ *
+ * Input: fname - file name of the utterance being searched for
+ *
+ * Returns: index of the utterance in the MLF or the transcript store
+ */
+int CRF_MLFManager::findKey(string fname) {
+	string key = this->getKey(fname);
+	if (key == "") {
+		string errstr="Unable to acquire key from filename "+fname;
+		throw runtime_error(errstr);
+	}
+	int idx=-1;
+	if (this->store != NULL) {
+		idx=this->store->find(key);
+	}
+	else {
+		map<string,int>::iterator it=this->fnameTable.find(key);
+		if (it != this->fnameTable.end()) {
+			idx=it->second;
+		}
+	}
+	if (idx < 0) {
+		string errstr="CRF_MLFManager::findKey() caught exception: no transcript for "+fname+" in the MLF";
+		throw runtime_error(errstr);
+	}
+	return idx;
+}
+
 /*
  * CRF_MLFManager::readMLF
  *
@@ -85,6 +130,7 @@ void CRF_MLFManager::readMLF(char* mlffile) {
 					}
 					//cout << "LABEL: " << s << "\t" << key << endl;
 					this->transcripts.push_back(new vector<int>);
+					this->keys.push_back(key);
 					this->fnameTable[key]=count;
 				}
 				else if (s[0]=='.' && s.size()<=1) {
@@ -122,32 +168,67 @@ void CRF_MLFManager::readMLF(char* mlffile) {
  *
  * Input: fname - the filename of the sequence being requested
  *
- * Returns: OpenFst formated VectorFst of the transcript from the MLF
+ * Returns: OpenFst formated VectorFst of the transcript from the MLF, to be deleted by the caller
  *
  */
 StdVectorFst* CRF_MLFManager::getFst(string fname) {
-	string key = this->getKey(fname);
-	if (key == "") {
-		string errstr="Unable to acquire key from filename "+fname;
-		throw runtime_error(errstr);
+	return new StdVectorFst(*(this->getCachedFst(fname)));
+}
+
+/*
+ * CRF_MLFManager::getCachedFst
+ *
+ * Input: fname - the filename of the sequence being requested
+ *
+ * Returns: OpenFst formated VectorFst of the transcript from the MLF.  The fst is built on the
+ *   first request and owned by the CRF_MLFManager; callers must not delete it.  With a
+ *   compiled store only the last fsts are kept (see CRF_TranscriptStore::getFst), so use or
+ *   copy it before the next call.
+ *
+ */
+const StdVectorFst* CRF_MLFManager::getCachedFst(string fname) {
+	int idx=this->findKey(fname);
+	if (this->store != NULL) {
+		return this->store->getFst(idx);
+	}
+	if (this->fstCache.size() != this->transcripts.size()) {
+		this->fstCache.resize(this->transcripts.size(), NULL);
+	}
+	if (this->fstCache[idx] == NULL) {
+		StdVectorFst* fst = new StdVectorFst();
+		StateId startState = fst->AddState();
+		fst->SetStart(startState);
+		StateId prevState=startState;
+		StateId curState;
+
+		//cout << fname << "\t";
+		vector<int>::iterator itNode;
+		for(itNode = this->transcripts.at(idx)->begin(); itNode != this->transcripts.at(idx)->end(); itNode++)
+		{
+			curState=fst->AddState();
+			fst->AddArc(prevState,StdArc(*itNode,*itNode,0,curState));
+			//cout << *itNode << " ";
+			prevState=curState;
+		}
+		fst->SetFinal(prevState,0);
+		//cout << endl;
+		this->fstCache[idx]=fst;
 	}
-	int idx=this->fnameTable[key];
-	StdVectorFst* fst = new StdVectorFst();
-	StateId startState = fst->AddState();
-	fst->SetStart(startState);
-	StateId prevState=startState;
-	StateId curState;
+	return this->fstCache[idx];
+}
 
-	//cout << key << "\t";
-	vector<int>::iterator itNode;
-	for(itNode = this->transcripts.at(idx)->begin(); itNode != this->transcripts.at(idx)->end(); itNode++)
-	{
-		curState=fst->AddState();
-		fst->AddArc(prevState,StdArc(*itNode,*itNode,0,curState));
-		//cout << *itNode << " ";
-		prevState=curState;
+/*
+ * CRF_MLFManager::writeStore
+ *
+ * Input: fname - output file name
+ *
+ * Writes the transcripts read from a text MLF as a compiled CRF_TranscriptStore, which later
+ *   runs can pass in place of the MLF.
+ */
+void CRF_MLFManager::writeStore(const char* fname) {
+	if (this->store != NULL) {
+		string errstr="CRF_MLFManager::writeStore() caught exception: the MLF was already read from a transcript store";
+		throw runtime_error(errstr);
 	}
-	fst->SetFinal(curState,0);
-	//cout << endl;
-	return fst;
+	CRF_TranscriptStore::write(fname, this->keys, this->transcripts);
 }
@@ -12,6 +12,7 @@
 #include "fst/fstlib.h"
 #include <stdexcept>
 #include <vector>
+#include "CRF_TranscriptStore.h"
 
 using namespace fst;
 using namespace std;
@@ -20,6 +21,8 @@ using namespace std;
  * class CRF_MLFManager
  *
  * Reads the MLF file format used by HTK.  Uses the MLF to generate lattices in OpenFST format.
+ * The MLF may also be given as a compiled CRF_TranscriptStore (see writeStore()), which is
+ * mapped into memory instead of parsed.
  *
  */
 
@@ -28,12 +31,18 @@ private:
 	SymbolTable* symTab;
 	vector< vector<int>* > transcripts;
 	map<string,int > fnameTable;
+	vector<string> keys;
+	vector<StdVectorFst*> fstCache;
+	CRF_TranscriptStore* store;
 	string getKey(string fname);
+	int findKey(string fname);
 public:
 	CRF_MLFManager(char* mlffile, char* olist, SymbolTable* symTab);
 	virtual ~CRF_MLFManager();
 	void readMLF(char* mlffile);
 	StdVectorFst* getFst(string fname);
+	const StdVectorFst* getCachedFst(string fname);
+	void writeStore(const char* fname);
 };
 
 #endif /* CRF_MLFMANAGER_H_ */
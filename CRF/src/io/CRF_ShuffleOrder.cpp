@@ -0,0 +1,97 @@
+/*
+ * CRF_ShuffleOrder.cpp
+ *
+ */
+
+#include "CRF_ShuffleOrder.h"
+#include <stdlib.h>
+
+/*
+ * CRF_ShuffleOrder constructor
+ *
+ * Input: buf_segs - number of segments held by the shuffle buffer
+ */
+CRF_ShuffleOrder::CRF_ShuffleOrder(size_t buf_segs)
+	: bufSegs(buf_segs)
+{
+	if (buf_segs == 0) {
+		string errstr="CRF_ShuffleOrder::CRF_ShuffleOrder() caught exception: the shuffle buffer must hold at least one segment";
+		throw runtime_error(errstr);
+	}
+}
+
+/*
+ * CRF_ShuffleOrder destructor
+ */
+CRF_ShuffleOrder::~CRF_ShuffleOrder()
+{
+}
+
+/*
+ * CRF_ShuffleOrder::generate
+ *
+ * Input: num_segs - number of segments in the stream
+ *        seed - random seed for this epoch
+ *
+ * Simulates the shuffle buffer over the whole stream and stores the resulting presentation
+ * order.  Uses its own rand48 state so that the order is reproducible from the seed alone.
+ */
+void CRF_ShuffleOrder::generate(size_t num_segs, QNUInt32 seed)
+{
+	unsigned short xsubi[3];
+	xsubi[0]=0x330E;
+	xsubi[1]=(unsigned short)(seed & 0xFFFF);
+	xsubi[2]=(unsigned short)(seed >> 16);
+
+	this->order.clear();
+	this->order.reserve(num_segs);
+	vector<size_t> pool;
+	pool.reserve(this->bufSegs);
+	size_t next_seg=0;
+	while (next_seg < num_segs && pool.size() < this->bufSegs) {
+		pool.push_back(next_seg++);
+	}
+	while (!pool.empty()) {
+		size_t slot=(size_t)nrand48(xsubi) % pool.size();
+		this->order.push_back(pool[slot]);
+		if (next_seg < num_segs) {
+			pool[slot]=next_seg++;
+		}
+		else {
+			pool[slot]=pool.back();
+			pool.pop_back();
+		}
+	}
+}
+
+/*
+ * CRF_ShuffleOrder::size
+ *
+ * Returns: number of segments in the current order
+ */
+size_t CRF_ShuffleOrder::size()
+{
+	return this->order.size();
+}
+
+/*
+ * CRF_ShuffleOrder::at
+ *
+ * Input: i - presentation index
+ *
+ * Returns: segment number presented in position i
+ */
+size_t CRF_ShuffleOrder::at(size_t i)
+{
+	return this->order[i];
+}
+
+/*
+ * CRF_ShuffleOrder::getBufSegs
+ *
+ * Returns: number of segments held by the shuffle buffer
+ */
+size_t CRF_ShuffleOrder::getBufSegs()
+{
+	return this->bufSegs;
+}
@@ -0,0 +1,40 @@
+#ifndef CRF_SHUFFLEORDER_H_
+#define CRF_SHUFFLEORDER_H_
+/*
+ * CRF_ShuffleOrder.h
+ *
+ * Contains the class definition for CRF_ShuffleOrder
+ */
+
+#include "../CRF.h"
+#include <vector>
+
+/*
+ * class CRF_ShuffleOrder
+ *
+ * Presentation order of the segments of a stream that is read sequentially through a shuffle
+ * buffer.  The buffer is first filled with the first bufSegs segments of the stream; each
+ * presented segment is drawn at random from the buffer and its place is taken by the next
+ * segment of the stream.  A segment is therefore never presented more than bufSegs-1 segments
+ * before it has been read, so a stream wrapper following this order only holds bufSegs segments
+ * in memory and never seeks.  With bufSegs >= numSegs the order is a full random permutation.
+ *
+ * The order only depends on the number of segments, the buffer size and the seed, so the
+ * feature and label wrappers (see CRF_InFtrStream_ShuffleBuffer and CRF_InLabStream_ShuffleBuffer)
+ * each compute the same order on their own.
+ */
+class CRF_ShuffleOrder
+{
+protected:
+	vector<size_t> order;
+	size_t bufSegs;
+public:
+	CRF_ShuffleOrder(size_t buf_segs);
+	virtual ~CRF_ShuffleOrder();
+	virtual void generate(size_t num_segs, QNUInt32 seed);
+	virtual size_t size();
+	virtual size_t at(size_t i);
+	virtual size_t getBufSegs();
+};
+
+#endif /*CRF_SHUFFLEORDER_H_*/
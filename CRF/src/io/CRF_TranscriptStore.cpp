@@ -0,0 +1,355 @@
+/*
+ * CRF_TranscriptStore.cpp
+ *
+ */
+
+#include "CRF_TranscriptStore.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef StdArc::StateId StateId;
+
+/*
+ * CRF_TranscriptStore constructor
+ */
+CRF_TranscriptStore::CRF_TranscriptStore()
+	: mapAddr(NULL),
+	  mapSize(0),
+	  numUtts(0),
+	  numTokens(0),
+	  numBuckets(0),
+	  tokenOffsets(NULL),
+	  tokens(NULL),
+	  keyOffsets(NULL),
+	  buckets(NULL),
+	  keyChars(NULL),
+	  fstCacheNext(0)
+{
+}
+
+/*
+ * CRF_TranscriptStore destructor
+ */
+CRF_TranscriptStore::~CRF_TranscriptStore()
+{
+	this->close();
+}
+
+/*
+ * CRF_TranscriptStore::hashKey
+ *
+ * Returns: FNV-1a hash of the len characters of key
+ */
+QNUInt32 CRF_TranscriptStore::hashKey(const char* key, size_t len)
+{
+	QNUInt32 h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * CRF_TranscriptStore::isStoreFile
+ *
+ * Input: fname - file name
+ *
+ * Returns: true if fname starts with the magic number of a compiled transcript store
+ */
+bool CRF_TranscriptStore::isStoreFile(const char* fname)
+{
+	ifstream ifile(fname, ios::in | ios::binary);
+	if (!ifile.is_open()) {
+		return false;
+	}
+	QNUInt32 magic = 0;
+	ifile.read((char*)&magic, sizeof(magic));
+	return (!ifile.fail() && magic == CRF_TRANSCRIPTSTORE_MAGIC);
+}
+
+/*
+ * CRF_TranscriptStore::write
+ *
+ * Input: fname - file to write the store to
+ *        keys - utterance keys, in the same order as transcripts
+ *        transcripts - symbol ids of each utterance
+ *
+ * Writes a compiled transcript store in the format described in CRF_TranscriptStore.h.
+ */
+void CRF_TranscriptStore::write(const char* fname, const vector<string>& keys,
+		const vector< vector<int>* >& transcripts)
+{
+	if (keys.size() != transcripts.size()) {
+		string errstr="CRF_TranscriptStore::write() caught exception: number of keys does not match number of transcripts.";
+		throw runtime_error(errstr);
+	}
+	QNUInt32 num_utts = keys.size();
+	QNUInt32 num_buckets = 1;
+	while (num_buckets < 2 * num_utts) { num_buckets *= 2; }
+
+	vector<QNUInt32> token_offsets(num_utts + 1, 0);
+	vector<QNUInt32> key_offsets(num_utts + 1, 0);
+	vector<QNUInt32> bucket_table(num_buckets, CRF_UINT32_MAX);
+	for (QNUInt32 i = 0; i < num_utts; i++) {
+		token_offsets[i + 1] = token_offsets[i] + transcripts[i]->size();
+		key_offsets[i + 1] = key_offsets[i] + keys[i].size();
+		QNUInt32 slot = hashKey(keys[i].c_str(), keys[i].size()) & (num_buckets - 1);
+		while (bucket_table[slot] != CRF_UINT32_MAX) {
+			slot = (slot + 1) & (num_buckets - 1);
+		}
+		bucket_table[slot] = i;
+	}
+
+	ofstream ofile(fname, ios::out | ios::binary);
+	if (!ofile.is_open()) {
+		string errstr="CRF_TranscriptStore::write() caught exception: cannot open the file:\n";
+		errstr += string(fname) + "\n";
+		throw runtime_error(errstr);
+	}
+	QNUInt32 header[6];
+	header[0] = CRF_TRANSCRIPTSTORE_MAGIC;
+	header[1] = CRF_TRANSCRIPTSTORE_VERSION;
+	header[2] = num_utts;
+	header[3] = token_offsets[num_utts];
+	header[4] = num_buckets;
+	header[5] = key_offsets[num_utts];
+	ofile.write((const char*)header, sizeof(header));
+	ofile.write((const char*)&(token_offsets[0]), sizeof(QNUInt32) * (num_utts + 1));
+	for (QNUInt32 i = 0; i < num_utts; i++) {
+		for (QNUInt32 j = 0; j < transcripts[i]->size(); j++) {
+			QNInt32 tok = transcripts[i]->at(j);
+			ofile.write((const char*)&tok, sizeof(tok));
+		}
+	}
+	ofile.write((const char*)&(key_offsets[0]), sizeof(QNUInt32) * (num_utts + 1));
+	ofile.write((const char*)&(bucket_table[0]), sizeof(QNUInt32) * num_buckets);
+	for (QNUInt32 i = 0; i < num_utts; i++) {
+		ofile.write(keys[i].data(), keys[i].size());
+	}
+	if (ofile.bad() || ofile.fail()) {
+		string errstr="CRF_TranscriptStore::write() caught exception: errors when writing the store to the file:\n";
+		errstr += string(fname) + "\n";
+		errstr += "Maybe because it is running out of space, or the file is deleted, or the permission is changed.";
+		throw runtime_error(errstr);
+	}
+	ofile.close();
+}
+
+/*
+ * CRF_TranscriptStore::open
+ *
+ * Input: fname - compiled transcript store
+ *
+ * Maps the store into memory.  Nothing is copied; the arrays are read in place, after a
+ * check of their structure (see checkStructure).
+ */
+void CRF_TranscriptStore::open(const char* fname)
+{
+	this->close();
+	int fd = ::open(fname, O_RDONLY);
+	if (fd < 0) {
+		string errstr="CRF_TranscriptStore::open() caught exception: cannot open the file " + string(fname);
+		throw runtime_error(errstr);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < 6 * sizeof(QNUInt32)) {
+		::close(fd);
+		string errstr="CRF_TranscriptStore::open() caught exception: " + string(fname) + " is not a transcript store";
+		throw runtime_error(errstr);
+	}
+	void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		string errstr="CRF_TranscriptStore::open() caught exception: cannot map the file " + string(fname);
+		throw runtime_error(errstr);
+	}
+	this->mapAddr = addr;
+	this->mapSize = st.st_size;
+
+	const QNUInt32* header = (const QNUInt32*)addr;
+	if (header[0] != CRF_TRANSCRIPTSTORE_MAGIC || header[1] != CRF_TRANSCRIPTSTORE_VERSION) {
+		this->close();
+		string errstr="CRF_TranscriptStore::open() caught exception: " + string(fname) +
+				" is not a transcript store of the current version";
+		throw runtime_error(errstr);
+	}
+	this->numUtts = header[2];
+	this->numTokens = header[3];
+	this->numBuckets = header[4];
+	QNUInt32 key_bytes = header[5];
+	size_t expected = sizeof(QNUInt32) * (6 + 2 * ((size_t)this->numUtts + 1) + (size_t)this->numTokens
+			+ (size_t)this->numBuckets) + key_bytes;
+	if (this->mapSize != expected) {
+		this->close();
+		string errstr="CRF_TranscriptStore::open() caught exception: " + string(fname) + " has the wrong size";
+		throw runtime_error(errstr);
+	}
+	this->tokenOffsets = header + 6;
+	this->tokens = (const QNInt32*)(this->tokenOffsets + this->numUtts + 1);
+	this->keyOffsets = (const QNUInt32*)(this->tokens + this->numTokens);
+	this->buckets = this->keyOffsets + this->numUtts + 1;
+	this->keyChars = (const char*)(this->buckets + this->numBuckets);
+	if (!this->checkStructure(key_bytes)) {
+		this->close();
+		string errstr="CRF_TranscriptStore::open() caught exception: " + string(fname) + " is corrupt";
+		throw runtime_error(errstr);
+	}
+	this->fstCache.assign(this->numUtts, (StdVectorFst*)NULL);
+	this->fstCacheOrder.clear();
+	this->fstCacheNext = 0;
+}
+
+/*
+ * CRF_TranscriptStore::checkStructure
+ *
+ * Input: key_bytes - number of key bytes from the header
+ *
+ * Returns: true if the offsets of the mapped store are monotonic and end at the token and key
+ *   counts, and the hash table is a power of two larger than the number of utterances, holds
+ *   only valid utterance indices and has an empty slot to stop find()
+ */
+bool CRF_TranscriptStore::checkStructure(QNUInt32 key_bytes)
+{
+	if (this->numBuckets <= this->numUtts || (this->numBuckets & (this->numBuckets - 1)) != 0) {
+		return false;
+	}
+	if (this->tokenOffsets[0] != 0 || this->tokenOffsets[this->numUtts] != this->numTokens ||
+			this->keyOffsets[0] != 0 || this->keyOffsets[this->numUtts] != key_bytes) {
+		return false;
+	}
+	for (QNUInt32 i = 0; i < this->numUtts; i++) {
+		if (this->tokenOffsets[i + 1] < this->tokenOffsets[i] || this->keyOffsets[i + 1] < this->keyOffsets[i]) {
+			return false;
+		}
+	}
+	QNUInt32 empty = 0;
+	for (QNUInt32 i = 0; i < this->numBuckets; i++) {
+		if (this->buckets[i] == CRF_UINT32_MAX) {
+			empty++;
+		}
+		else if (this->buckets[i] >= this->numUtts) {
+			return false;
+		}
+	}
+	return (empty > 0);
+}
+
+/*
+ * CRF_TranscriptStore::close
+ *
+ * Unmaps the store and frees the cached fsts.
+ */
+void CRF_TranscriptStore::close()
+{
+	for (QNUInt32 i = 0; i < this->fstCache.size(); i++) {
+		delete this->fstCache[i];
+	}
+	this->fstCache.clear();
+	this->fstCacheOrder.clear();
+	this->fstCacheNext = 0;
+	if (this->mapAddr != NULL) {
+		munmap(this->mapAddr, this->mapSize);
+		this->mapAddr = NULL;
+		this->mapSize = 0;
+	}
+	this->numUtts = 0;
+	this->numTokens = 0;
+	this->numBuckets = 0;
+}
+
+/*
+ * CRF_TranscriptStore::find
+ *
+ * Input: key - utterance key (see CRF_MLFManager::getKey())
+ *
+ * Returns: index of the utterance, -1 if the key is not in the store
+ */
+int CRF_TranscriptStore::find(const string& key)
+{
+	if (this->numBuckets == 0) {
+		return -1;
+	}
+	QNUInt32 slot = hashKey(key.c_str(), key.size()) & (this->numBuckets - 1);
+	while (this->buckets[slot] != CRF_UINT32_MAX) {
+		QNUInt32 idx = this->buckets[slot];
+		QNUInt32 len = this->keyOffsets[idx + 1] - this->keyOffsets[idx];
+		if (len == key.size() && memcmp(this->keyChars + this->keyOffsets[idx], key.data(), len) == 0) {
+			return idx;
+		}
+		slot = (slot + 1) & (this->numBuckets - 1);
+	}
+	return -1;
+}
+
+QNUInt32 CRF_TranscriptStore::getNumUtts()
+{
+	return this->numUtts;
+}
+
+/*
+ * CRF_TranscriptStore::getLength
+ *
+ * Returns: number of tokens of utterance idx
+ */
+QNUInt32 CRF_TranscriptStore::getLength(QNUInt32 idx)
+{
+	return this->tokenOffsets[idx + 1] - this->tokenOffsets[idx];
+}
+
+/*
+ * CRF_TranscriptStore::getTokens
+ *
+ * Returns: pointer to the getLength(idx) symbol ids of utterance idx, inside the mapped file
+ */
+const QNInt32* CRF_TranscriptStore::getTokens(QNUInt32 idx)
+{
+	return this->tokens + this->tokenOffsets[idx];
+}
+
+/*
+ * CRF_TranscriptStore::getFst
+ *
+ * Input: idx - utterance index
+ *
+ * Returns: linear acceptor of the transcript of utterance idx, in the same form as
+ *   CRF_MLFManager::getFst().  The fst is owned by the store and stays valid until
+ *   CRF_TRANSCRIPTSTORE_FST_CACHE other fsts have been built; copy it to keep it longer.
+ */
+const StdVectorFst* CRF_TranscriptStore::getFst(QNUInt32 idx)
+{
+	if (idx >= this->numUtts) {
+		string errstr="CRF_TranscriptStore::getFst() caught exception: utterance index out of range";
+		throw runtime_error(errstr);
+	}
+	if (this->fstCache[idx] == NULL) {
+		if (this->fstCacheOrder.size() < CRF_TRANSCRIPTSTORE_FST_CACHE) {
+			this->fstCacheOrder.push_back(idx);
+		}
+		else {
+			// drop the oldest cached fst
+			QNUInt32 old_idx = this->fstCacheOrder[this->fstCacheNext];
+			delete this->fstCache[old_idx];
+			this->fstCache[old_idx] = NULL;
+			this->fstCacheOrder[this->fstCacheNext] = idx;
+			this->fstCacheNext = (this->fstCacheNext + 1) % CRF_TRANSCRIPTSTORE_FST_CACHE;
+		}
+		StdVectorFst* fst = new StdVectorFst();
+		StateId startState = fst->AddState();
+		fst->SetStart(startState);
+		StateId prevState = startState;
+		const QNInt32* toks = this->getTokens(idx);
+		QNUInt32 len = this->getLength(idx);
+		fst->ReserveStates(len + 1);
+		for (QNUInt32 i = 0; i < len; i++) {
+			StateId curState = fst->AddState();
+			fst->AddArc(prevState, StdArc(toks[i], toks[i], 0, curState));
+			prevState = curState;
+		}
+		fst->SetFinal(prevState, 0);
+		this->fstCache[idx] = fst;
+	}
+	return this->fstCache[idx];
+}
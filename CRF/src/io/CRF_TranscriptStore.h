@@ -0,0 +1,69 @@
+/*
+ * CRF_TranscriptStore.h
+ *
+ * Contains the class definitions for CRF_TranscriptStore
+ * Compiled, memory-mapped form of an MLF transcript file.
+ */
+#ifndef CRF_TRANSCRIPTSTORE_H_
+#define CRF_TRANSCRIPTSTORE_H_
+#include "fst/fstlib.h"
+#include "../CRF.h"
+#include <vector>
+
+using namespace fst;
+using namespace std;
+
+#define CRF_TRANSCRIPTSTORE_MAGIC 0x53524354
+#define CRF_TRANSCRIPTSTORE_VERSION 1
+// number of fsts getFst() keeps before it drops the oldest
+#define CRF_TRANSCRIPTSTORE_FST_CACHE 64
+
+/*
+ * class CRF_TranscriptStore
+ *
+ * Holds the transcripts of an MLF in one file that is mapped into memory instead of parsed:
+ *
+ *   header       - magic, version, number of utterances, number of tokens, number of hash
+ *                  buckets, number of key bytes (6 x QNUInt32)
+ *   tokenOffsets - numUtts+1 offsets into tokens, utterance i is tokens[offsets[i]..offsets[i+1])
+ *   tokens       - the symbol ids of all utterances, as one QNInt32 array
+ *   keyOffsets   - numUtts+1 offsets into keyChars
+ *   buckets      - open-addressing hash table of utterance indices (CRF_UINT32_MAX when empty)
+ *   keyChars     - the utterance keys, not terminated
+ *
+ * Stores are written once with write() (see CRF_MLFManager::writeStore()) and opened with
+ * open().  The linear fsts returned by getFst() are built on first use, and the last
+ * CRF_TRANSCRIPTSTORE_FST_CACHE of them are cached.
+ */
+class CRF_TranscriptStore {
+protected:
+	void* mapAddr;
+	size_t mapSize;
+	QNUInt32 numUtts;
+	QNUInt32 numTokens;
+	QNUInt32 numBuckets;
+	const QNUInt32* tokenOffsets;
+	const QNInt32* tokens;
+	const QNUInt32* keyOffsets;
+	const QNUInt32* buckets;
+	const char* keyChars;
+	vector<StdVectorFst*> fstCache;
+	vector<QNUInt32> fstCacheOrder;	// utterances of the cached fsts, oldest at fstCacheNext
+	QNUInt32 fstCacheNext;
+	virtual bool checkStructure(QNUInt32 key_bytes);
+	static QNUInt32 hashKey(const char* key, size_t len);
+public:
+	CRF_TranscriptStore();
+	virtual ~CRF_TranscriptStore();
+	virtual void open(const char* fname);
+	virtual void close();
+	virtual int find(const string& key);
+	virtual QNUInt32 getNumUtts();
+	virtual QNUInt32 getLength(QNUInt32 idx);
+	virtual const QNInt32* getTokens(QNUInt32 idx);
+	virtual const StdVectorFst* getFst(QNUInt32 idx);
+	static bool isStoreFile(const char* fname);
+	static void write(const char* fname, const vector<string>& keys, const vector< vector<int>* >& transcripts);
+};
+
+#endif /* CRF_TRANSCRIPTSTORE_H_ */
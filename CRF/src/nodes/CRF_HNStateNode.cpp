@@ -6,19 +6,19 @@ CRF_HNStateNode::CRF_HNStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CR
 	//QNUInt32 nLabs=this->crf_ptr->getNLabs();
 	this->nStates=this->crf_ptr->getFeatureMap()->getNumStates();
 	this->trueNLabs = nLabs*this->nStates;
-	this->stateArray = new double[this->trueNLabs];
-	this->denseTransMatrix = new double[nLabs*nLabs]; // Dense transition matrix
-	this->diagTransMatrix = new double[this->trueNLabs];
-	this->offDiagTransMatrix = new double[this->trueNLabs];
-	this->alphaArray = new double[this->trueNLabs];
-	this->betaArray = new double[this->trueNLabs];
-	this->alphaBetaArray = new double[this->trueNLabs];
-	this->tempBeta = new double[this->trueNLabs];
+	this->stateArray = this->newNodeArray(this->trueNLabs);
+	this->denseTransMatrix = this->newNodeArray(nLabs*nLabs); // Dense transition matrix
+	this->diagTransMatrix = this->newNodeArray(this->trueNLabs);
+	this->offDiagTransMatrix = this->newNodeArray(this->trueNLabs);
+	this->alphaArray = this->newNodeArray(this->trueNLabs);
+	this->betaArray = this->newNodeArray(this->trueNLabs);
+	this->alphaBetaArray = this->newNodeArray(this->trueNLabs);
+	this->tempBeta = this->newNodeArray(this->trueNLabs);
 	this->alphaSize = this->trueNLabs;
 	this->alphaScale = 0.0;
-	this->logAddAcc = new double[this->trueNLabs];
-	this->alphaArrayAligned.assign(this->trueNLabs,CRF_LogMath::LOG0);
-	this->betaArrayAligned.assign(this->trueNLabs,CRF_LogMath::LOG0);
+	this->logAddAcc = this->newNodeArray(this->trueNLabs);
+	this->assignNodeVector(this->alphaArrayAligned,this->trueNLabs,CRF_LogMath::LOG0);
+	this->assignNodeVector(this->betaArrayAligned,this->trueNLabs,CRF_LogMath::LOG0);
 }
 
 CRF_HNStateNode::~CRF_HNStateNode()
@@ -0,0 +1,217 @@
+/*
+ * CRF_SegNodeKernel.cpp
+ *
+ */
+
+#include "CRF_SegNodeKernel.h"
+
+/*
+ * CRF_SegNodeKernel constructor
+ *
+ * Input: *fmap - feature map whose lambda layout the kernel scores against
+ *
+ * Copies the feature ranges, bias values and the lambda index caches out of the feature
+ * map so that the kernels do not need to go back through its virtual interface.
+ */
+CRF_SegNodeKernel::CRF_SegNodeKernel(CRF_StdFeatureMap* fmap)
+	: ftrMap(fmap)
+{
+	CRF_FeatureMap_config* cnf = fmap->getConfig();
+	this->stateIdx = fmap->getStateFeatureIdxCache();
+	this->transIdx = fmap->getTransFeatureIdxCache();
+	this->nLabs = cnf->numLabs;
+	this->stateFidxStart = cnf->stateFidxStart;
+	this->stateFidxEnd = cnf->stateFidxEnd;
+	this->transFidxStart = cnf->transFidxStart;
+	this->transFidxEnd = cnf->transFidxEnd;
+	this->stateBiasVal = cnf->stateBiasVal;
+	this->transBiasVal = cnf->transBiasVal;
+}
+
+/*
+ * CRF_SegNodeKernel destructor
+ */
+CRF_SegNodeKernel::~CRF_SegNodeKernel()
+{
+}
+
+/*
+ * CRF_SegNodeKernel::computeAlphaPlusTrans
+ *
+ * Input: *alpha - alpha vector of the current node
+ *        *next_trans_matrix - transition matrix of the next node, indexed [clab][next_lab]
+ *        nactual_labs - number of labels
+ *        *alpha_plus_trans - output, log-sum over clab of alpha[clab]+trans[clab][next_lab]
+ *        *acc - scratch array of at least nactual_labs values
+ *
+ * Same computation as CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeAlphaPlusTrans.
+ */
+void CRF_SegNodeKernel::computeAlphaPlusTrans(double* alpha, double* next_trans_matrix,
+		QNUInt32 nactual_labs, double* alpha_plus_trans, double* acc)
+{
+	for (QNUInt32 next_lab = 0; next_lab < nactual_labs; next_lab++)
+	{
+		for (QNUInt32 clab = 0; clab < nactual_labs; clab++)
+		{
+			acc[clab] = alpha[clab] + next_trans_matrix[clab * nactual_labs + next_lab];
+		}
+		try {
+			alpha_plus_trans[next_lab] = logAdd(acc,nactual_labs);
+		}
+		catch (exception &e) {
+			string errstr="CRF_SegNodeKernel::computeAlphaPlusTrans() caught exception: "+string(e.what())+", while computing alpha plus trans";
+			throw runtime_error(errstr);
+		}
+	}
+}
+
+/*
+ * CRF_SegNodeKernel::computeAlpha
+ *
+ * Input: **prev_alpha_plus_trans - alphaPlusTrans vectors of the previous nodes, indexed by dur-1
+ *        num_prev_nodes - number of previous nodes
+ *        node_max_dur - maximum label duration for the node
+ *        nactual_labs - number of labels
+ *        *state_array - state array of the node, nactual_labs values per duration
+ *        *alpha_with_dur - output, alpha values per (label, duration)
+ *        *alpha - output, alpha vector of the node
+ *        *acc - scratch array of at least node_max_dur values
+ *
+ * Same computation as CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeAlpha.
+ */
+void CRF_SegNodeKernel::computeAlpha(double** prev_alpha_plus_trans, QNUInt32 num_prev_nodes,
+		QNUInt32 node_max_dur, QNUInt32 nactual_labs, double* state_array, double* alpha_with_dur,
+		double* alpha, double* acc)
+{
+	for (QNUInt32 clab = 0; clab < nactual_labs; clab++)
+	{
+		QNUInt32 logAddID = 0;
+		double* alpha_with_dur_for_lab = &(alpha_with_dur[clab * node_max_dur]);
+		for (QNUInt32 dur = 1; dur <= num_prev_nodes; dur++)
+		{
+			acc[logAddID] = prev_alpha_plus_trans[dur - 1][clab] + state_array[nactual_labs * (dur - 1) + clab];
+			alpha_with_dur_for_lab[dur - 1] = acc[logAddID];
+			logAddID++;
+		}
+		for (QNUInt32 dur = num_prev_nodes + 1; dur <= node_max_dur; dur++)
+		{
+			acc[logAddID] = state_array[nactual_labs * (dur - 1) + clab];
+			alpha_with_dur_for_lab[dur - 1] = acc[logAddID];
+			logAddID++;
+		}
+		try {
+			alpha[clab] = logAdd(acc,logAddID);
+		}
+		catch (exception &e) {
+			string errstr="CRF_SegNodeKernel::computeAlpha() caught exception: "+string(e.what())+", while computing alpha";
+			throw runtime_error(errstr);
+		}
+	}
+}
+
+/*
+ * CRF_SegNodeKernel::computeBeta
+ *
+ * Input: **next_state_arrays - state arrays of the next nodes, indexed by dur-1
+ *        **next_betas - beta vectors of the next nodes, indexed by dur-1
+ *        num_next_nodes - number of next nodes (must be > 0)
+ *        *next_trans_matrix - transition matrix of the adjacent next node
+ *        nactual_labs - number of labels
+ *        *temp_beta - output, next beta plus next state value per (duration, label)
+ *        *beta_sum_over_dur - output, log-sum of temp_beta over duration
+ *        *beta - output, beta vector of the node
+ *        *acc - scratch array of at least max(nactual_labs, num_next_nodes) values
+ *
+ * Same computation as CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeBeta.
+ */
+void CRF_SegNodeKernel::computeBeta(double** next_state_arrays, double** next_betas,
+		QNUInt32 num_next_nodes, double* next_trans_matrix, QNUInt32 nactual_labs, double* temp_beta,
+		double* beta_sum_over_dur, double* beta, double* acc)
+{
+	for (QNUInt32 nextlab = 0; nextlab < nactual_labs; nextlab++)
+	{
+		for (QNUInt32 dur = 1; dur <= num_next_nodes; dur++)
+		{
+			QNUInt32 idx = nactual_labs * (dur - 1) + nextlab;
+			temp_beta[idx] = next_state_arrays[dur - 1][idx] + next_betas[dur - 1][nextlab];
+			acc[dur - 1] = temp_beta[idx];
+		}
+		try {
+			beta_sum_over_dur[nextlab] = logAdd(acc,num_next_nodes);
+		}
+		catch (exception &e) {
+			string errstr="CRF_SegNodeKernel::computeBeta() caught exception: "+string(e.what())+", while computing beta";
+			throw runtime_error(errstr);
+		}
+	}
+
+	for (QNUInt32 clab = 0; clab < nactual_labs; clab++)
+	{
+		double* next_trans_from_clab = &(next_trans_matrix[clab * nactual_labs]);
+		for (QNUInt32 nextlab = 0; nextlab < nactual_labs; nextlab++)
+		{
+			acc[nextlab] = next_trans_from_clab[nextlab] + beta_sum_over_dur[nextlab];
+		}
+		try {
+			beta[clab] = logAdd(acc,nactual_labs);
+		}
+		catch (exception &e) {
+			string errstr="CRF_SegNodeKernel::computeBeta() caught exception: "+string(e.what())+", while computing beta";
+			throw runtime_error(errstr);
+		}
+	}
+}
+
+/*
+ * CRF_SegNodeKernel::getFeatureMap
+ *
+ * Returns: the feature map this kernel was built from
+ */
+CRF_FeatureMap* CRF_SegNodeKernel::getFeatureMap()
+{
+	return this->ftrMap;
+}
+
+/*
+ * CRF_SegNodeKernel::createKernel
+ *
+ * Input: *crf - CRF model the nodes are scored against
+ *
+ * Returns: a new kernel specialized for the flags of the model's feature map, or NULL if
+ *   the feature map does not support kernels (see CRF_FeatureMap::supportsSegKernel).
+ *
+ * Factory function.  Called once per utterance by CRF_StateVector, so the choice of
+ * specialization is a single runtime switch rather than one per label.
+ */
+CRF_SegNodeKernel* CRF_SegNodeKernel::createKernel(CRF_Model* crf)
+{
+	if (!crf->getFeatureMap()->supportsSegKernel()) {
+		return NULL;
+	}
+	CRF_StdFeatureMap* fmap = dynamic_cast<CRF_StdFeatureMap*>(crf->getFeatureMap());
+	if (fmap == NULL) {
+		return NULL;
+	}
+	CRF_FeatureMap_config* cnf = fmap->getConfig();
+	int flags = (cnf->useStateFtrs ? 8 : 0) | (cnf->useStateBias ? 4 : 0) |
+			(cnf->useTransFtrs ? 2 : 0) | (cnf->useTransBias ? 1 : 0);
+	switch (flags)
+	{
+	case 0: return new CRF_SegNodeKernel_Impl<false,false,false,false>(fmap);
+	case 1: return new CRF_SegNodeKernel_Impl<false,false,false,true>(fmap);
+	case 2: return new CRF_SegNodeKernel_Impl<false,false,true,false>(fmap);
+	case 3: return new CRF_SegNodeKernel_Impl<false,false,true,true>(fmap);
+	case 4: return new CRF_SegNodeKernel_Impl<false,true,false,false>(fmap);
+	case 5: return new CRF_SegNodeKernel_Impl<false,true,false,true>(fmap);
+	case 6: return new CRF_SegNodeKernel_Impl<false,true,true,false>(fmap);
+	case 7: return new CRF_SegNodeKernel_Impl<false,true,true,true>(fmap);
+	case 8: return new CRF_SegNodeKernel_Impl<true,false,false,false>(fmap);
+	case 9: return new CRF_SegNodeKernel_Impl<true,false,false,true>(fmap);
+	case 10: return new CRF_SegNodeKernel_Impl<true,false,true,false>(fmap);
+	case 11: return new CRF_SegNodeKernel_Impl<true,false,true,true>(fmap);
+	case 12: return new CRF_SegNodeKernel_Impl<true,true,false,false>(fmap);
+	case 13: return new CRF_SegNodeKernel_Impl<true,true,false,true>(fmap);
+	case 14: return new CRF_SegNodeKernel_Impl<true,true,true,false>(fmap);
+	default: return new CRF_SegNodeKernel_Impl<true,true,true,true>(fmap);
+	}
+}
@@ -0,0 +1,184 @@
+#ifndef CRF_SEGNODEKERNEL_H_
+#define CRF_SEGNODEKERNEL_H_
+/*
+ * CRF_SegNodeKernel.h
+ *
+ * Contains the class definitions for CRF_SegNodeKernel and the compile-time
+ * specialized kernels derived from it.
+ */
+
+#include "../CRF.h"
+#include "../CRF_Model.h"
+#include "../ftrmaps/CRF_StdFeatureMap.h"
+
+/*
+ * class CRF_SegNodeKernel
+ *
+ * Used by the segmental state nodes to compute their state arrays, transition matrices
+ * and forward-backward recursions over whole arrays at a time, instead of through one
+ * virtual feature map or node call per (label, duration) pair.
+ *
+ * The scoring functions are implemented by CRF_SegNodeKernel_Impl, which is templated on
+ * the feature map flags (state features, state bias, transition features, transition bias)
+ * so that the inner dot products have no runtime branches and can be inlined.  The
+ * recursion functions do not depend on these flags and are shared by all specializations.
+ *
+ * The arithmetic in every function follows the order used by CRF_StdFeatureMap and
+ * CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr, so results are identical to the
+ * virtual path.  Kernels are only available for feature maps whose supportsSegKernel() is
+ * true; createKernel() returns NULL for any other feature map and the nodes fall back to
+ * their virtual path.
+ */
+class CRF_SegNodeKernel
+{
+protected:
+	CRF_FeatureMap* ftrMap;
+	const QNUInt32* stateIdx;
+	const QNUInt32* transIdx;
+	QNUInt32 nLabs;
+	QNUInt32 stateFidxStart;
+	QNUInt32 stateFidxEnd;
+	QNUInt32 transFidxStart;
+	QNUInt32 transFidxEnd;
+	double stateBiasVal;
+	double transBiasVal;
+
+public:
+	CRF_SegNodeKernel(CRF_StdFeatureMap* fmap);
+	virtual ~CRF_SegNodeKernel();
+
+	virtual void computeStateArray(float* ftr_buf, QNUInt32 nftrs_per_seg, QNUInt32 node_max_dur,
+			QNUInt32 nactual_labs, bool dur_labs, double* lambda, double* state_array)=0;
+	virtual void computeTransMatrix(float* ftr_buf, QNUInt32 nactual_labs, double* lambda,
+			double* trans_matrix)=0;
+
+	void computeAlphaPlusTrans(double* alpha, double* next_trans_matrix, QNUInt32 nactual_labs,
+			double* alpha_plus_trans, double* acc);
+	void computeAlpha(double** prev_alpha_plus_trans, QNUInt32 num_prev_nodes, QNUInt32 node_max_dur,
+			QNUInt32 nactual_labs, double* state_array, double* alpha_with_dur, double* alpha, double* acc);
+	void computeBeta(double** next_state_arrays, double** next_betas, QNUInt32 num_next_nodes,
+			double* next_trans_matrix, QNUInt32 nactual_labs, double* temp_beta, double* beta_sum_over_dur,
+			double* beta, double* acc);
+
+	CRF_FeatureMap* getFeatureMap();
+	static CRF_SegNodeKernel* createKernel(CRF_Model* crf);
+};
+
+/*
+ * class CRF_SegNodeKernel_Impl
+ *
+ * Specialization of CRF_SegNodeKernel for a fixed combination of feature map flags.
+ * One instance is selected per feature map by CRF_SegNodeKernel::createKernel().
+ */
+template <bool UseStateFtrs, bool UseStateBias, bool UseTransFtrs, bool UseTransBias>
+class CRF_SegNodeKernel_Impl : public CRF_SegNodeKernel
+{
+protected:
+	inline double stateValue(const float* ftr_buf, const double* lambda, QNUInt32 clab) const;
+	inline double transValue(const float* ftr_buf, const double* lambda, QNUInt32 plab, QNUInt32 clab) const;
+
+public:
+	CRF_SegNodeKernel_Impl(CRF_StdFeatureMap* fmap)
+		: CRF_SegNodeKernel(fmap) {}
+
+	virtual void computeStateArray(float* ftr_buf, QNUInt32 nftrs_per_seg, QNUInt32 node_max_dur,
+			QNUInt32 nactual_labs, bool dur_labs, double* lambda, double* state_array);
+	virtual void computeTransMatrix(float* ftr_buf, QNUInt32 nactual_labs, double* lambda,
+			double* trans_matrix);
+};
+
+/*
+ * CRF_SegNodeKernel_Impl::stateValue
+ *
+ * Same computation as CRF_StdFeatureMap::computeStateArrayValue, with the feature map
+ * flags resolved at compile time.
+ */
+template <bool UseStateFtrs, bool UseStateBias, bool UseTransFtrs, bool UseTransBias>
+inline double CRF_SegNodeKernel_Impl<UseStateFtrs,UseStateBias,UseTransFtrs,UseTransBias>::stateValue(
+		const float* ftr_buf, const double* lambda, QNUInt32 clab) const
+{
+	double value=0.0;
+	QNUInt32 lc=this->stateIdx[clab];
+	if (UseStateFtrs) {
+		for (QNUInt32 fidx=this->stateFidxStart; fidx<=this->stateFidxEnd; fidx++) {
+			value+=ftr_buf[fidx]*lambda[lc];
+			lc++;
+		}
+	}
+	if (UseStateBias) {
+		value+=lambda[lc]*this->stateBiasVal;
+	}
+	return value;
+}
+
+/*
+ * CRF_SegNodeKernel_Impl::transValue
+ *
+ * Same computation as CRF_StdFeatureMap::computeTransMatrixValue, with the feature map
+ * flags resolved at compile time.
+ */
+template <bool UseStateFtrs, bool UseStateBias, bool UseTransFtrs, bool UseTransBias>
+inline double CRF_SegNodeKernel_Impl<UseStateFtrs,UseStateBias,UseTransFtrs,UseTransBias>::transValue(
+		const float* ftr_buf, const double* lambda, QNUInt32 plab, QNUInt32 clab) const
+{
+	double value=0.0;
+	QNUInt32 lc=this->transIdx[plab*this->nLabs+clab];
+	if (UseTransFtrs) {
+		for (QNUInt32 fidx=this->transFidxStart; fidx<=this->transFidxEnd; fidx++) {
+			value+=ftr_buf[fidx]*lambda[lc];
+			lc++;
+		}
+	}
+	if (UseTransBias) {
+		value+=lambda[lc]*this->transBiasVal;
+	}
+	return value;
+}
+
+/*
+ * CRF_SegNodeKernel_Impl::computeStateArray
+ *
+ * Input: *ftr_buf - segment feature buffer of the node, one block of nftrs_per_seg per duration
+ *        nftrs_per_seg - number of features per duration block
+ *        node_max_dur - maximum label duration for the node
+ *        nactual_labs - number of labels per duration
+ *        dur_labs - true if labels carry their duration (stdseg), false otherwise
+ *        *lambda - lambda vector from the CRF
+ *        *state_array - output, nactual_labs values per duration
+ */
+template <bool UseStateFtrs, bool UseStateBias, bool UseTransFtrs, bool UseTransBias>
+void CRF_SegNodeKernel_Impl<UseStateFtrs,UseStateBias,UseTransFtrs,UseTransBias>::computeStateArray(
+		float* ftr_buf, QNUInt32 nftrs_per_seg, QNUInt32 node_max_dur, QNUInt32 nactual_labs,
+		bool dur_labs, double* lambda, double* state_array)
+{
+	float* seg_ftr_buf=ftr_buf;
+	for (QNUInt32 dur=1; dur<=node_max_dur; dur++) {
+		double* state_array_for_dur=&(state_array[nactual_labs*(dur-1)]);
+		QNUInt32 lab_offset=dur_labs?nactual_labs*(dur-1):0;
+		for (QNUInt32 lab=0; lab<nactual_labs; lab++) {
+			state_array_for_dur[lab]=this->stateValue(seg_ftr_buf,lambda,lab_offset+lab);
+		}
+		seg_ftr_buf+=nftrs_per_seg;
+	}
+}
+
+/*
+ * CRF_SegNodeKernel_Impl::computeTransMatrix
+ *
+ * Input: *ftr_buf - feature buffer of the node (the duration 1 block is used)
+ *        nactual_labs - number of labels
+ *        *lambda - lambda vector from the CRF
+ *        *trans_matrix - output, nactual_labs x nactual_labs matrix indexed [plab][clab]
+ */
+template <bool UseStateFtrs, bool UseStateBias, bool UseTransFtrs, bool UseTransBias>
+void CRF_SegNodeKernel_Impl<UseStateFtrs,UseStateBias,UseTransFtrs,UseTransBias>::computeTransMatrix(
+		float* ftr_buf, QNUInt32 nactual_labs, double* lambda, double* trans_matrix)
+{
+	for (QNUInt32 lab=0; lab<nactual_labs; lab++) {
+		for (QNUInt32 plab=0; plab<nactual_labs; plab++) {
+			trans_matrix[plab*nactual_labs+lab]=this->transValue(ftr_buf,lambda,plab,lab);
+		}
+	}
+}
+
+#endif /*CRF_SEGNODEKERNEL_H_*/
@@ -7,6 +7,7 @@
  */
 
 #include "CRF_StateNode.h"
+#include "../utils/CRF_MemStats.h"
 
 #include "CRF_StdStateNode.h"
 #include "CRF_StdNStateNode.h"
@@ -32,10 +33,18 @@
 CRF_StateNode::CRF_StateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
 	: ftrBuf(fb),
 	  ftrBuf_size(sizeof_fb),
+	  ftrBuf_capacity(sizeof_fb),
+	  ftrBufOwned(true),
 	  label(lab),
-	  crf_ptr(crf_in)
+	  crf_ptr(crf_in),
+	  kernel(NULL),
+	  nodeMemBytes(0),
+	  ftrMemBytes(0),
+	  hypMemBytes(0)
 {
+	this->ftrView.numBlocks=0;
 	this->nLabs=this->crf_ptr->getNLabs();
+	this->trackFtrMem();
 }
 
 /*
@@ -43,7 +52,113 @@ CRF_StateNode::CRF_StateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Mo
  */
 CRF_StateNode::~CRF_StateNode()
 {
-	delete [] this->ftrBuf;
+	if (this->ftrBufOwned) {
+		delete [] this->ftrBuf;
+	}
+	CRF_MemStats::release(MEM_NODES,this->nodeMemBytes);
+	CRF_MemStats::release(MEM_FEATURES,this->ftrMemBytes);
+	CRF_MemStats::release(MEM_HYPS,this->hypMemBytes);
+}
+
+/*
+ * CRF_StateNode::trackMem
+ *
+ * Input: old_bytes - size of the node arrays freed
+ *        new_bytes - size of the node arrays allocated in their place
+ *
+ * Called by the constructors of the subclasses for the arrays they allocate, including the
+ * arrays of a base class they replace.  The base destructor releases the total.
+ */
+void CRF_StateNode::trackMem(size_t old_bytes, size_t new_bytes)
+{
+	this->nodeMemBytes=this->nodeMemBytes-old_bytes+new_bytes;
+	CRF_MemStats::update(MEM_NODES,old_bytes,new_bytes);
+}
+
+/*
+ * CRF_StateNode::newNodeArray
+ *
+ * Input: n - number of values
+ *
+ * Returns: a new array of n doubles, reported to CRF_MemStats as node memory
+ *
+ * The subclass constructors allocate their arrays with it, so that the bytes reported are
+ * computed from the allocations themselves.  The arrays are freed with delete [] as usual.
+ */
+double* CRF_StateNode::newNodeArray(size_t n)
+{
+	double* arr=new double[n];
+	this->trackMem(0,n*sizeof(double));
+	return arr;
+}
+
+/*
+ * CRF_StateNode::deleteNodeArray
+ *
+ * Input: arr - array allocated by newNodeArray
+ *        n - number of values it was allocated with
+ *
+ * Frees an array of a base class that a subclass constructor replaces with one of its own size.
+ */
+void CRF_StateNode::deleteNodeArray(double* arr, size_t n)
+{
+	delete [] arr;
+	this->trackMem(n*sizeof(double),0);
+}
+
+/*
+ * CRF_StateNode::assignNodeVector
+ *
+ * Input: vec - node vector to fill
+ *        n - number of values
+ *        value - value of each element
+ *
+ * Assigns n copies of value to vec and reports the change of its capacity as node memory.
+ */
+void CRF_StateNode::assignNodeVector(vector<double>& vec, size_t n, double value)
+{
+	size_t old_bytes=vec.capacity()*sizeof(double);
+	vec.assign(n,value);
+	this->trackMem(old_bytes,vec.capacity()*sizeof(double));
+}
+
+/*
+ * CRF_StateNode::trackFtrMem
+ *
+ * Reports the feature buffer to CRF_MemStats if the node owns it.  Called whenever the
+ * buffer or its ownership changes.
+ */
+void CRF_StateNode::trackFtrMem()
+{
+	size_t bytes=(this->ftrBufOwned && this->ftrBuf != NULL)?this->ftrBuf_capacity*sizeof(float):0;
+	CRF_MemStats::update(MEM_FEATURES,this->ftrMemBytes,bytes);
+	this->ftrMemBytes=bytes;
+}
+
+/*
+ * CRF_StateNode::trackViterbiMem
+ *
+ * Reports the capacity of the Viterbi traceback tables to CRF_MemStats.  Called by the
+ * decoders once they have filled the tables of the node.
+ */
+void CRF_StateNode::trackViterbiMem()
+{
+	size_t bytes=this->viterbiPhnIds.capacity()*sizeof(uint)
+			+this->viterbiPointers.capacity()*sizeof(int)
+			+this->viterbiDurs.capacity()*sizeof(uint)
+			+this->isPhoneStartBoundary.capacity()/8;
+	CRF_MemStats::update(MEM_HYPS,this->hypMemBytes,bytes);
+	this->hypMemBytes=bytes;
+}
+
+/*
+ * CRF_StateNode::getMemBytes
+ *
+ * Returns: bytes of the alpha, beta, state and transition arrays of the node
+ */
+size_t CRF_StateNode::getMemBytes()
+{
+	return this->nodeMemBytes;
 }
 
 /*
@@ -201,6 +316,23 @@ double CRF_StateNode::computeExpF(double* ExpF, double* grad, double Zx, double*
 	return 0;
 }
 
+/*
+ * CRF_StateNode::computeTransExpF
+ *
+ * Inputs: see computeExpF
+ *         *gamma - vector to store the state occupation probabilities of this node
+ *
+ * Returns:
+ *
+ * Stub function.
+ * Should compute the transition feature part of computeExpF and store the state posteriors in
+ *   *gamma, leaving the state features to the caller.
+ */
+double CRF_StateNode::computeTransExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma)
+{
+	return 0;
+}
+
 /*
  * CRF_StateNode::computeExpF
  *
@@ -284,15 +416,176 @@ void CRF_StateNode::reset(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model
 {
 	//memcpy(fb,this->ftrBuf,sizeof_fb);
 
-	if (this->ftrBuf != NULL) {
+	if (this->ftrBuf != NULL && this->ftrBufOwned) {
+		delete [] this->ftrBuf;
+	}
+
+	this->ftrBuf=fb;
+	this->ftrBuf_size=sizeof_fb;
+	this->ftrBuf_capacity=sizeof_fb;
+	this->ftrBufOwned=true;
+	this->ftrView.numBlocks=0;
+	this->trackFtrMem();
+	this->label=lab;
+	this->crf_ptr=crf_in;
+	this->alphaScale=0.0;
+}
+
+/*
+ * CRF_StateNode::resetCopy
+ *
+ * Input: see constructor
+ *
+ * Returns: true if the feature buffer of the node had to be (re)allocated
+ *
+ * Same as reset(), but copies the features from fb into the buffer the node already
+ * owns instead of taking ownership of fb.  The buffer is only reallocated when it is
+ * smaller than sizeof_fb, so a node reused across sequences stops allocating once it
+ * has seen its largest feature buffer.
+ */
+bool CRF_StateNode::resetCopy(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	bool grown=false;
+	if (!this->ftrBufOwned) {
+		this->ftrBuf=NULL;
+		this->ftrBufOwned=true;
+	}
+	if (this->ftrBuf == NULL || this->ftrBuf_capacity < sizeof_fb) {
 		delete [] this->ftrBuf;
+		this->ftrBuf=new float[sizeof_fb];
+		this->ftrBuf_capacity=sizeof_fb;
+		this->trackFtrMem();
+		grown=true;
 	}
+	memcpy(this->ftrBuf,fb,sizeof_fb*sizeof(float));
+	this->ftrBuf_size=sizeof_fb;
+	this->ftrView.numBlocks=0;
+	this->label=lab;
+	this->crf_ptr=crf_in;
+	this->alphaScale=0.0;
+	return grown;
+}
 
+/*
+ * CRF_StateNode::resetView
+ *
+ * Input: see constructor
+ *
+ * Same as reset(), but the node only points at fb and never frees it.  Used with a
+ * CRF_FeatureSlab that holds the features of the whole sequence; fb must stay valid for as
+ * long as the node is used.
+ */
+void CRF_StateNode::resetView(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	if (this->ftrBuf != NULL && this->ftrBufOwned && this->ftrBuf != fb) {
+		delete [] this->ftrBuf;
+	}
 	this->ftrBuf=fb;
 	this->ftrBuf_size=sizeof_fb;
+	this->ftrBuf_capacity=0;
+	this->ftrBufOwned=false;
+	this->ftrView.numBlocks=0;
+	this->trackFtrMem();
+	this->label=lab;
+	this->crf_ptr=crf_in;
+	this->alphaScale=0.0;
+}
+
+/*
+ * CRF_StateNode::resetFtrView
+ *
+ * Input: fv - frame of a joined feature stream (see CRF_JoinedFeatureStream)
+ *        sizeof_fb - number of features in the frame
+ *        lab, crf_in - see constructor
+ *
+ * Returns: true if the feature buffer of the node had to be (re)allocated
+ *
+ * Same as reset(), for features seen through a CRF_FtrView.  This version gathers the frame
+ * into a buffer the node owns, as resetCopy() does, since the subclasses read ftrBuf
+ * directly.  Nodes that score through the ftrStateValue() family keep the view instead.
+ */
+bool CRF_StateNode::resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	bool grown=false;
+	if (!this->ftrBufOwned) {
+		this->ftrBuf=NULL;
+		this->ftrBufOwned=true;
+	}
+	if (this->ftrBuf == NULL || this->ftrBuf_capacity < sizeof_fb) {
+		delete [] this->ftrBuf;
+		this->ftrBuf=new float[sizeof_fb];
+		this->ftrBuf_capacity=sizeof_fb;
+		this->trackFtrMem();
+		grown=true;
+	}
+	fv->gather(this->ftrBuf);
+	this->ftrBuf_size=sizeof_fb;
+	this->ftrView.numBlocks=0;
 	this->label=lab;
 	this->crf_ptr=crf_in;
 	this->alphaScale=0.0;
+	return grown;
+}
+
+/*
+ * CRF_StateNode::ftrStateValue
+ *
+ * Input: *lambda, clab - see CRF_FeatureMap::computeStateArrayValue
+ *
+ * Returns: state value of label clab on the features of the node, read from the view if the
+ *   node has one and from ftrBuf otherwise
+ */
+double CRF_StateNode::ftrStateValue(double* lambda, QNUInt32 clab)
+{
+	if (this->ftrView.numBlocks > 0) {
+		return this->crf_ptr->getFeatureMap()->computeStateArrayValueView(&(this->ftrView),lambda,clab);
+	}
+	return this->crf_ptr->getFeatureMap()->computeStateArrayValue(this->ftrBuf,lambda,clab);
+}
+
+/*
+ * CRF_StateNode::ftrTransValue
+ *
+ * Input: *lambda, plab, clab - see CRF_FeatureMap::computeTransMatrixValue
+ *
+ * Returns: transition value of plab->clab on the features of the node
+ */
+double CRF_StateNode::ftrTransValue(double* lambda, QNUInt32 plab, QNUInt32 clab)
+{
+	if (this->ftrView.numBlocks > 0) {
+		return this->crf_ptr->getFeatureMap()->computeTransMatrixValueView(&(this->ftrView),lambda,plab,clab);
+	}
+	return this->crf_ptr->getFeatureMap()->computeTransMatrixValue(this->ftrBuf,lambda,plab,clab);
+}
+
+/*
+ * CRF_StateNode::ftrStateExpF
+ *
+ * Input: see CRF_FeatureMap::computeStateExpF
+ *
+ * Returns: log likelihood of the state features of the node
+ */
+double CRF_StateNode::ftrStateExpF(double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab)
+{
+	if (this->ftrView.numBlocks > 0) {
+		return this->crf_ptr->getFeatureMap()->computeStateExpFView(&(this->ftrView),lambda,ExpF,grad,alpha_beta,t_clab,clab);
+	}
+	return this->crf_ptr->getFeatureMap()->computeStateExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,t_clab,clab);
+}
+
+/*
+ * CRF_StateNode::ftrTransExpF
+ *
+ * Input: see CRF_FeatureMap::computeTransExpF
+ *
+ * Returns: log likelihood of the transition features of the node
+ */
+double CRF_StateNode::ftrTransExpF(double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab)
+{
+	if (this->ftrView.numBlocks > 0) {
+		return this->crf_ptr->getFeatureMap()->computeTransExpFView(&(this->ftrView),lambda,ExpF,grad,alpha_beta,t_plab,t_clab,plab,clab);
+	}
+	return this->crf_ptr->getFeatureMap()->computeTransExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,t_plab,t_clab,plab,clab);
 }
 
 /*
@@ -573,6 +866,15 @@ QNUInt32 CRF_StateNode::getFtrBufferSize() {
 	return this->ftrBuf_size;
 }
 
+/*
+ * CRF_StateNode::getFtrView
+ *
+ * Returns: the view the node reads its features from, or NULL if it uses its feature buffer
+ */
+const CRF_FtrView* CRF_StateNode::getFtrView() {
+	return (this->ftrView.numBlocks > 0)?&(this->ftrView):NULL;
+}
+
 // Added by Ryan
 /*
  * CRF_StateNode::setPrevNodes
@@ -693,6 +995,19 @@ double CRF_StateNode::getTempBeta(QNUInt32 cur_lab, QNUInt32 dur)
 	return 0.0;
 }
 
+/*
+ * CRF_StateNode::setKernel
+ *
+ * Input: kern - specialized kernel selected for the current utterance, or NULL
+ *
+ * Nodes that support CRF_SegNodeKernel use it in place of their virtual feature map
+ * calls when it is set.  Other nodes ignore it.
+ */
+void CRF_StateNode::setKernel(CRF_SegNodeKernel* kern)
+{
+	this->kernel = kern;
+}
+
 //// Added by Ryan
 ///*
 // * CRF_StateNode::deleteFtrBuf
@@ -16,6 +16,9 @@
 #include <vector>
 
 using namespace fst;
+
+class CRF_SegNodeKernel;
+
 /*
  * class CRF_StateNode
  *
@@ -30,6 +33,9 @@ class CRF_StateNode
 protected:
 	float* ftrBuf;
 	QNUInt32 ftrBuf_size;
+	QNUInt32 ftrBuf_capacity;
+	bool ftrBufOwned;
+	CRF_FtrView ftrView;	// features seen in place, used instead of ftrBuf when numBlocks>0
 	QNUInt32 label;
 	CRF_Model* crf_ptr;
 	double* alphaArray;
@@ -51,6 +57,22 @@ protected:
 	QNUInt32 numPrevNodes;
 	QNUInt32 numNextNodes;
 	QNUInt32 numAvailLabs;
+	CRF_SegNodeKernel* kernel;
+
+	// bytes of the node arrays, feature buffer and traceback tables reported to CRF_MemStats
+	size_t nodeMemBytes;
+	size_t ftrMemBytes;
+	size_t hypMemBytes;
+	virtual void trackMem(size_t old_bytes, size_t new_bytes);
+	virtual void trackFtrMem();
+	double* newNodeArray(size_t n);
+	void deleteNodeArray(double* arr, size_t n);
+	void assignNodeVector(vector<double>& vec, size_t n, double value);
+
+	double ftrStateValue(double* lambda, QNUInt32 clab);
+	double ftrTransValue(double* lambda, QNUInt32 plab, QNUInt32 clab);
+	double ftrStateExpF(double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_clab, QNUInt32 clab);
+	double ftrTransExpF(double* lambda, double* ExpF, double* grad, double alpha_beta, QNUInt32 t_plab, QNUInt32 t_clab, QNUInt32 plab, QNUInt32 clab);
 
 public:
 
@@ -74,10 +96,14 @@ public:
 	virtual double* computeAlphaBeta(double Zx);
 	virtual void setTailBeta();
 	virtual double computeExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab);
+	virtual double computeTransExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma);
 	virtual double computeSoftExpF(double* ExpF, double* grad, double Zx, double soft_Zx, double* prev_alpha, vector<double>* prevAlphaAligned, bool firstFrame);
 	virtual double computeAlphaSum();
 	virtual double computeAlphaAlignedSum();
 	virtual void reset(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
+	virtual bool resetCopy(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
+	virtual void resetView(float *fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
+	virtual bool resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
 	virtual double* getAlpha();
 	virtual double* getPrevAlpha();
 	virtual double* getBeta();
@@ -94,6 +120,7 @@ public:
 	static CRF_StateNode* createStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf);
 	virtual float *getFtrBuffer();
 	virtual QNUInt32 getFtrBufferSize();
+	virtual const CRF_FtrView* getFtrView();
 
 	// Added by Ryan
 	static CRF_StateNode* createStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab,
@@ -113,6 +140,9 @@ public:
 	virtual double getStateValue(QNUInt32 cur_lab, QNUInt32 dur);
 	virtual double getFullTransValue(QNUInt32 prev_lab, QNUInt32 cur_lab, QNUInt32 dur);
 	virtual double getTempBeta(QNUInt32 cur_lab, QNUInt32 dur);
+	virtual void setKernel(CRF_SegNodeKernel* kern);
+	virtual void trackViterbiMem();
+	virtual size_t getMemBytes();
 //	virtual void deleteFtrBuf();
 };
 
@@ -9,12 +9,19 @@
 #include "CRF_StateVector.h"
 
 #include "CRF_StateNode.h"
+#include "../utils/CRF_Utils.h"
 
 /*
  * CRF_StateVector constructor
  */
 CRF_StateVector::CRF_StateVector()
+	: nodeCount(0),
+	  kernel(NULL)
 {
+	this->allocStats.nodeAllocs=0;
+	this->allocStats.ftrBufAllocs=0;
+	this->allocStats.linkAllocs=0;
+	this->allocStats.scratchAllocs=0;
 }
 
 /*
@@ -23,6 +30,13 @@ CRF_StateVector::CRF_StateVector()
 CRF_StateVector::~CRF_StateVector()
 {
 	this->deleteAll();
+	delete this->kernel;
+	for (size_t n=0;n<this->prevLinks.size();n++) {
+		delete [] this->prevLinks[n];
+	}
+	for (size_t n=0;n<this->nextLinks.size();n++) {
+		delete [] this->nextLinks[n];
+	}
 	//cerr << "in statevector destructor" << endl;
 	// vector destroys objects, but not pointers to objects
 }
@@ -57,6 +71,9 @@ void CRF_StateVector::set(QNUInt32 idx, float* new_buf, QNUInt32 num_ftrs,
 		QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
 		QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
 {
+	if (idx == 0) {
+		this->selectKernel(crf_in);
+	}
 	if (idx >= this->size() ) {
 		this->push_back( CRF_StateNode::createStateNode(new_buf,num_ftrs,lab_buf,crf_in,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs));
 	}
@@ -64,6 +81,423 @@ void CRF_StateVector::set(QNUInt32 idx, float* new_buf, QNUInt32 num_ftrs,
 		// By Ryan: For CRF_StdSegStateNode, the parameters nodeMaxDur, prevNode_nLabs and nextNode_nActualLabs should not be changed for the same node index.
 		this->at(idx)->reset(new_buf,num_ftrs,lab_buf,crf_in);
 	}
+	this->at(idx)->setKernel(this->kernel);
+}
+
+/*
+ * CRF_StateVector::setCopy
+ *
+ * Input: idx - index for current state node being created/set
+ *        buf - feature buffer, copied into the node (the caller keeps ownership)
+ *        num_ftrs, lab_buf, crf_in - see constructor for CRF_StateNode
+ *
+ * Same as set(), but never takes ownership of buf, so the caller can pass the same read
+ * buffer for every node.  A node reused from an earlier sequence only reallocates its
+ * feature buffer if buf is larger than any buffer it has held before.
+ */
+void CRF_StateVector::setCopy(QNUInt32 idx, float* buf, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in)
+{
+	if (idx >= this->size() ) {
+		float* new_buf = new float[num_ftrs];
+		memcpy(new_buf,buf,num_ftrs*sizeof(float));
+		this->push_back( CRF_StateNode::createStateNode(new_buf,num_ftrs,lab_buf,crf_in));
+		this->allocStats.nodeAllocs++;
+		this->allocStats.ftrBufAllocs++;
+	}
+	else if (this->at(idx)->resetCopy(buf,num_ftrs,lab_buf,crf_in)) {
+		this->allocStats.ftrBufAllocs++;
+	}
+}
+
+/*
+ * CRF_StateVector::setCopy
+ *
+ * Input: idx - index for current state node being created/set
+ *        buf - feature buffer, copied into the node (the caller keeps ownership)
+ *        num_ftrs, lab_buf, crf_in,
+ *        nodeMaxDur, prevNode_nLabs, nextNode_nActualLabs
+ *        - see constructor for CRF_StateNode
+ *
+ * Segmental version of setCopy().
+ */
+void CRF_StateVector::setCopy(QNUInt32 idx, float* buf, QNUInt32 num_ftrs,
+		QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
+		QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
+{
+	if (idx == 0) {
+		this->selectKernel(crf_in);
+	}
+	if (idx >= this->size() ) {
+		float* new_buf = new float[num_ftrs];
+		memcpy(new_buf,buf,num_ftrs*sizeof(float));
+		this->push_back( CRF_StateNode::createStateNode(new_buf,num_ftrs,lab_buf,crf_in,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs));
+		this->allocStats.nodeAllocs++;
+		this->allocStats.ftrBufAllocs++;
+	}
+	else if (this->at(idx)->resetCopy(buf,num_ftrs,lab_buf,crf_in)) {
+		// By Ryan: For CRF_StdSegStateNode, the parameters nodeMaxDur, prevNode_nLabs and nextNode_nActualLabs should not be changed for the same node index.
+		this->allocStats.ftrBufAllocs++;
+	}
+	this->at(idx)->setKernel(this->kernel);
+}
+
+/*
+ * CRF_StateVector::setView
+ *
+ * Input: idx - index for current state node being created/set
+ *        buf - feature buffer, usually space in a CRF_FeatureSlab (the caller keeps ownership)
+ *        num_ftrs, lab_buf, crf_in - see constructor for CRF_StateNode
+ *
+ * Same as set(), but the node only points at buf, which must stay valid while the node is
+ * used.  Only creating a new node allocates.
+ */
+void CRF_StateVector::setView(QNUInt32 idx, float* buf, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in)
+{
+	if (idx >= this->size() ) {
+		this->push_back( CRF_StateNode::createStateNode(buf,num_ftrs,lab_buf,crf_in));
+		this->allocStats.nodeAllocs++;
+	}
+	this->at(idx)->resetView(buf,num_ftrs,lab_buf,crf_in);
+}
+
+/*
+ * CRF_StateVector::setFtrView
+ *
+ * Input: idx - index for current state node being created/set
+ *        fv - frame of a joined feature stream, valid until the stream moves to the next segment
+ *        num_ftrs, lab_buf, crf_in - see constructor for CRF_StateNode
+ *
+ * Same as setView(), for the frame-level models, with the features seen through a CRF_FtrView.
+ * CRF_StdStateNode and CRF_StdNStateNode keep the view; other nodes copy the frame.
+ */
+void CRF_StateVector::setFtrView(QNUInt32 idx, const CRF_FtrView* fv, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in)
+{
+	if (idx >= this->size() ) {
+		this->push_back( CRF_StateNode::createStateNode(NULL,num_ftrs,lab_buf,crf_in));
+		this->allocStats.nodeAllocs++;
+	}
+	if (this->at(idx)->resetFtrView(fv,num_ftrs,lab_buf,crf_in)) {
+		this->allocStats.ftrBufAllocs++;
+	}
+}
+
+/*
+ * CRF_StateVector::setView
+ *
+ * Input: idx - index for current state node being created/set
+ *        buf - feature buffer, usually space in a CRF_FeatureSlab (the caller keeps ownership)
+ *        num_ftrs, lab_buf, crf_in,
+ *        nodeMaxDur, prevNode_nLabs, nextNode_nActualLabs
+ *        - see constructor for CRF_StateNode
+ *
+ * Segmental version of setView().
+ */
+void CRF_StateVector::setView(QNUInt32 idx, float* buf, QNUInt32 num_ftrs,
+		QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
+		QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
+{
+	if (idx == 0) {
+		this->selectKernel(crf_in);
+	}
+	if (idx >= this->size() ) {
+		this->push_back( CRF_StateNode::createStateNode(buf,num_ftrs,lab_buf,crf_in,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs));
+		this->allocStats.nodeAllocs++;
+	}
+	this->at(idx)->resetView(buf,num_ftrs,lab_buf,crf_in);
+	this->at(idx)->setKernel(this->kernel);
+}
+
+/*
+ * CRF_StateVector::getLinks
+ *
+ * Input: links - per-index link arrays (prevLinks or nextLinks)
+ *        links_size - allocated size of each array in links
+ *        idx - node index
+ *        num - number of entries needed
+ *
+ * Returns: the link array kept for node idx, grown to hold at least num entries
+ */
+CRF_StateNode** CRF_StateVector::getLinks(vector<CRF_StateNode**>& links, vector<QNUInt32>& links_size,
+		QNUInt32 idx, QNUInt32 num)
+{
+	while (links.size() <= idx) {
+		links.push_back(NULL);
+		links_size.push_back(0);
+	}
+	if (links_size[idx] < num) {
+		delete [] links[idx];
+		links[idx] = new CRF_StateNode*[num];
+		links_size[idx] = num;
+		this->allocStats.linkAllocs++;
+	}
+	return links[idx];
+}
+
+/*
+ * CRF_StateVector::linkPrevNodes
+ *
+ * Input: idx - index of the node to link
+ *        numPrevNodes - number of nodes directly preceding idx that it can see
+ *
+ * Returns: the array of previous nodes passed to the node, or NULL if numPrevNodes is 0
+ *
+ * Replaces the per-node "new CRF_StateNode*[numPrevNodes]" in the segmental decoders and
+ * lattice builders.  The array is owned by the vector and stays valid until the node is
+ * linked again.
+ */
+CRF_StateNode** CRF_StateVector::linkPrevNodes(QNUInt32 idx, QNUInt32 numPrevNodes)
+{
+	CRF_StateNode** prevNodes = NULL;
+	if (numPrevNodes > 0)
+	{
+		prevNodes = this->getLinks(this->prevLinks, this->prevLinksSize, idx, numPrevNodes);
+		for (QNUInt32 i = 0; i < numPrevNodes; i++)
+		{
+			prevNodes[i] = this->at(idx - numPrevNodes + i);
+		}
+	}
+	this->at(idx)->setPrevNodes(prevNodes, numPrevNodes);
+	return prevNodes;
+}
+
+/*
+ * CRF_StateVector::linkNextNodes
+ *
+ * Input: idx - index of the node to link
+ *        numNextNodes - number of nodes directly following idx that it can see
+ *
+ * Returns: the array of next nodes passed to the node, or NULL if numNextNodes is 0
+ *
+ * Counterpart of linkPrevNodes() for the backward pass.
+ */
+CRF_StateNode** CRF_StateVector::linkNextNodes(QNUInt32 idx, QNUInt32 numNextNodes)
+{
+	CRF_StateNode** nextNodes = NULL;
+	if (numNextNodes > 0)
+	{
+		nextNodes = this->getLinks(this->nextLinks, this->nextLinksSize, idx, numNextNodes);
+		for (QNUInt32 i = 0; i < numNextNodes; i++)
+		{
+			nextNodes[i] = this->at(idx + 1 + i);
+		}
+	}
+	this->at(idx)->setNextNodes(nextNodes, numNextNodes);
+	return nextNodes;
+}
+
+/*
+ * CRF_StateVector::getAllocStats
+ *
+ * Returns: the allocation counters of this vector.  Users of the vector that keep their
+ *   own scratch buffers add their growth to scratchAllocs.
+ */
+CRF_AllocStats* CRF_StateVector::getAllocStats()
+{
+	return &(this->allocStats);
+}
+
+/*
+ * CRF_StateVector::getTotalAllocs
+ *
+ * Returns: sum of all the allocation counters of this vector
+ */
+QNUInt32 CRF_StateVector::getTotalAllocs()
+{
+	return this->allocStats.nodeAllocs + this->allocStats.ftrBufAllocs +
+			this->allocStats.linkAllocs + this->allocStats.scratchAllocs;
+}
+
+/*
+ * CRF_StateVector::setAlignmentMask
+ *
+ * Collapses the labels of the first nodeCount nodes into the sequence of label segments and
+ * sets, for each frame, the range of segments allowed there.  Segment k can only cover frame t
+ * if the k segments before it fit in the frames before t and the segments after it fit in the
+ * frames after t.
+ */
+void CRF_StateVector::setAlignmentMask()
+{
+	QNUInt32 numNodes = this->nodeCount;
+	this->maskSeq.clear();
+	for (QNUInt32 t=0; t<numNodes; t++) {
+		QNUInt32 lab = this->at(t)->getLabel();
+		if (lab >= this->at(t)->getNLabs()) {
+			string errstr="CRF_StateVector::setAlignmentMask() caught exception: node "+stringify(t)+" has no valid label";
+			throw runtime_error(errstr);
+		}
+		if (this->maskSeq.empty() || this->maskSeq.back() != lab) {
+			this->maskSeq.push_back(lab);
+		}
+	}
+	QNUInt32 numSegs = this->maskSeq.size();
+	this->maskLo.resize(numNodes);
+	this->maskHi.resize(numNodes);
+	this->maskOffset.resize(numNodes+1);
+	this->maskOffset[0] = 0;
+	for (QNUInt32 t=0; t<numNodes; t++) {
+		// numSegs <= numNodes, so both bounds stay inside [0,numSegs-1]
+		this->maskLo[t] = (t + numSegs > numNodes) ? t + numSegs - numNodes : 0;
+		this->maskHi[t] = (t < numSegs - 1) ? t : numSegs - 1;
+		this->maskOffset[t+1] = this->maskOffset[t] + this->maskHi[t] - this->maskLo[t] + 1;
+	}
+	if (this->maskAlpha.size() < this->maskOffset[numNodes]) {
+		this->maskAlpha.resize(this->maskOffset[numNodes]);
+		this->maskBeta.resize(this->maskOffset[numNodes]);
+		this->allocStats.scratchAllocs++;
+	}
+}
+
+/*
+ * CRF_StateVector::computeMaskedAlphaBeta
+ *
+ * Returns: log of the normalization constant of the label-constrained paths
+ *
+ * Runs the forward-backward over the segments allowed at each frame by setAlignmentMask.  A
+ * segment is entered either from itself (the label continues) or from the segment before it,
+ * with the full transition value of the node (see CRF_StateNode::getFullTransValue).  The alpha
+ * and beta values follow the convention of the nodes: alpha includes the state value of its
+ * frame, beta does not.
+ */
+double CRF_StateVector::computeMaskedAlphaBeta()
+{
+	this->setAlignmentMask();
+	QNUInt32 numNodes = this->nodeCount;
+	QNUInt32 lastNode = numNodes - 1;
+	QNUInt32 lastSeg = this->maskSeq.size() - 1;
+
+	this->maskAlpha[0] = this->at(0)->getStateValue(this->maskSeq[0]);
+	for (QNUInt32 t=1; t<numNodes; t++) {
+		CRF_StateNode* node = this->at(t);
+		const double* prev_alpha = &(this->maskAlpha[this->maskOffset[t-1]]);
+		QNUInt32 prev_lo = this->maskLo[t-1];
+		QNUInt32 prev_hi = this->maskHi[t-1];
+		double* alpha = &(this->maskAlpha[this->maskOffset[t]]);
+		for (QNUInt32 k=this->maskLo[t]; k<=this->maskHi[t]; k++) {
+			QNUInt32 clab = this->maskSeq[k];
+			double value = CRF_LogMath::LOG0;
+			bool found = false;
+			if (k >= prev_lo && k <= prev_hi) {
+				value = prev_alpha[k-prev_lo] + node->getFullTransValue(clab,clab);
+				found = true;
+			}
+			if (k > prev_lo && k-1 <= prev_hi) {
+				double entry = prev_alpha[k-1-prev_lo] + node->getFullTransValue(this->maskSeq[k-1],clab);
+				value = found ? logAdd(value,entry) : entry;
+			}
+			alpha[k-this->maskLo[t]] = value;
+		}
+	}
+
+	this->maskBeta[this->maskOffset[lastNode]] = 0.0;
+	for (QNUInt32 t=lastNode; t>0; t--) {
+		CRF_StateNode* node = this->at(t);
+		const double* next_beta = &(this->maskBeta[this->maskOffset[t]]);
+		QNUInt32 next_lo = this->maskLo[t];
+		QNUInt32 next_hi = this->maskHi[t];
+		double* beta = &(this->maskBeta[this->maskOffset[t-1]]);
+		for (QNUInt32 k=this->maskLo[t-1]; k<=this->maskHi[t-1]; k++) {
+			QNUInt32 plab = this->maskSeq[k];
+			double value = CRF_LogMath::LOG0;
+			bool found = false;
+			if (k >= next_lo && k <= next_hi) {
+				value = next_beta[k-next_lo] + node->getFullTransValue(plab,plab);
+				found = true;
+			}
+			if (k+1 >= next_lo && k+1 <= next_hi) {
+				double leave = next_beta[k+1-next_lo] + node->getFullTransValue(plab,this->maskSeq[k+1]);
+				value = found ? logAdd(value,leave) : leave;
+			}
+			beta[k-this->maskLo[t-1]] = value;
+		}
+	}
+	return this->maskAlpha[this->maskOffset[lastNode] + lastSeg - this->maskLo[lastNode]];
+}
+
+/*
+ * CRF_StateVector::getMaskLo
+ *
+ * Returns: first label segment allowed at node idx (see setAlignmentMask)
+ */
+QNUInt32 CRF_StateVector::getMaskLo(QNUInt32 idx)
+{
+	return this->maskLo[idx];
+}
+
+/*
+ * CRF_StateVector::getMaskHi
+ *
+ * Returns: last label segment allowed at node idx (see setAlignmentMask)
+ */
+QNUInt32 CRF_StateVector::getMaskHi(QNUInt32 idx)
+{
+	return this->maskHi[idx];
+}
+
+/*
+ * CRF_StateVector::getMaskLabel
+ *
+ * Returns: label of label segment seg
+ */
+QNUInt32 CRF_StateVector::getMaskLabel(QNUInt32 seg)
+{
+	return this->maskSeq[seg];
+}
+
+/*
+ * CRF_StateVector::getMaskedAlpha
+ *
+ * Returns: constrained alpha of segment seg at node idx, LOG0 if seg is not allowed there
+ */
+double CRF_StateVector::getMaskedAlpha(QNUInt32 idx, QNUInt32 seg)
+{
+	if (seg < this->maskLo[idx] || seg > this->maskHi[idx]) {
+		return CRF_LogMath::LOG0;
+	}
+	return this->maskAlpha[this->maskOffset[idx] + seg - this->maskLo[idx]];
+}
+
+/*
+ * CRF_StateVector::getMaskedBeta
+ *
+ * Returns: constrained beta of segment seg at node idx, LOG0 if seg is not allowed there
+ */
+double CRF_StateVector::getMaskedBeta(QNUInt32 idx, QNUInt32 seg)
+{
+	if (seg < this->maskLo[idx] || seg > this->maskHi[idx]) {
+		return CRF_LogMath::LOG0;
+	}
+	return this->maskBeta[this->maskOffset[idx] + seg - this->maskLo[idx]];
+}
+
+/*
+ * CRF_StateVector::selectKernel
+ *
+ * Input: crf_in - CRF model used by the nodes of the current sequence
+ *
+ * Picks the CRF_SegNodeKernel specialization for the model's feature map.  The kernel is
+ * kept across sequences and only rebuilt when the feature map changes.  It is dropped as
+ * soon as the map stops supporting kernels, e.g. when sparse or quantized weights are set
+ * on it.
+ */
+void CRF_StateVector::selectKernel(CRF_Model* crf_in)
+{
+	if (this->kernel != NULL && this->kernel->getFeatureMap() == crf_in->getFeatureMap() &&
+			crf_in->getFeatureMap()->supportsSegKernel()) {
+		return;
+	}
+	delete this->kernel;
+	this->kernel = CRF_SegNodeKernel::createKernel(crf_in);
+}
+
+/*
+ * CRF_StateVector::getKernel
+ *
+ * Returns: the kernel selected for the current sequence, or NULL if the nodes use
+ *   their virtual path
+ */
+CRF_SegNodeKernel* CRF_StateVector::getKernel()
+{
+	return this->kernel;
 }
 
 /*
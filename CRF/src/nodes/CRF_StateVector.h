@@ -13,6 +13,22 @@
 #include "../CRF.h"
 #include "../CRF_Model.h"
 #include "CRF_StateNode.h"
+#include "CRF_SegNodeKernel.h"
+
+/*
+ * struct CRF_AllocStats
+ *
+ * Counts the heap allocations made by a CRF_StateVector and by the decoders and lattice
+ * builders sharing it.  Once the vector has seen its longest sequence, none of these
+ * counters should move.
+ */
+struct CRF_AllocStats
+{
+	QNUInt32 nodeAllocs;	// state nodes created
+	QNUInt32 ftrBufAllocs;	// node feature buffers (re)allocated
+	QNUInt32 linkAllocs;	// prev/next node link arrays (re)allocated
+	QNUInt32 scratchAllocs;	// scratch buffers grown by the users of the vector
+};
 
 /*
  * class CRF_StateVector
@@ -22,11 +38,42 @@
  * CRF_StateVector uses the factor class createStateNode in CRF_StateNode to generate the right
  * kind of state based on the crf model used in the function "set".
  *
+ * For segmental models it also selects, once per sequence, the CRF_SegNodeKernel
+ * specialization matching the feature map and hands it to every node it sets.
+ *
+ * The setCopy and link functions let a caller reuse the vector across sequences without
+ * allocating: feature buffers are copied into the buffers the nodes already own, and the
+ * prev/next node arrays are kept per node index.  Allocations made on the way are counted
+ * in a CRF_AllocStats.  The setView functions go one step further and let the nodes point
+ * into a CRF_FeatureSlab holding the features of the whole sequence, so nothing is copied.
+ * setFtrView does the same for the frames of a CRF_JoinedFeatureStream, seen in place.
+ *
+ * computeMaskedAlphaBeta runs the label-constrained ("soft" numerator) forward-backward directly
+ * over the nodes.  The node labels are collapsed into the sequence of label segments, and at each
+ * frame only the segments that can still cover that frame are allowed; the paths allowed are the
+ * paths of the composition of the CRF lattice with the label acceptor of CRF_LatticeBuilder, but no
+ * fst is built.  The nodes' transition matrices must already be computed.
+ *
  */
 class CRF_StateVector : public vector <CRF_StateNode*>
 {
 private:
 	QNUInt32 nodeCount;
+	CRF_SegNodeKernel* kernel;
+	vector<CRF_StateNode**> prevLinks;
+	vector<CRF_StateNode**> nextLinks;
+	vector<QNUInt32> prevLinksSize;
+	vector<QNUInt32> nextLinksSize;
+	CRF_AllocStats allocStats;
+	vector<QNUInt32> maskSeq;
+	vector<QNUInt32> maskLo;
+	vector<QNUInt32> maskHi;
+	vector<QNUInt32> maskOffset;
+	vector<double> maskAlpha;
+	vector<double> maskBeta;
+	virtual void selectKernel(CRF_Model* crf_in);
+	virtual CRF_StateNode** getLinks(vector<CRF_StateNode**>& links, vector<QNUInt32>& links_size,
+			QNUInt32 idx, QNUInt32 num);
 public:
 	CRF_StateVector();
 	virtual ~CRF_StateVector();
@@ -34,11 +81,32 @@ public:
 	virtual void setNodeCount(QNUInt32 cnt);
 	virtual QNUInt32 getNodeCount();
 	virtual void deleteAll();
+	virtual CRF_SegNodeKernel* getKernel();
+	virtual void setCopy(QNUInt32 idx, float* buf, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in);
+	virtual void setView(QNUInt32 idx, float* buf, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in);
+	virtual void setFtrView(QNUInt32 idx, const CRF_FtrView* fv, QNUInt32 num_ftrs, QNUInt32 lab_buf, CRF_Model* crf_in);
+	virtual CRF_StateNode** linkPrevNodes(QNUInt32 idx, QNUInt32 numPrevNodes);
+	virtual CRF_StateNode** linkNextNodes(QNUInt32 idx, QNUInt32 numNextNodes);
+	virtual CRF_AllocStats* getAllocStats();
+	virtual QNUInt32 getTotalAllocs();
+	virtual void setAlignmentMask();
+	virtual double computeMaskedAlphaBeta();
+	virtual QNUInt32 getMaskLo(QNUInt32 idx);
+	virtual QNUInt32 getMaskHi(QNUInt32 idx);
+	virtual QNUInt32 getMaskLabel(QNUInt32 seg);
+	virtual double getMaskedAlpha(QNUInt32 idx, QNUInt32 seg);
+	virtual double getMaskedBeta(QNUInt32 idx, QNUInt32 seg);
 
 	// Added by Ryan
 	virtual void set(QNUInt32 idx, float* new_buf, QNUInt32 num_ftrs,
 			QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
 			QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs);
+	virtual void setCopy(QNUInt32 idx, float* buf, QNUInt32 num_ftrs,
+			QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
+			QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs);
+	virtual void setView(QNUInt32 idx, float* buf, QNUInt32 num_ftrs,
+			QNUInt32 lab_buf, CRF_Model* crf_in, QNUInt32 nodeMaxDur,
+			QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs);
 };
 
 #endif /*CRF_STATEVECTOR_H_*/
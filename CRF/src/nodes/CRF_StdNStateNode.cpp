@@ -22,19 +22,19 @@ CRF_StdNStateNode::CRF_StdNStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab
 		throw runtime_error(errstr);
 	}
 	this->nFullLabs = nLabs/this->nStates;
-	this->stateArray = new double[nLabs];
-	this->denseTransMatrix = new double[nFullLabs*nFullLabs]; // Dense transition matrix
-	this->diagTransMatrix = new double[nLabs];
-	this->offDiagTransMatrix = new double[nLabs];
-	this->alphaArray = new double[nLabs];
-	this->betaArray = new double[nLabs];
-	this->alphaBetaArray = new double[nLabs];
-	this->tempBeta = new double[nLabs];
+	this->stateArray = this->newNodeArray(nLabs);
+	this->denseTransMatrix = this->newNodeArray(nFullLabs*nFullLabs); // Dense transition matrix
+	this->diagTransMatrix = this->newNodeArray(nLabs);
+	this->offDiagTransMatrix = this->newNodeArray(nLabs);
+	this->alphaArray = this->newNodeArray(nLabs);
+	this->betaArray = this->newNodeArray(nLabs);
+	this->alphaBetaArray = this->newNodeArray(nLabs);
+	this->tempBeta = this->newNodeArray(nLabs);
 	this->alphaSize = nLabs;
 	this->alphaScale = 0.0;
-	this->logAddAcc = new double[nLabs];
-	this->alphaArrayAligned.assign(nLabs,CRF_LogMath::LOG0);
-	this->betaArrayAligned.assign(nLabs,CRF_LogMath::LOG0);
+	this->logAddAcc = this->newNodeArray(nLabs);
+	this->assignNodeVector(this->alphaArrayAligned,nLabs,CRF_LogMath::LOG0);
+	this->assignNodeVector(this->betaArrayAligned,nLabs,CRF_LogMath::LOG0);
 }
 
 /*
@@ -53,6 +53,23 @@ CRF_StdNStateNode::~CRF_StdNStateNode()
 	delete [] this->logAddAcc;
 }
 
+/*
+ * CRF_StdNStateNode::resetFtrView
+ *
+ * Input: see CRF_StateNode::resetFtrView
+ *
+ * Returns: false, nothing is allocated
+ *
+ * Keeps the view itself: the node reads its features through the ftrStateValue() family,
+ * which index the blocks of the view in place.
+ */
+bool CRF_StdNStateNode::resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	this->resetView(NULL,sizeof_fb,lab,crf_in);
+	this->ftrView=*fv;
+	return false;
+}
+
 /*
  * CRF_StdNStateNode::computeTransMatrix
  *
@@ -72,11 +89,11 @@ double CRF_StdNStateNode::computeTransMatrix()
 
 	for (QNUInt32 clab=0; clab<nLabs; clab++) {
 
-		this->stateArray[clab]=this->crf_ptr->getFeatureMap()->computeStateArrayValue(this->ftrBuf,lambda,clab);
+		this->stateArray[clab]=this->ftrStateValue(lambda,clab);
 
 		// Here we need to work some magic.  All entries on the diagonal get their self transition assigned
 		//this->diagTransMatrix[clab]=this->crf_ptr->getFeatureMap()->computeMij(this->ftrBuf,lambda,lc,clab,clab);
-		this->diagTransMatrix[clab]=this->crf_ptr->getFeatureMap()->computeTransMatrixValue(this->ftrBuf,lambda,clab,clab);
+		this->diagTransMatrix[clab]=this->ftrTransValue(lambda,clab,clab);
 
 		// Besides the diagonal, we need to update the off-diagonal or the dense transition matrix
 		// dense transition matrix is updated when the current label is a start state (e.g. when the
@@ -87,13 +104,13 @@ double CRF_StdNStateNode::computeTransMatrix()
 				QNUInt32 idx=plab*nFullLabs+clab/this->nStates;
 				// And our previous label is actually the end state for the previous "label"
 				QNUInt32 real_plab = plab*nStates+nStates-1;  // real_plab is the end state
-				this->denseTransMatrix[idx]=this->crf_ptr->getFeatureMap()->computeTransMatrixValue(this->ftrBuf,lambda,real_plab,clab);
+				this->denseTransMatrix[idx]=this->ftrTransValue(lambda,real_plab,clab);
 			}
 		}
 		else {
 			// We're on the off-diagonal - clab is not a start  state and the only previous
 			// transition must be from the immediate prior state (e.g. clab-1)
-			this->offDiagTransMatrix[clab-1]=this->crf_ptr->getFeatureMap()->computeTransMatrixValue(this->ftrBuf,lambda,clab-1,clab);
+			this->offDiagTransMatrix[clab-1]=this->ftrTransValue(lambda,clab-1,clab);
 		}
 	}
 	return result;
@@ -301,7 +318,7 @@ double CRF_StdNStateNode::computeExpF(double* ExpF, double* grad, double Zx, dou
 	for (QNUInt32 clab=0; clab<nLabs; clab++) {
 		alpha_beta=expE(this->alphaArray[clab]+this->betaArray[clab]-Zx);
 		alpha_beta_tot += alpha_beta;
-		logLi+=this->crf_ptr->getFeatureMap()->computeStateExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,this->label,clab);
+		logLi+=this->ftrStateExpF(lambda,ExpF,grad,alpha_beta,this->label,clab);
 		// With the new transition matrices, we need to be careful.  The order of this computation needs to
 		// match the computeTransitionMatrix code above
 		if (prev_lab > nLabs) {
@@ -314,7 +331,7 @@ double CRF_StdNStateNode::computeExpF(double* ExpF, double* grad, double Zx, dou
 			// First we compute the self transitions
 			alpha_beta=expE(prev_alpha[clab]+this->diagTransMatrix[clab]+this->stateArray[clab]+this->betaArray[clab]-Zx);
 			alpha_beta_trans_tot+=alpha_beta;
-			logLi+=this->crf_ptr->getFeatureMap()->computeTransExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,prev_lab,this->label,clab,clab);
+			logLi+=this->ftrTransExpF(lambda,ExpF,grad,alpha_beta,prev_lab,this->label,clab,clab);
 
 			// Next we check to see if the clab state is an end state or not
 			if (clab % this->nStates == 0) {
@@ -327,14 +344,14 @@ double CRF_StdNStateNode::computeExpF(double* ExpF, double* grad, double Zx, dou
 					QNUInt32 real_plab = plab*nStates+nStates-1;  // real_plab is the end state
 					alpha_beta=expE(prev_alpha[real_plab]+this->denseTransMatrix[idx]+this->stateArray[clab]+this->betaArray[clab]-Zx);
 					alpha_beta_trans_tot+=alpha_beta;
-					logLi+=this->crf_ptr->getFeatureMap()->computeTransExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,prev_lab,this->label,real_plab,clab);
+					logLi+=this->ftrTransExpF(lambda,ExpF,grad,alpha_beta,prev_lab,this->label,real_plab,clab);
 				}
 			}
 			else {
 				// If not, we only update the lambda values on the offDiagonal
 				alpha_beta=expE(prev_alpha[clab-1]+this->offDiagTransMatrix[clab-1]+this->stateArray[clab]+this->betaArray[clab]-Zx);
 				alpha_beta_trans_tot+=alpha_beta;
-				logLi+=this->crf_ptr->getFeatureMap()->computeTransExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,prev_lab,this->label,clab-1,clab);
+				logLi+=this->ftrTransExpF(lambda,ExpF,grad,alpha_beta,prev_lab,this->label,clab-1,clab);
 			}
 		}
 	}
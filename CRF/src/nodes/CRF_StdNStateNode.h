@@ -35,6 +35,7 @@ protected:
 public:
 	CRF_StdNStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf);
 	virtual ~CRF_StdNStateNode();
+	virtual bool resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
 	virtual double computeTransMatrix();
 //	virtual double computeTransMatrixLog();
 	virtual double computeAlpha(double* prev_alpha);
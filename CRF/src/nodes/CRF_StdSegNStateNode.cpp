@@ -76,6 +76,21 @@ CRF_StdSegNStateNode::~CRF_StdSegNStateNode() {
 	// transMatrix will be deleted in the base class.
 }
 
+/*
+ * CRF_StdSegNStateNode::resetFtrView
+ *
+ * Input: see CRF_StateNode::resetFtrView
+ *
+ * Returns: true if the feature buffer of the node had to be (re)allocated
+ *
+ * The segmental nodes slice ftrBuf by duration, so the frame is gathered into the node's own
+ * buffer instead of keeping the view as the parent class does.
+ */
+bool CRF_StdSegNStateNode::resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	return CRF_StateNode::resetFtrView(fv,sizeof_fb,lab,crf_in);
+}
+
 /*
  * CRF_StdSegNStateNode::computeTransMatrix
  *
@@ -24,6 +24,7 @@ protected:
 public:
 	CRF_StdSegNStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf, QNUInt32 nodeMaxDur, QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs);
 	virtual ~CRF_StdSegNStateNode();
+	virtual bool resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
 	virtual double computeTransMatrix();
 	virtual double computeAlpha();
 	virtual double computeFirstAlpha();
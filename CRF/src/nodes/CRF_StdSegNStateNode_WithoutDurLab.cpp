@@ -13,14 +13,14 @@ CRF_StdSegNStateNode_WithoutDurLab::CRF_StdSegNStateNode_WithoutDurLab(float* fb
 	this->nActualLabs = nLabs;
 	this->numAvailLabs = this->nActualLabs;
 
-	this->alphaArray_WithDur = new double[this->nActualLabs * this->nodeLabMaxDur];
+	this->alphaArray_WithDur = this->newNodeArray(this->nActualLabs * this->nodeLabMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //		this->alphaArray_WithDur[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->stateArray;
-	this->stateArray = new double[this->nActualLabs * this->nodeLabMaxDur];
+	this->deleteNodeArray(this->stateArray,nLabs);
+	this->stateArray = this->newNodeArray(this->nActualLabs * this->nodeLabMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //      // Changed by Ryan. It should be CRF_LogMath::LOG0 instead of 0.0. TODO: verify.
@@ -28,24 +28,24 @@ CRF_StdSegNStateNode_WithoutDurLab::CRF_StdSegNStateNode_WithoutDurLab(float* fb
 //      this->stateArray[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->denseTransMatrix;
-	delete [] this->diagTransMatrix;
-	delete [] this->offDiagTransMatrix;
-	this->denseTransMatrix = new double[nFullLabs * nFullLabs * this->nodeLabMaxDur]; // Dense transition matrix
-	this->diagTransMatrix = new double[nLabs * this->nodeLabMaxDur];
-	this->offDiagTransMatrix = new double[nLabs * this->nodeLabMaxDur];
+	this->deleteNodeArray(this->denseTransMatrix,nFullLabs*nFullLabs);
+	this->deleteNodeArray(this->diagTransMatrix,nLabs);
+	this->deleteNodeArray(this->offDiagTransMatrix,nLabs);
+	this->denseTransMatrix = this->newNodeArray(nFullLabs * nFullLabs * this->nodeLabMaxDur); // Dense transition matrix
+	this->diagTransMatrix = this->newNodeArray(nLabs * this->nodeLabMaxDur);
+	this->offDiagTransMatrix = this->newNodeArray(nLabs * this->nodeLabMaxDur);
 
-	delete [] this->tempBeta;
-	this->tempBeta = new double[this->nActualLabs * this->labMaxDur];  // this tempBeta is beta(phone, dur, endtime)*stateValue(phone, dur, endtime) for current node, which is different from tempBeta in CRF_StdSegStateNode.
+	this->deleteNodeArray(this->tempBeta,nLabs);
+	this->tempBeta = this->newNodeArray(this->nActualLabs * this->labMaxDur);  // this tempBeta is beta(phone, dur, endtime)*stateValue(phone, dur, endtime) for current node, which is different from tempBeta in CRF_StdSegStateNode.
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->labMaxDur; id++)
 //	{
 //		this->tempBeta[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->logAddAcc;
+	this->deleteNodeArray(this->logAddAcc,nLabs);
 	// this->nActualLabs is for cross phone transitions,
 	// 2 is for the self transition and the transition from previous internal state.
-	this->logAddAcc = new double[(this->nActualLabs + 2) * this->labMaxDur];
+	this->logAddAcc = this->newNodeArray((this->nActualLabs + 2) * this->labMaxDur);
 //	for (QNUInt32 id = 0; id < (this->nActualLabs + 2) * this->labMaxDur; id++)
 //	{
 //		this->logAddAcc[id] = CRF_LogMath::LOG0;
@@ -10,15 +10,15 @@
 CRF_StdSegNStateNode_WithoutDurLab_WithoutSegTransFtr::CRF_StdSegNStateNode_WithoutDurLab_WithoutSegTransFtr(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf, QNUInt32 nodeMaxDur, QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
 	: CRF_StdSegNStateNode_WithoutDurLab(fb, sizeof_fb, lab, crf, nodeMaxDur, prevNode_nLabs, nextNode_nActualLabs)
 {
-	delete [] this->denseTransMatrix;
-	delete [] this->diagTransMatrix;
-	delete [] this->offDiagTransMatrix;
-	this->denseTransMatrix = new double[nFullLabs * nFullLabs]; // Dense transition matrix
-	this->diagTransMatrix = new double[nLabs];
-	this->offDiagTransMatrix = new double[nLabs];
-
-	alphaPlusTrans = new double[this->nActualLabs];
-	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = new double[this->nActualLabs];
+	this->deleteNodeArray(this->denseTransMatrix,nFullLabs*nFullLabs*this->nodeLabMaxDur);
+	this->deleteNodeArray(this->diagTransMatrix,nLabs*this->nodeLabMaxDur);
+	this->deleteNodeArray(this->offDiagTransMatrix,nLabs*this->nodeLabMaxDur);
+	this->denseTransMatrix = this->newNodeArray(nFullLabs * nFullLabs); // Dense transition matrix
+	this->diagTransMatrix = this->newNodeArray(nLabs);
+	this->offDiagTransMatrix = this->newNodeArray(nLabs);
+
+	alphaPlusTrans = this->newNodeArray(this->nActualLabs);
+	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = this->newNodeArray(this->nActualLabs);
 }
 
 CRF_StdSegNStateNode_WithoutDurLab_WithoutSegTransFtr::~CRF_StdSegNStateNode_WithoutDurLab_WithoutSegTransFtr()
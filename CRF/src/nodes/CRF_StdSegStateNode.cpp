@@ -63,8 +63,8 @@ CRF_StdSegStateNode::CRF_StdSegStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32
 
 	// transMatrix created in the base class has same size of horizontal and vertical indice.
 	// but we need them to be different for this class.
-	delete [] this->transMatrix;
-	this->transMatrix = new double[this->prevNodeNLabs * this->nLabs];
+	this->deleteNodeArray(this->transMatrix,this->nLabs*this->nLabs);
+	this->transMatrix = this->newNodeArray(this->prevNodeNLabs * this->nLabs);
 }
 
 /*
@@ -74,6 +74,21 @@ CRF_StdSegStateNode::~CRF_StdSegStateNode() {
 	// transMatrix will be deleted in the base class.
 }
 
+/*
+ * CRF_StdSegStateNode::resetFtrView
+ *
+ * Input: see CRF_StateNode::resetFtrView
+ *
+ * Returns: true if the feature buffer of the node had to be (re)allocated
+ *
+ * The segmental nodes slice ftrBuf by duration, so the frame is gathered into the node's own
+ * buffer instead of keeping the view as the parent class does.
+ */
+bool CRF_StdSegStateNode::resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	return CRF_StateNode::resetFtrView(fv,sizeof_fb,lab,crf_in);
+}
+
 /*
  * CRF_StdSegStateNode::computeTransMatrix
  *
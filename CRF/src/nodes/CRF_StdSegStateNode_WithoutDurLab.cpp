@@ -13,14 +13,14 @@ CRF_StdSegStateNode_WithoutDurLab::CRF_StdSegStateNode_WithoutDurLab(float* fb,
 	this->nActualLabs = nLabs;
 	this->numAvailLabs = this->nActualLabs;
 
-	this->alphaArray_WithDur = new double[this->nActualLabs * this->nodeLabMaxDur];
+	this->alphaArray_WithDur = this->newNodeArray(this->nActualLabs * this->nodeLabMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //		this->alphaArray_WithDur[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->stateArray;
-	this->stateArray = new double[this->nActualLabs * this->nodeLabMaxDur];
+	this->deleteNodeArray(this->stateArray,nLabs);
+	this->stateArray = this->newNodeArray(this->nActualLabs * this->nodeLabMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //		// Changed by Ryan. It should be CRF_LogMath::LOG0 instead of 0.0. TODO: verify.
@@ -28,8 +28,8 @@ CRF_StdSegStateNode_WithoutDurLab::CRF_StdSegStateNode_WithoutDurLab(float* fb,
 //		this->stateArray[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->transMatrix;
-	this->transMatrix = new double[this->nActualLabs * this->nActualLabs * this->nodeLabMaxDur];
+	this->deleteNodeArray(this->transMatrix,this->prevNodeNLabs*nLabs);
+	this->transMatrix = this->newNodeArray(this->nActualLabs * this->nActualLabs * this->nodeLabMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //		// Changed by Ryan. It should be CRF_LogMath::LOG0 instead of 0.0. TODO: verify.
@@ -37,15 +37,15 @@ CRF_StdSegStateNode_WithoutDurLab::CRF_StdSegStateNode_WithoutDurLab(float* fb,
 //		this->transMatrix[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->tempBeta;
-	this->tempBeta = new double[this->nActualLabs * this->labMaxDur];  // this tempBeta is beta(phone, dur, endtime)*stateValue(phone, dur, endtime) for current node, which is different from tempBeta in CRF_StdSegStateNode.
+	this->deleteNodeArray(this->tempBeta,nLabs);
+	this->tempBeta = this->newNodeArray(this->nActualLabs * this->labMaxDur);  // this tempBeta is beta(phone, dur, endtime)*stateValue(phone, dur, endtime) for current node, which is different from tempBeta in CRF_StdSegStateNode.
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->labMaxDur; id++)
 //	{
 //		this->tempBeta[id] = CRF_LogMath::LOG0;
 //	}
 
-	delete [] this->logAddAcc;
-	this->logAddAcc = new double[this->nActualLabs * this->labMaxDur];
+	this->deleteNodeArray(this->logAddAcc,nLabs);
+	this->logAddAcc = this->newNodeArray(this->nActualLabs * this->labMaxDur);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->labMaxDur; id++)
 //	{
 //		this->logAddAcc[id] = CRF_LogMath::LOG0;
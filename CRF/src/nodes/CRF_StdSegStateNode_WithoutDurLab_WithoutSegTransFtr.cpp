@@ -11,8 +11,8 @@
 CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf, QNUInt32 nodeMaxDur, QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
 	: CRF_StdSegStateNode_WithoutDurLab(fb, sizeof_fb, lab, crf, nodeMaxDur, prevNode_nLabs, nextNode_nActualLabs)
 {
-	delete [] this->transMatrix;
-	this->transMatrix = new double[this->nActualLabs * this->nActualLabs];
+	this->deleteNodeArray(this->transMatrix,this->nActualLabs*this->nActualLabs*this->nodeLabMaxDur);
+	this->transMatrix = this->newNodeArray(this->nActualLabs * this->nActualLabs);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nActualLabs; id++)
 //	{
 //      // Changed by Ryan. It should be CRF_LogMath::LOG0 instead of 0.0. TODO: verify.
@@ -20,14 +20,17 @@ CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::CRF_StdSegStateNode_Withou
 //		this->transMatrix[id] = CRF_LogMath::LOG0;
 //	}
 
-	alphaPlusTrans = new double[this->nActualLabs];
-	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = new double[this->nActualLabs];
+	alphaPlusTrans = this->newNodeArray(this->nActualLabs);
+	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = this->newNodeArray(this->nActualLabs);
+	kernelNodeArrays = new double*[2 * this->labMaxDur];
+	this->trackMem(0,2*this->labMaxDur*sizeof(double*));
 }
 
 CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::~CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr()
 {
 	delete [] this->alphaPlusTrans;
 	delete [] this->tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur;
+	delete [] this->kernelNodeArrays;
 }
 
 /*
@@ -44,6 +47,14 @@ double CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeTransMatrix(
 
 	double* lambda = this->crf_ptr->getLambda();
 
+	if (this->kernel != NULL)
+	{
+		this->kernel->computeTransMatrix(this->ftrBuf, this->nActualLabs, lambda, this->transMatrix);
+		this->kernel->computeStateArray(this->ftrBuf, this->nFtrsPerSeg, this->nodeLabMaxDur,
+				this->nActualLabs, false, lambda, this->stateArray);
+		return result;
+	}
+
 	// fill in the transition matrix
 	// Important Note: also need to fill in the transition matrix even for the first node,
 	//                 since it will be used in computeExpF().
@@ -127,6 +138,29 @@ double CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeAlpha()
 
 	checkNumPrevNodes();
 
+	if (this->kernel != NULL)
+	{
+		// the previous nodes are checked once here instead of once per label
+		for (QNUInt32 dur = 1; dur <= this->numPrevNodes; dur++)
+		{
+			CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr* prevAdjacentSeg_dnmcast =
+					dynamic_cast<CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr*>(this->prevNodes[this->numPrevNodes - dur]);
+			if (prevAdjacentSeg_dnmcast == 0)
+			{
+				string errstr="CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeAlpha() caught exception: the previous node is a base class object of CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr.";
+				throw runtime_error(errstr);
+			}
+			if (dur == 1)
+			{
+				prevAdjacentSeg_dnmcast->computeAlphaPlusTrans(this->transMatrix);
+			}
+			this->kernelNodeArrays[dur - 1] = prevAdjacentSeg_dnmcast->alphaPlusTrans;
+		}
+		this->kernel->computeAlpha(this->kernelNodeArrays, this->numPrevNodes, this->nodeLabMaxDur,
+				this->nActualLabs, this->stateArray, this->alphaArray_WithDur, this->alphaArray, this->logAddAcc);
+		return this->alphaScale;
+	}
+
 //	double* tmpAlphaArray_gatherPreviousNodes = new double[this->nActualLabs];
 //	double* tmpAlphaArray_gatherPreviousNodes_addTransValue = new double[this->nActualLabs];
 	QNUInt32 logAddAccSize = this->nActualLabs;
@@ -404,6 +438,28 @@ double CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeBeta(double
 		return this->alphaScale;
 	}
 
+	if (this->kernel != NULL)
+	{
+		for (QNUInt32 dur = 1; dur <= this->numNextNodes; dur++)
+		{
+			CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr* nextAdjacentSeg_dnmcast =
+					dynamic_cast<CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr*>(this->nextNodes[dur - 1]);
+			if (nextAdjacentSeg_dnmcast == 0)
+			{
+				string errstr="CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeBeta() caught exception: the next node is a base class object of CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr.";
+				throw runtime_error(errstr);
+			}
+			this->kernelNodeArrays[dur - 1] = nextAdjacentSeg_dnmcast->stateArray;
+			this->kernelNodeArrays[this->labMaxDur + dur - 1] = nextAdjacentSeg_dnmcast->betaArray;
+		}
+		CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr* nextAdjacentSeg =
+				static_cast<CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr*>(this->nextNodes[0]);
+		this->kernel->computeBeta(this->kernelNodeArrays, &(this->kernelNodeArrays[this->labMaxDur]),
+				this->numNextNodes, nextAdjacentSeg->transMatrix, this->nActualLabs, this->tempBeta,
+				this->tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur, this->betaArray, this->logAddAcc);
+		return this->alphaScale;
+	}
+
 	QNUInt32 logAddAccSize = this->nActualLabs;
 	if (this->labMaxDur > logAddAccSize)
 		logAddAccSize = this->labMaxDur;
@@ -1078,6 +1134,13 @@ double CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr::computeAlphaPlusTra
 {
 	double result = 0.0;
 
+	if (this->kernel != NULL)
+	{
+		this->kernel->computeAlphaPlusTrans(this->alphaArray, nextNodeTransMatrix, this->nActualLabs,
+				this->alphaPlusTrans, this->logAddAcc);
+		return result;
+	}
+
 	// add transition values (from current node to the next node) to the alphas for future use in next nodes.
 
 	QNUInt32 logAddAccSize = this->nActualLabs;
@@ -11,6 +11,7 @@
 #include "CRF_StateNode.h"
 #include "CRF_StdSegStateNode_WithoutDurLab.h"
 #include "../io/CRF_FeatureStream.h"  // for declaration of CRF_LAB_BAD
+#include "CRF_SegNodeKernel.h"
 
 class CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr : public CRF_StdSegStateNode_WithoutDurLab {
 
@@ -23,6 +24,9 @@ protected:
 	// over all duration for a given next_lab,
 	// for calculation of betas and ExpF(trans) in the current node.
 	double* tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur;
+	// pointers into the arrays of the neighbouring nodes, gathered once per node
+	// before handing them to the kernel (2 * labMaxDur entries).
+	double** kernelNodeArrays;
 
 public:
 	CRF_StdSegStateNode_WithoutDurLab_WithoutSegTransFtr(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf, QNUInt32 nodeMaxDur, QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs);
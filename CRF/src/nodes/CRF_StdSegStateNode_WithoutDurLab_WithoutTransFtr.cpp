@@ -10,8 +10,8 @@
 CRF_StdSegStateNode_WithoutDurLab_WithoutTransFtr::CRF_StdSegStateNode_WithoutDurLab_WithoutTransFtr(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf, QNUInt32 nodeMaxDur, QNUInt32 prevNode_nLabs, QNUInt32 nextNode_nActualLabs)
 	: CRF_StdSegStateNode_WithoutDurLab(fb, sizeof_fb, lab, crf, nodeMaxDur, prevNode_nLabs, nextNode_nActualLabs)
 {
-	delete [] this->transMatrix;
-	this->transMatrix = new double[this->nActualLabs * this->nActualLabs];
+	this->deleteNodeArray(this->transMatrix,this->nActualLabs*this->nActualLabs*this->nodeLabMaxDur);
+	this->transMatrix = this->newNodeArray(this->nActualLabs * this->nActualLabs);
 //	for (QNUInt32 id = 0; id < this->nActualLabs * this->nActualLabs * this->nodeLabMaxDur; id++)
 //	{
 //      // Changed by Ryan. It should be CRF_LogMath::LOG0 instead of 0.0. TODO: verify.
@@ -19,8 +19,8 @@ CRF_StdSegStateNode_WithoutDurLab_WithoutTransFtr::CRF_StdSegStateNode_WithoutDu
 //		this->transMatrix[id] = CRF_LogMath::LOG0;
 //	}
 
-	alphaPlusTrans = new double[this->nActualLabs];
-	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = new double[this->nActualLabs];
+	alphaPlusTrans = this->newNodeArray(this->nActualLabs);
+	tmpBetaArray_nextBetasPlusNextStateValue_sumOverDur = this->newNodeArray(this->nActualLabs);
 }
 
 CRF_StdSegStateNode_WithoutDurLab_WithoutTransFtr::~CRF_StdSegStateNode_WithoutDurLab_WithoutTransFtr()
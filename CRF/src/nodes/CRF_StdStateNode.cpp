@@ -19,17 +19,17 @@ CRF_StdStateNode::CRF_StdStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab,
 	: CRF_StateNode(fb, sizeof_fb, lab, crf)
 {
 
-	this->stateArray = new double[nLabs];
-	this->transMatrix = new double[nLabs*nLabs];
-	this->alphaArray = new double[nLabs];
-	this->betaArray = new double[nLabs];
-	this->alphaBetaArray = new double[nLabs];
-	this->tempBeta = new double[nLabs];
+	this->stateArray = this->newNodeArray(nLabs);
+	this->transMatrix = this->newNodeArray(nLabs*nLabs);
+	this->alphaArray = this->newNodeArray(nLabs);
+	this->betaArray = this->newNodeArray(nLabs);
+	this->alphaBetaArray = this->newNodeArray(nLabs);
+	this->tempBeta = this->newNodeArray(nLabs);
 	this->alphaSize = nLabs;
 	this->alphaScale = 0.0;
-	this->logAddAcc = new double[nLabs];
-	this->alphaArrayAligned.assign(nLabs,CRF_LogMath::LOG0);
-	this->betaArrayAligned.assign(nLabs,CRF_LogMath::LOG0);
+	this->logAddAcc = this->newNodeArray(nLabs);
+	this->assignNodeVector(this->alphaArrayAligned,nLabs,CRF_LogMath::LOG0);
+	this->assignNodeVector(this->betaArrayAligned,nLabs,CRF_LogMath::LOG0);
 
 }
 
@@ -48,6 +48,23 @@ CRF_StdStateNode::~CRF_StdStateNode()
 	// Ryan: why not delete alphaBetaArray?
 }
 
+/*
+ * CRF_StdStateNode::resetFtrView
+ *
+ * Input: see CRF_StateNode::resetFtrView
+ *
+ * Returns: false, nothing is allocated
+ *
+ * Keeps the view itself: the node reads its features through the ftrStateValue() family,
+ * which index the blocks of the view in place.
+ */
+bool CRF_StdStateNode::resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in)
+{
+	this->resetView(NULL,sizeof_fb,lab,crf_in);
+	this->ftrView=*fv;
+	return false;
+}
+
 
 /*
  * CRF_StateNode::computeTransMatrix
@@ -61,11 +78,11 @@ double CRF_StdStateNode::computeTransMatrix()
 
 	double* lambda = this->crf_ptr->getLambda();
 	for (QNUInt32 clab=0; clab<nLabs; clab++) {
-		this->stateArray[clab]=this->crf_ptr->getFeatureMap()->computeStateArrayValue(this->ftrBuf,lambda,clab);
+		this->stateArray[clab]=this->ftrStateValue(lambda,clab);
 
 		for (QNUInt32 plab=0; plab<nLabs; plab++) {
 			QNUInt32 idx=plab*nLabs+clab;
-			this->transMatrix[idx]=this->crf_ptr->getFeatureMap()->computeTransMatrixValue(this->ftrBuf,lambda,plab,clab);
+			this->transMatrix[idx]=this->ftrTransValue(lambda,plab,clab);
 		}
 	}
 	return result;
@@ -219,6 +236,35 @@ void CRF_StdStateNode::setTailBeta()
  *   *ExpF vectors respectively.  State features and transition features are computed in the same function.
  */
 double CRF_StdStateNode::computeExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab)
+{
+	return this->accumulateExpF(ExpF,grad,Zx,prev_alpha,prev_lab,NULL);
+}
+
+/*
+ * CRF_StdStateNode::computeTransExpF
+ *
+ * Inputs: see computeExpF
+ *         *gamma - vector of nLabs values to store the state occupation probabilities of this node
+ *
+ * Returns: log likelihood of the node, as computeExpF
+ *
+ * Same as computeExpF, except that the state feature expectations and counts are not added to
+ *   *ExpF and *grad.  The posteriors are returned in *gamma instead, so that the caller can
+ *   accumulate the state features of the whole sequence with one matrix product (see
+ *   CRF_NewGradBuilder::buildGradient).
+ */
+double CRF_StdStateNode::computeTransExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma)
+{
+	return this->accumulateExpF(ExpF,grad,Zx,prev_alpha,prev_lab,gamma);
+}
+
+/*
+ * CRF_StdStateNode::accumulateExpF
+ *
+ * Shared body of computeExpF and computeTransExpF.  If *gamma is NULL the state features are
+ *   accumulated through the feature map, otherwise only the state posteriors are stored in it.
+ */
+double CRF_StdStateNode::accumulateExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma)
 {
 	double logLi=0.0;
 	double alpha_beta=0.0;
@@ -231,7 +277,15 @@ double CRF_StdStateNode::computeExpF(double* ExpF, double* grad, double Zx, doub
 		alpha_beta=expE(this->alphaArray[clab]+this->betaArray[clab]-Zx);
 		alpha_beta_tot += alpha_beta;
 		bool match=(clab==this->label);
-		logLi+=this->crf_ptr->getFeatureMap()->computeStateExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,this->label,clab);
+		if (gamma == NULL) {
+			logLi+=this->ftrStateExpF(lambda,ExpF,grad,alpha_beta,this->label,clab);
+		}
+		else {
+			gamma[clab]=alpha_beta;
+			if (match) {
+				logLi+=this->stateArray[clab];
+			}
+		}
 		if (prev_lab > nLabs) {
 			// if prev_lab > nLabs, we're in the first label frame and there are no previous
 			// transitions - skip the transition calculation in this case
@@ -245,7 +299,7 @@ double CRF_StdStateNode::computeExpF(double* ExpF, double* grad, double Zx, doub
 				alpha_beta=expE(prev_alpha[plab]+this->transMatrix[idx]+this->stateArray[clab]+this->betaArray[clab]-Zx);
 				alpha_beta_trans_tot+=alpha_beta;
 				match=((clab==this->label)&&(plab==prev_lab));
-				logLi+=this->crf_ptr->getFeatureMap()->computeTransExpF(this->ftrBuf,lambda,ExpF,grad,alpha_beta,prev_lab,this->label,plab,clab);
+				logLi+=this->ftrTransExpF(lambda,ExpF,grad,alpha_beta,prev_lab,this->label,plab,clab);
 			}
 		}
 	}
@@ -30,9 +30,12 @@ protected:
 	// added by Ryan, transition matrix for the whole utterance
 	static double* transMatrix_utt;
 
+	virtual double accumulateExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma);
+
 public:
 	CRF_StdStateNode(float* fb, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf);
 	virtual ~CRF_StdStateNode();
+	virtual bool resetFtrView(const CRF_FtrView* fv, QNUInt32 sizeof_fb, QNUInt32 lab, CRF_Model* crf_in);
 	virtual double computeTransMatrix();
 //	virtual double computeTransMatrixLog();
 	virtual double computeAlpha(double* prev_alpha);
@@ -40,6 +43,7 @@ public:
 	virtual double computeBeta(double* result_beta, double scale=1.0);
 	virtual void setTailBeta();
 	virtual double computeExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab);
+	virtual double computeTransExpF(double* ExpF, double* grad, double Zx, double* prev_alpha, QNUInt32 prev_lab, double* gamma);
 	virtual double* computeAlphaBeta(double Zx);
 	virtual double computeAlphaSum();
 	virtual double computeAlphaAlignedSum();
@@ -6,6 +6,7 @@
  *
  */
 #include "CRF_AISTrainer.h"
+#include <sys/time.h>
 
 #define QN_UINT32_MAX (0xffffffff)
 
@@ -18,6 +19,19 @@ CRF_AISTrainer::CRF_AISTrainer(CRF_Model* crf_in, CRF_FeatureStreamManager* ftr_
 	: CRF_Trainer(crf_in, ftr_str_mgr, wt_fname)
 {
 	l1alpha=0;
+	this->iCounter=this->crf_ptr->getInitIter();
+	this->computeTransitions=false;
+}
+
+/*
+ * CRF_AISTrainer::setComputeTransitions
+ *
+ * Input: compute - true to initialize the transition biases from the label transitions counted
+ *   during the first pass over the training data
+ */
+void CRF_AISTrainer::setComputeTransitions(bool compute)
+{
+	this->computeTransitions=compute;
 }
 
 #ifdef OLDCODE
@@ -41,10 +55,11 @@ void CRF_AISTrainer::train()
 	int count=0;
 
 	int nframes;
-	vector<double> modelgamma;
-	vector<double> aligngamma;
-	vector<double> modeltransgamma;
-	vector<double> aligntransgamma;
+	CRF_SparseGamma modelgamma;
+	CRF_SparseGamma aligngamma;
+	size_t gammaBytes, denseGammaBytes, peakGammaBytes, peakDenseGammaBytes;
+	double gammaTime;
+	struct timeval gammaStart, gammaEnd;
 	int lambdalen=this->crf_ptr->getLambdaLen();
 	int nlabs=this->crf_ptr->getNLabs();
 	double numeratorcounts[lambdalen];
@@ -151,91 +166,72 @@ void CRF_AISTrainer::train()
 			denominatorcounts[ii]=0.0;
 		}
 		count=0;
+		peakGammaBytes=0;
+		peakDenseGammaBytes=0;
+		gammaTime=0.0;
 		while (segid != QN_SEGID_BAD) {
 			if (count % this->uttRpt == 0)
 				cout << "Processing segment " << count << endl;
 			try {
-				if (train_transitions)
-					nframes=lb->getAlignmentGammas(&modelgamma,&aligngamma,&modeltransgamma,&aligntransgamma);
-				else {
-					nframes=lb->getAlignmentGammas(&modelgamma,&aligngamma,NULL,NULL);
-				}
+				gettimeofday(&gammaStart, NULL);
+				nframes=lb->getAlignmentGammas(&modelgamma,&aligngamma,train_transitions);
+				gettimeofday(&gammaEnd, NULL);
+				gammaTime+=(gammaEnd.tv_sec - gammaStart.tv_sec) + (gammaEnd.tv_usec - gammaStart.tv_usec) / 1e6;
 			}
 			catch (exception &e) {
 				cerr << "Exception: " << e.what() << endl;
 				exit(-1);
 			}
-	//		cout << " ... gammas ... " << endl;
-	//		cerr << "aligngamma.length=" << aligngamma.size() << endl;
-	//		cerr << "modelgamma.length=" << modelgamma.size() << endl;
+			gammaBytes=modelgamma.getBytes()+aligngamma.getBytes();
+			denseGammaBytes=modelgamma.getDenseBytes()+aligngamma.getDenseBytes();
+			if (gammaBytes>peakGammaBytes) { peakGammaBytes=gammaBytes; }
+			if (denseGammaBytes>peakDenseGammaBytes) { peakDenseGammaBytes=denseGammaBytes; }
 
 			CRF_StateVector *nodelist=lb->getNodeList();
 
 			try {
+				// only the labels present in the lattice are visited
 				for (int j=0; j<nframes; j++) {
-					for (int i=0; i<nlabs; i++) {
-						//cerr << "frame " << j << " lab " << i;
-						double alignalphabeta=expE(aligngamma.at(j*nlabs+i));
-						double modelalphabeta=expE(modelgamma.at(j*nlabs+i));
-												//cerr << " alignab " << alignalphabeta << " modelab " << modelalphabeta << endl;
-						float *ftrs=nodelist->at(j)->getFtrBuffer();
-
-#ifdef DEBUG
-						if (alignalphabeta>0.001) {
-							cerr << "frame " << j << " lab " << i << " gamma " << alignalphabeta << endl;
-							for (int ii=0;ii<crf_ftr_str->num_ftrs();ii++) {
-								cerr << " " << ftrs[ii];
-							}
-							cerr << endl;
-							for (int ii=0;ii<crf_ftr_str->num_ftrs();ii++) {
-								cerr << " " << numeratorcounts[this->crf_ptr->getFeatureMap()->getStateFeatureIdx(i,ii)];
-							}
-							cerr << endl;
-						}
-#endif
+					float *ftrs=nodelist->at(j)->getFtrBuffer();
+					for (QNUInt32 g=aligngamma.getStateBegin(j); g<aligngamma.getStateEnd(j); g++) {
+						int i=aligngamma.getStateLab(g);
+						double alignalphabeta=expE(aligngamma.getStateGamma(g));
 						if (alignalphabeta>0.0)
 							this->crf_ptr->getFeatureMap()->computeStateExpF(ftrs,NULL,numeratorcounts,NULL,alignalphabeta,i,i,0);
+					}
+					for (QNUInt32 g=modelgamma.getStateBegin(j); g<modelgamma.getStateEnd(j); g++) {
+						int i=modelgamma.getStateLab(g);
+						double modelalphabeta=expE(modelgamma.getStateGamma(g));
 						if (modelalphabeta>0.0)
 							this->crf_ptr->getFeatureMap()->computeStateExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,i,0);
-#ifdef DEBUG
-						if (alignalphabeta>0.001) {
-							for (int ii=0;ii<crf_ftr_str->num_ftrs();ii++) {
-								cerr << " " << numeratorcounts[this->crf_ptr->getFeatureMap()->getStateFeatureIdx(i,ii)];
-							}
-							cerr << endl;
-							cerr << endl;
-						}
-#endif
-
-						if (train_transitions && j>0) {
-							for (int k=0; k<nlabs; k++) {
-								alignalphabeta=expE(aligntransgamma.at((j-1)*nlabs*nlabs+i*nlabs+k));
-								modelalphabeta=expE(modeltransgamma.at((j-1)*nlabs*nlabs+i*nlabs+k));
-								if (alignalphabeta>0.0)
-									this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,numeratorcounts,NULL,alignalphabeta,i,k,i,k,0);
-								if (modelalphabeta>0.0)
-									this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,k,i,k,0);
+					}
 
-							}
+					if (train_transitions && j>0) {
+						for (QNUInt32 g=aligngamma.getTransBegin(j-1); g<aligngamma.getTransEnd(j-1); g++) {
+							int i=aligngamma.getTransFromLab(g);
+							int k=aligngamma.getTransToLab(g);
+							double alignalphabeta=expE(aligngamma.getTransGamma(g));
+							if (alignalphabeta>0.0)
+								this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,numeratorcounts,NULL,alignalphabeta,i,k,i,k,0);
+						}
+						for (QNUInt32 g=modelgamma.getTransBegin(j-1); g<modelgamma.getTransEnd(j-1); g++) {
+							int i=modelgamma.getTransFromLab(g);
+							int k=modelgamma.getTransToLab(g);
+							double modelalphabeta=expE(modelgamma.getTransGamma(g));
+							if (modelalphabeta>0.0)
+								this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,k,i,k,0);
 						}
 					}
-
 				}
 				segid=crf_ftr_str->nextseg();
 				count++;
-
-
-								//delete posteriorList;
-				modelgamma.clear();
-				modeltransgamma.clear();
-				aligngamma.clear();
-				aligntransgamma.clear();
-
 			} catch (exception& e) {
 				cerr << "Exception: " << e.what() << endl;
 				exit(-1);
 			}
 		}
+		cout << "Iteration: " << iCounter << " gamma time: " << gammaTime << " s, peak gamma memory: "
+				<< peakGammaBytes << " bytes (dense: " << peakDenseGammaBytes << " bytes)" << endl;
 	#ifdef DEBUG
 		cout << "numcounts: ";
 		for (QNUInt32 ii=0;ii<lambdalen;ii++){
@@ -286,19 +282,53 @@ void CRF_AISTrainer::train()
 
 #else
 
+/*
+ * CRF_AISTrainer::setTransitionBiases
+ *
+ * Input: transitions - nlabs x nlabs matrix of label transition counts, NULL to use the default
+ *          of 0.5 for staying in a label and 0.5 spread over the other labels
+ *        counts - number of transitions out of each label
+ *
+ * Initializes the transition bias lambdas with the log transition probabilities.
+ */
+void CRF_AISTrainer::setTransitionBiases(double* transitions, double* counts)
+{
+	int nlabs=this->crf_ptr->getNLabs();
+	double *lambda=this->crf_ptr->getLambda();
+	double epsilon=0.0000001;
+	for (int i=0;i<nlabs;i++) {
+		for (int j=0;j<nlabs;j++) {
+			double logprob;
+			if (transitions != NULL) {
+				logprob=log((transitions[i*nlabs+j]+epsilon)/(counts[i]+epsilon*nlabs));
+			} else if (i==j) {
+				logprob=log(0.5);
+			} else {
+				logprob=log(0.5/(nlabs-1));
+			}
+			QNUInt32 ix=this->crf_ptr->getFeatureMap()->getTransBiasIdx(i,j);
+			// if QN_UINT32_MAX then this feature is not used
+			// or the function is not defined by the feature map
+			if (ix != QN_UINT32_MAX) {
+				lambda[ix]=logprob;
+			}
+		}
+	}
+}
+
 /*
  * CRF_AISTrainer::train
  *
  * Performs AIS training.
+ *
+ * The counts are accumulated by a CRF_CountAccumulator, or by a CRF_Pthread_CountAccumulator
+ * over the children of the feature stream manager when more than one thread is used.  If
+ * computeTransitions is set, the label transitions are counted during the first accumulation pass
+ * and the transition biases are set from them before the first update; that pass itself uses the
+ * default transition biases.
  */
-
 void CRF_AISTrainer::train()
 {
-	bool train_transitions=false;
-	bool compute_transitions=false;
-	ofstream ofile;
-	QNUInt32 nStates = this->crf_ptr->getFeatureMap()->getNumStates();
-
 	CRF_FeatureStream *crf_ftr_str=this->ftr_strm_mgr->trn_stream;
 	CRF_CountAccumulator *ca;
 	int nthreads=this->ftr_strm_mgr->getNThreads();
@@ -307,184 +337,43 @@ void CRF_AISTrainer::train()
 	} else {
 		ca=new CRF_Pthread_CountAccumulator(this->crf_ptr,this->ftr_strm_mgr,nthreads,this->uttRpt);
 	}
-	int nframes;
 	int lambdalen=this->crf_ptr->getLambdaLen();
 	int nlabs=this->crf_ptr->getNLabs();
 
-	double numeratorcounts[lambdalen];
-	double denominatorcounts[lambdalen];
-
-
-	cout << "COMPUTING TRANSITIONS for " << nlabs << endl;
-
-	size_t bunch_size=1024;
-	int nftrs=this->crf_ptr->getFeatureMap()->getNumStateFuncs(0);
-	int nftrs_ftrstrm=this->ftr_strm_mgr->getNumFtrs();
-
-	float *ftr_buf=new float[nftrs_ftrstrm*bunch_size];
-	QNUInt32 *lab_buf=new QNUInt32[bunch_size];
-	double *transitions=new double[nlabs*nlabs];
-	double *counts=new double[nlabs];
-	double *ftrcounts=new double[nlabs*nftrs];
-	double *sumftrcounts=new double[nftrs];
-	double *penaltyfunction= new double[lambdalen];
-	double epsilon=0.0000001;
-	for (int i=0;i<nlabs;i++) {
-		counts[i]=epsilon*nlabs;
-		for (int j=0;j<nlabs;j++) {
-			transitions[i*nlabs+j]=epsilon;
-		}
-		for (int j=0;j<nftrs;j++) {
-			ftrcounts[i*nftrs+j]=0.0;
-		}
-	}
-	for (int i=0;i<nftrs;i++) {
-		sumftrcounts[i]=0.0;
-	}
-	for (int i=0;i<lambdalen;i++) {
-		penaltyfunction[i]=1.0;
-	}
-
-	QNUInt32 ftr_count;
-	// this section of code looks at the label file and computes
-	// transition probabilities to initialize the lambda vector
-	if (compute_transitions) {
-		crf_ftr_str->rewind();
-		QN_SegID segid=crf_ftr_str->nextseg();
-
-		while (segid != QN_SEGID_BAD) {
-			QNUInt32 last_lab;
-			bool sent_start=true;
-
-			do {
-				ftr_count=crf_ftr_str->read(bunch_size,ftr_buf,lab_buf);
-				// catch overflow from >bunch_size sentences
-				if (!sent_start && ftr_count>0) {
-					transitions[last_lab*nlabs+lab_buf[0]]++;
-					counts[last_lab]++;
-				}
-
-				last_lab=lab_buf[0];
-				//crf_ptr->getFeatureMap()->accumulateFeatures(ftr_buf,ftrcounts,last_lab);
-				//crf_ptr->getFeatureMap()->accumulateFeatures(ftr_buf,sumftrcounts,0);
-				for (int ii=0;ii<nftrs_ftrstrm;ii+=2) {
-					int ix=(int)ftr_buf[ii];
-					//cout << ix << ":" << ftr_buf[ii+1] << " ";
-					ftrcounts[last_lab*nftrs+ix]+=ftr_buf[ii+1];
-					sumftrcounts[ix]+=ftr_buf[ii+1];
-				}
-				//cout << endl;
-				sent_start=false;
-				for (QNUInt32 i=1; i<ftr_count; i++) {
-					QNUInt32 lab=lab_buf[i];
-					transitions[last_lab*nlabs+lab]++;
-					counts[last_lab]++;
-
-					//for (int ii=0;ii<nftrs;ii++) {
-					//	ftrcounts[lab*nftrs+ii]+=ftr_buf[i*nftrs+ii];
-					//	sumftrcounts[ii]+=ftr_buf[i*nftrs+ii];
-					//}
-					for (int ii=0;ii<nftrs_ftrstrm;ii+=2) {
-						int iii=ii+nftrs_ftrstrm*i;
-						int ix=(int)ftr_buf[iii];
-						//cout << ix << ":" << ftr_buf[iii+1] << " ";
-						ftrcounts[lab*nftrs+ix]+=ftr_buf[iii+1];
-						sumftrcounts[ix]+=ftr_buf[iii+1];
-					}
-					//cout << endl;
-					//crf_ptr->getFeatureMap()->accumulateFeatures(ftr_buf,ftrcounts,lab);
-					//crf_ptr->getFeatureMap()->accumulateFeatures(ftr_buf,sumftrcounts,0);
-
-					last_lab=lab;
-				}
-			} while(ftr_count>=bunch_size);
-
-			segid = crf_ftr_str->nextseg();
-		}
-	}
-	// reset stream
-	crf_ftr_str->rewind();
+	vector<double> numeratorcounts(lambdalen,0.0);
+	vector<double> denominatorcounts(lambdalen,0.0);
+	vector<double> transitions(nlabs*nlabs,0.0);
+	vector<double> counts(nlabs,0.0);
 
 	cout << "initializing lambdas with transition biases" << endl;
+	this->setTransitionBiases(NULL,NULL);
+	bool countTransitions=this->computeTransitions;
+	if (countTransitions) {
+		cout << "COMPUTING TRANSITIONS for " << nlabs << " during the first pass" << endl;
+	}
 
 	double *lambda=crf_ptr->getLambda();
 
-	for (int i=0;i<nlabs;i++) {
-		//cout << "ct(" << i << ")= " << counts[i];
-		for (int j=0;j<nlabs;j++) {
-			//cout << " " << j << ":" << transitions[i*nlabs+j];
-			//if (counts[i]>0.0)
-			if (compute_transitions) {
-				transitions[i*nlabs+j]=log(transitions[i*nlabs+j]/counts[i]);
-			} else {
-				if (i==j) {
-					transitions[i*nlabs+j]=log(0.5);
-				} else {
-					transitions[i*nlabs+j]=log(0.5/(nlabs-1));
-				}
-				//transitions[i*nlabs+j]=0.0;
-			}
-			QNUInt32 ix=this->crf_ptr->getFeatureMap()->getTransBiasIdx(i,j);
-			// if QN_UINT32_MAX then this feature is not used
-			// or the function is not defined by the feature map
-			if (ix != QN_UINT32_MAX) {
-				lambda[ix]=transitions[i*nlabs+j];
-			}
-			//cout << "/" << ix << "->" << transitions[i*nlabs+j];
-		}
-		//cout << endl;
-
-		if (0) {
- 		// now initialize ftr counts
-		int maxix=0;
-		double maxval=ftrcounts[i*nftrs];
-		cout << "ftrct " << i << " 0:" << ftrcounts[i*nftrs];
-		for (int j=1;j<nftrs;j++) {
-			cout << " " << j << ":" << ftrcounts[i*nftrs+j];
-			if (ftrcounts[i*nftrs+j]>maxval) {
-				maxval=ftrcounts[i*nftrs+j];
-				maxix=j;
-			}
-		}
-		cout << endl;
-		cout << endl;
-		cout  << "Setting lab " << i << " ftr " << maxix << "to 1" << endl;
-		QNUInt32 ix=this->crf_ptr->getFeatureMap()->getStateFeatureIdx(i,maxix);
-		if (ix != QN_UINT32_MAX) {
-			lambda[ix]=1.0;
-		}
-		}
-
-
-
-	}
-
-	if (1) {
- 	cout << "sumftrct:";
-	for(int ii=0;ii<nftrs;ii++) {
-		cout << " " << ii << ":" << sumftrcounts[ii];
-		for (int j=0;j<nlabs;j++) {
-			penaltyfunction[this->crf_ptr->getFeatureMap()->getStateFeatureIdx(j,ii)]=log(sumftrcounts[ii]/nlabs);
-		}
-	}
-	cout << endl;
-	}
 	cout << "STARTING AIS TRAINING" << endl;
 
 	while (iCounter<this->maxIters) {
-		cout << "initialize local vars" << endl;
 		for (int ii=0;ii<lambdalen;ii++) {
 			numeratorcounts[ii]=0.0;
 			denominatorcounts[ii]=0.0;
 		}
 
 		// use the accumulator to get counts
-		cout << "initialize CA vars" << endl;
+		ca->setCountTransitions(countTransitions);
 		ca->reset();
-		cout << "accumulate" << endl;
 		ca->accumulate();
-		cout << "results" << endl;
-		ca->add_results(numeratorcounts,denominatorcounts);
+		ca->add_results(&(numeratorcounts[0]),&(denominatorcounts[0]));
+
+		if (countTransitions) {
+			ca->add_transitions(&(transitions[0]),&(counts[0]));
+			cout << "initializing lambdas with transition biases from the training labels" << endl;
+			this->setTransitionBiases(&(transitions[0]),&(counts[0]));
+			countTransitions=false;
+		}
 
 		// now update the lambda vector
 		for (QNUInt32 ii=0;ii<lambdalen;ii++) {
@@ -492,7 +381,6 @@ void CRF_AISTrainer::train()
 			if (numeratorcounts[ii] > 0 && denominatorcounts[ii] > 0 &&
 				((lambda[ii]!=0.0) ||
 					(numeratorcounts[ii] > 0.1 && abs(numeratorcounts[ii]-denominatorcounts[ii])> this->l1alpha ))) {
-				//lambda[ii]=lambda[ii] + this->lr * log(numeratorcounts[ii]/denominatorcounts[ii])/penaltyfunction[ii];
 				double step=log(numeratorcounts[ii]/denominatorcounts[ii]);
 				//step=this->lr *((step<-1.0)?-1.0:(step>1.0)?1.0:step);
 				step= this->lr * step;
@@ -514,8 +402,6 @@ void CRF_AISTrainer::train()
 		}
 		iCounter++;
 	}
+	delete ca;
 }
 #endif
-
-
-
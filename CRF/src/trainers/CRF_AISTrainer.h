@@ -23,7 +23,9 @@
 /*
  * class CRF_AISTrainer
  *
- * Used in training.  This class implements AIS training for CRFs.
+ * Used in training.  This class implements AIS training for CRFs.  The feature counts are
+ * accumulated in parallel over the children of the feature stream manager when it has more than
+ * one thread (see CRF_Pthread_CountAccumulator).
  */
 class CRF_AISTrainer: public CRF_Trainer
 {
@@ -39,12 +41,15 @@ protected:
 
 	double *grad;
 	float l1alpha;
+	bool computeTransitions;
+	virtual void setTransitionBiases(double* transitions, double* counts);
 
 public:
 	CRF_AISTrainer(CRF_Model* crf_in, CRF_FeatureStreamManager* ftr_str, char* wt_fname);
 	void train();
 	inline void setl1alpha(float a) {l1alpha=a;}
 	inline float getl1apha() {return l1alpha;}
+	virtual void setComputeTransitions(bool compute);
 };
 
 #endif /*CRF_AISTRAINER_H_*/
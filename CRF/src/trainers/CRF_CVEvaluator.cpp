@@ -0,0 +1,472 @@
+/*
+ * CRF_CVEvaluator.cpp
+ *
+ */
+
+#include "CRF_CVEvaluator.h"
+#include "../utils/CRF_MemStats.h"
+
+/*
+ * CRF_CVSnapshotModel constructor
+ *
+ * Input: src - model to take the snapshots of; its feature map is shared, not copied
+ */
+CRF_CVSnapshotModel::CRF_CVSnapshotModel(CRF_Model* src)
+	: CRF_Model(src->getNLabs())
+{
+	this->featureMap=src->getFeatureMap();
+	this->lambda_len=src->getLambdaLen();
+	this->lambda=new double[this->lambda_len];
+	memcpy(this->lambda,src->getLambda(),this->lambda_len*sizeof(double));
+	CRF_MemStats::add(MEM_GRADIENT,this->lambda_len*sizeof(double));
+	this->lambdaAcc=NULL;
+	this->gradSqrAcc=NULL;
+	this->lab_max_dur=src->getLabMaxDur();
+	this->nActualLabs=src->getNActualLabs();
+	this->model_type=src->getModelType();
+	this->use_broken_class_label=src->ifUseBrokenClassLabel();
+	this->useLog=src->useLog;
+	this->useMask=src->useMask;
+	this->setNodeType();
+}
+
+/*
+ * CRF_CVSnapshotModel destructor
+ *
+ * Frees the snapshot; the feature map belongs to the source model.
+ */
+CRF_CVSnapshotModel::~CRF_CVSnapshotModel()
+{
+	delete [] this->lambda;
+	CRF_MemStats::release(MEM_GRADIENT,this->lambda_len*sizeof(double));
+	this->lambda=NULL;
+	this->featureMap=NULL;
+}
+
+/*
+ * CRF_CVSnapshotModel::copyLambda
+ *
+ * Input: lam - weights to copy, of the length of the source model's lambda vector
+ */
+void CRF_CVSnapshotModel::copyLambda(const double* lam)
+{
+	memcpy(this->lambda,lam,this->lambda_len*sizeof(double));
+}
+
+/*
+ * CRF_CVSnapshotModel::copyAverage
+ *
+ * Input: lam_acc - accumulated weights
+ *        acc_cnt - number of samples accumulated in lam_acc
+ *
+ * Sets the snapshot to the averaged weights, computed the same way as the trainer does.
+ */
+void CRF_CVSnapshotModel::copyAverage(const double* lam_acc, int acc_cnt)
+{
+	for (QNUInt32 i=0; i<this->lambda_len; i++) {
+		this->lambda[i]=(acc_cnt == 0) ? 0.0 : (lam_acc[i]/(float)acc_cnt);
+	}
+}
+
+/*
+ * CRF_CVEvaluator_Thread constructor
+ *
+ * Input: models - snapshot models, at most two (current and averaged weights)
+ *        n_models - number of models
+ *        ftr - cross-validation stream scored by this thread
+ */
+CRF_CVEvaluator_Thread::CRF_CVEvaluator_Thread(CRF_Model** models, QNUInt32 n_models, CRF_FeatureStream* ftr)
+	: ftr_str(ftr), nModels(n_models), nActive(0), running(NULL),
+	  uttCount(0), frameCount(0)
+{
+	for (QNUInt32 m=0; m<this->nModels; m++) {
+		this->gBuilders[m]=CRF_GradBuilder::create(models[m],EXPF);
+		this->nodeLists[m]=new CRF_StateVector();
+		this->gBuilders[m]->setNodeList(this->nodeLists[m]);
+		this->frameErrs[m]=0;
+		this->logLi[m]=0.0;
+	}
+	// the frame errors need one node per frame
+	this->countErrs=(models[0]->getModelType() == STDFRAME);
+	this->nLabs=models[0]->getNLabs();
+}
+
+CRF_CVEvaluator_Thread::~CRF_CVEvaluator_Thread()
+{
+	for (QNUInt32 m=0; m<this->nModels; m++) {
+		delete this->gBuilders[m];
+	}
+}
+
+/*
+ * CRF_CVEvaluator_Thread::start
+ *
+ * Input: n_models - number of snapshot models to score, the first n_models passed to the
+ *          constructor
+ *        run_cnt - counter of running threads, decremented when this thread is done
+ */
+int CRF_CVEvaluator_Thread::start(QNUInt32 n_models, QNUInt32* run_cnt)
+{
+	this->nActive=n_models;
+	this->running=run_cnt;
+	return pthread_create(&threadId,
+			              NULL,
+			              CRF_CVEvaluator_Thread::threadEntry,
+			              (void *)this);
+}
+
+/*
+ * CRF_CVEvaluator_Thread::score
+ *
+ * Input: m - index of the snapshot model
+ *
+ * Makes one pass over the stream with model m.  The utterances are scored with the forward
+ * pass only (see CRF_GradBuilder::computeLogLi), plus the backward pass when the frame errors
+ * are counted.
+ */
+void CRF_CVEvaluator_Thread::score(QNUInt32 m)
+{
+	double Zx;
+	this->ftr_str->rewind();
+	QN_SegID segid=this->ftr_str->nextseg();
+	while (segid != QN_SEGID_BAD) {
+		double numer=this->gBuilders[m]->computeLogLi(this->ftr_str,&Zx,this->countErrs);
+		this->logLi[m]+=numer-Zx;
+		if (m == 0) {
+			this->uttCount++;
+		}
+		if (this->countErrs) {
+			QNUInt32 nodeCnt=this->nodeLists[m]->getNodeCount();
+			for (QNUInt32 n=0; n<nodeCnt; n++) {
+				CRF_StateNode* node=this->nodeLists[m]->at(n);
+				double* alpha_beta=node->computeAlphaBeta(Zx);
+				QNUInt32 best=0;
+				for (QNUInt32 clab=1; clab<this->nLabs; clab++) {
+					if (alpha_beta[clab] > alpha_beta[best]) {
+						best=clab;
+					}
+				}
+				QNUInt32 lab=node->getLabel();
+				if (lab < this->nLabs && best != lab) {
+					this->frameErrs[m]++;
+				}
+			}
+			if (m == 0) {
+				this->frameCount+=nodeCnt;
+			}
+		}
+		segid=this->ftr_str->nextseg();
+	}
+}
+
+int CRF_CVEvaluator_Thread::run()
+{
+	this->uttCount=0;
+	this->frameCount=0;
+	for (QNUInt32 m=0; m<this->nActive; m++) {
+		this->logLi[m]=0.0;
+		this->frameErrs[m]=0;
+		this->score(m);
+	}
+	__sync_sub_and_fetch(this->running,1);
+	return 0;
+}
+
+/*static */
+void * CRF_CVEvaluator_Thread::threadEntry(void * pthis)
+{
+	CRF_CVEvaluator_Thread * pt = (CRF_CVEvaluator_Thread*)pthis;
+	pt->run();
+	return pthis;
+}
+
+int CRF_CVEvaluator_Thread::join() {
+	return pthread_join(this->threadId,NULL);
+}
+
+/*
+ * CRF_CVEvaluator constructor
+ *
+ * Input: crf_in - the model being trained
+ *        cv_mgr - feature stream manager over the cross-validation utterances, with their
+ *                 labels; its training stream (or the training streams of its children, one
+ *                 per evaluation thread) are scored
+ */
+CRF_CVEvaluator::CRF_CVEvaluator(CRF_Model* crf_in, CRF_FeatureStreamManager* cv_mgr)
+	: crf(crf_in), running(0), busy(false), hasPending(false)
+{
+	this->nStreams=cv_mgr->getNThreads();
+	this->ftrStrms=new CRF_FeatureStream*[this->nStreams];
+	if (this->nStreams == 1) {
+		this->ftrStrms[0]=cv_mgr->trn_stream;
+	}
+	else {
+		for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+			CRF_FeatureStreamManager* child=cv_mgr->getChild(stream);
+			this->ftrStrms[stream]=(child == NULL) ? NULL : child->trn_stream;
+		}
+	}
+	for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+		if (this->ftrStrms[stream] == NULL || this->ftrStrms[stream]->num_labs() == 0) {
+			string errstr="CRF_CVEvaluator constructor caught exception: the cross-validation streams need features and labels.";
+			throw runtime_error(errstr);
+		}
+	}
+
+	this->curModel=new CRF_CVSnapshotModel(this->crf);
+	this->avgModel=new CRF_CVSnapshotModel(this->crf);
+	CRF_Model* models[2]={this->curModel,this->avgModel};
+	this->threads=new CRF_CVEvaluator_Thread*[this->nStreams];
+	for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+		this->threads[stream]=new CRF_CVEvaluator_Thread(models,2,this->ftrStrms[stream]);
+	}
+	memset(&(this->result),0,sizeof(this->result));
+
+	this->lambdaLen=this->crf->getLambdaLen();
+	this->pendingLambda=new double[this->lambdaLen];
+	this->pendingAvg=new double[this->lambdaLen];
+	CRF_MemStats::add(MEM_GRADIENT,2*this->lambdaLen*sizeof(double));
+	this->pendingIter=0;
+	this->pendingUtt=0;
+	this->pendingHasAvg=false;
+}
+
+/*
+ * CRF_CVEvaluator destructor
+ *
+ * Waits for a running evaluation before freeing the threads.
+ */
+CRF_CVEvaluator::~CRF_CVEvaluator()
+{
+	if (this->busy) {
+		this->collect();
+	}
+	for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+		delete this->threads[stream];
+	}
+	delete [] this->threads;
+	delete [] this->ftrStrms;
+	delete this->curModel;
+	delete this->avgModel;
+	delete [] this->pendingLambda;
+	delete [] this->pendingAvg;
+	CRF_MemStats::release(MEM_GRADIENT,2*this->lambdaLen*sizeof(double));
+}
+
+/*
+ * CRF_CVEvaluator::start
+ *
+ * Input: iter - training iteration of the snapshot
+ *        utt - utterances trained on in the iteration
+ *        lam - current weights
+ *        lam_acc - accumulated weights, NULL to score the current weights only
+ *        acc_cnt - number of samples accumulated in lam_acc
+ *
+ * Copies the weights and starts scoring them in the background.  The previous evaluation
+ * must have been collected.
+ */
+void CRF_CVEvaluator::start(int iter, QNUInt32 utt, const double* lam, const double* lam_acc, int acc_cnt)
+{
+	if (this->busy) {
+		string errstr="CRF_CVEvaluator::start() caught exception: the previous evaluation has not been collected.";
+		throw runtime_error(errstr);
+	}
+	this->curModel->copyLambda(lam);
+	QNUInt32 n_models=1;
+	if (lam_acc != NULL) {
+		this->avgModel->copyAverage(lam_acc,acc_cnt);
+		n_models=2;
+	}
+	this->launch(iter,utt,n_models);
+}
+
+/*
+ * CRF_CVEvaluator::launch
+ *
+ * Input: iter - training iteration of the snapshot
+ *        utt - utterances trained on in the iteration
+ *        n_models - 1 to score the current weights, 2 to score the averaged weights too
+ *
+ * Starts the threads on the weights already copied into the snapshot models.
+ */
+void CRF_CVEvaluator::launch(int iter, QNUInt32 utt, QNUInt32 n_models)
+{
+	memset(&(this->result),0,sizeof(this->result));
+	this->result.iter=iter;
+	this->result.utt=utt;
+	this->result.hasAvg=(n_models == 2);
+	gettimeofday(&(this->startTime),NULL);
+
+	this->running=this->nStreams;
+	this->busy=true;
+	for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+		if (this->threads[stream]->start(n_models,&(this->running)) != 0) {
+			cerr << "CRF_CVEvaluator::start() Error: cannot create the thread for stream " << stream << endl;
+			exit(1);
+		}
+	}
+}
+
+/*
+ * CRF_CVEvaluator::submit
+ *
+ * Input: see start()
+ *
+ * Returns: true if the snapshot was started now, false if it was queued
+ *
+ * Starts the snapshot if no evaluation is running.  Otherwise the weights are copied aside and
+ * startPending() starts them once the running evaluation has been collected, so the trainer
+ * never waits for the threads.  A newer snapshot replaces a queued one that was not started.
+ */
+bool CRF_CVEvaluator::submit(int iter, QNUInt32 utt, const double* lam, const double* lam_acc, int acc_cnt)
+{
+	if (!this->busy) {
+		this->hasPending=false;
+		this->start(iter,utt,lam,lam_acc,acc_cnt);
+		return true;
+	}
+	memcpy(this->pendingLambda,lam,this->lambdaLen*sizeof(double));
+	this->pendingHasAvg=(lam_acc != NULL);
+	if (this->pendingHasAvg) {
+		for (QNUInt32 i=0; i<this->lambdaLen; i++) {
+			this->pendingAvg[i]=(acc_cnt == 0) ? 0.0 : (lam_acc[i]/(float)acc_cnt);
+		}
+	}
+	this->pendingIter=iter;
+	this->pendingUtt=utt;
+	this->hasPending=true;
+	return false;
+}
+
+/*
+ * CRF_CVEvaluator::startPending
+ *
+ * Returns: true if a queued snapshot was started
+ *
+ * Starts the snapshot queued by submit(), if any, once the previous evaluation is collected.
+ */
+bool CRF_CVEvaluator::startPending()
+{
+	if (this->busy || !this->hasPending) {
+		return false;
+	}
+	this->hasPending=false;
+	this->curModel->copyLambda(this->pendingLambda);
+	QNUInt32 n_models=1;
+	if (this->pendingHasAvg) {
+		this->avgModel->copyLambda(this->pendingAvg);
+		n_models=2;
+	}
+	this->launch(this->pendingIter,this->pendingUtt,n_models);
+	return true;
+}
+
+/*
+ * CRF_CVEvaluator::isBusy
+ *
+ * Returns: true from start() until the scores are collected
+ */
+bool CRF_CVEvaluator::isBusy()
+{
+	return this->busy;
+}
+
+/*
+ * CRF_CVEvaluator::isDone
+ *
+ * Returns: true if an evaluation was started and all its threads have finished, so collect()
+ *   will not wait
+ */
+bool CRF_CVEvaluator::isDone()
+{
+	return this->busy && (__sync_fetch_and_add(&(this->running),0) == 0);
+}
+
+/*
+ * CRF_CVEvaluator::collect
+ *
+ * Returns: the scores of the last snapshot started, summed over the streams
+ *
+ * Waits for the threads if they are still running.
+ */
+CRF_CVResult CRF_CVEvaluator::collect()
+{
+	if (!this->busy) {
+		return this->result;
+	}
+	for (QNUInt32 stream=0; stream<this->nStreams; stream++) {
+		CRF_CVEvaluator_Thread* thread=this->threads[stream];
+		thread->join();
+		this->result.nUtts+=thread->getUttCount();
+		this->result.nFrames+=thread->getFrameCount();
+		this->result.logLi+=thread->getLogLi(0);
+		this->result.frameErrs+=thread->getFrameErrs(0);
+		if (this->result.hasAvg) {
+			this->result.avgLogLi+=thread->getLogLi(1);
+			this->result.avgFrameErrs+=thread->getFrameErrs(1);
+		}
+	}
+	struct timeval endTime;
+	gettimeofday(&endTime,NULL);
+	this->result.wallTime=(endTime.tv_sec - this->startTime.tv_sec)
+			+ (endTime.tv_usec - this->startTime.tv_usec) / 1e6;
+	this->busy=false;
+	return this->result;
+}
+
+/*
+ * CRF_CVEvaluator::getNStreams
+ *
+ * Returns: number of cross-validation streams, i.e. of evaluation threads
+ */
+QNUInt32 CRF_CVEvaluator::getNStreams()
+{
+	return this->nStreams;
+}
+
+/*
+ * CRF_CVEvaluator::getSnapshotLambda
+ *
+ * Returns: the current weights of the last snapshot
+ */
+const double* CRF_CVEvaluator::getSnapshotLambda()
+{
+	return this->curModel->getLambda();
+}
+
+/*
+ * CRF_CVEvaluator::getSnapshotAverage
+ *
+ * Returns: the averaged weights of the last snapshot, valid if it was taken with them
+ */
+const double* CRF_CVEvaluator::getSnapshotAverage()
+{
+	return this->avgModel->getLambda();
+}
+
+/*
+ * CRF_CVEvaluator::format
+ *
+ * Returns: one line with the scores of res, averaged per utterance and, on frame models, per frame
+ */
+string CRF_CVEvaluator::format(const CRF_CVResult& res)
+{
+	char buf[512];
+	double utts=(res.nUtts > 0) ? res.nUtts : 1;
+	double frames=(res.nFrames > 0) ? res.nFrames : 1;
+	int len=snprintf(buf,sizeof(buf),"Iteration: %d Utt: %u CV utts: %u frames: %u LogLi/utt: %.4f",
+			res.iter,res.utt,res.nUtts,res.nFrames,res.logLi/utts);
+	if (res.nFrames > 0) {
+		len+=snprintf(buf+len,sizeof(buf)-len," LogLi/frame: %.6f Frame err: %.2f%%",
+				res.logLi/frames,100.0*res.frameErrs/frames);
+	}
+	if (res.hasAvg) {
+		len+=snprintf(buf+len,sizeof(buf)-len," Avg LogLi/utt: %.4f",res.avgLogLi/utts);
+		if (res.nFrames > 0) {
+			len+=snprintf(buf+len,sizeof(buf)-len," Avg LogLi/frame: %.6f Avg frame err: %.2f%%",
+					res.avgLogLi/frames,100.0*res.avgFrameErrs/frames);
+		}
+	}
+	snprintf(buf+len,sizeof(buf)-len," wall time: %.1f s",res.wallTime);
+	return string(buf);
+}
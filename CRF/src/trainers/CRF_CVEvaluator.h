@@ -0,0 +1,140 @@
+#ifndef CRF_CVEVALUATOR_H_
+#define CRF_CVEVALUATOR_H_
+/*
+ * CRF_CVEvaluator.h
+ *
+ * Contains the class definitions for CRF_CVSnapshotModel, CRF_CVEvaluator_Thread and
+ * CRF_CVEvaluator
+ */
+
+#include "../CRF.h"
+#include "../CRF_Model.h"
+#include "../io/CRF_FeatureStreamManager.h"
+#include "gradbuilders/CRF_GradBuilder.h"
+#include <pthread.h>
+#include <sys/time.h>
+
+/*
+ * class CRF_CVSnapshotModel
+ *
+ * A copy of the weights of a model, taken while the model goes on training.  It shares the
+ * feature map and the settings of the source model and owns only its lambda vector, so it can
+ * be handed to the gradient builders in place of the source model.
+ */
+class CRF_CVSnapshotModel : public CRF_Model
+{
+public:
+	CRF_CVSnapshotModel(CRF_Model* src);
+	virtual ~CRF_CVSnapshotModel();
+	virtual void copyLambda(const double* lam);
+	virtual void copyAverage(const double* lam_acc, int acc_cnt);
+};
+
+/*
+ * struct CRF_CVResult
+ *
+ * Cross-validation scores of one snapshot.  The frame errors are counted on frame models only;
+ * the avg fields are set when the averaged weights were evaluated too.
+ */
+struct CRF_CVResult {
+	int iter;
+	QNUInt32 utt;
+	QNUInt32 nUtts;
+	QNUInt32 nFrames;
+	double logLi;
+	QNUInt32 frameErrs;
+	bool hasAvg;
+	double avgLogLi;
+	QNUInt32 avgFrameErrs;
+	double wallTime;
+};
+
+/*
+ * class CRF_CVEvaluator_Thread
+ *
+ * Scores one cross-validation stream with the snapshot models, one pass over the stream per
+ * model: the log-likelihood of every utterance and, on frame models, the frames whose most
+ * likely label (by the state posteriors) is not the reference label.  No gradient is built.
+ */
+class CRF_CVEvaluator_Thread
+{
+public:
+	CRF_CVEvaluator_Thread(CRF_Model** models, QNUInt32 n_models, CRF_FeatureStream* ftr_str);
+	~CRF_CVEvaluator_Thread();
+	int start(QNUInt32 n_models, QNUInt32* running);
+	int join();
+	inline QNUInt32 getUttCount() { return this->uttCount; }
+	inline QNUInt32 getFrameCount() { return this->frameCount; }
+	inline QNUInt32 getFrameErrs(QNUInt32 m) { return this->frameErrs[m]; }
+	inline double getLogLi(QNUInt32 m) { return this->logLi[m]; }
+
+protected:
+	int run();
+	void score(QNUInt32 m);
+	static void * threadEntry(void*);
+private:
+	pthread_t threadId;
+	CRF_FeatureStream* ftr_str;
+	CRF_GradBuilder* gBuilders[2];
+	CRF_StateVector* nodeLists[2];
+	QNUInt32 nModels;
+	QNUInt32 nActive;
+	bool countErrs;
+	QNUInt32 nLabs;
+	QNUInt32* running;
+	QNUInt32 uttCount;
+	QNUInt32 frameCount;
+	QNUInt32 frameErrs[2];
+	double logLi[2];
+};
+
+/*
+ * class CRF_CVEvaluator
+ *
+ * Background cross-validation for the SGD trainer.  start() copies the current weights (and,
+ * if asked, the averaged weights) into snapshot models and scores the cross-validation streams
+ * with them, one thread per stream, while the trainer goes on with the next minibatches.  The
+ * trainer polls isDone() and picks the scores up with collect(), which waits for the threads
+ * if they are still running.  Only one snapshot is evaluated at a time: submit() queues a
+ * snapshot taken while another one is running, and startPending() starts it later.
+ *
+ * The cross-validation streams come from their own feature stream manager, built over the
+ * cross-validation range, so they do not share file handles with the training streams.
+ */
+class CRF_CVEvaluator
+{
+protected:
+	CRF_Model* crf;
+	CRF_CVSnapshotModel* curModel;
+	CRF_CVSnapshotModel* avgModel;
+	CRF_FeatureStream** ftrStrms;
+	QNUInt32 nStreams;
+	CRF_CVEvaluator_Thread** threads;
+	QNUInt32 running;
+	bool busy;
+	CRF_CVResult result;
+	struct timeval startTime;
+	QNUInt32 lambdaLen;
+	double* pendingLambda;
+	double* pendingAvg;
+	bool hasPending;
+	bool pendingHasAvg;
+	int pendingIter;
+	QNUInt32 pendingUtt;
+	virtual void launch(int iter, QNUInt32 utt, QNUInt32 n_models);
+public:
+	CRF_CVEvaluator(CRF_Model* crf_in, CRF_FeatureStreamManager* cv_mgr);
+	virtual ~CRF_CVEvaluator();
+	virtual void start(int iter, QNUInt32 utt, const double* lam, const double* lam_acc, int acc_cnt);
+	virtual bool submit(int iter, QNUInt32 utt, const double* lam, const double* lam_acc, int acc_cnt);
+	virtual bool startPending();
+	virtual bool isBusy();
+	virtual bool isDone();
+	virtual CRF_CVResult collect();
+	virtual QNUInt32 getNStreams();
+	virtual const double* getSnapshotLambda();
+	virtual const double* getSnapshotAverage();
+	static string format(const CRF_CVResult& res);
+};
+
+#endif /* CRF_CVEVALUATOR_H_ */
@@ -6,6 +6,9 @@
  *
  */
 #include "CRF_SGTrainer.h"
+#include "../utils/CRF_MemStats.h"
+#include <sys/time.h>
+#include <iomanip>
 
 /*
  * CRF_SGTrainer constructor
@@ -18,7 +21,20 @@ CRF_SGTrainer::CRF_SGTrainer(CRF_Model* crf_in, CRF_FeatureStreamManager* ftr_st
 	// Added by Ryan
 	this->eta = 1.0;
 	this->useAdagrad = false;
+	this->useFtrSlab = true;
+	this->logChecksum = false;
 	this->eps = 1e-12;
+	this->cvStrmMgr = NULL;
+	this->cvInterval = 0;
+	this->cvAvg = true;
+	this->cvPatience = 0;
+	this->cvLRDecay = false;
+	this->cvBestLogLi = 0.0;
+	this->cvHasBest = false;
+	this->cvBadCount = 0;
+	this->cvStop = false;
+	this->l1 = 0.0;
+	this->sparseExport = false;
 }
 
 // Added by Ryan
@@ -49,6 +65,211 @@ void CRF_SGTrainer::setUseAdagrad(double useAdagrad) {
 	this->useAdagrad = useAdagrad;
 }
 
+/*
+ * CRF_SGTrainer::setUseFtrSlab
+ *
+ * Input: use - keep the features of each utterance in the gradient builders' feature slab
+ *   (the default) instead of one heap copy per node.  Each iteration reports its wall time and
+ *   feature buffer allocations, so the two settings can be compared directly.
+ */
+void CRF_SGTrainer::setUseFtrSlab(bool use) {
+	this->useFtrSlab = use;
+}
+
+/*
+ * CRF_SGTrainer::setLogChecksum
+ *
+ * Input: log - print the checksum of lambda (see CRF_Model::getLambdaChecksum()) after each
+ *   minibatch, to check that runs with different numbers of threads stay bit-identical
+ */
+void CRF_SGTrainer::setLogChecksum(bool log) {
+	this->logChecksum = log;
+}
+
+/*
+ * CRF_SGTrainer::setCV
+ *
+ * Input: cv_mgr - feature stream manager over the cross-validation utterances, one evaluation
+ *          thread per stream (see CRF_CVEvaluator); NULL turns the cross-validation off
+ *        interval - minibatches between snapshots, 0 to take one at the end of each iteration
+ *          only
+ *        avg - score the averaged weights of each snapshot too
+ *
+ * The snapshots are scored in the background while training goes on.  A snapshot taken while
+ * the previous one is still being scored waits in a queue of one, where a newer snapshot
+ * replaces it, so the scoring threads can fall behind but never hold up training.  Each
+ * result is logged when it comes in, and the weights of the best one so far are written to the .cvbest.out
+ * (and .cvbest.avg.out) files.  The averaged weights decide which snapshot is best when they
+ * are scored, the current weights otherwise.
+ */
+void CRF_SGTrainer::setCV(CRF_FeatureStreamManager* cv_mgr, int interval, bool avg) {
+	if (interval < 0) {
+		cerr << "CRF_SGTrainer::setCV() Error: the cross-validation interval cannot be negative." << endl;
+		exit(-1);
+	}
+	this->cvStrmMgr = cv_mgr;
+	this->cvInterval = interval;
+	this->cvAvg = avg;
+}
+
+/*
+ * CRF_SGTrainer::setCVPatience
+ *
+ * Input: patience - stop training after this many cross-validation results in a row without
+ *   improvement, 0 to never stop early
+ */
+void CRF_SGTrainer::setCVPatience(int patience) {
+	this->cvPatience = patience;
+}
+
+/*
+ * CRF_SGTrainer::setCVLRDecay
+ *
+ * Input: decay - decay the learning rate (the AdaGrad eta with AdaGrad) by the decay rate each
+ *   time a cross-validation result does not improve, instead of at the end of every iteration
+ */
+void CRF_SGTrainer::setCVLRDecay(bool decay) {
+	this->cvLRDecay = decay;
+}
+
+/*
+ * CRF_SGTrainer::setL1
+ *
+ * Input: l1 - weight of the L1 penalty, 0 (the default) for none
+ *
+ * The penalty is applied with the cumulative penalty method (Tsuruoka et al., 2009): after
+ * each update every weight is pulled towards zero by the penalty it has not received yet,
+ * and clipped at zero instead of crossing it, so that weights the data does not support
+ * stay exactly zero.  With AdaGrad the penalty of each weight follows its own step size,
+ * and starts with the first gradient of the weight (see updateWeight).
+ */
+void CRF_SGTrainer::setL1(double l1) {
+	if (l1 < 0) {
+		cerr << "CRF_SGTrainer::setL1() Error: the L1 penalty cannot be negative." << endl;
+		exit(-1);
+	}
+	this->l1 = l1;
+}
+
+/*
+ * CRF_SGTrainer::updateWeight
+ *
+ * Input: lam - weight to update
+ *        g - gradient of the weight for this minibatch
+ *        *grad_sqr_acc - AdaGrad sum of the squared gradients of the weight, NULL for plain SGD
+ *        rate - AdaGrad eta, or the SGD learning rate if grad_sqr_acc is NULL
+ *        eps - AdaGrad epsilon
+ *        l1 - weight of the L1 penalty
+ *        *l1_total, *l1_applied - cumulative penalty of the weight (see setL1), NULL for none
+ *
+ * A weight whose AdaGrad sum is still zero has had no gradient yet and gets a zero step,
+ * so it does not build up a penalty budget that would pin it at zero once it is used.
+ */
+void CRF_SGTrainer::updateWeight(double& lam, double g, double* grad_sqr_acc, double rate, double eps,
+		double l1, double* l1_total, double* l1_applied) {
+	double step = rate;
+	if (grad_sqr_acc != NULL) {
+		*grad_sqr_acc += g*g;
+		step = (*grad_sqr_acc > 0) ? rate / (std::sqrt(*grad_sqr_acc) + eps) : 0.0;
+	}
+	lam += step * g;
+	if (l1_total != NULL) {
+		*l1_total += l1 * step;
+		double old_lam = lam;
+		if (lam > 0) {
+			lam = std::max(0.0, lam - (*l1_total + *l1_applied));
+		} else if (lam < 0) {
+			lam = std::min(0.0, lam + (*l1_total - *l1_applied));
+		}
+		*l1_applied += lam - old_lam;
+	}
+}
+
+/*
+ * CRF_SGTrainer::setSparseExport
+ *
+ * Input: exp - also write the final weights and average weights in the sparse format (see
+ *   CRF_Model::writeSparseToFile), to <weight file>.sparse.out and <weight file>.avg.sparse.out
+ */
+void CRF_SGTrainer::setSparseExport(bool exp) {
+	this->sparseExport = exp;
+}
+
+/*
+ * CRF_SGTrainer::writeSparse
+ *
+ * Input: fname - file to write
+ *        lam - weights to write
+ *        ll - length of lam
+ */
+void CRF_SGTrainer::writeSparse(const string& fname, double* lam, QNUInt32 ll) {
+	QNUInt32 nnz=0;
+	for (QNUInt32 i=0; i<ll; i++) {
+		if (lam[i] != 0.0) nnz++;
+	}
+	cout << "Writing " << nnz << " non-zero weights out of " << ll << " to sparse file " << fname << endl;
+	bool chkwrite=this->crf_ptr->writeSparseToFile(fname.c_str(),lam,ll);
+	if (!chkwrite) {
+		cerr << "ERROR! File " << fname << " unable to be opened for writing.  ABORT!" << endl;
+		exit(-1);
+	}
+}
+
+/*
+ * CRF_SGTrainer::collectCV
+ *
+ * Input: cv - the background evaluator
+ *        wait - wait for a running evaluation; otherwise it is collected only if it is done
+ *
+ * Logs the result of the last snapshot, keeps the best weights, and applies the learning rate
+ * decay and early stopping rules of setCVLRDecay() and setCVPatience().
+ */
+void CRF_SGTrainer::collectCV(CRF_CVEvaluator* cv, bool wait) {
+	if (!cv->isBusy() || (!wait && !cv->isDone())) {
+		return;
+	}
+	CRF_CVResult res = cv->collect();
+	cout << "CV: " << CRF_CVEvaluator::format(res) << endl;
+
+	double score = res.hasAvg ? res.avgLogLi : res.logLi;
+	if (!this->cvHasBest || score > this->cvBestLogLi) {
+		this->cvBestLogLi = score;
+		this->cvHasBest = true;
+		this->cvBadCount = 0;
+
+		QNUInt32 lambdaLen = this->crf_ptr->getLambdaLen();
+		string fname = string(this->weight_fname) + ".cvbest.out";
+		cout << "CV: new best, writing weights to file " << fname << endl;
+		bool chkwrite = this->crf_ptr->writeToFile(fname.c_str(), const_cast<double*>(cv->getSnapshotLambda()), lambdaLen);
+		if (chkwrite && res.hasAvg) {
+			fname = string(this->weight_fname) + ".cvbest.avg.out";
+			cout << "CV: new best, writing average weights to file " << fname << endl;
+			chkwrite = this->crf_ptr->writeToFile(fname.c_str(), const_cast<double*>(cv->getSnapshotAverage()), lambdaLen);
+		}
+		if (!chkwrite) {
+			cerr << "ERROR! File " << fname << " unable to be opened for writing.  ABORT!" << endl;
+			exit(-1);
+		}
+		return;
+	}
+
+	this->cvBadCount++;
+	cout << "CV: no improvement on the best LogLi " << this->cvBestLogLi << " for " << this->cvBadCount << " result(s)" << endl;
+	if (this->cvLRDecay) {
+		if (useAdagrad) {
+			this->eta *= this->lr_decay_rate;
+			cout << "AdaGrad scaling factor (eta) is decayed by " << this->lr_decay_rate << " to " << this->eta << endl;
+		} else {
+			this->lr *= this->lr_decay_rate;
+			cout << "Learning rate is decayed by " << this->lr_decay_rate << " to " << this->lr << endl;
+		}
+	}
+	if (this->cvPatience > 0 && this->cvBadCount >= this->cvPatience) {
+		cout << "CV: stopping early after " << this->cvBadCount << " results without improvement" << endl;
+		this->cvStop = true;
+	}
+}
+
 // Added by Ryan
 /*
  *
@@ -87,9 +308,7 @@ void CRF_SGTrainer::sgtrainMinibatch()
 	// the previous training stopped at.
 	for (int i = 0; i < iCounter; ++i) {
 		this->ftr_strm_mgr->trn_stream->rewind();
-		if (this->nThreads > 1) {
-			this->ftr_strm_mgr->rewindAllChildrenTrn();
-		}
+		this->ftr_strm_mgr->rewindAllChildrenTrn();
 	}
 
 	cout << "Before loading feature streams ..." << endl;
@@ -140,10 +359,25 @@ void CRF_SGTrainer::sgtrainMinibatch()
 	//int accCnt = 0;
 	int accCnt = this->crf_ptr->getPresentations();
 	double* grad = new double[lambdaLen];
+	CRF_MemStats::add(MEM_GRADIENT,4*lambdaLen*sizeof(double));
 
 	// Added by Ryan, for AdaGrad
 	double* gradSqrAcc = this->crf_ptr->getGradSqrAcc();
 
+	// L1 cumulative penalty: total penalty each weight could have received so far, and what
+	// it actually received (see setL1)
+	double* l1Total = NULL;
+	double* l1Applied = NULL;
+	if (this->l1 > 0) {
+		l1Total = new double[lambdaLen];
+		l1Applied = new double[lambdaLen];
+		CRF_MemStats::add(MEM_GRADIENT,2*lambdaLen*sizeof(double));
+		for (QNUInt32 i=0; i<lambdaLen; i++) {
+			l1Total[i]=0.0;
+			l1Applied[i]=0.0;
+		}
+	}
+
 	for (QNUInt32 i=0; i<lambdaLen; i++) {
 		grad[i]=0.0;
 		lambdaSqrAcc[i]=0.0;
@@ -175,13 +409,31 @@ void CRF_SGTrainer::sgtrainMinibatch()
 			new CRF_Pthread_GradAccumulator(this->crf_ptr, this->useLogspace,
 					this->crf_ptr->getFeatureMap()->getNumStates());
 	*/
+	// one slot per stream of the feature stream manager; the threads share out the slots
+	QNUInt32 nStreams = this->ftr_strm_mgr->getNThreads();
 	CRF_Minibatch_GradAccumulator *gaccum = new CRF_Minibatch_GradAccumulator(
-			this->crf_ptr, this->ftr_strm_mgr, this->nThreads);
+			this->crf_ptr, this->ftr_strm_mgr, nStreams);
+	gaccum->setNThreads(((QNUInt32)this->nThreads < nStreams) ? this->nThreads : nStreams);
 	gaccum->setMinibatch(this->minibatch);
 	gaccum->setUttReport(this->uttRpt);
+	gaccum->setUseFtrSlab(this->useFtrSlab);
 	cout << "Utterance report interval: " << this->uttRpt << endl;
+	cout << "Feature slab: " << (this->useFtrSlab ? "on" : "off") << endl;
+	cout << "Minibatch slots: " << nStreams << " threads: " << gaccum->getNThreads() << endl;
 	cout << "Using Logspace training..." << endl;
 
+	// snapshots scored in the background, see setCV()
+	CRF_CVEvaluator *cv = NULL;
+	int cvBatches = 0;
+	if (this->cvStrmMgr != NULL) {
+		cv = new CRF_CVEvaluator(this->crf_ptr, this->cvStrmMgr);
+		cout << "Background CV threads: " << cv->getNStreams() << " snapshot interval: ";
+		if (this->cvInterval > 0) {
+			cout << this->cvInterval << " minibatches and ";
+		}
+		cout << "end of iteration, average weights: " << (this->cvAvg ? "on" : "off") << endl;
+	}
+
 	cout << "Before rewinding all feature streams ..." << endl;
 
 	// TODO: rewind all feature streams
@@ -196,6 +448,9 @@ void CRF_SGTrainer::sgtrainMinibatch()
 	gaccum->rewindAllAndNextSegs();
 
 	time_t rawtime;
+	struct timeval iterStart, iterEnd;
+	gettimeofday(&iterStart, NULL);
+	QNUInt32 iterFtrAllocs = gaccum->getFtrAllocs();
 
 	// Added by Ryan, just for debugging
 //	string testfname;
@@ -307,14 +562,11 @@ void CRF_SGTrainer::sgtrainMinibatch()
 
 			// Added the AdaGrad condition by Ryan
 			if (useAdagrad) {
-				//if (std::abs(gradSqrAcc[i]-0.0) < 1e-18) {
-				//	cerr << "Error: zero accumulated gradient square sum: gradSqrAcc[" << i << "]=" << gradSqrAcc[i] << endl;
-				//	exit(-1);
-				//}
-				gradSqrAcc[i] += grad[i]*grad[i];
-				lambda[i] += this->eta / (std::sqrt(gradSqrAcc[i]) + this->eps) * grad[i];
+				updateWeight(lambda[i], grad[i], &(gradSqrAcc[i]), this->eta, this->eps, this->l1,
+						(l1Total == NULL) ? NULL : &(l1Total[i]), (l1Applied == NULL) ? NULL : &(l1Applied[i]));
 			} else {
-				lambda[i] += this->lr * grad[i];
+				updateWeight(lambda[i], grad[i], NULL, this->lr, this->eps, this->l1,
+						(l1Total == NULL) ? NULL : &(l1Total[i]), (l1Applied == NULL) ? NULL : &(l1Applied[i]));
 			}
 			lambdaAcc[i] += lambda[i];
 			lambdaSqrAcc[i] += lambda[i] * lambda[i];
@@ -326,6 +578,24 @@ void CRF_SGTrainer::sgtrainMinibatch()
 		//accCnt++;
 		accCnt += uCounterInc;
 
+		if (this->logChecksum) {
+			ios_base::fmtflags flags = cout.flags();
+			cout << "Iteration: " << iCounter << " Utt: " << uCounter
+					<< " lambda checksum: " << hex << setw(8) << setfill('0')
+					<< this->crf_ptr->getLambdaChecksum() << setfill(' ') << endl;
+			cout.flags(flags);
+		}
+
+		// the snapshots are queued while an evaluation is running, training never waits for it
+		if (cv != NULL && !isEndOfIter) {
+			this->collectCV(cv, false);
+			cv->startPending();
+			cvBatches++;
+			if (this->cvInterval > 0 && cvBatches % this->cvInterval == 0) {
+				cv->submit(iCounter, uCounter, lambda, this->cvAvg ? lambdaAcc : NULL, accCnt);
+			}
+		}
+
 		//cout << "Utterance " << uCounter << ": Lambda[0]: " << lambda[0] << endl;
 		//cout << "Utterance " << uCounter << ": Acc Lambda[0]: " << (lambdaAcc[0]/accCnt) << endl;
 		//segid = ftr_str->nextseg();
@@ -334,7 +604,18 @@ void CRF_SGTrainer::sgtrainMinibatch()
 		//if (segid == QN_SEGID_BAD) {
 		if (isEndOfIter) {
 			cout << "Iteration: " << iCounter << " ending" << endl;
+			gettimeofday(&iterEnd, NULL);
+			cout << "Iteration: " << iCounter << " wall time: "
+					<< (iterEnd.tv_sec - iterStart.tv_sec) + (iterEnd.tv_usec - iterStart.tv_usec) / 1e6
+					<< " s, feature buffer allocations: " << gaccum->getFtrAllocs() - iterFtrAllocs << endl;
 			cout << "Iteration: " << iCounter << " applying lambda updates" << endl;
+			if (l1Total != NULL) {
+				QNUInt32 nnz=0;
+				for (QNUInt32 i=0; i<lambdaLen; i++) {
+					if (lambda[i] != 0.0) nnz++;
+				}
+				cout << "Iteration: " << iCounter << " non-zero weights: " << nnz << " of " << lambdaLen << endl;
+			}
 
 			string fname;
 
@@ -398,19 +679,46 @@ void CRF_SGTrainer::sgtrainMinibatch()
 			*/
 			gaccum->rewindAllAndNextSegs();
 
+			if (cv != NULL) {
+				this->collectCV(cv, false);
+				cv->submit(iCounter, uCounter, lambda, this->cvAvg ? lambdaAcc : NULL, accCnt);
+				cvBatches = 0;
+			}
+
 			touchDoneFileIter(iCounter);
 
 			iCounter++;
 			uCounter=0;
 			totLogLi=0.0;
 			start=true;
+			gettimeofday(&iterStart, NULL);
+			iterFtrAllocs = gaccum->getFtrAllocs();
 
 			// Added by Ryan, learning rate decay
-			if (!useAdagrad) {
+			// (with setCVLRDecay() the cross-validation results decide when to decay)
+			if (!useAdagrad && !this->cvLRDecay) {
 				this->lr *= this->lr_decay_rate;
 				cout << "Learning rate is decayed by " << this->lr_decay_rate << " to " << this->lr << endl;
 			}
 		}
+
+		if (this->cvStop) {
+			cout << "Iteration: " << iCounter << " stopped early at Utt: " << uCounter << endl;
+			break;
+		}
+	}
+	if (cv != NULL) {
+		this->collectCV(cv, true);
+		if (!this->cvStop && cv->startPending()) {
+			this->collectCV(cv, true);
+		}
+		delete cv;
+	}
+	if (this->cvStop) {
+		// stopped within an iteration, the average has not been updated since its end
+		for (QNUInt32 i=0; i<lambdaLen; i++) {
+			lambdaAvg[i]=(accCnt == 0) ? 0.0 : (lambdaAcc[i]/(float)accCnt);
+		}
 	}
 	cout << "Writing Final Iteration weights to file " << this->weight_fname << endl;
 	this->crf_ptr->writeToFile(this->weight_fname);
@@ -420,6 +728,10 @@ void CRF_SGTrainer::sgtrainMinibatch()
 	savg >> fname;
 	cout << "Writing Final Iteration average weights to file " << fname << endl;
 	this->crf_ptr->writeToFile(fname.c_str(),lambdaAvg,lambdaLen);
+	if (this->sparseExport) {
+		this->writeSparse(string(this->weight_fname)+".sparse.out",lambda,lambdaLen);
+		this->writeSparse(string(this->weight_fname)+".avg.sparse.out",lambdaAvg,lambdaLen);
+	}
 
 	touchDoneFileFinal();
 
@@ -434,6 +746,12 @@ void CRF_SGTrainer::sgtrainMinibatch()
 	delete[] lambdaVar;
 	delete[] lambdaSqrAcc;
 	delete[] grad;
+	CRF_MemStats::release(MEM_GRADIENT,4*lambdaLen*sizeof(double));
+	if (l1Total != NULL) {
+		delete[] l1Total;
+		delete[] l1Applied;
+		CRF_MemStats::release(MEM_GRADIENT,2*lambdaLen*sizeof(double));
+	}
 
 	// Added by Ryan
 	//delete[] ftr_strs;
@@ -491,6 +809,7 @@ void CRF_SGTrainer::sgtrain()
 	//int accCnt = 0;
 	int accCnt = this->crf_ptr->getPresentations();
 	double* grad = new double[lambdaLen];
+	CRF_MemStats::add(MEM_GRADIENT,4*lambdaLen*sizeof(double));
 
 	// Added by Ryan, for AdaGrad
 	double* gradSqrAcc = this->crf_ptr->getGradSqrAcc();
@@ -742,4 +1061,5 @@ void CRF_SGTrainer::sgtrain()
 	delete[] lambdaVar;
 	delete[] lambdaSqrAcc;
 	delete[] grad;
+	CRF_MemStats::release(MEM_GRADIENT,4*lambdaLen*sizeof(double));
 }
@@ -15,6 +15,7 @@
 //#include "accumulators/CRF_GradAccumulator.h"
 //#include "accumulators/CRF_Pthread_GradAccumulator.h"
 #include "accumulators/CRF_Minibatch_GradAccumulator.h"
+#include "CRF_CVEvaluator.h"
 
 /*
  * class CRF_SGTrainer
@@ -38,6 +39,24 @@ protected:
 	int nThreads;
 	int minibatch;
 
+	bool useFtrSlab;
+	bool logChecksum;
+
+	// background cross-validation, see setCV()
+	CRF_FeatureStreamManager* cvStrmMgr;
+	int cvInterval;
+	bool cvAvg;
+	int cvPatience;
+	bool cvLRDecay;
+	double cvBestLogLi;
+	bool cvHasBest;
+	int cvBadCount;
+	bool cvStop;
+
+	// L1 regularization with the cumulative penalty, see setL1()
+	double l1;
+	bool sparseExport;
+
 public:
 	CRF_SGTrainer(CRF_Model* crf_in, CRF_FeatureStreamManager* ftr_str_mgr, char* wt_fname);
 	void train();
@@ -47,10 +66,21 @@ public:
 	void setMinibatch(int m);
 	void setEta(double eta);
 	void setUseAdagrad(double useAdagrad);
+	void setUseFtrSlab(bool use);
+	void setLogChecksum(bool log);
+	void setCV(CRF_FeatureStreamManager* cv_mgr, int interval, bool avg);
+	void setCVPatience(int patience);
+	void setCVLRDecay(bool decay);
+	void setL1(double l1);
+	void setSparseExport(bool exp);
+	static void updateWeight(double& lam, double g, double* grad_sqr_acc, double rate, double eps,
+			double l1, double* l1_total, double* l1_applied);
 
 private:
 	void sgtrain();
 	void sgtrainMinibatch();
+	void collectCV(CRF_CVEvaluator* cv, bool wait);
+	void writeSparse(const string& fname, double* lam, QNUInt32 ll);
 };
 
 #endif /*CRF_SGTRAINER_H_*/
@@ -11,24 +11,37 @@ CRF_CountAccumulator::CRF_CountAccumulator(CRF_Model *crf_ptr_in,
 										   CRF_FeatureStream *ftr_strm_in,
 										   int uttRpt_in) :
 	crf_ptr(crf_ptr_in), ftr_strm(ftr_strm_in), uttRpt(uttRpt_in) {
+	this->count_transitions=false;
 	this->nlambdas=this->crf_ptr->getLambdaLen();
-	this->lb=new CRF_LatticeBuilder(this->ftr_strm,this->crf_ptr);
+	this->nlabs=this->crf_ptr->getNLabs();
+	this->nodeList=new CRF_StateVector();
 	this->numeratorcounts=new double[this->nlambdas];
 	this->denominatorcounts=new double[this->nlambdas];
+	this->transitions=new double[this->nlabs*this->nlabs];
+	this->transcounts=new double[this->nlabs];
+	this->alpha_base=new double[this->nlabs];
+	for (int i=0;i<this->nlabs;i++) {
+		this->alpha_base[i]=0.0;
+	}
 
-	this->bunch_size=1024;
+	// CRF_InFtrStream_SeqMultiWindow streams return one frame per read
+	this->bunch_size=1;
 	this->ftr_buf=new float[ftr_strm->num_ftrs()*bunch_size];
 	this->lab_buf=new QNUInt32[bunch_size];
 	this->uttOffset=0;
 	this->threadno=-1;
+	this->reset();
 }
 
 CRF_CountAccumulator::~CRF_CountAccumulator() {
-	delete this->lb;
+	delete this->nodeList;
 	delete [] this->ftr_buf;
 	delete [] this->lab_buf;
 	delete [] this->numeratorcounts;
 	delete [] this->denominatorcounts;
+	delete [] this->transitions;
+	delete [] this->transcounts;
+	delete [] this->alpha_base;
 }
 
 void CRF_CountAccumulator::reset() {
@@ -36,13 +49,85 @@ void CRF_CountAccumulator::reset() {
 		numeratorcounts[ii]=0.0;
 		denominatorcounts[ii]=0.0;
 	}
+	for (int ii=0;ii<this->nlabs;ii++) {
+		transcounts[ii]=0.0;
+		for (int jj=0;jj<this->nlabs;jj++) {
+			transitions[ii*this->nlabs+jj]=0.0;
+		}
+	}
+}
+
+/*
+ * CRF_CountAccumulator::setCountTransitions
+ *
+ * Input: count - true if accumulate() should also count the label transitions of the stream
+ */
+void CRF_CountAccumulator::setCountTransitions(bool count) {
+	this->count_transitions=count;
+}
+
+/*
+ * CRF_CountAccumulator::computePosteriors
+ *
+ * Returns: number of frames in the current segment of the feature stream
+ *
+ * Reads the current segment into the node list and runs the forward-backward pass over it.
+ *   Afterwards getAlphaBeta() of each node holds the log posteriors of the labels of that frame.
+ *   If count_transitions is set, the transitions between the labels read are counted as well.
+ */
+int CRF_CountAccumulator::computePosteriors() {
+	size_t num_ftrs=this->ftr_strm->num_ftrs();
+	size_t ftr_count;
+	QNUInt32 nodeCnt=0;
+	QNUInt32 last_lab=CRF_LAB_BAD;
+	do {
+		ftr_count=this->ftr_strm->read(this->bunch_size,this->ftr_buf,this->lab_buf);
+		for (QNUInt32 i=0; i<ftr_count; i++) {
+			this->nodeList->setCopy(nodeCnt,&(this->ftr_buf[i*num_ftrs]),num_ftrs,this->lab_buf[i],this->crf_ptr);
+			CRF_StateNode* node=this->nodeList->at(nodeCnt);
+			node->computeTransMatrix();
+			if (nodeCnt==0) {
+				node->computeFirstAlpha(this->alpha_base);
+			}
+			else {
+				node->computeAlpha(this->nodeList->at(nodeCnt-1)->getAlpha());
+			}
+			QNUInt32 lab=this->lab_buf[i];
+			if (this->count_transitions && last_lab < (QNUInt32)this->nlabs && lab < (QNUInt32)this->nlabs) {
+				this->transitions[last_lab*this->nlabs+lab]++;
+				this->transcounts[last_lab]++;
+			}
+			last_lab=lab;
+			nodeCnt++;
+		}
+	} while (ftr_count>=this->bunch_size);
+	this->nodeList->setNodeCount(nodeCnt);
+	if (nodeCnt==0) {
+		return 0;
+	}
+
+	QNUInt32 lastNode=nodeCnt-1;
+	double Zx=this->nodeList->at(lastNode)->computeAlphaSum();
+	QNUInt32 j=lastNode;
+	while (true) {
+		CRF_StateNode* node=this->nodeList->at(j);
+		if (j==lastNode) {
+			node->setTailBeta();
+		}
+		else {
+			this->nodeList->at(j+1)->computeBeta(node->getBeta(),node->getAlphaScale());
+		}
+		node->computeAlphaBeta(Zx);
+		if (j==0) { break; }
+		j--;
+	}
+	return nodeCnt;
 }
 
 void CRF_CountAccumulator::accumulate() {
 	int count=0;
-	bool train_transitions=false;
 	int nframes;
-	int nlabs=this->crf_ptr->getNLabs();
+	CRF_FeatureMap* ftr_map=this->crf_ptr->getFeatureMap();
 
 	this->ftr_strm->rewind();
 	QN_SegID segid=this->ftr_strm->nextseg();
@@ -57,60 +142,27 @@ void CRF_CountAccumulator::accumulate() {
 		}
 
 		try {
-			if (train_transitions)
-				nframes=lb->getAlignmentGammas(&modelgamma,&aligngamma,&modeltransgamma,&aligntransgamma);
-			else {
-				nframes=lb->getAlignmentGammas(&modelgamma,&aligngamma,NULL,NULL);
-			}
-		}
-		catch (exception &e) {
-			cerr << "Exception: " << e.what() << endl;
-			exit(-1);
-		}
+			nframes=this->computePosteriors();
 
-
-		CRF_StateVector *nodelist=lb->getNodeList();
-
-		try {
 			for (int j=0; j<nframes; j++) {
-				float *ftrs=nodelist->at(j)->getFtrBuffer();
-				QNUInt32 lab=nodelist->at(j)->getLabel();
-
-				for (int i=0; i<nlabs; i++) {
-
-					double alignalphabeta=expE(aligngamma.at(j*nlabs+i));
-					double modelalphabeta=expE(modelgamma.at(j*nlabs+i));
-
-					//cout << "frame " << j << " lab " << i << " align: " << alignalphabeta << " model: " << modelalphabeta << endl;
-					alignalphabeta=(lab==i)?1.0:0.0;
-
-					if (alignalphabeta>0.0)
-						this->crf_ptr->getFeatureMap()->computeStateExpF(ftrs,NULL,numeratorcounts,NULL,alignalphabeta,i,i,0);
+				CRF_StateNode* node=this->nodeList->at(j);
+				float *ftrs=node->getFtrBuffer();
+				QNUInt32 lab=node->getLabel();
+				double* modelgamma=node->getAlphaBeta();
+
+				// the numerator counts the aligned label only
+				if (lab < (QNUInt32)this->nlabs) {
+					ftr_map->computeStateExpF(ftrs,NULL,numeratorcounts,NULL,1.0,lab,lab,0);
+				}
+				for (int i=0; i<this->nlabs; i++) {
+					double modelalphabeta=expE(modelgamma[i]);
 					if (modelalphabeta>0.0)
-						this->crf_ptr->getFeatureMap()->computeStateExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,i,0);
-
-					if (train_transitions && j>0) {
-						for (int k=0; k<nlabs; k++) {
-							alignalphabeta=expE(aligntransgamma.at((j-1)*nlabs*nlabs+i*nlabs+k));
-							modelalphabeta=expE(modeltransgamma.at((j-1)*nlabs*nlabs+i*nlabs+k));
-							if (alignalphabeta>0.0)
-								this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,numeratorcounts,NULL,alignalphabeta,i,k,i,k,0);
-							if (modelalphabeta>0.0)
-								this->crf_ptr->getFeatureMap()->computeTransExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,k,i,k,0);
-
-						}
-					}
+						ftr_map->computeStateExpF(ftrs,NULL,denominatorcounts,NULL,modelalphabeta,i,i,0);
 				}
-
 			}
 			segid=this->ftr_strm->nextseg();
 			count++;
 
-			modelgamma.clear();
-			modeltransgamma.clear();
-			aligngamma.clear();
-			aligntransgamma.clear();
-
 		} catch (exception& e) {
 			cerr << "Exception: " << e.what() << endl;
 			exit(-1);
@@ -124,3 +176,18 @@ void CRF_CountAccumulator::add_results(double *num_in, double *den_in) {
 		den_in[ii]+=denominatorcounts[ii];
 	}
 }
+
+/*
+ * CRF_CountAccumulator::add_transitions
+ *
+ * Input: trans_in - nlabs x nlabs matrix of transition counts to add this accumulator's counts to
+ *        counts_in - vector of nlabs counts of the previous label of each transition
+ */
+void CRF_CountAccumulator::add_transitions(double *trans_in, double *counts_in) {
+	for (int ii=0;ii<this->nlabs;ii++) {
+		counts_in[ii]+=transcounts[ii];
+		for (int jj=0;jj<this->nlabs;jj++) {
+			trans_in[ii*this->nlabs+jj]+=transitions[ii*this->nlabs+jj];
+		}
+	}
+}
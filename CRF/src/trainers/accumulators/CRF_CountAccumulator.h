@@ -10,34 +10,47 @@
 #include "../../CRF.h"
 #include "../../io/CRF_FeatureStream.h"
 #include "../../nodes/CRF_StateVector.h"
-#include "../../decoders/CRF_LatticeBuilder.h"
 #include "../../ftrmaps/CRF_FeatureMap.h" // for QN_UINT32_MAX -- move elsewhere?
 
+/*
+ * class CRF_CountAccumulator
+ *
+ * Accumulates the numerator (aligned label) and denominator (model posterior) feature counts used
+ * by AIS training over one feature stream.  The posteriors are computed with a forward-backward
+ * pass over a node list that is reused from one utterance to the next, and all count buffers are
+ * on the heap, so one accumulator can be run per thread (see CRF_Pthread_CountAccumulator).
+ *
+ * If setCountTransitions(true) is called, the label transitions of the stream are counted in the
+ * same read pass.
+ */
 class CRF_CountAccumulator {
 protected:
 	bool count_transitions;
 	CRF_Model *crf_ptr;
 	CRF_FeatureStream *ftr_strm;
-	CRF_LatticeBuilder *lb;
+	CRF_StateVector *nodeList;
 	int nlambdas;
+	int nlabs;
 	double *numeratorcounts;
 	double *denominatorcounts;
-	vector<double> modelgamma;
-	vector<double> aligngamma;
-	vector<double> modeltransgamma;
-	vector<double> aligntransgamma;
+	double *transitions;
+	double *transcounts;
+	double *alpha_base;
 	size_t bunch_size;
 	float *ftr_buf;
 	QNUInt32 *lab_buf;
 	int uttRpt;
 	int uttOffset;
 	int threadno;
+	virtual int computePosteriors();
 public:
 	CRF_CountAccumulator(CRF_Model *crf_ptr_in,CRF_FeatureStream *ftr_strm_in, int uttRpt_in);
 	virtual ~CRF_CountAccumulator();
 	virtual void reset();
 	virtual void accumulate();
 	virtual void add_results(double *global_numcounts, double *global_dencounts);
+	virtual void add_transitions(double *global_transitions, double *global_counts);
+	virtual void setCountTransitions(bool count);
 };
 
 #endif /* CRF_COUNTACCUMULATOR_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "CRF_Minibatch_GradAccumulator.h"
+#include "../../utils/CRF_MemStats.h"
 
 CRF_Minibatch_GradAccumulator_Thread::CRF_Minibatch_GradAccumulator_Thread(CRF_GradBuilder *bldr, double *gradient)
 : gBuilder(bldr), grad(gradient), bunchLogLiDenom(0.), bunchLogLiNumer(0.), bunchLogLi(0.),
@@ -109,6 +110,63 @@ int CRF_Minibatch_GradAccumulator_Thread::join() {
 	return pthread_join(this->threadId,NULL);
 }
 
+/*
+ * CRF_Minibatch_GradAccumulator_Thread::process
+ *
+ * Input: ftr - feature stream of this slot
+ *
+ * Runs the slot in the calling thread (see CRF_Minibatch_GradAccumulator_Worker).
+ */
+int CRF_Minibatch_GradAccumulator_Thread::process(CRF_FeatureStream *ftr)
+{
+	this->ftr_str=ftr;
+	this->threadId=pthread_self();
+	return this->run();
+}
+
+CRF_Minibatch_GradAccumulator_Worker::CRF_Minibatch_GradAccumulator_Worker(
+		CRF_Minibatch_GradAccumulator_Thread **slts, CRF_FeatureStream **strms,
+		QNUInt32 fst, QNUInt32 stp, QNUInt32 nslts)
+: slots(slts), ftrStrms(strms), first(fst), step(stp), nSlots(nslts)
+{
+}
+
+int CRF_Minibatch_GradAccumulator_Worker::start()
+{
+	return pthread_create(&threadId,
+			              NULL,
+			              CRF_Minibatch_GradAccumulator_Worker::threadEntry,
+			              (void *)this);
+}
+
+/*
+ * CRF_Minibatch_GradAccumulator_Worker::run
+ *
+ * Processes the worker's slots in increasing order.  Each slot accumulates into its own gradient,
+ * so the result of a slot does not depend on which worker runs it.
+ */
+int CRF_Minibatch_GradAccumulator_Worker::run()
+{
+	for (QNUInt32 slot = this->first; slot < this->nSlots; slot += this->step) {
+		if (this->slots[slot] != NULL) {
+			this->slots[slot]->process(this->ftrStrms[slot]);
+		}
+	}
+	return 0;
+}
+
+/*static */
+void * CRF_Minibatch_GradAccumulator_Worker::threadEntry(void * pthis)
+{
+	CRF_Minibatch_GradAccumulator_Worker * pw = (CRF_Minibatch_GradAccumulator_Worker*)pthis;
+	pw->run();
+	return pthis;
+}
+
+int CRF_Minibatch_GradAccumulator_Worker::join() {
+	return pthread_join(this->threadId,NULL);
+}
+
 
 
 CRF_Minibatch_GradAccumulator::CRF_Minibatch_GradAccumulator(
@@ -118,6 +176,7 @@ CRF_Minibatch_GradAccumulator::CRF_Minibatch_GradAccumulator(
 	this->uttReport = 0;
 	this->objective = EXPF;
 	this->minibatch = CRF_UINT32_MAX;
+	this->nThreads = nStreams;
 
 	this->ftrStrms = new CRF_FeatureStream*[nStreams];
 	if (!myFtrStrmMgr) {
@@ -178,6 +237,26 @@ void CRF_Minibatch_GradAccumulator::setMinibatch(QNUInt32 minibatch) {
 	}
 }
 
+/*
+ * CRF_Minibatch_GradAccumulator::setNThreads
+ *
+ * Input: n - number of threads used to process the nStreams slots of a minibatch
+ *
+ * The utterances of a minibatch are scheduled to slots (one per feature stream) independently of
+ * the number of threads, and the slot gradients are summed in slot order.  With a fixed number of
+ * slots the gradient is therefore bit-identical for any number of threads.
+ */
+void CRF_Minibatch_GradAccumulator::setNThreads(QNUInt32 n) {
+
+	if (n == 0 || n > this->nStreams) {
+		cerr << "CRF_Minibatch_GradAccumulator::setNThreads() Error: "
+				<< "the number of threads (" << n << ") has to be between 1 and "
+				<< "the number of streams (" << this->nStreams << ")." << endl;
+		exit(1);
+	}
+	this->nThreads = n;
+}
+
 void CRF_Minibatch_GradAccumulator::rewindAllAndNextSegs() {
 
 	for (int stream = 0; stream < this->nStreams; ++stream) {
@@ -207,6 +286,7 @@ double CRF_Minibatch_GradAccumulator::accumulateGradient(
 	// set up stream gradients
 	double **sgrad = new double*[nStreams];
 	double *sgrad_data = sgrad[0] = new double[nStreams*nlambda];
+	CRF_MemStats::add(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	memset(sgrad[0],0,nStreams*nlambda*sizeof(double));
 
 	for(QNUInt32 s = 1; s < nStreams; s++) {
@@ -256,12 +336,29 @@ double CRF_Minibatch_GradAccumulator::accumulateGradient(
 			threads[stream]->setUttReport(this->uttReport);
 			threads[stream]->setMinibatchPerThread(minibatch_per_thread + (stream < remainder ? 1 : 0));
 
-			//cerr << "Starting thread " << stream << endl;
-			threads[stream]->start(ftr_str);
-			//cerr << "thread " << stream << " started" << endl;
+			if (this->nThreads == this->nStreams) {
+				//cerr << "Starting thread " << stream << endl;
+				threads[stream]->start(ftr_str);
+				//cerr << "thread " << stream << " started" << endl;
+			}
 		}
 	}
 
+	// fewer threads than streams: each worker runs a fixed set of slots
+	CRF_Minibatch_GradAccumulator_Worker **workers = NULL;
+	if (this->nThreads < this->nStreams) {
+		workers = new CRF_Minibatch_GradAccumulator_Worker *[this->nThreads];
+		for (QNUInt32 t = 0; t < this->nThreads; ++t) {
+			workers[t] = new CRF_Minibatch_GradAccumulator_Worker(threads, this->ftrStrms, t, this->nThreads, nStreams);
+			workers[t]->start();
+		}
+		for (QNUInt32 t = 0; t < this->nThreads; ++t) {
+			workers[t]->join();
+			delete workers[t];
+		}
+		delete[] workers;
+	}
+
 	if (nStreamsEnd == nStreams) {
 		cerr << "All feature streams are at the end! "
 				<< "You don't have any utterances or you forget to rewind all the streams." << endl
@@ -278,9 +375,11 @@ double CRF_Minibatch_GradAccumulator::accumulateGradient(
 		if (!threads[stream]) {
 			continue;
 		}
-		//cerr << "Joining thread " << stream << endl;
-		threads[stream]->join();
-		//cerr << "Thread joined " << endl;
+		if (this->nThreads == this->nStreams) {
+			//cerr << "Joining thread " << stream << endl;
+			threads[stream]->join();
+			//cerr << "Thread joined " << endl;
+		}
 
 		++nStreams_active;
 
@@ -315,8 +414,33 @@ double CRF_Minibatch_GradAccumulator::accumulateGradient(
 	delete[] threads;
 	//cerr << "Deleting array sgrad_data" << endl;
 	delete[] sgrad_data;
+	CRF_MemStats::release(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	//cerr << "Deleting array sgrad" << endl;
 	delete[] sgrad;
 
 	return totLogLiNumer;
 }
+
+/*
+ * CRF_Minibatch_GradAccumulator::setUseFtrSlab
+ *
+ * Input: use - passed to CRF_GradBuilder::setUseFtrSlab() of every stream's builder
+ */
+void CRF_Minibatch_GradAccumulator::setUseFtrSlab(bool use) {
+	for (QNUInt32 stream = 0; stream < this->nStreams; ++stream) {
+		this->gBuilders[stream]->setUseFtrSlab(use);
+	}
+}
+
+/*
+ * CRF_Minibatch_GradAccumulator::getFtrAllocs
+ *
+ * Returns: feature buffer allocations made by the builders of all streams so far
+ */
+QNUInt32 CRF_Minibatch_GradAccumulator::getFtrAllocs() {
+	QNUInt32 total = 0;
+	for (QNUInt32 stream = 0; stream < this->nStreams; ++stream) {
+		total += this->gBuilders[stream]->getFtrAllocs();
+	}
+	return total;
+}
@@ -21,6 +21,7 @@ public:
 	~CRF_Minibatch_GradAccumulator_Thread();
 	int start(CRF_FeatureStream *ftr_str);
 	int join();
+	int process(CRF_FeatureStream *ftr_str);
 	inline double getBunchLogLiDenom() { return this->bunchLogLiDenom; }
 	inline double getBunchLogLiNumer() { return this->bunchLogLiNumer; }
 	inline double getBunchLogLi() { return this->bunchLogLi; }
@@ -48,6 +49,33 @@ private:
 	QNUInt32 minibatchPerThread;
 };
 
+/*
+ * class CRF_Minibatch_GradAccumulator_Worker
+ *
+ * A thread that processes the slots first, first+step, first+2*step, ... of a minibatch one after
+ * another.  Used when there are fewer threads than slots (feature streams), so that the schedule
+ * of utterances to slots does not depend on the number of threads.
+ */
+class CRF_Minibatch_GradAccumulator_Worker
+{
+public:
+	CRF_Minibatch_GradAccumulator_Worker(CRF_Minibatch_GradAccumulator_Thread **slots,
+			CRF_FeatureStream **ftrStrms, QNUInt32 first, QNUInt32 step, QNUInt32 nSlots);
+	int start();
+	int join();
+
+protected:
+	int run();
+	static void * threadEntry(void*);
+private:
+	pthread_t threadId;
+	CRF_Minibatch_GradAccumulator_Thread **slots;
+	CRF_FeatureStream **ftrStrms;
+	QNUInt32 first;
+	QNUInt32 step;
+	QNUInt32 nSlots;
+};
+
 class CRF_Minibatch_GradAccumulator {
 protected:
 	CRF_Model* crf;
@@ -58,6 +86,7 @@ protected:
 	QNUInt32 minibatch;
 	CRF_GradBuilder **gBuilders;
 	const QNUInt32 nStreams;
+	QNUInt32 nThreads;
 
 public:
 	CRF_Minibatch_GradAccumulator(CRF_Model *myCrf, CRF_FeatureStreamManager* myFtrStrmMgr, QNUInt32 myNStreams);
@@ -69,6 +98,10 @@ public:
 	void setObjectiveFunction(objfunctype ofunc) { this->objective = ofunc; }
 	void setMinibatch(QNUInt32 minibatch);
 	QNUInt32 getNStreams() { return this->nStreams; }
+	void setNThreads(QNUInt32 n);
+	QNUInt32 getNThreads() { return this->nThreads; }
+	void setUseFtrSlab(bool use);
+	QNUInt32 getFtrAllocs();
 	void rewindAllAndNextSegs();
 };
 
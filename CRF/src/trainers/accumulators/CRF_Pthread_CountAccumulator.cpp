@@ -7,8 +7,9 @@
 
 #include "CRF_Pthread_CountAccumulator.h"
 
-CRF_Pthread_CountAccumulator_Thread::CRF_Pthread_CountAccumulator_Thread(CRF_Model *crf_ptr_in,CRF_FeatureStream *ftr_strm_in, int uttRpt_in)
+CRF_Pthread_CountAccumulator_Thread::CRF_Pthread_CountAccumulator_Thread(CRF_Model *crf_ptr_in,CRF_FeatureStream *ftr_strm_in, int uttRpt_in, int threadno_in)
 : CRF_CountAccumulator(crf_ptr_in,ftr_strm_in,uttRpt_in) {
+	this->threadno=threadno_in;
 
 }
 
@@ -45,7 +46,7 @@ CRF_Pthread_CountAccumulator::CRF_Pthread_CountAccumulator(CRF_Model *crf_ptr_in
 	this->nthreads=nthreads_in;
 	this->children = new CRF_Pthread_CountAccumulator_Thread *[nthreads];
 	for (int i=0;i<this->nthreads;i++) {
-		this->children[i]=new CRF_Pthread_CountAccumulator_Thread(this->crf_ptr,ftr_str_mgr->getChild(i)->trn_stream,this->uttRpt);
+		this->children[i]=new CRF_Pthread_CountAccumulator_Thread(this->crf_ptr,ftr_str_mgr->getChild(i)->trn_stream,this->uttRpt,i);
 	}
 
 }
@@ -61,9 +62,18 @@ void CRF_Pthread_CountAccumulator::reset() {
 	for (int i=0;i<this->nthreads;i++) {
 		this->children[i]->reset();
 	}
-	for (int i=0;i<this->nlambdas;i++) {
-		this->numeratorcounts[i]=0.0;
-		this->denominatorcounts[i]=0.0;
+	CRF_CountAccumulator::reset();
+}
+
+/*
+ * CRF_Pthread_CountAccumulator::setCountTransitions
+ *
+ * Input: count - true if the threads should also count the label transitions of their streams
+ */
+void CRF_Pthread_CountAccumulator::setCountTransitions(bool count) {
+	CRF_CountAccumulator::setCountTransitions(count);
+	for (int i=0;i<this->nthreads;i++) {
+		this->children[i]->setCountTransitions(count);
 	}
 }
 
@@ -74,7 +84,11 @@ void CRF_Pthread_CountAccumulator::accumulate() {
 	}
 	for (int i=0;i<this->nthreads;i++) {
 		this->children[i]->join();
+	}
+	// reduce in thread order, so the sums do not depend on which thread finishes first
+	for (int i=0;i<this->nthreads;i++) {
 		this->children[i]->add_results(this->numeratorcounts,this->denominatorcounts);
+		this->children[i]->add_transitions(this->transitions,this->transcounts);
 	}
 
 	if (0) {
@@ -14,7 +14,7 @@
 
 class CRF_Pthread_CountAccumulator_Thread : public CRF_CountAccumulator {
 public:
-	CRF_Pthread_CountAccumulator_Thread(CRF_Model *crf_ptr_in,CRF_FeatureStream *ftr_strm_in, int uttRpt_in);
+	CRF_Pthread_CountAccumulator_Thread(CRF_Model *crf_ptr_in,CRF_FeatureStream *ftr_strm_in, int uttRpt_in, int threadno_in);
 	virtual ~CRF_Pthread_CountAccumulator_Thread();
 	int join();
 	int start();
@@ -36,6 +36,7 @@ public:
 	virtual ~CRF_Pthread_CountAccumulator();
 	virtual void accumulate();
 	virtual void reset();
+	virtual void setCountTransitions(bool count);
 };
 
 #endif /* CRF_PTHREAD_COUNTACCUMULATOR_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "CRF_Pthread_GradAccumulator.h"
+#include "../../utils/CRF_MemStats.h"
 
 
 CRF_Pthread_GradAccumulator_Thread::CRF_Pthread_GradAccumulator_Thread(CRF_GradBuilder *bldr,double *gradient)
@@ -144,6 +145,7 @@ double CRF_Pthread_GradAccumulator::accumulateGradient(CRF_FeatureStreamManager*
 	// set up stream gradients
 	double **sgrad=new double*[nStreams];
 	double *sgrad_data=sgrad[0]=new double[nStreams*nlambda];
+	CRF_MemStats::add(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	memset(sgrad[0],0,nStreams*nlambda*sizeof(double));
 
 	for(QNUInt32 s=1;s<nStreams;s++) {
@@ -224,6 +226,7 @@ double CRF_Pthread_GradAccumulator::accumulateGradient(CRF_FeatureStreamManager*
 	delete[] threads;
 	//cerr << "Deleting array sgrad_data" << endl;
 	delete[] sgrad_data;
+	CRF_MemStats::release(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	//cerr << "Deleting array sgrad" << endl;
 	delete[] sgrad;
 
@@ -258,6 +261,7 @@ double CRF_Pthread_GradAccumulator::accumulateGradientMinibatch(CRF_FeatureStrea
 	// set up stream gradients
 	double **sgrad = new double*[nStreams];
 	double *sgrad_data = sgrad[0] = new double[nStreams*nlambda];
+	CRF_MemStats::add(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	memset(sgrad[0],0,nStreams*nlambda*sizeof(double));
 
 	for(QNUInt32 s = 1; s < nStreams; s++) {
@@ -388,6 +392,7 @@ double CRF_Pthread_GradAccumulator::accumulateGradientMinibatch(CRF_FeatureStrea
 	delete[] threads;
 	//cerr << "Deleting array sgrad_data" << endl;
 	delete[] sgrad_data;
+	CRF_MemStats::release(MEM_GRADIENT,nStreams*nlambda*sizeof(double));
 	//cerr << "Deleting array sgrad" << endl;
 	delete[] sgrad;
 
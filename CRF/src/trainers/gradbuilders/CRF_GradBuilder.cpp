@@ -10,7 +10,8 @@
 #include "CRF_NewGradBuilder_StdSeg.h"
 #include "CRF_NewGradBuilder_StdSeg_BrokenClass.h"
 #include "CRF_NewGradBuilder_StdSeg_NoDur_NoTrans.h"
-//#include "CRF_NewGradBuilderSoft.h"
+#include "CRF_NewGradBuilderSoft.h"
+#include "../../utils/CRF_MemStats.h"
 //#include "CRF_FerrGradBuilder.h"
 
 /*
@@ -28,6 +29,9 @@ CRF_GradBuilder::CRF_GradBuilder(CRF_Model* crf_in)
 	this->ftr_buf=NULL;
 	this->lab_buf=NULL;
 	this->nodeList=NULL;
+	this->ftrSlab=new CRF_FeatureSlab();
+	this->useFtrSlab=true;
+	this->ftrCopyAllocs=0;
 }
 
 /*
@@ -44,6 +48,8 @@ CRF_GradBuilder::~CRF_GradBuilder()
 		//this->nodeList->deleteAll();
 		delete nodeList;
 	}
+	delete this->ftrSlab;
+	CRF_MemStats::release(MEM_GRADIENT,this->scoreGrad.size()*sizeof(double));
 	//cerr << "exiting GradBuilder destructor" << endl;
 }
 
@@ -63,6 +69,29 @@ double CRF_GradBuilder::buildGradient(CRF_FeatureStream* ftr_strm,double* grad,
 	return 0.0;
 }
 
+/*
+ * CRF_GradBuilder::computeLogLi
+ *
+ * Input: *ftr_strm - input feature stream
+ *        *Zx_out - normalization constant return value
+ *        posteriors - the node posteriors are needed after the call
+ *
+ * Returns: the score of the label path of the sequence, as buildGradient
+ *
+ * Default version for the builders without a forward-only pass: builds the gradient into a
+ * scratch vector that is thrown away.  Both passes are run, so posteriors is always honoured.
+ */
+double CRF_GradBuilder::computeLogLi(CRF_FeatureStream* ftr_strm, double* Zx_out, bool posteriors)
+{
+	QNUInt32 lambda_len=this->crf->getLambdaLen();
+	if (this->scoreGrad.size() < lambda_len) {
+		CRF_MemStats::add(MEM_GRADIENT,(lambda_len-this->scoreGrad.size())*sizeof(double));
+		this->scoreGrad.resize(lambda_len);
+	}
+	std::fill(this->scoreGrad.begin(),this->scoreGrad.end(),0.0);
+	return this->buildGradient(ftr_strm,&(this->scoreGrad[0]),Zx_out);
+}
+
 /*
  * CRF_GradBuilder::setNodeList
  *
@@ -86,6 +115,64 @@ CRF_GradBuilder *CRF_GradBuilder::create(CRF_Model *crf_ptr,bool useLogspace, in
 }
 */
 
+/*
+ * CRF_GradBuilder::setUseFtrSlab
+ *
+ * Input: use - true to keep the features of a sequence in the feature slab, false to give every
+ *   node its own copy
+ */
+void CRF_GradBuilder::setUseFtrSlab(bool use)
+{
+	this->useFtrSlab = use;
+}
+
+/*
+ * CRF_GradBuilder::getFtrAllocs
+ *
+ * Returns: number of feature buffers allocated so far, either per node copies or slab blocks
+ */
+QNUInt32 CRF_GradBuilder::getFtrAllocs()
+{
+	return this->ftrCopyAllocs + this->ftrSlab->getBlockAllocs();
+}
+
+/*
+ * CRF_GradBuilder::getReadBuf
+ *
+ * Input: max_size - largest number of floats the next read from the feature stream can return
+ *
+ * Returns: buffer to read the next node's features into: space reserved in the feature slab, or
+ *   the builder's ftr_buf when the slab is not used
+ */
+float* CRF_GradBuilder::getReadBuf(QNUInt32 max_size)
+{
+	if (this->useFtrSlab) {
+		return this->ftrSlab->reserve(max_size);
+	}
+	return this->ftr_buf;
+}
+
+/*
+ * CRF_GradBuilder::keepNodeFtrs
+ *
+ * Input: read_buf - buffer returned by getReadBuf, holding the features just read
+ *        size - number of floats read
+ *
+ * Returns: feature buffer for the node.  With the slab this is read_buf itself, to be passed to
+ *   CRF_StateVector::setView; otherwise it is a new copy to be owned by the node via set().
+ */
+float* CRF_GradBuilder::keepNodeFtrs(float* read_buf, QNUInt32 size)
+{
+	if (this->useFtrSlab) {
+		this->ftrSlab->commit(size);
+		return read_buf;
+	}
+	float* new_buf = new float[size];
+	memcpy(new_buf, read_buf, size*sizeof(float));
+	this->ftrCopyAllocs++;
+	return new_buf;
+}
+
 /*
  * CRF_GradBuilder::create
  *
@@ -127,9 +214,13 @@ CRF_GradBuilder* CRF_GradBuilder::create(CRF_Model *crf_ptr, objfunctype ofunc)
 		}
 
 		break;
-	//case EXPFSOFT :
-	//	gbuild = new CRF_NewGradBuilderSoft(crf_ptr);
-	//	break;
+	case EXPFSOFT :
+		if (mtype != STDFRAME) {
+			string errstr="CRF_GradBuilder::create() caught exception: the softexpf objective is only implemented for frame models.";
+			throw runtime_error(errstr);
+		}
+		gbuild = new CRF_NewGradBuilderSoft(crf_ptr);
+		break;
 	//case FERR :
 	//	gbuild = new CRF_FerrGradBuilder(crf_ptr);
 	//	break;
@@ -13,6 +13,8 @@
 #include "../../CRF_Model.h"
 #include "../../io/CRF_FeatureStream.h"
 #include "../../nodes/CRF_StateVector.h"
+#include "../../io/CRF_FeatureSlab.h"
+#include <vector>
 
 /*
  * class CRF_GradBuilder
@@ -20,6 +22,13 @@
  * Used to construct a gradient for gradient-based training methods.  This class is an interface class
  * and should be used to construct subclasses to build the gradient as needed by a model topology.  See
  * NewGradBuilder for one example.
+ *
+ * By default the features of a sequence are read into a CRF_FeatureSlab and the nodes point into
+ * it; setUseFtrSlab(false) restores the older behaviour of one heap copy per node, and
+ * getFtrAllocs() counts the feature buffer allocations of either path.
+ *
+ * computeLogLi scores a sequence without building its gradient, for evaluation.  Builders that
+ * do not provide a forward-only pass fall back to buildGradient into a scratch gradient.
  */
 
 class CRF_GradBuilder
@@ -34,11 +43,20 @@ protected:
 	QNUInt32 num_labs;
 	QNUInt32 lambda_len;
 	CRF_StateVector* nodeList;
+	CRF_FeatureSlab* ftrSlab;
+	bool useFtrSlab;
+	QNUInt32 ftrCopyAllocs;
+	vector<double> scoreGrad;
+	virtual float* getReadBuf(QNUInt32 max_size);
+	virtual float* keepNodeFtrs(float* read_buf, QNUInt32 size);
 public:
 	CRF_GradBuilder(CRF_Model* crf_in);
 	virtual ~CRF_GradBuilder();
 	virtual double buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out);
+	virtual double computeLogLi(CRF_FeatureStream* ftr_strm, double* Zx_out, bool posteriors);
 	virtual void setNodeList(CRF_StateVector* nl);
+	virtual void setUseFtrSlab(bool use);
+	virtual QNUInt32 getFtrAllocs();
 	// factory method
 //	static CRF_GradBuilder *create(CRF_Model *crf_ptr, bool useLogspace,int nStates);
 	static CRF_GradBuilder* create(CRF_Model *crf_ptr, objfunctype ofunc);
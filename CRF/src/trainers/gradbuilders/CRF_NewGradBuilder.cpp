@@ -6,6 +6,7 @@
  *
  */
 #include "CRF_NewGradBuilder.h"
+#include "../../utils/CRF_MemStats.h"
 
 /*
  * CRF_NewGradBuilder constructor
@@ -20,7 +21,9 @@ CRF_NewGradBuilder::CRF_NewGradBuilder(CRF_Model* crf_in)
 	}
 	this->lambda_len = crf_in->getLambdaLen();
 	this->ExpF = new double[this->lambda_len];
+	CRF_MemStats::add(MEM_GRADIENT,this->lambda_len*sizeof(double));
 	this->nodeList = new CRF_StateVector();
+	this->gemmFtrMap = dynamic_cast<CRF_StdFeatureMap*>(crf_in->getFeatureMap());
 }
 
 /*
@@ -33,22 +36,61 @@ CRF_NewGradBuilder::~CRF_NewGradBuilder()
 	//if (this->ftr_buf != NULL) { delete this->ftr_buf; }
 	//if (this->lab_buf != NULL) { delete this->lab_buf; }
 	delete [] this->ExpF;
+	CRF_MemStats::release(MEM_GRADIENT,this->lambda_len*sizeof(double));
 }
 
 /*
- * CRF_NewGradBuilder::buildGradient
+ * CRF_NewGradBuilder::useGemmStateExpF
  *
- * Input: *ftr_stream - input feature stream
- *        *grad - gradient vector return value
- *        *Zx_out - normalization constant return value
+ * Returns: true if the state features can be accumulated with accumulateStateExpF, i.e. the model
+ *   uses single state CRF_StdStateNode nodes and its feature map lays the state functions out as a
+ *   labels x state functions matrix in lambda over dense features (a non-zero state feature stride).
+ */
+bool CRF_NewGradBuilder::useGemmStateExpF()
+{
+	return (this->gemmFtrMap != NULL &&
+			this->crf->getModelType() == STDFRAME &&
+			this->gemmFtrMap->getNumStates() == 1 &&
+			this->gemmFtrMap->getNumStateFuncs(0) > 0 &&
+			this->gemmFtrMap->getStateFeatureStride() > 0);
+}
+
+/*
+ * CRF_NewGradBuilder::accumulateStateExpF
  *
- * Computes the gradient given the current CRF model and the features in ftr_strm and returns it in
- * grad.  Zx_out contains the normalization constant for the current sequence.
+ * Input: numNodes - number of frames in the sequence
+ *
+ * Adds (Gamma-Y)^T X to the state block of ExpF, where the rows of gemmGamma hold the state
+ *   posteriors of each frame with the true label already subtracted and the rows of gemmFtrs hold
+ *   the state function values of each frame.  Since ExpF is subtracted from the gradient at the
+ *   end of buildGradient, this adds both the empirical counts and the expected values of all state
+ *   functions for the sequence.
  */
-double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out)
+void CRF_NewGradBuilder::accumulateStateExpF(QNUInt32 numNodes)
 {
-	QNUInt32 lambda_len = this->crf->getLambdaLen();
+	QNUInt32 numStateFuncs = this->gemmFtrMap->getNumStateFuncs(0);
+	QNUInt32 base = this->gemmFtrMap->getStateFeatureIdx(0);
+	QNUInt32 stride = this->gemmFtrMap->getStateFeatureStride();
+	cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans,
+			this->num_labs, numStateFuncs, numNodes,
+			1.0, &(this->gemmGamma[0]), this->num_labs,
+			&(this->gemmFtrs[0]), numStateFuncs,
+			1.0, &(this->ExpF[base]), stride);
+}
 
+/*
+ * CRF_NewGradBuilder::computeForward
+ *
+ * Input: *ftr_strm - input feature stream
+ *        *logLi_out - sum of the negated alpha scales of the sequence return value
+ *
+ * Returns: number of nodes in the sequence
+ *
+ * Reads the next sequence of ftr_strm into the node list and computes the transition matrices
+ * and the alpha vectors of its nodes.
+ */
+QNUInt32 CRF_NewGradBuilder::computeForward(CRF_FeatureStream* ftr_strm, double* logLi_out)
+{
 	double logLi = 0.0;
 
 	// Changed by Ryan, CRF_InFtrStream_SeqMultiWindow can just accept 1 as bunch_size for frame model.
@@ -77,25 +119,40 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 
 	size_t ftr_count;
 
-	for (QNUInt32 i=0; i<lambda_len; i++) {
-		this->ExpF[i]=0.0;
-	}
+	this->ftrSlab->rewind();
+
+	// A joined stream already holds the sequence in place, one block per feature file
+	bool use_view=ftr_strm->has_view();
+	CRF_FtrView fv;
 
 	// Changed by Ryan
 	QNUInt32 nodeCnt=0;
 	do {
 		// First, read in the next training value from the file
 		//	We can read in a "bunch" at a time, then separate them into individual frames
-		ftr_count=ftr_strm->read(bunch_size,this->ftr_buf,this->lab_buf);
+		// The bunch is read straight into the feature slab, where the nodes can use it in place
+		float* read_buf=NULL;
+		if (use_view) {
+			ftr_count=ftr_strm->read_view(bunch_size,&fv,this->lab_buf);
+		}
+		else {
+			read_buf=this->getReadBuf(num_ftrs*bunch_size);
+			ftr_count=ftr_strm->read(bunch_size,read_buf,this->lab_buf);
+			if (this->useFtrSlab) {
+				this->keepNodeFtrs(read_buf,num_ftrs*ftr_count);
+			}
+		}
 
 		for (QNUInt32 i=0; i<ftr_count; i++) {
 			//cout << "\tLabel: " << lab_buf[i] << "\tFeas:";
 			// Now, separate the bunch into individual frames
-			float* new_buf = new float[num_ftrs];
-			for (QNUInt32 j=0; j<num_ftrs; j++) {
-				int idx=i*num_ftrs+j;
-				new_buf[j]=this->ftr_buf[idx];
-				//cout << " " << new_buf[j];
+			// (with a view there is no buffer, the node reads the frame where the stream holds it)
+			float* new_buf=NULL;
+			if (!use_view && this->useFtrSlab) {
+				new_buf = &(read_buf[i*num_ftrs]);
+			}
+			else if (!use_view) {
+				new_buf = this->keepNodeFtrs(&(read_buf[i*num_ftrs]),num_ftrs);
 			}
 			//cout << endl;
 			// Store the current frame/label information in a sequence node
@@ -107,7 +164,16 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 			else {
 				this->nodeList.at(nodeCnt)->reset(new_buf,num_ftrs,this->lab_buf[i],this->crf);
 			}*/
-			this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			if (use_view) {
+				CRF_FtrView frame_fv=fv.next(i);
+				this->nodeList->setFtrView(nodeCnt,&frame_fv,num_ftrs,this->lab_buf[i],this->crf);
+			}
+			else if (this->useFtrSlab) {
+				this->nodeList->setView(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			}
+			else {
+				this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			}
 			//cout << "Label: " << this->lab_buf[i] << endl;
 			double value=this->nodeList->at(nodeCnt)->computeTransMatrix();
 			double scale;
@@ -266,11 +332,37 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 	// added by Ryan
 	if (nodeCnt == 0)
 	{
-		string errstr="CRF_NewGradBuilder::buildGradient() caught exception: No features read from this sentence.";
+		string errstr="CRF_NewGradBuilder::computeForward() caught exception: No features read from this sentence.";
 		throw runtime_error(errstr);
 	}
 
-	nodeCnt--;//Correct for the fact that we add 1 to the nodeCnt at the end of the above loop...
+	this->nodeList->setNodeCount(nodeCnt);
+	*logLi_out=logLi;
+	return nodeCnt;
+}
+
+/*
+ * CRF_NewGradBuilder::buildGradient
+ *
+ * Input: *ftr_stream - input feature stream
+ *        *grad - gradient vector return value
+ *        *Zx_out - normalization constant return value
+ *
+ * Computes the gradient given the current CRF model and the features in ftr_strm and returns it in
+ * grad.  Zx_out contains the normalization constant for the current sequence.
+ */
+double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out)
+{
+	QNUInt32 lambda_len = this->crf->getLambdaLen();
+
+	for (QNUInt32 i=0; i<lambda_len; i++) {
+		this->ExpF[i]=0.0;
+	}
+
+	double logLi;
+	QNUInt32 nodeCnt=this->computeForward(ftr_strm,&logLi);
+
+	nodeCnt--;//computeForward returns the number of nodes, the last one is one less...
 	QNUInt32 lastNode=nodeCnt;
 
 	double Zx=this->nodeList->at(lastNode)->computeAlphaSum();
@@ -282,6 +374,19 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 	//	cout << tmp_i << " :" << tmpAlpha[tmp_i] << endl;
 	//}
 
+	// State features are gathered per frame and accumulated with one GEMM after the backward pass
+	bool useGemm=this->useGemmStateExpF();
+	QNUInt32 numStateFuncs=0;
+	if (useGemm) {
+		numStateFuncs=this->gemmFtrMap->getNumStateFuncs(0);
+		if (this->gemmGamma.size() < (lastNode+1)*this->num_labs) {
+			this->gemmGamma.resize((lastNode+1)*this->num_labs);
+		}
+		if (this->gemmFtrs.size() < (lastNode+1)*numStateFuncs) {
+			this->gemmFtrs.resize((lastNode+1)*numStateFuncs);
+		}
+	}
+
 	// Changed by Ryan
 	bool stop=false;
 	while (!stop) {
@@ -307,7 +412,23 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 		}
 		//double cur_alpha_sum = this->nodeList->at(nodeCnt)->computeAlphaSum(); //*DEBUG*//
 		//cout << "\t" << nodeCnt << ":\tAlpha Sum: " << cur_alpha_sum;  //Added by Ryan, just for debugging
-		logLi += this->nodeList->at(nodeCnt)->computeExpF(this->ExpF, grad, Zx, prev_alpha, prev_lab);
+		if (useGemm) {
+			CRF_StateNode* node = this->nodeList->at(nodeCnt);
+			double* gamma = &(this->gemmGamma[nodeCnt*this->num_labs]);
+			logLi += node->computeTransExpF(this->ExpF, grad, Zx, prev_alpha, prev_lab, gamma);
+			if (node->getLabel() < this->num_labs) {
+				gamma[node->getLabel()] -= 1.0;
+			}
+			if (node->getFtrView() != NULL) {
+				this->gemmFtrMap->copyStateFeaturesView(node->getFtrView(), &(this->gemmFtrs[nodeCnt*numStateFuncs]));
+			}
+			else {
+				this->gemmFtrMap->copyStateFeatures(node->getFtrBuffer(), &(this->gemmFtrs[nodeCnt*numStateFuncs]));
+			}
+		}
+		else {
+			logLi += this->nodeList->at(nodeCnt)->computeExpF(this->ExpF, grad, Zx, prev_alpha, prev_lab);
+		}
 		//cout << "\t" << nodeCnt << ":\tLogLi is now: " << logLi << "\tAlpha Sum: " << cur_alpha_sum << endl; //*DEBUG*//
 		//cout << "\tLogLi is now: " << logLi << endl;  //Added by Ryan, just for debugging
 		if (nodeCnt==0) { stop=true;} // nodeCnt is unsigned, so we can't do the obvious loop control here
@@ -371,6 +492,10 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 //		nodeCnt--;
 //	}
 
+	if (useGemm) {
+		this->accumulateStateExpF(lastNode+1);
+	}
+
 	for (QNUInt32 i=0; i<lambda_len; i++) {
 		grad[i]-=this->ExpF[i];
 	}
@@ -381,3 +506,49 @@ double CRF_NewGradBuilder::buildGradient(CRF_FeatureStream* ftr_strm, double* gr
 	return logLi;
 }
 
+/*
+ * CRF_NewGradBuilder::computeLogLi
+ *
+ * Input: *ftr_strm - input feature stream
+ *        *Zx_out - normalization constant return value
+ *        posteriors - also compute the beta vectors, so that the state posteriors of the nodes can
+ *          be read with computeAlphaBeta
+ *
+ * Returns: the score of the label path of the sequence, as buildGradient
+ *
+ * Runs the forward pass only (and the backward pass if posteriors is set) and scores the label
+ *   path from the node values, without the feature expectations buildGradient accumulates.
+ */
+double CRF_NewGradBuilder::computeLogLi(CRF_FeatureStream* ftr_strm, double* Zx_out, bool posteriors)
+{
+	double logLi;
+	QNUInt32 nodeCnt=this->computeForward(ftr_strm,&logLi);
+	QNUInt32 lastNode=nodeCnt-1;
+	double Zx=this->nodeList->at(lastNode)->computeAlphaSum();
+
+	QNUInt32 prev_lab=this->num_labs;
+	for (QNUInt32 n=0; n<nodeCnt; n++) {
+		CRF_StateNode* node=this->nodeList->at(n);
+		QNUInt32 lab=node->getLabel();
+		if (lab < this->num_labs) {
+			if (prev_lab < this->num_labs) {
+				logLi+=node->getFullTransValue(prev_lab,lab);
+			}
+			else {
+				logLi+=node->getStateValue(lab);
+			}
+		}
+		prev_lab=lab;
+	}
+
+	if (posteriors) {
+		this->nodeList->at(lastNode)->setTailBeta();
+		for (QNUInt32 n=lastNode; n>0; n--) {
+			CRF_StateNode* prev=this->nodeList->at(n-1);
+			this->nodeList->at(n)->computeBeta(prev->getBeta(),prev->getAlphaScale());
+		}
+	}
+	*Zx_out=Zx;
+	return logLi;
+}
+
@@ -14,20 +14,34 @@
 #include "CRF_GradBuilder.h"
 #include "../../nodes/CRF_StdStateNode.h"
 #include "../../nodes/CRF_StateVector.h"
+#include "../../ftrmaps/CRF_StdFeatureMap.h"
 
 /*
  * class CRF_NewGradBuilder
  *
  * Used to construct a gradient for gradient-based training methods.  This is a basic gradient builder
  * that is suitable for a linear chain model with either a single state or multi-state toplogy.
+ *
+ * For single state models with a CRF_StdFeatureMap, the state feature part of the gradient is
+ * accumulated once per sequence as a matrix product: with Gamma the frames x labels matrix of state
+ * posteriors, Y the matching one-hot matrix of the true labels and X the frames x state functions
+ * matrix of feature values, the state block of the gradient gets (Y-Gamma)^T X from one cblas_dgemm
+ * call instead of a computeStateExpF call per frame and label.
  */
 
 class CRF_NewGradBuilder : public CRF_GradBuilder
 {
-
+protected:
+	CRF_StdFeatureMap* gemmFtrMap;
+	vector<double> gemmGamma;
+	vector<double> gemmFtrs;
+	virtual bool useGemmStateExpF();
+	virtual void accumulateStateExpF(QNUInt32 numNodes);
+	virtual QNUInt32 computeForward(CRF_FeatureStream* ftr_strm, double* logLi_out);
 public:
 	CRF_NewGradBuilder(CRF_Model* crf_in);
 	virtual double buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out);
+	virtual double computeLogLi(CRF_FeatureStream* ftr_strm, double* Zx_out, bool posteriors);
 	virtual ~CRF_NewGradBuilder();
 };
 
@@ -6,100 +6,163 @@
  */
 
 #include "CRF_NewGradBuilderSoft.h"
-#include "fst/fstlib.h"
 
+/*
+ * CRF_NewGradBuilderSoft constructor
+ *
+ * See CRF_NewGradBuilder constructor for details
+ */
 CRF_NewGradBuilderSoft::CRF_NewGradBuilderSoft(CRF_Model* crf_in)
-	: CRF_GradBuilder(crf_in)
+	: CRF_NewGradBuilder(crf_in)
 {
-	for (QNUInt32 i=0; i<this->num_labs; i++) {
-		this->alpha_base[i]=0.0;
-	}
-	this->alphaAlignBase.assign(this->num_labs,0);
-	// nodelist may come from base constructor
-	if (this->nodeList) {
-		delete this->nodeList;
-	}
-	this->lb=NULL;
-	this->nodeList=NULL;
 }
 
 CRF_NewGradBuilderSoft::~CRF_NewGradBuilderSoft() {
-	// TODO Auto-generated destructor stub
 }
 
-double CRF_NewGradBuilderSoft::buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out)
+/*
+ * CRF_NewGradBuilderSoft::accumulateSoftExpF
+ *
+ * Input: nodeIdx - node to accumulate
+ *        *grad - gradient vector
+ *        Zx_aligned - normalization constant of the label-constrained paths
+ *
+ * Adds the expected feature values of node nodeIdx under the label-constrained paths to grad,
+ *   using the masked alphas and betas of the node list.  computeExpF has already added the counts
+ *   of the hard aligned labels to grad, so the same counts are added to ExpF here to cancel them
+ *   when ExpF is subtracted at the end of buildGradient.
+ */
+void CRF_NewGradBuilderSoft::accumulateSoftExpF(QNUInt32 nodeIdx, double* grad, double Zx_aligned)
 {
-	if (this->lb == NULL ) {
-		//cerr << "Creating LatticeBuilder" << endl;
-		// Slight hack so that we don't need to re-engineer LatticeBuilder
-		this->lb = new CRF_LatticeBuilder(ftr_strm,this->crf);
-		this->nodeList=this->lb->getNodeList();
-	}
-	QNUInt32 lambda_len = this->crf->getLambdaLen();
+	CRF_FeatureMap* ftrMap = this->crf->getFeatureMap();
 	double* lambda = this->crf->getLambda();
-	for (QNUInt32 i=0; i<lambda_len; i++) {
-		this->ExpF[i]=0.0;
+	CRF_StateNode* node = this->nodeList->at(nodeIdx);
+	float* ftrs = node->getFtrBuffer();
+	QNUInt32 lab = node->getLabel();
+	QNUInt32 lo = this->nodeList->getMaskLo(nodeIdx);
+	QNUInt32 hi = this->nodeList->getMaskHi(nodeIdx);
+
+	for (QNUInt32 k=lo; k<=hi; k++) {
+		QNUInt32 clab = this->nodeList->getMaskLabel(k);
+		double beta = this->nodeList->getMaskedBeta(nodeIdx,k);
+		double gamma = expE(this->nodeList->getMaskedAlpha(nodeIdx,k)+beta-Zx_aligned);
+		ftrMap->computeStateExpF(ftrs,lambda,grad,NULL,gamma,lab,clab,false);
+		if (nodeIdx > 0) {
+			// the segment continues from the previous node, or is entered from the segment before it
+			double alpha_prev = this->nodeList->getMaskedAlpha(nodeIdx-1,k);
+			if (alpha_prev != CRF_LogMath::LOG0) {
+				gamma = expE(alpha_prev+node->getFullTransValue(clab,clab)+beta-Zx_aligned);
+				ftrMap->computeTransExpF(ftrs,lambda,grad,NULL,gamma,clab,clab,clab,clab,false);
+			}
+			if (k > 0) {
+				QNUInt32 plab = this->nodeList->getMaskLabel(k-1);
+				alpha_prev = this->nodeList->getMaskedAlpha(nodeIdx-1,k-1);
+				if (alpha_prev != CRF_LogMath::LOG0) {
+					gamma = expE(alpha_prev+node->getFullTransValue(plab,clab)+beta-Zx_aligned);
+					ftrMap->computeTransExpF(ftrs,lambda,grad,NULL,gamma,plab,clab,plab,clab,false);
+				}
+			}
+		}
+	}
+
+	ftrMap->computeStateExpF(ftrs,lambda,this->ExpF,NULL,1.0,lab,lab,false);
+	if (nodeIdx > 0) {
+		QNUInt32 prev_lab = this->nodeList->at(nodeIdx-1)->getLabel();
+		ftrMap->computeTransExpF(ftrs,lambda,this->ExpF,NULL,1.0,prev_lab,lab,prev_lab,lab,false);
 	}
+}
 
-	VectorFst<LogArc> phn_lat;
-	VectorFst<LogArc> lab_lat;
+/*
+ * CRF_NewGradBuilderSoft::buildGradient
+ *
+ * Input: *ftr_stream - input feature stream
+ *        *grad - gradient vector return value
+ *        *Zx_out - normalization constant return value
+ *
+ * Returns: log of the normalization constant of the label-constrained paths
+ *
+ * Computes the gradient of the soft objective: the expected feature values under the
+ *   label-constrained paths minus the expected feature values under all paths.
+ */
+double CRF_NewGradBuilderSoft::buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out)
+{
+	QNUInt32 lambda_len = this->crf->getLambdaLen();
+	size_t bunch_size = 1;
+	size_t num_ftrs=ftr_strm->num_ftrs();
 
-	//cerr << "Building lattice" << endl;
-	int nstates=0;
-	if (this->crf->getFeatureMap()->getNumStates()==1) {
-		nstates=lb->buildLattice(&phn_lat,true,&lab_lat,false);
+	if (this->ftr_buf==NULL) {
+		this->ftr_buf = new float[num_ftrs*bunch_size];
+		this->lab_buf = new QNUInt32[bunch_size];
 	}
-	else {
-		nstates=lb->nStateBuildLattice(&phn_lat,true,&lab_lat,false);
+
+	for (QNUInt32 i=0; i<lambda_len; i++) {
+		this->ExpF[i]=0.0;
 	}
 
-	ComposeFst<LogArc> result(phn_lat,lab_lat);
+	this->ftrSlab->rewind();
 
-	this->lb->computeAlignedAlphaBeta(result,nstates);
+	size_t ftr_count;
+	QNUInt32 nodeCnt=0;
+	do {
+		float* read_buf=this->getReadBuf(num_ftrs*bunch_size);
+		ftr_count=ftr_strm->read(bunch_size,read_buf,this->lab_buf);
+		if (this->useFtrSlab) {
+			this->keepNodeFtrs(read_buf,num_ftrs*ftr_count);
+		}
 
-	double logLi = 0.0;
+		for (QNUInt32 i=0; i<ftr_count; i++) {
+			if (this->useFtrSlab) {
+				this->nodeList->setView(nodeCnt,&(read_buf[i*num_ftrs]),num_ftrs,this->lab_buf[i],this->crf);
+			}
+			else {
+				float* new_buf = this->keepNodeFtrs(&(read_buf[i*num_ftrs]),num_ftrs);
+				this->nodeList->set(nodeCnt,new_buf,num_ftrs,this->lab_buf[i],this->crf);
+			}
+			this->nodeList->at(nodeCnt)->computeTransMatrix();
+			if (nodeCnt == 0) {
+				this->nodeList->at(nodeCnt)->computeFirstAlpha(this->alpha_base);
+			}
+			else {
+				this->nodeList->at(nodeCnt)->computeAlpha(this->nodeList->at(nodeCnt-1)->getAlpha());
+			}
+			nodeCnt++;
+		}
+	} while (ftr_count >= bunch_size);
 
-	for (QNUInt32 i=0; i<lambda_len; i++) {
-		this->ExpF[i]=0.0;
+	if (nodeCnt == 0)
+	{
+		string errstr="CRF_NewGradBuilderSoft::buildGradient() caught exception: No features read from this sentence.";
+		throw runtime_error(errstr);
 	}
+	this->nodeList->setNodeCount(nodeCnt);
 
-	QNUInt32 nodeCnt=this->nodeList->getNodeCount()-1;
-	// Alphas are already computed, so we just need the beta values
+	nodeCnt--;
 	QNUInt32 lastNode=nodeCnt;
 	double Zx=this->nodeList->at(lastNode)->computeAlphaSum();
-	double Zx_aligned=this->nodeList->at(lastNode)->computeAlphaAlignedSum();
+	double Zx_aligned=this->nodeList->computeMaskedAlphaBeta();
 
 	bool stop=false;
 	while (!stop) {
 		double* beta = this->nodeList->at(nodeCnt)->getBeta();
-		vector<double>* betaAligned=this->nodeList->at(nodeCnt)->getBetaAligned();
-		logLi-=this->nodeList->at(nodeCnt)->getAlphaScale();
 		if (nodeCnt==lastNode) {
 			this->nodeList->at(nodeCnt)->setTailBeta();
 		}
 		else {
-			// We compute the beta value for the node following our current one, and store the result
-			// as the beta for our current node (as per the equations).
 			this->nodeList->at(nodeCnt+1)->computeBeta(beta,this->nodeList->at(nodeCnt)->getAlphaScale());
 		}
 		double* prev_alpha;
-		vector<double>* prev_alphaAligned;
 		QNUInt32 prev_lab;
 		if (nodeCnt>0) {
 			prev_alpha=this->nodeList->at(nodeCnt-1)->getAlpha();
 			prev_lab = this->nodeList->at(nodeCnt-1)->getLabel();
-			prev_alphaAligned = this->nodeList->at(nodeCnt-1)->getAlphaAligned();
 		}
 		else {
 			prev_alpha=this->alpha_base;
 			prev_lab=this->num_labs+1;
-			prev_alphaAligned = &(this->alphaAlignBase);
 		}
-		//double cur_alpha_sum = this->nodeList->at(nodeCnt)->computeAlphaSum(); //*DEBUG*//
-		logLi += this->nodeList->at(nodeCnt)->computeExpF(this->ExpF, grad, Zx, prev_alpha, prev_lab);
-		// Here we replace the ExpF calculation with our new soft ExpF calculation
-
-		//cout << "\t" << nodeCnt << ":\tLogLi is now: " << logLi << "\tAlpha Sum: " << cur_alpha_sum << endl;
+		// the hard label counts added to grad here are cancelled by accumulateSoftExpF
+		this->nodeList->at(nodeCnt)->computeExpF(this->ExpF, grad, Zx, prev_alpha, prev_lab);
+		this->accumulateSoftExpF(nodeCnt, grad, Zx_aligned);
 		if (nodeCnt==0) { stop=true;} // nodeCnt is unsigned, so we can't do the obvious loop control here
 		nodeCnt--;
 	}
@@ -108,9 +171,5 @@ double CRF_NewGradBuilderSoft::buildGradient(CRF_FeatureStream* ftr_strm, double
 		grad[i]-=this->ExpF[i];
 	}
 	*Zx_out=Zx;
-	//logLi-=Zx;
-
-
-	//nodeList.clear();
-	return logLi;
+	return Zx_aligned;
 }
@@ -8,14 +8,22 @@
 #ifndef CRF_NEWGRADBUILDERSOFT_H_
 #define CRF_NEWGRADBUILDERSOFT_H_
 
-#include "CRF_GradBuilder.h"
-#include "../../decoders/CRF_LatticeBuilder.h"
-#include <vector>
+#include "CRF_NewGradBuilder.h"
 
-class CRF_NewGradBuilderSoft: public CRF_GradBuilder {
-private:
-	CRF_LatticeBuilder* lb;
-	vector<double> alphaAlignBase;
+/*
+ * class CRF_NewGradBuilderSoft
+ *
+ * Gradient builder for the "soft" objective (crf_objective_function=softexpf).  The numerator is
+ * the sum over all the label paths that collapse to the label sequence of the alignment, i.e. the
+ * boundaries between labels are free, instead of the single path of the alignment.
+ *
+ * The numerator forward-backward is the masked alpha/beta computation of CRF_StateVector (see
+ * CRF_StateVector::computeMaskedAlphaBeta) over the same nodes as the denominator, so the cost
+ * of a sequence stays close to that of CRF_NewGradBuilder.
+ */
+class CRF_NewGradBuilderSoft: public CRF_NewGradBuilder {
+protected:
+	virtual void accumulateSoftExpF(QNUInt32 nodeIdx, double* grad, double Zx_aligned);
 public:
 	CRF_NewGradBuilderSoft(CRF_Model* crf_in);
 	virtual double buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out);
@@ -20,6 +20,7 @@ public:
 	CRF_NewGradBuilder_StdSeg(CRF_Model* crf_in);
 	virtual ~CRF_NewGradBuilder_StdSeg();
 	virtual double buildGradient(CRF_FeatureStream* ftr_strm, double* grad, double* Zx_out);
+	virtual double computeLogLi(CRF_FeatureStream* ftr_strm, double* Zx_out, bool posteriors);
 };
 
 #endif /* CRF_NEWGRADBUILDER_STDSEG_H_ */
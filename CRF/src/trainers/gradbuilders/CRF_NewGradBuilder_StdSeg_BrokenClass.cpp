@@ -116,11 +116,15 @@ double CRF_NewGradBuilder_StdSeg_BrokenClass::buildGradient(CRF_FeatureStream* f
 //			//	alpha[i] = alpha[i-1]*M[i]
 //		}
 //	} while (ftr_count >= bunch_size);
+	this->ftrSlab->rewind();
+
 	QNUInt32 nodeCnt=0;
 	do {
 		// First, read in the next training value from the file
 		//	We can read in a "bunch" at a time, then separate them into individual frames
-		ftr_count=ftr_strm->read(bunch_size,this->ftr_buf,this->lab_buf);
+		// Read straight into the feature slab, where the node can use the window in place
+		float* read_buf=this->getReadBuf(num_ftrs*lab_max_dur);
+		ftr_count=ftr_strm->read(bunch_size,read_buf,this->lab_buf);
 
 		if (ftr_count > 0)
 		{
@@ -135,12 +139,7 @@ double CRF_NewGradBuilder_StdSeg_BrokenClass::buildGradient(CRF_FeatureStream* f
 
 			QNUInt32 cur_ftr_buf_size = num_ftrs * ftr_count;
 
-			float* new_buf = new float[cur_ftr_buf_size];
-
-			for (QNUInt32 j=0; j<cur_ftr_buf_size; j++) {
-				new_buf[j]=this->ftr_buf[j];
-				//cout << " " << new_buf[j];
-			}
+			float* new_buf = this->keepNodeFtrs(read_buf,cur_ftr_buf_size);
 
 			//TODO: design a labmap class to do the label mapping.
 			QNUInt32 actualLab = CRF_LAB_BAD;
@@ -206,7 +205,12 @@ double CRF_NewGradBuilder_StdSeg_BrokenClass::buildGradient(CRF_FeatureStream* f
 			QNUInt32 prevNode_nLabs = this->crf->getNLabs();
 			QNUInt32 nextNode_nActualLabs = nActualLabs;
 
-			this->nodeList->set(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+			if (this->useFtrSlab) {
+				this->nodeList->setView(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+			}
+			else {
+				this->nodeList->set(nodeCnt,new_buf,cur_ftr_buf_size,label,this->crf,nodeMaxDur,prevNode_nLabs,nextNode_nActualLabs);
+			}
 
 			QNUInt32 numPrevNodes;
 			if (nodeCnt + 1 <= lab_max_dur)
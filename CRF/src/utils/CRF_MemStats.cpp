@@ -0,0 +1,334 @@
+/*
+ * CRF_MemStats.cpp
+ *
+ */
+
+#include "CRF_MemStats.h"
+#include "CRF_Utils.h"
+#include "../nodes/CRF_StateNode.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+long CRF_MemStats::current[MEM_NUM_CATEGORIES] = {0};
+long CRF_MemStats::peak[MEM_NUM_CATEGORIES] = {0};
+long CRF_MemStats::total = 0;
+long CRF_MemStats::totalPeak = 0;
+long CRF_MemStats::uttPeak = 0;
+
+/*
+ * CRF_MemStats::raise
+ *
+ * Input: mark - high-water mark to update
+ *        value - new value of the counter it follows
+ *
+ * Raises *mark to value if value is larger, atomically.
+ */
+void CRF_MemStats::raise(long* mark, long value)
+{
+	long old_mark=*mark;
+	while (value > old_mark) {
+		long seen=__sync_val_compare_and_swap(mark,old_mark,value);
+		if (seen == old_mark) break;
+		old_mark=seen;
+	}
+}
+
+/*
+ * CRF_MemStats::add
+ *
+ * Input: cat - category of the memory
+ *        bytes - bytes allocated
+ */
+void CRF_MemStats::add(memcategory cat, size_t bytes)
+{
+	if (bytes == 0) return;
+	long cur=__sync_add_and_fetch(&(CRF_MemStats::current[cat]),(long)bytes);
+	long tot=__sync_add_and_fetch(&(CRF_MemStats::total),(long)bytes);
+	CRF_MemStats::raise(&(CRF_MemStats::peak[cat]),cur);
+	CRF_MemStats::raise(&(CRF_MemStats::totalPeak),tot);
+	CRF_MemStats::raise(&(CRF_MemStats::uttPeak),tot);
+}
+
+/*
+ * CRF_MemStats::release
+ *
+ * Input: cat - category of the memory
+ *        bytes - bytes freed
+ */
+void CRF_MemStats::release(memcategory cat, size_t bytes)
+{
+	if (bytes == 0) return;
+	__sync_sub_and_fetch(&(CRF_MemStats::current[cat]),(long)bytes);
+	__sync_sub_and_fetch(&(CRF_MemStats::total),(long)bytes);
+}
+
+/*
+ * CRF_MemStats::update
+ *
+ * Input: cat - category of the memory
+ *        old_bytes - size of a buffer before it was resized or replaced
+ *        new_bytes - size of the buffer after
+ */
+void CRF_MemStats::update(memcategory cat, size_t old_bytes, size_t new_bytes)
+{
+	if (new_bytes > old_bytes) {
+		CRF_MemStats::add(cat,new_bytes-old_bytes);
+	}
+	else {
+		CRF_MemStats::release(cat,old_bytes-new_bytes);
+	}
+}
+
+/*
+ * CRF_MemStats::getCurrent
+ *
+ * Returns: bytes currently counted in category cat
+ */
+size_t CRF_MemStats::getCurrent(memcategory cat)
+{
+	return (size_t) CRF_MemStats::current[cat];
+}
+
+/*
+ * CRF_MemStats::getPeak
+ *
+ * Returns: largest number of bytes counted in category cat at any time
+ */
+size_t CRF_MemStats::getPeak(memcategory cat)
+{
+	return (size_t) CRF_MemStats::peak[cat];
+}
+
+/*
+ * CRF_MemStats::getTotal
+ *
+ * Returns: bytes currently counted in all categories
+ */
+size_t CRF_MemStats::getTotal()
+{
+	return (size_t) CRF_MemStats::total;
+}
+
+/*
+ * CRF_MemStats::getTotalPeak
+ *
+ * Returns: largest number of bytes counted in all categories together at any time
+ */
+size_t CRF_MemStats::getTotalPeak()
+{
+	return (size_t) CRF_MemStats::totalPeak;
+}
+
+/*
+ * CRF_MemStats::startUtterance
+ *
+ * Restarts the per-utterance high-water mark from the current total.
+ */
+void CRF_MemStats::startUtterance()
+{
+	CRF_MemStats::uttPeak=CRF_MemStats::total;
+}
+
+/*
+ * CRF_MemStats::getUtterancePeak
+ *
+ * Returns: largest total counted since the last call to startUtterance()
+ */
+size_t CRF_MemStats::getUtterancePeak()
+{
+	return (size_t) CRF_MemStats::uttPeak;
+}
+
+/*
+ * CRF_MemStats::getCategoryName
+ *
+ * Returns: short name of category cat, as used in the reports
+ */
+const char* CRF_MemStats::getCategoryName(memcategory cat)
+{
+	switch (cat) {
+	case MEM_NODES: return "nodes";
+	case MEM_FEATURES: return "features";
+	case MEM_GRADIENT: return "gradient";
+	case MEM_HYPS: return "hyps";
+	case MEM_FST: return "fst";
+	default: return "unknown";
+	}
+}
+
+/*
+ * CRF_MemStats::getCurrentRSS
+ *
+ * Returns: resident set size of the process in bytes, 0 if it cannot be read
+ */
+size_t CRF_MemStats::getCurrentRSS()
+{
+	FILE* fp=fopen("/proc/self/statm","r");
+	if (fp == NULL) return 0;
+	long pages_total=0, pages_resident=0;
+	int n=fscanf(fp,"%ld %ld",&pages_total,&pages_resident);
+	fclose(fp);
+	if (n != 2) return 0;
+	return (size_t) pages_resident * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * CRF_MemStats::getPeakRSS
+ *
+ * Returns: peak resident set size of the process in bytes
+ */
+size_t CRF_MemStats::getPeakRSS()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF,&usage) != 0) return 0;
+	return (size_t) usage.ru_maxrss * 1024;
+}
+
+/*
+ * CRF_MemStats::report
+ *
+ * Returns: one line with the current and peak bytes of each category, the peak total and
+ *   the current and peak resident set size, all in MB
+ */
+string CRF_MemStats::report()
+{
+	char buf[128];
+	string line;
+	for (int cat=0; cat<MEM_NUM_CATEGORIES; cat++) {
+		snprintf(buf,sizeof(buf),"%s=%.1f/%.1f ",CRF_MemStats::getCategoryName((memcategory)cat),
+				CRF_MemStats::getCurrent((memcategory)cat)/1048576.0,
+				CRF_MemStats::getPeak((memcategory)cat)/1048576.0);
+		line+=buf;
+	}
+	snprintf(buf,sizeof(buf),"counted_peak=%.1f rss=%.1f peak_rss=%.1f (MB, current/peak)",
+			CRF_MemStats::getTotalPeak()/1048576.0,CRF_MemStats::getCurrentRSS()/1048576.0,
+			CRF_MemStats::getPeakRSS()/1048576.0);
+	line+=buf;
+	return line;
+}
+
+/*
+ * CRF_MemEstimator constructor
+ *
+ * Input: crf_in - the model, with its feature map set
+ *        num_ftrs - number of features per node, as returned by the feature stream
+ *        max_frames - number of frames of the longest utterance
+ */
+CRF_MemEstimator::CRF_MemEstimator(CRF_Model* crf_in, QNUInt32 num_ftrs, QNUInt32 max_frames)
+	: crf(crf_in),
+	  numFtrs(num_ftrs),
+	  maxFrames(max_frames),
+	  numWeightCopies(6)
+{
+}
+
+/*
+ * CRF_MemEstimator destructor
+ */
+CRF_MemEstimator::~CRF_MemEstimator()
+{
+}
+
+/*
+ * CRF_MemEstimator::setNumWeightCopies
+ *
+ * Input: copies - number of arrays of the size of the weight vector held by the trainer,
+ *          besides the per-thread gradients (default 6: weights, gradient, averaged
+ *          weights, variance, squared gradient sum and ExpF)
+ */
+void CRF_MemEstimator::setNumWeightCopies(QNUInt32 copies)
+{
+	this->numWeightCopies=copies;
+}
+
+/*
+ * CRF_MemEstimator::nodeBytes
+ *
+ * Returns: bytes of one node of the longest duration, without its feature buffer
+ *
+ * Builds a sample node of the model's node type and reads back what it reported.
+ */
+size_t CRF_MemEstimator::nodeBytes()
+{
+	float* fb=new float[this->numFtrs];
+	memset(fb,0,this->numFtrs*sizeof(float));
+	CRF_StateNode* node;
+	if (this->crf->getModelType() == STDFRAME) {
+		node=CRF_StateNode::createStateNode(fb,this->numFtrs,0,this->crf);
+	}
+	else {
+		node=CRF_StateNode::createStateNode(fb,this->numFtrs,0,this->crf,this->crf->getLabMaxDur(),
+				this->crf->getNLabs(),this->crf->getNActualLabs());
+	}
+	size_t bytes=node->getMemBytes()+sizeof(*node);
+	if (this->crf->getModelType() != STDFRAME) {
+		// prev and next node link arrays
+		bytes+=2*this->crf->getLabMaxDur()*sizeof(CRF_StateNode*);
+	}
+	delete node;
+	return bytes;
+}
+
+/*
+ * CRF_MemEstimator::estimateTraining
+ *
+ * Input: threads - number of training threads
+ *
+ * Returns: predicted peak memory of training with threads threads
+ */
+CRF_MemEstimate CRF_MemEstimator::estimateTraining(QNUInt32 threads)
+{
+	CRF_MemEstimate est;
+	size_t lambda_bytes=this->crf->getLambdaLen()*sizeof(double);
+	est.base=CRF_MemStats::getCurrentRSS();
+	est.nodes=(size_t)threads*this->maxFrames*this->nodeBytes();
+	// the node feature buffers, plus the read buffer of each gradient builder
+	est.features=(size_t)threads*(this->maxFrames+1)*this->numFtrs*sizeof(float);
+	// the trainer's arrays, and the gradient and ExpF of each thread
+	est.gradient=this->numWeightCopies*lambda_bytes+(size_t)threads*2*lambda_bytes;
+	est.hyps=0;
+	est.fst=0;
+	est.total=est.base+est.nodes+est.features+est.gradient+est.hyps+est.fst;
+	return est;
+}
+
+/*
+ * CRF_MemEstimator::estimateDecoding
+ *
+ * Input: threads - number of decoding threads
+ *
+ * Returns: predicted peak memory of decoding with threads threads, without pruning
+ */
+CRF_MemEstimate CRF_MemEstimator::estimateDecoding(QNUInt32 threads)
+{
+	CRF_MemEstimate est;
+	QNUInt32 nLabs=this->crf->getNLabs();
+	QNUInt32 maxDur=this->crf->getLabMaxDur();
+	est.base=CRF_MemStats::getCurrentRSS();
+	est.nodes=(size_t)threads*this->maxFrames*this->nodeBytes();
+	est.features=(size_t)threads*(this->maxFrames+1)*this->numFtrs*sizeof(float);
+	est.gradient=0;
+	// one traceback entry (phone, pointer, duration) per label and duration at every frame
+	est.hyps=(size_t)threads*this->maxFrames*nLabs*maxDur*(2*sizeof(uint)+sizeof(int));
+	// a full lattice with an arc per label and duration at every frame, a state per frame
+	// and label, and the best path
+	est.fst=(size_t)threads*this->maxFrames*((size_t)nLabs*maxDur*sizeof(StdArc)+nLabs*64);
+	est.total=est.base+est.nodes+est.features+est.gradient+est.hyps+est.fst;
+	return est;
+}
+
+/*
+ * CRF_MemEstimator::format
+ *
+ * Returns: one line with the categories and the total of est, in MB
+ */
+string CRF_MemEstimator::format(const CRF_MemEstimate& est)
+{
+	char buf[256];
+	snprintf(buf,sizeof(buf),"base=%.1f nodes=%.1f features=%.1f gradient=%.1f hyps=%.1f fst=%.1f total=%.1f (MB)",
+			est.base/1048576.0,est.nodes/1048576.0,est.features/1048576.0,est.gradient/1048576.0,
+			est.hyps/1048576.0,est.fst/1048576.0,est.total/1048576.0);
+	return string(buf);
+}
@@ -0,0 +1,102 @@
+#ifndef CRF_MEMSTATS_H_
+#define CRF_MEMSTATS_H_
+/*
+ * CRF_MemStats.h
+ *
+ * Contains the class definitions for CRF_MemStats and CRF_MemEstimator
+ */
+
+#include "../CRF.h"
+#include "../CRF_Model.h"
+
+/*
+ * class CRF_MemStats
+ *
+ * Process-wide counters of the memory held by the main CRF data structures, by category:
+ *   MEM_NODES    - alpha, beta, state and transition arrays of the state nodes
+ *   MEM_FEATURES - feature buffers owned by the nodes and by the gradient builders
+ *   MEM_GRADIENT - gradient, ExpF and per-thread gradient buffers of the trainers
+ *   MEM_HYPS     - Viterbi traceback tables kept in the nodes
+ *   MEM_FST      - lattices held by the decode contexts
+ *
+ * The owners of the structures report their allocations with add(), release() and
+ * update().  The counters are updated atomically, so the owners may live in different
+ * threads.  Only the large per-utterance and per-model buffers are counted; std::map
+ * bookkeeping and allocations made inside OpenFst are not.
+ *
+ * Besides the current and peak value of each category, the counters keep a high-water mark
+ * of the total since the last call to startUtterance().  With several threads this mark
+ * covers all the utterances in flight.
+ */
+class CRF_MemStats
+{
+private:
+	static long current[MEM_NUM_CATEGORIES];
+	static long peak[MEM_NUM_CATEGORIES];
+	static long total;
+	static long totalPeak;
+	static long uttPeak;
+	static void raise(long* mark, long value);
+public:
+	static void add(memcategory cat, size_t bytes);
+	static void release(memcategory cat, size_t bytes);
+	static void update(memcategory cat, size_t old_bytes, size_t new_bytes);
+	static size_t getCurrent(memcategory cat);
+	static size_t getPeak(memcategory cat);
+	static size_t getTotal();
+	static size_t getTotalPeak();
+	static void startUtterance();
+	static size_t getUtterancePeak();
+	static const char* getCategoryName(memcategory cat);
+	static size_t getCurrentRSS();
+	static size_t getPeakRSS();
+	static string report();
+};
+
+/*
+ * struct CRF_MemEstimate
+ *
+ * Predicted peak memory of a job, by category, in bytes.  base is the resident memory of the
+ * process when the estimate was made (model, feature map, libraries); total adds them up.
+ */
+struct CRF_MemEstimate {
+	size_t base;
+	size_t nodes;
+	size_t features;
+	size_t gradient;
+	size_t hyps;
+	size_t fst;
+	size_t total;
+};
+
+/*
+ * class CRF_MemEstimator
+ *
+ * Pre-flight estimate of the peak memory of a training or decoding job, made before the
+ * first utterance is read.  The node storage is measured on a sample node of the model's
+ * node type, so it follows the same accounting as CRF_MemStats; the other buffers are sized
+ * from the model dimensions, the longest utterance and the thread count.
+ *
+ * Each thread holds a node list as long as the longest utterance.  Training adds the
+ * trainer's copies of the weights and one gradient buffer per thread; decoding adds the
+ * traceback tables and the lattices of one utterance per thread, sized for an unpruned
+ * search, so the estimate is an upper bound when a beam is used.
+ */
+class CRF_MemEstimator
+{
+protected:
+	CRF_Model* crf;
+	QNUInt32 numFtrs;
+	QNUInt32 maxFrames;
+	QNUInt32 numWeightCopies;
+	virtual size_t nodeBytes();
+public:
+	CRF_MemEstimator(CRF_Model* crf_in, QNUInt32 num_ftrs, QNUInt32 max_frames);
+	virtual ~CRF_MemEstimator();
+	virtual void setNumWeightCopies(QNUInt32 copies);
+	virtual CRF_MemEstimate estimateTraining(QNUInt32 threads);
+	virtual CRF_MemEstimate estimateDecoding(QNUInt32 threads);
+	static string format(const CRF_MemEstimate& est);
+};
+
+#endif /* CRF_MEMSTATS_H_ */
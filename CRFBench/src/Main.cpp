@@ -0,0 +1,1113 @@
+/*
+ * CRFBench.cpp
+ *
+ * Benchmarks of the CRF building blocks on synthetic data: log math, L1/AdaGrad weight updates,
+ * feature map scoring, per-node forward/backward/ExpF, gradient building (with and without the
+ * feature slab), minibatch accumulation, Viterbi decoding, lattice building, alignment gammas
+ * and quantized weight scoring.  Needs no corpus; the features, labels and language model fst are generated
+ * from the command line options.
+ * Follows command line interface model for ICSI Quicknet.
+ */
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <stdlib.h>
+
+#include "quicknet3/QN_config.h"
+#include "fst/fstlib.h"
+#include <vector>
+#include <string>
+#include <set>
+#include "CRF.h"
+#include "CRF_Model.h"
+#include "utils/CRF_Utils.h"
+#include "utils/CRF_LogMath.h"
+#include "io/CRF_FeatureStreamManager.h"
+#include "ftrmaps/CRF_StdFeatureMap.h"
+#include "ftrmaps/CRF_StdSparseFeatureMap.h"
+#include "trainers/gradbuilders/CRF_GradBuilder.h"
+#include "trainers/CRF_SGTrainer.h"
+#include "trainers/accumulators/CRF_Minibatch_GradAccumulator.h"
+#include "decoders/CRF_DecodeContext.h"
+#include "decoders/CRF_LatticeBuilder.h"
+#include "decoders/CRF_ViterbiDecoder_StdSeg_NoSegTransFtr.h"
+
+using namespace std;
+using namespace fst;
+
+/*
+ * command line options
+ */
+static struct {
+	int bench_utts;
+	int bench_frames;
+	int bench_ftrs;
+	int bench_labels;
+	float bench_sparsity;
+	float bench_lm_density;
+	int bench_reps;
+	char* bench_only;
+	char* bench_output;
+	char* bench_tmpdir;
+	int bench_seed;
+	char* crf_model_type;
+	char* crf_featuremap;
+	int crf_states;
+	int label_maximum_duration;
+	int crf_bunch_size;
+	float crf_decode_beam;
+	int threads;
+	int verbose;
+} config;
+
+/*
+ * Command line options to be presented to the screen
+ */
+QN_ArgEntry argtab[] =
+{
+	{ NULL, "ASR CRaFT CRF benchmark program version " CRF_VERSION, QN_ARG_DESC },
+	{ "bench_utts", "Number of synthetic utterances", QN_ARG_INT, &(config.bench_utts) },
+	{ "bench_frames", "Number of frames per synthetic utterance", QN_ARG_INT, &(config.bench_frames) },
+	{ "bench_ftrs", "Number of features per frame", QN_ARG_INT, &(config.bench_ftrs) },
+	{ "bench_labels", "Number of actual labels (phones)", QN_ARG_INT, &(config.bench_labels) },
+	{ "bench_sparsity", "Fraction of the features that are zero", QN_ARG_FLOAT, &(config.bench_sparsity) },
+	{ "bench_lm_density", "Fraction of the phone bigrams kept in the synthetic lm fst", QN_ARG_FLOAT, &(config.bench_lm_density) },
+	{ "bench_reps", "Number of repetitions of each benchmark", QN_ARG_INT, &(config.bench_reps) },
+	{ "bench_only", "Comma separated benchmarks to run (logmath,l1,ftrmap,node,gradient,slab,minibatch,viterbi,lattice,gamma,quant|all)", QN_ARG_STR, &(config.bench_only) },
+	{ "bench_output", "Output file for the results, - for standard output", QN_ARG_STR, &(config.bench_output) },
+	{ "bench_tmpdir", "Directory for the synthetic feature and label files", QN_ARG_STR, &(config.bench_tmpdir) },
+	{ "bench_seed", "Random seed of the synthetic data and weights", QN_ARG_INT, &(config.bench_seed) },
+	{ "crf_model_type", "CRF model structure (stdframe|stdseg|stdseg_no_dur|stdseg_no_dur_no_transftr|stdseg_no_dur_no_segtransftr|all)", QN_ARG_STR, &(config.crf_model_type) },
+	{ "crf_featuremap", "Association of inputs to feature functions (stdstate|stdtrans|stdsparse|stdsparsetrans)", QN_ARG_STR, &(config.crf_featuremap) },
+	{ "crf_states", "Number of states per label (stdframe only)", QN_ARG_INT, &(config.crf_states) },
+	{ "label_maximum_duration", "The maximum duration of labels of the segmental models", QN_ARG_INT, &(config.label_maximum_duration) },
+	{ "crf_bunch_size", "Minibatch size of the minibatch benchmark", QN_ARG_INT, &(config.crf_bunch_size) },
+	{ "crf_decode_beam", "Beam of the Viterbi benchmark (0 for no pruning)", QN_ARG_FLOAT, &(config.crf_decode_beam) },
+	{ "threads", "The minibatch benchmark is run with 1 to threads threads", QN_ARG_INT, &(config.threads) },
+	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
+	{ NULL, NULL, QN_ARG_NOMOREARGS }
+};
+
+/*
+ * Default values for command line options
+ */
+static void set_defaults(void) {
+	config.bench_utts=8;
+	config.bench_frames=300;
+	config.bench_ftrs=39;
+	config.bench_labels=48;
+	config.bench_sparsity=0.0;
+	config.bench_lm_density=1.0;
+	config.bench_reps=3;
+	config.bench_only="all";
+	config.bench_output="-";
+	config.bench_tmpdir="/tmp";
+	config.bench_seed=0;
+	config.crf_model_type="all";
+	config.crf_featuremap="stdtrans";
+	config.crf_states=1;
+	config.label_maximum_duration=10;
+	config.crf_bunch_size=8;
+	config.crf_decode_beam=0.0;
+	config.threads=1;
+	config.verbose=0;
+};
+
+static const char* model_names[] = { "stdframe", "stdseg", "stdseg_no_dur",
+		"stdseg_no_dur_no_transftr", "stdseg_no_dur_no_segtransftr" };
+static const modeltype model_types[] = { STDFRAME, STDSEG, STDSEG_NO_DUR,
+		STDSEG_NO_DUR_NO_TRANSFTR, STDSEG_NO_DUR_NO_SEGTRANSFTR };
+static const int num_model_types = 5;
+
+static set<string> bench_set;
+static string data_dir;
+static string ftr_fname;
+static string framelab_fname;
+static string seglab_fname;
+static string sent_range;
+static struct CRF_FeatureMap_config fmap_config;
+static int bench_status = 0;
+
+/*
+ * logs a message to standard error, standard output holds the results
+ */
+void log_msg(string outstr) {
+	if (config.verbose) {
+		cerr << outstr << endl;
+	}
+}
+
+/*
+ * Returns the seconds elapsed since start
+ */
+static double elapsed_seconds(const struct timeval& start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+/*
+ * Returns true if the benchmark name was selected with bench_only
+ */
+static bool bench_enabled(const string& name) {
+	return (bench_set.count("all") > 0 || bench_set.count(name) > 0);
+}
+
+/*
+ * Writes one result line.  units is the number of frames, calls or utterances processed by all
+ * repetitions together; checksum is a sum of the results, to compare across versions and to
+ * keep the compiler from dropping the work.
+ */
+static void report(ostream& out, const string& bench, const string& model, const string& fmap,
+		int threads, double units, const char* unit, double secs, double checksum) {
+	char line[512];
+	snprintf(line, sizeof(line), "%s\t%s\t%s\t%d\t%d\t%.0f\t%s\t%.6f\t%.4f\t%.10g\n",
+			bench.c_str(), model.c_str(), fmap.c_str(), threads, config.bench_reps, units, unit,
+			secs, (units > 0) ? secs * 1e6 / units : 0.0, checksum);
+	out << line;
+	out.flush();
+	log_msg(string("Finished ") + bench + " " + model);
+}
+
+/*
+ * Writes the synthetic features and labels to data_dir.
+ *
+ * The label sequence of each utterance is a run of phones, each of a random duration of
+ * crf_states to label_maximum_duration frames and different from the phone before.  The
+ * segmental models read the phone of every frame, the frame model the state of the phone
+ * (phone * crf_states + state).  Features are uniform in [-1,1), and zero with probability
+ * bench_sparsity.
+ */
+static void write_synthetic_data() {
+	FILE* ftr_fp = fopen(ftr_fname.c_str(), "w+");
+	FILE* framelab_fp = fopen(framelab_fname.c_str(), "w+");
+	FILE* seglab_fp = fopen(seglab_fname.c_str(), "w+");
+	if (ftr_fp == NULL || framelab_fp == NULL || seglab_fp == NULL) {
+		cerr << "ERROR: cannot create the synthetic data files in " << data_dir << endl;
+		exit(-1);
+	}
+	QN_OutFtrLabStream_PFile* ftr_out = new QN_OutFtrLabStream_PFile(0, "bench_ftrs", ftr_fp,
+			config.bench_ftrs, 0, 1);
+	QN_OutLabStream_ILab* framelab_out = new QN_OutLabStream_ILab(0, "bench_framelabs", framelab_fp,
+			config.bench_labels * config.crf_states, 1);
+	QN_OutLabStream_ILab* seglab_out = new QN_OutLabStream_ILab(0, "bench_seglabs", seglab_fp,
+			config.bench_labels, 1);
+
+	QNUInt32 min_dur = config.crf_states;
+	QNUInt32 max_dur = (config.label_maximum_duration > config.crf_states) ?
+			config.label_maximum_duration : config.crf_states;
+	vector<float> ftrs(config.bench_frames * config.bench_ftrs);
+	vector<QNUInt32> framelabs(config.bench_frames);
+	vector<QNUInt32> seglabs(config.bench_frames);
+	for (int utt = 0; utt < config.bench_utts; utt++) {
+		for (size_t i = 0; i < ftrs.size(); i++) {
+			ftrs[i] = (drand48() < config.bench_sparsity) ? 0.0 : (float)(2.0 * drand48() - 1.0);
+		}
+		QNUInt32 phn = config.bench_labels;
+		int frame = 0;
+		while (frame < config.bench_frames) {
+			QNUInt32 next_phn = lrand48() % config.bench_labels;
+			if (next_phn == phn && config.bench_labels > 1) {
+				next_phn = (next_phn + 1) % config.bench_labels;
+			}
+			phn = next_phn;
+			QNUInt32 dur = min_dur + lrand48() % (max_dur - min_dur + 1);
+			for (QNUInt32 i = 0; i < dur && frame < config.bench_frames; i++, frame++) {
+				framelabs[frame] = phn * config.crf_states + i * config.crf_states / dur;
+				seglabs[frame] = phn;
+			}
+		}
+		ftr_out->write_ftrslabs(config.bench_frames, &(ftrs[0]), NULL);
+		ftr_out->doneseg((QN_SegID)utt);
+		framelab_out->write_labs(config.bench_frames, &(framelabs[0]));
+		framelab_out->doneseg((QN_SegID)utt);
+		seglab_out->write_labs(config.bench_frames, &(seglabs[0]));
+		seglab_out->doneseg((QN_SegID)utt);
+	}
+	// the streams write their headers and indices when deleted
+	delete ftr_out;
+	delete framelab_out;
+	delete seglab_out;
+	fclose(ftr_fp);
+	fclose(framelab_fp);
+	fclose(seglab_fp);
+}
+
+/*
+ * Builds a synthetic phone bigram lm fst in the layout of createFreePhoneLmFst(): one state
+ * per phone after the start state, arcs labelled with phone + 1, every phone state final.
+ * Each bigram is kept with probability bench_lm_density and gets a random weight.
+ */
+static void make_synthetic_lm(VectorFst<StdArc>* lm_fst, QNUInt32 nStates) {
+	StateId start_state = lm_fst->AddState();
+	lm_fst->SetStart(start_state);
+	QNUInt32 nPhones = config.bench_labels;
+	for (QNUInt32 cur_lab = 0; cur_lab < nPhones; cur_lab++) {
+		StateId cur_state = lm_fst->AddState();
+		lm_fst->AddArc(start_state, StdArc(cur_lab+1,cur_lab+1,-log(0.05+0.95*drand48()),cur_state));
+		if (nStates > 1) {
+			lm_fst->AddArc(cur_state, StdArc(0,0,0,start_state));
+		}
+		lm_fst->SetFinal(cur_state, 0);
+	}
+	if (nStates == 1) {
+		for (QNUInt32 cur_lab = 0; cur_lab < nPhones; cur_lab++) {
+			for (QNUInt32 next_lab = 0; next_lab < nPhones; next_lab++) {
+				if (cur_lab != next_lab && drand48() < config.bench_lm_density) {
+					lm_fst->AddArc(start_state + cur_lab + 1, StdArc(next_lab+1,next_lab+1,
+							-log(0.05+0.95*drand48()),start_state + next_lab + 1));
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Creates a sequential feature stream manager over the synthetic data for model type mtype,
+ * split over nthreads streams
+ */
+static CRF_FeatureStreamManager* create_stream(modeltype mtype, size_t nthreads) {
+	bool seg = (mtype != STDFRAME);
+	size_t win_len = seg ? config.label_maximum_duration : 1;
+	const string& lab_fname = seg ? seglab_fname : framelab_fname;
+	return new CRF_FeatureStreamManager(config.verbose > 1, "bench_ftrs",
+			(char*)ftr_fname.c_str(), "pfile", (char*)lab_fname.c_str(), 0,
+			(size_t) config.bench_ftrs, 0, (size_t) config.bench_ftrs,
+			win_len, 0, win_len,
+			0, 0, seg, false, false,
+			0, 0,
+			(char*)sent_range.c_str(), NULL,
+			NULL, 0, 0, 0, SEQUENTIAL, config.bench_seed, nthreads);
+}
+
+/*
+ * Sets the feature map config for model type mtype, as CRFTrain does from its options
+ */
+static void set_fmap_config(modeltype mtype, QNUInt32 nfeas, QNUInt32 nlabs) {
+	fmap_config.map_type=STDSTATE;
+	if (strcmp(config.crf_featuremap,"stdtrans")==0) { fmap_config.map_type=STDTRANS;}
+	if (strcmp(config.crf_featuremap,"stdsparse")==0) { fmap_config.map_type=STDSPARSE;}
+	if (strcmp(config.crf_featuremap,"stdsparsetrans")==0) { fmap_config.map_type=STDSPARSETRANS;}
+	// the model without transition features only supports the stdstate feature map
+	if (mtype == STDSEG_NO_DUR_NO_TRANSFTR) { fmap_config.map_type=STDSTATE;}
+	fmap_config.numLabs=nlabs;
+	fmap_config.numFeas=nfeas;
+	fmap_config.numStates=(mtype == STDFRAME) ? config.crf_states : 1;
+	fmap_config.useStateFtrs=true;
+	fmap_config.stateFidxStart=0;
+	fmap_config.stateFidxEnd=nfeas-1;
+	if (fmap_config.map_type==STDTRANS || fmap_config.map_type==STDSPARSETRANS) {
+		fmap_config.useTransFtrs=true;
+		fmap_config.transFidxStart=0;
+		fmap_config.transFidxEnd=nfeas-1;
+	}
+	else {
+		fmap_config.useTransFtrs=false;
+	}
+	fmap_config.useStateBias=true;
+	fmap_config.useTransBias=true;
+	fmap_config.stateBiasVal=1.0;
+	fmap_config.transBiasVal=1.0;
+	fmap_config.maxDur=(mtype == STDFRAME) ? 1 : config.label_maximum_duration;
+	fmap_config.durFtrStart=0;
+	fmap_config.nActualLabs=(mtype == STDFRAME) ? nlabs : config.bench_labels;
+}
+
+/*
+ * Creates the model of type mtype for the features of str, with random weights
+ */
+static CRF_Model* create_model(modeltype mtype, CRF_FeatureStreamManager* str) {
+	QNUInt32 nlabs;
+	QNUInt32 max_dur = 1;
+	QNUInt32 nActualLabs = config.bench_labels;
+	if (mtype == STDFRAME) {
+		nlabs = config.bench_labels * config.crf_states;
+		nActualLabs = nlabs;
+	}
+	else if (mtype == STDSEG) {
+		nlabs = config.bench_labels * config.label_maximum_duration;
+		max_dur = config.label_maximum_duration;
+	}
+	else {
+		nlabs = config.bench_labels;
+		max_dur = config.label_maximum_duration;
+	}
+	CRF_Model* crf = new CRF_Model(nlabs);
+	crf->setLabMaxDur(max_dur);
+	crf->setNActualLabs(nActualLabs);
+	crf->setModelType(mtype);
+	crf->setBrokenClassLabel(false);
+	set_fmap_config(mtype, str->getNumFtrs(), nlabs);
+	crf->setFeatureMap(CRF_FeatureMap::createFeatureMap(&fmap_config));
+	double* lambda = crf->getLambda();
+	for (QNUInt32 i = 0; i < crf->getLambdaLen(); i++) {
+		lambda[i] = 0.02 * drand48() - 0.01;
+	}
+	return crf;
+}
+
+/*
+ * Returns the name of the feature map of the model last created
+ */
+static string fmap_name() {
+	switch (fmap_config.map_type) {
+	case STDTRANS: return "stdtrans";
+	case STDSPARSE: return "stdsparse";
+	case STDSPARSETRANS: return "stdsparsetrans";
+	default: return "stdstate";
+	}
+}
+
+/*
+ * log-sum-exp over vectors of the size of a node's alpha vector
+ */
+static void bench_logmath(ostream& out) {
+	QNUInt32 n = config.bench_labels * config.label_maximum_duration;
+	vector<double> vals(n);
+	for (QNUInt32 i = 0; i < n; i++) {
+		vals[i] = -20.0 * drand48();
+	}
+	double checksum = 0.0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		for (int t = 0; t < config.bench_frames; t++) {
+			double acc = CRF_LogMath::LOG0;
+			for (QNUInt32 i = 0; i < n; i++) {
+				acc = CRF_LogMath::logAdd(acc, vals[i]);
+			}
+			checksum += acc;
+		}
+	}
+	double calls = (double)config.bench_reps * config.bench_frames * n;
+	report(out, "logadd_pair", "-", "-", 1, calls, "call", elapsed_seconds(start), checksum);
+
+	checksum = 0.0;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		for (int t = 0; t < config.bench_frames; t++) {
+			checksum += CRF_LogMath::logAdd(&(vals[0]), n);
+		}
+	}
+	calls = (double)config.bench_reps * config.bench_frames;
+	report(out, "logadd_vec", "-", "-", 1, calls, "call", elapsed_seconds(start), checksum);
+}
+
+/*
+ * AdaGrad updates with the L1 cumulative penalty (CRF_SGTrainer::updateWeight) over
+ * bench_frames weights and 100 minibatches.  Weight i gets its first gradient in minibatch
+ * i % 100 and one in every minibatch after it, so it must end up nonzero however late it
+ * started; throws if one is left at zero.
+ */
+static void bench_l1(ostream& out) {
+	const int nbatches = 100;
+	const double eta = 0.1, eps = 1e-12, l1 = 0.1;
+	QNUInt32 n = config.bench_frames;
+	vector<double> lam(n), gsqr(n), l1Total(n), l1Applied(n);
+	double checksum = 0.0;
+	QNUInt32 late_zero = 0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		lam.assign(n, 0.0);
+		gsqr.assign(n, 0.0);
+		l1Total.assign(n, 0.0);
+		l1Applied.assign(n, 0.0);
+		for (int b = 0; b < nbatches; b++) {
+			for (QNUInt32 i = 0; i < n; i++) {
+				double g = ((int)(i % nbatches) <= b) ? 1.0 : 0.0;
+				CRF_SGTrainer::updateWeight(lam[i], g, &(gsqr[i]), eta, eps, l1, &(l1Total[i]), &(l1Applied[i]));
+			}
+		}
+		for (QNUInt32 i = 0; i < n; i++) {
+			checksum += lam[i];
+			if (lam[i] == 0.0) late_zero++;
+		}
+	}
+	double calls = (double)config.bench_reps * nbatches * n;
+	report(out, "l1_update", "-", "-", 1, calls, "call", elapsed_seconds(start), checksum);
+	out << "# l1\t-\t-\tlate_zero=" << late_zero << endl;
+	if (late_zero > 0) {
+		string errstr="bench_l1: " + stringify(late_zero) + " weights updated only after the first minibatch stayed at zero";
+		throw runtime_error(errstr);
+	}
+}
+
+/*
+ * Reads the first utterance of ftr_str into the node list of gbuild, through a full
+ * buildGradient() pass.  Returns the number of nodes.
+ */
+static QNUInt32 load_sequence(CRF_GradBuilder* gbuild, CRF_FeatureStream* ftr_str, double* grad,
+		CRF_StateVector* nodes) {
+	double Zx;
+	ftr_str->rewind();
+	ftr_str->nextseg();
+	gbuild->buildGradient(ftr_str, grad, &Zx);
+	return nodes->getNodeCount();
+}
+
+/*
+ * Feature map scoring: the state values and transition values of every label of every node
+ * of the first utterance
+ */
+static void bench_ftrmap(ostream& out, const string& model, CRF_Model* crf, CRF_StateVector* nodes,
+		QNUInt32 nodeCnt) {
+	CRF_FeatureMap* fmap = crf->getFeatureMap();
+	double* lambda = crf->getLambda();
+	QNUInt32 nlabs = crf->getNLabs();
+	double checksum = 0.0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			float* fb = nodes->at(i)->getFtrBuffer();
+			for (QNUInt32 clab = 0; clab < nlabs; clab++) {
+				checksum += fmap->computeStateArrayValue(fb, lambda, clab);
+			}
+		}
+	}
+	double calls = (double)config.bench_reps * nodeCnt * nlabs;
+	report(out, "ftrmap_state", model, fmap_name(), 1, calls, "call", elapsed_seconds(start), checksum);
+
+	checksum = 0.0;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			float* fb = nodes->at(i)->getFtrBuffer();
+			for (QNUInt32 plab = 0; plab < nlabs; plab++) {
+				for (QNUInt32 clab = 0; clab < nlabs; clab++) {
+					checksum += fmap->computeTransMatrixValue(fb, lambda, plab, clab);
+				}
+			}
+		}
+	}
+	calls = (double)config.bench_reps * nodeCnt * nlabs * nlabs;
+	report(out, "ftrmap_trans", model, fmap_name(), 1, calls, "call", elapsed_seconds(start), checksum);
+}
+
+/*
+ * Times the state values of every label of every node of the first utterance, and stores
+ * them in values (node by node)
+ */
+static double time_state_values(CRF_Model* crf, CRF_StateVector* nodes, QNUInt32 nodeCnt,
+		vector<double>& values) {
+	CRF_FeatureMap* fmap = crf->getFeatureMap();
+	double* lambda = crf->getLambda();
+	QNUInt32 nlabs = crf->getNLabs();
+	values.assign((size_t)nodeCnt * nlabs, 0.0);
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			float* fb = nodes->at(i)->getFtrBuffer();
+			for (QNUInt32 clab = 0; clab < nlabs; clab++) {
+				values[(size_t)i * nlabs + clab] = fmap->computeStateArrayValue(fb, lambda, clab);
+			}
+		}
+	}
+	return elapsed_seconds(start);
+}
+
+/*
+ * Quantized weights: state value scoring of the first utterance with the double weights and
+ * with the weights quantized to 16 and 8 bits.  Besides the timing lines, writes one line
+ * per quantization starting with "# quant" with the dot product kernel used on this CPU
+ * (see CRF_QuantizedWeights::getKernel), the model size, the largest weight error,
+ * the largest state value error and the fraction of the nodes whose best label is unchanged.
+ */
+static void bench_quant(ostream& out, const string& model, CRF_Model* crf, CRF_StateVector* nodes,
+		QNUInt32 nodeCnt) {
+	QNUInt32 nlabs = crf->getNLabs();
+	double calls = (double)config.bench_reps * nodeCnt * nlabs;
+	vector<double> ref;
+	double secs = time_state_values(crf, nodes, nodeCnt, ref);
+	double checksum = 0.0;
+	for (size_t i = 0; i < ref.size(); i++) checksum += ref[i];
+	report(out, "quant_state", model, fmap_name() + "/double", 1, calls, "call", secs, checksum);
+	const int bits[] = { 16, 8 };
+	for (int b = 0; b < 2; b++) {
+		if (!crf->setQuantizedScoring(bits[b])) {
+			log_msg("Feature map " + fmap_name() + " does not support quantized weights");
+			return;
+		}
+		vector<double> values;
+		secs = time_state_values(crf, nodes, nodeCnt, values);
+		checksum = 0.0;
+		double maxerr = 0.0;
+		QNUInt32 agree = 0;
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			QNUInt32 best_ref = 0, best = 0;
+			for (QNUInt32 clab = 0; clab < nlabs; clab++) {
+				size_t idx = (size_t)i * nlabs + clab;
+				checksum += values[idx];
+				if (fabs(values[idx] - ref[idx]) > maxerr) maxerr = fabs(values[idx] - ref[idx]);
+				if (ref[idx] > ref[(size_t)i * nlabs + best_ref]) best_ref = clab;
+				if (values[idx] > values[(size_t)i * nlabs + best]) best = clab;
+			}
+			if (best == best_ref) agree++;
+		}
+		string fmap = fmap_name() + "/int" + stringify(bits[b]);
+		report(out, "quant_state", model, fmap, 1, calls, "call", secs, checksum);
+		CRF_QuantizedWeights* qw = crf->getQuantizedWeights();
+		char line[512];
+		snprintf(line, sizeof(line), "# quant\t%s\t%s\tkernel=%s\tbytes=%lu\tdouble_bytes=%lu\tmax_weight_err=%.3g\tmax_state_err=%.3g\tbest_label_agree=%.4f\n",
+				model.c_str(), fmap.c_str(), CRF_QuantizedWeights::getKernel(), (unsigned long)qw->getBytes(),
+				(unsigned long)(crf->getLambdaLen() * sizeof(double)), qw->getMaxError(crf->getLambda()),
+				maxerr, (nodeCnt > 0) ? (double)agree / nodeCnt : 1.0);
+		out << line;
+	}
+	crf->clearQuantizedScoring();
+}
+
+/*
+ * Per-node forward (transition matrix and alpha), backward (beta) and ExpF passes over the
+ * nodes of the first utterance, in the order the gradient builders run them
+ */
+static void bench_nodes(ostream& out, const string& model, CRF_Model* crf, CRF_StateVector* nodes,
+		QNUInt32 nodeCnt) {
+	bool seg = (crf->getModelType() != STDFRAME);
+	QNUInt32 lab_max_dur = crf->getLabMaxDur();
+	QNUInt32 nlabs = crf->getNLabs();
+	QNUInt32 lastNode = nodeCnt - 1;
+	vector<double> alpha_base(nlabs, 0.0);
+	vector<double> ExpF(crf->getLambdaLen(), 0.0);
+	vector<double> grad(crf->getLambdaLen(), 0.0);
+	double fwd_secs = 0.0, bwd_secs = 0.0, expf_secs = 0.0;
+	double fwd_sum = 0.0, bwd_sum = 0.0, expf_sum = 0.0;
+	struct timeval start;
+
+	if (seg) {
+		// the builders free their link arrays, so link the nodes again from the node list
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			nodes->linkPrevNodes(i, (i < lab_max_dur) ? i : lab_max_dur);
+			nodes->linkNextNodes(i, (lastNode - i < lab_max_dur) ? lastNode - i : lab_max_dur);
+		}
+	}
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		gettimeofday(&start, NULL);
+		for (QNUInt32 i = 0; i < nodeCnt; i++) {
+			nodes->at(i)->computeTransMatrix();
+			if (seg) {
+				fwd_sum -= (i == 0) ? nodes->at(i)->computeFirstAlpha() : nodes->at(i)->computeAlpha();
+			}
+			else {
+				fwd_sum -= (i == 0) ? nodes->at(i)->computeFirstAlpha(&(alpha_base[0])) :
+						nodes->at(i)->computeAlpha(nodes->at(i-1)->getAlpha());
+			}
+		}
+		fwd_secs += elapsed_seconds(start);
+		double Zx = nodes->at(lastNode)->computeAlphaSum();
+
+		gettimeofday(&start, NULL);
+		for (QNUInt32 i = nodeCnt; i-- > 0; ) {
+			if (i == lastNode) {
+				nodes->at(i)->setTailBeta();
+			}
+			else if (seg) {
+				bwd_sum += nodes->at(i)->computeBeta(nodes->at(i)->getAlphaScale());
+			}
+			else {
+				bwd_sum += nodes->at(i+1)->computeBeta(nodes->at(i)->getBeta(), nodes->at(i)->getAlphaScale());
+			}
+		}
+		bwd_secs += elapsed_seconds(start);
+
+		gettimeofday(&start, NULL);
+		for (QNUInt32 i = nodeCnt; i-- > 0; ) {
+			if (seg) {
+				QNUInt32 prev_lab = CRF_LAB_BAD;
+				for (QNUInt32 j = i; j > 0; j--) {
+					prev_lab = nodes->at(j-1)->getLabel();
+					if (prev_lab != CRF_LAB_BAD) break;
+				}
+				expf_sum += nodes->at(i)->computeExpF(&(ExpF[0]), &(grad[0]), Zx, prev_lab);
+			}
+			else {
+				double* prev_alpha = (i > 0) ? nodes->at(i-1)->getAlpha() : &(alpha_base[0]);
+				QNUInt32 prev_lab = (i > 0) ? nodes->at(i-1)->getLabel() : nlabs + 1;
+				expf_sum += nodes->at(i)->computeExpF(&(ExpF[0]), &(grad[0]), Zx, prev_alpha, prev_lab);
+			}
+		}
+		expf_secs += elapsed_seconds(start);
+	}
+	double frames = (double)config.bench_reps * nodeCnt;
+	report(out, "node_forward", model, fmap_name(), 1, frames, "frame", fwd_secs, fwd_sum);
+	report(out, "node_backward", model, fmap_name(), 1, frames, "frame", bwd_secs, bwd_sum);
+	report(out, "node_expf", model, fmap_name(), 1, frames, "frame", expf_secs, expf_sum);
+}
+
+/*
+ * Full buildGradient() over every utterance
+ */
+static void bench_gradient(ostream& out, const string& model, CRF_Model* crf, CRF_GradBuilder* gbuild,
+		CRF_FeatureStream* ftr_str) {
+	vector<double> grad(crf->getLambdaLen(), 0.0);
+	double checksum = 0.0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		ftr_str->rewind();
+		QN_SegID segid = ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			double Zx;
+			checksum += gbuild->buildGradient(ftr_str, &(grad[0]), &Zx);
+			segid = ftr_str->nextseg();
+		}
+	}
+	double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+	report(out, "gradient", model, fmap_name(), 1, frames, "frame", elapsed_seconds(start), checksum);
+}
+
+/*
+ * buildGradient() over every utterance with the node features read into the feature slab and
+ * with one heap copy per node (CRF_GradBuilder::setUseFtrSlab(false)), each with a new gradient
+ * builder.  Followed by a line "# slab" with the feature buffer allocations of either path.
+ */
+static void bench_slab(ostream& out, const string& model, CRF_Model* crf, CRF_FeatureStream* ftr_str) {
+	const char* names[2] = { "gradient_slab", "gradient_copy" };
+	QNUInt32 allocs[2];
+	vector<double> grad(crf->getLambdaLen(), 0.0);
+	double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+	for (int mode = 0; mode < 2; mode++) {
+		CRF_GradBuilder* gbuild = CRF_GradBuilder::create(crf, EXPF);
+		gbuild->setUseFtrSlab(mode == 0);
+		double checksum = 0.0;
+		struct timeval start;
+		gettimeofday(&start, NULL);
+		for (int rep = 0; rep < config.bench_reps; rep++) {
+			ftr_str->rewind();
+			QN_SegID segid = ftr_str->nextseg();
+			while (segid != QN_SEGID_BAD) {
+				double Zx;
+				checksum += gbuild->buildGradient(ftr_str, &(grad[0]), &Zx);
+				segid = ftr_str->nextseg();
+			}
+		}
+		double secs = elapsed_seconds(start);
+		allocs[mode] = gbuild->getFtrAllocs();
+		report(out, names[mode], model, fmap_name(), 1, frames, "frame", secs, checksum);
+		delete gbuild;
+	}
+
+	char line[512];
+	snprintf(line, sizeof(line), "# slab\t%s\t%s\tslab_allocs=%u\tcopy_allocs=%u\n",
+			model.c_str(), fmap_name().c_str(), allocs[0], allocs[1]);
+	out << line;
+}
+
+/*
+ * Minibatch gradient accumulation over every utterance with 1 to threads threads
+ */
+static void bench_minibatch(ostream& out, const string& model, CRF_Model* crf) {
+	vector<double> grad(crf->getLambdaLen(), 0.0);
+	for (int nthreads = 1; nthreads <= config.threads; nthreads++) {
+		CRF_FeatureStreamManager* str = create_stream(crf->getModelType(), nthreads);
+		CRF_Minibatch_GradAccumulator* gaccum = new CRF_Minibatch_GradAccumulator(crf, str, nthreads);
+		gaccum->setNThreads(nthreads);
+		gaccum->setMinibatch((config.crf_bunch_size > nthreads) ? config.crf_bunch_size : nthreads);
+		double checksum = 0.0;
+		struct timeval start;
+		gettimeofday(&start, NULL);
+		for (int rep = 0; rep < config.bench_reps; rep++) {
+			gaccum->rewindAllAndNextSegs();
+			bool isEndOfIter = false;
+			while (!isEndOfIter) {
+				double Zx;
+				QNUInt32 uttCount;
+				checksum += gaccum->accumulateGradient(&(grad[0]), &Zx, &uttCount, &isEndOfIter);
+			}
+		}
+		double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+		report(out, "minibatch", model, fmap_name(), nthreads, frames, "frame", elapsed_seconds(start), checksum);
+		delete gaccum;
+		delete str;
+	}
+}
+
+/*
+ * Viterbi decoding of every utterance against the synthetic lm fst
+ */
+static void bench_viterbi(ostream& out, const string& model, CRF_Model* crf, CRF_FeatureStream* ftr_str) {
+	VectorFst<StdArc> lm_fst;
+	make_synthetic_lm(&lm_fst, crf->getFeatureMap()->getNumStates());
+	CRF_DecodeContext ctx;
+	CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>* vd =
+			new CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>(ftr_str,crf,&ctx);
+	double checksum = 0.0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		ftr_str->rewind();
+		QN_SegID segid = ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			ctx.reset();
+			checksum += vd->nStateDecode(ctx.getBestLat(),&lm_fst,ctx.getFullLat(),config.crf_decode_beam);
+			checksum += ctx.getBestLat()->NumStates();
+			segid = ftr_str->nextseg();
+		}
+	}
+	double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+	report(out, "viterbi", model, fmap_name(), 1, frames, "frame", elapsed_seconds(start), checksum);
+	delete vd;
+}
+
+/*
+ * Lattice building of every utterance
+ */
+static void bench_lattice(ostream& out, const string& model, CRF_Model* crf, CRF_FeatureStream* ftr_str) {
+	CRF_DecodeContext ctx;
+	CRF_LatticeBuilder* lb = CRF_LatticeBuilder::createLatticeBuilder(crf->getModelType(), ftr_str, crf, &ctx);
+	QNUInt32 nStates = crf->getFeatureMap()->getNumStates();
+	double checksum = 0.0;
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		ftr_str->rewind();
+		QN_SegID segid = ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			VectorFst<StdArc> phn_lat;
+			ctx.reset();
+			CRF_LatticeBuilder::buildStdLattice(lb, &phn_lat, nStates, false, (VectorFst<StdArc>*)NULL, false);
+			checksum += phn_lat.NumStates();
+			segid = ftr_str->nextseg();
+		}
+	}
+	double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+	report(out, "lattice", model, fmap_name(), 1, frames, "frame", elapsed_seconds(start), checksum);
+	delete lb;
+}
+
+/*
+ * Sum of g*exp(g) over log gammas, which is 0 for the LOG0 entries, so the dense and sparse
+ * gammas of a lattice give the same checksum
+ */
+static double gamma_checksum(const vector<double>& gammas) {
+	double sum = 0.0;
+	for (size_t i = 0; i < gammas.size(); i++) {
+		sum += gammas[i] * exp(gammas[i]);
+	}
+	return sum;
+}
+
+/*
+ * Numerator and denominator state and transition gammas of every utterance, as used by the
+ * AIS trainer, computed into dense vectors and into CRF_SparseGamma.  Only the time spent in
+ * getAlignmentGammas is counted.  Besides the timing lines, writes one line starting with
+ * "# gamma" with the peak memory of the gammas of one utterance in either form.
+ */
+static void bench_gamma(ostream& out, const string& model, CRF_Model* crf, CRF_FeatureStream* ftr_str) {
+	CRF_DecodeContext ctx;
+	CRF_LatticeBuilder lb(ftr_str, crf, &ctx);
+	bool nstate = (crf->getFeatureMap()->getNumStates() > 1);
+	double frames = (double)config.bench_reps * config.bench_utts * config.bench_frames;
+
+	double secs = 0.0;
+	double checksum = 0.0;
+	size_t dense_bytes = 0;
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		ftr_str->rewind();
+		QN_SegID segid = ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			vector<double> den_state, num_state, den_trans, num_trans;
+			ctx.reset();
+			struct timeval start;
+			gettimeofday(&start, NULL);
+			if (nstate) {
+				lb.getAlignmentGammasNState(&den_state, &num_state, &den_trans, &num_trans);
+			}
+			else {
+				lb.getAlignmentGammas(&den_state, &num_state, &den_trans, &num_trans);
+			}
+			secs += elapsed_seconds(start);
+			checksum += gamma_checksum(den_state) + gamma_checksum(num_state) +
+					gamma_checksum(den_trans) + gamma_checksum(num_trans);
+			size_t bytes = (den_state.size() + num_state.size() + den_trans.size() + num_trans.size()) *
+					sizeof(double);
+			if (bytes > dense_bytes) dense_bytes = bytes;
+			segid = ftr_str->nextseg();
+		}
+	}
+	report(out, "gamma_dense", model, fmap_name(), 1, frames, "frame", secs, checksum);
+
+	secs = 0.0;
+	checksum = 0.0;
+	size_t sparse_bytes = 0;
+	CRF_SparseGamma den_gamma, num_gamma;
+	for (int rep = 0; rep < config.bench_reps; rep++) {
+		ftr_str->rewind();
+		QN_SegID segid = ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			ctx.reset();
+			struct timeval start;
+			gettimeofday(&start, NULL);
+			if (nstate) {
+				lb.getAlignmentGammasNState(&den_gamma, &num_gamma, true);
+			}
+			else {
+				lb.getAlignmentGammas(&den_gamma, &num_gamma, true);
+			}
+			secs += elapsed_seconds(start);
+			CRF_SparseGamma* gammas[] = { &den_gamma, &num_gamma };
+			for (int g = 0; g < 2; g++) {
+				for (QNUInt32 f = 0; f < gammas[g]->getNumFrames(); f++) {
+					for (QNUInt32 i = gammas[g]->getStateBegin(f); i < gammas[g]->getStateEnd(f); i++) {
+						checksum += gammas[g]->getStateGamma(i) * exp(gammas[g]->getStateGamma(i));
+					}
+					for (QNUInt32 i = gammas[g]->getTransBegin(f); i < gammas[g]->getTransEnd(f); i++) {
+						checksum += gammas[g]->getTransGamma(i) * exp(gammas[g]->getTransGamma(i));
+					}
+				}
+			}
+			size_t bytes = den_gamma.getBytes() + num_gamma.getBytes();
+			if (bytes > sparse_bytes) sparse_bytes = bytes;
+			segid = ftr_str->nextseg();
+		}
+	}
+	report(out, "gamma_sparse", model, fmap_name(), 1, frames, "frame", secs, checksum);
+
+	char line[512];
+	snprintf(line, sizeof(line), "# gamma\t%s\t%s\tdense_bytes=%lu\tsparse_bytes=%lu\n",
+			model.c_str(), fmap_name().c_str(), (unsigned long)dense_bytes, (unsigned long)sparse_bytes);
+	out << line;
+}
+
+/*
+ * Reports a benchmark that threw and marks the run as failed, so that the remaining
+ * benchmarks still run
+ */
+static void bench_failed(const string& bench, const string& model, exception& e) {
+	cerr << "Exception in benchmark " << bench << " (" << model << "): " << e.what() << endl;
+	bench_status = -1;
+}
+
+/*
+ * Runs the benchmarks of one model type
+ */
+static void bench_model(ostream& out, modeltype mtype, const string& model) {
+	CRF_FeatureStreamManager* str = create_stream(mtype, 1);
+	CRF_Model* crf = create_model(mtype, str);
+	log_msg("Model "+model+": "+stringify(crf->getNLabs())+" labels, "+stringify(crf->getLambdaLen())+" weights");
+
+	CRF_GradBuilder* gbuild = CRF_GradBuilder::create(crf, EXPF);
+	CRF_StateVector* nodes = new CRF_StateVector();
+	gbuild->setNodeList(nodes);
+	if (bench_enabled("ftrmap") || bench_enabled("node") || bench_enabled("quant")) {
+		vector<double> grad(crf->getLambdaLen(), 0.0);
+		QNUInt32 nodeCnt = 0;
+		try {
+			nodeCnt = load_sequence(gbuild, str->trn_stream, &(grad[0]), nodes);
+		}
+		catch (exception &e) {
+			bench_failed("ftrmap/node/quant", model, e);
+		}
+		if (nodeCnt > 0 && bench_enabled("ftrmap")) {
+			try {
+				bench_ftrmap(out, model, crf, nodes, nodeCnt);
+			}
+			catch (exception &e) {
+				bench_failed("ftrmap", model, e);
+			}
+		}
+		if (nodeCnt > 0 && bench_enabled("node")) {
+			try {
+				bench_nodes(out, model, crf, nodes, nodeCnt);
+			}
+			catch (exception &e) {
+				bench_failed("node", model, e);
+			}
+		}
+		if (nodeCnt > 0 && bench_enabled("quant")) {
+			try {
+				bench_quant(out, model, crf, nodes, nodeCnt);
+			}
+			catch (exception &e) {
+				bench_failed("quant", model, e);
+			}
+		}
+	}
+	if (bench_enabled("gradient")) {
+		try {
+			bench_gradient(out, model, crf, gbuild, str->trn_stream);
+		}
+		catch (exception &e) {
+			bench_failed("gradient", model, e);
+		}
+	}
+	delete gbuild;
+	if (bench_enabled("slab")) {
+		try {
+			bench_slab(out, model, crf, str->trn_stream);
+		}
+		catch (exception &e) {
+			bench_failed("slab", model, e);
+		}
+	}
+	if (bench_enabled("minibatch")) {
+		try {
+			bench_minibatch(out, model, crf);
+		}
+		catch (exception &e) {
+			bench_failed("minibatch", model, e);
+		}
+	}
+	if (bench_enabled("viterbi")) {
+		// CRF_ViterbiDecoder_StdSeg_NoSegTransFtr always builds segmental nodes, so only this
+		// model type can be decoded (the frame level path of CRFDecode is disabled)
+		if (mtype == STDSEG_NO_DUR_NO_SEGTRANSFTR) {
+			try {
+				bench_viterbi(out, model, crf, str->trn_stream);
+			}
+			catch (exception &e) {
+				bench_failed("viterbi", model, e);
+			}
+		}
+	}
+	if (bench_enabled("lattice")) {
+		try {
+			bench_lattice(out, model, crf, str->trn_stream);
+		}
+		catch (exception &e) {
+			bench_failed("lattice", model, e);
+		}
+	}
+	if (bench_enabled("gamma")) {
+		// the alignment gammas are only built from frame level lattices
+		if (mtype == STDFRAME) {
+			try {
+				bench_gamma(out, model, crf, str->trn_stream);
+			}
+			catch (exception &e) {
+				bench_failed("gamma", model, e);
+			}
+		}
+	}
+	delete crf;
+	delete str;
+}
+
+/*
+ * Main benchmark block
+ *
+ * Writes the synthetic data, then runs the selected benchmarks and prints one tab separated
+ * line per result:
+ *   benchmark model featuremap threads reps units unit seconds usec_per_unit checksum
+ * Lines starting with # describe the run.
+ */
+int main(int argc, const char* argv[]) {
+	char* progname;
+
+	set_defaults();
+	QN_initargs(&argtab[0], &argc, &argv, &progname);
+	QN_printargs(stderr, progname, &argtab[0]);
+
+	if (config.bench_utts <= 0 || config.bench_frames <= 0 || config.bench_ftrs <= 0 ||
+			config.bench_labels <= 0 || config.bench_reps <= 0) {
+		cerr << "ERROR: bench_utts, bench_frames, bench_ftrs, bench_labels and bench_reps must be positive" << endl;
+		exit(-1);
+	}
+	if (config.crf_states <= 0 || config.label_maximum_duration <= 0) {
+		cerr << "ERROR: crf_states and label_maximum_duration must be positive" << endl;
+		exit(-1);
+	}
+	if (config.threads <= 0 || config.threads > config.bench_utts) {
+		cerr << "ERROR: threads must be between 1 and bench_utts" << endl;
+		exit(-1);
+	}
+	if (config.bench_frames < config.label_maximum_duration) {
+		cerr << "ERROR: bench_frames must be at least label_maximum_duration" << endl;
+		exit(-1);
+	}
+	if (strcmp(config.crf_featuremap,"stdstate") != 0 && strcmp(config.crf_featuremap,"stdtrans") != 0 &&
+			strcmp(config.crf_featuremap,"stdsparse") != 0 && strcmp(config.crf_featuremap,"stdsparsetrans") != 0) {
+		cerr << "ERROR: unknown crf_featuremap: " << config.crf_featuremap << endl;
+		exit(-1);
+	}
+
+	vector<int> models;
+	for (int m = 0; m < num_model_types; m++) {
+		if (strcmp(config.crf_model_type,"all") == 0 || strcmp(config.crf_model_type,model_names[m]) == 0) {
+			models.push_back(m);
+		}
+	}
+	if (models.empty()) {
+		cerr << "ERROR: unknown crf_model_type: " << config.crf_model_type << endl;
+		exit(-1);
+	}
+
+	string only(config.bench_only);
+	size_t pos = 0;
+	while (pos <= only.size()) {
+		size_t comma = only.find(',', pos);
+		if (comma == string::npos) comma = only.size();
+		if (comma > pos) bench_set.insert(only.substr(pos, comma - pos));
+		pos = comma + 1;
+	}
+
+	ofstream ofile;
+	ostream* out = &cout;
+	if (strcmp(config.bench_output,"-") != 0) {
+		ofile.open(config.bench_output);
+		if (!ofile.is_open()) {
+			cerr << "ERROR: Failed opening file: " << config.bench_output << endl;
+			exit(-1);
+		}
+		out = &ofile;
+	}
+
+	string tmpl = string(config.bench_tmpdir) + "/crfbench.XXXXXX";
+	vector<char> tmpl_buf(tmpl.begin(), tmpl.end());
+	tmpl_buf.push_back('\0');
+	if (mkdtemp(&(tmpl_buf[0])) == NULL) {
+		cerr << "ERROR: cannot create a directory in " << config.bench_tmpdir << endl;
+		exit(-1);
+	}
+	data_dir = &(tmpl_buf[0]);
+	ftr_fname = data_dir + "/bench.pfile";
+	framelab_fname = data_dir + "/bench_frame.ilab";
+	seglab_fname = data_dir + "/bench_seg.ilab";
+	sent_range = "0-" + stringify(config.bench_utts - 1);
+
+	srand48(config.bench_seed);
+	write_synthetic_data();
+	log_msg("Synthetic data written to "+data_dir);
+
+	*out << "# CRFBench " << CRF_VERSION << endl;
+	*out << "# utts=" << config.bench_utts << " frames=" << config.bench_frames
+			<< " ftrs=" << config.bench_ftrs << " labels=" << config.bench_labels
+			<< " states=" << config.crf_states << " maxdur=" << config.label_maximum_duration
+			<< " sparsity=" << config.bench_sparsity << " lm_density=" << config.bench_lm_density
+			<< " bunch=" << config.crf_bunch_size << " beam=" << config.crf_decode_beam
+			<< " seed=" << config.bench_seed << endl;
+	*out << "benchmark\tmodel\tfeaturemap\tthreads\treps\tunits\tunit\tseconds\tusec_per_unit\tchecksum" << endl;
+
+	if (bench_enabled("logmath")) {
+		try {
+			bench_logmath(*out);
+		}
+		catch (exception &e) {
+			bench_failed("logmath", "-", e);
+		}
+	}
+	if (bench_enabled("l1")) {
+		try {
+			bench_l1(*out);
+		}
+		catch (exception &e) {
+			bench_failed("l1", "-", e);
+		}
+	}
+	for (size_t m = 0; m < models.size(); m++) {
+		try {
+			bench_model(*out, model_types[models[m]], model_names[models[m]]);
+		}
+		catch (exception &e) {
+			bench_failed("setup", model_names[models[m]], e);
+		}
+	}
+
+	unlink(ftr_fname.c_str());
+	unlink(framelab_fname.c_str());
+	unlink(seglab_fname.c_str());
+	rmdir(data_dir.c_str());
+	return bench_status;
+}
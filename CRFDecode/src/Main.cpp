@@ -26,6 +26,11 @@
 #include "decoders/CRF_ViterbiDecoder.h"
 #include "decoders/CRF_ViterbiNode_PruneTrans.h"
 #include "decoders/CRF_ViterbiDecoder_StdSeg_NoSegTransFtr.h"
+#include "decoders/CRF_TokenPassDecoder.h"
+#include "io/CRF_LatticeArchive.h"
+#include "utils/CRF_MemStats.h"
+#include <sstream>
+#include <sys/time.h>
 
 using namespace std;
 typedef StdArc::StateId StateId;
@@ -52,6 +57,7 @@ static struct {
 	int ftr1_right_context_len;
 	bool ftr1_extract_seg_ftr;
 	bool ftr1_use_boundary_delta_ftr;
+	bool ftr1_use_kl_ftr;
 
 	char* ftr2_file;
 	char* ftr2_format;
@@ -68,6 +74,7 @@ static struct {
 	int ftr2_right_context_len;
 	bool ftr2_extract_seg_ftr;
 	bool ftr2_use_boundary_delta_ftr;
+	bool ftr2_use_kl_ftr;
 
 	char* ftr3_file;
 	char* ftr3_format;
@@ -84,6 +91,7 @@ static struct {
 	int ftr3_right_context_len;
 	bool ftr3_extract_seg_ftr;
 	bool ftr3_use_boundary_delta_ftr;
+	bool ftr3_use_kl_ftr;
 
 	int train_sent_start;
 	int train_sent_count;
@@ -114,6 +122,7 @@ static struct {
 	float crf_state_bias_value;
 	float crf_trans_bias_value;
 	char* crf_lm_bin;
+	char* crf_static_graph;
 
 	// Added by Ryan
 	char* crf_conf_bin;
@@ -128,11 +137,23 @@ static struct {
 	// Added by Ryan
 	bool crf_if_output_full_lat;
 	char* htk_lat_outdir;
+	char* crf_lat_archive;
+	char* htk_lat_archive;
+	int crf_lat_archive_compress;
 
 	float crf_decode_beam;
 	int crf_decode_max_hyp;
 	int crf_decode_min_hyp;
 	float crf_decode_hyp_inc;
+	int crf_decode_target_hyp;
+	float crf_decode_target_rtf;
+	char* crf_decode_search;
+	float crf_decode_trans_beam;
+	int crf_mem_estimate;
+	int crf_mem_max_frames;
+	int crf_sparse_weights;
+	int crf_quant_bits;
+	char* crf_quant_out;
 	int verbose;
 	int dummy;
 
@@ -164,6 +185,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr1_right_context_len", "Length of context features to the right of the window on ftr1_file (frames)", QN_ARG_INT, &(config.ftr1_right_context_len) },
 	{ "ftr1_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr1_extract_seg_ftr) },
 	{ "ftr1_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr1_use_boundary_delta_ftr) },
+	{ "ftr1_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr1_use_kl_ftr) },
 
 	{ "ftr2_file", "Input feature file", QN_ARG_STR, &(config.ftr2_file) },
 	{ "ftr2_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr2_format) },
@@ -180,6 +202,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr2_right_context_len", "Length of context features to the right of the window on ftr2_file (frames)", QN_ARG_INT, &(config.ftr2_right_context_len) },
 	{ "ftr2_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr2_extract_seg_ftr) },
 	{ "ftr2_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr2_use_boundary_delta_ftr) },
+	{ "ftr2_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr2_use_kl_ftr) },
 
 	{ "ftr3_file", "Input feature file", QN_ARG_STR, &(config.ftr3_file) },
 	{ "ftr3_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr3_format) },
@@ -196,6 +219,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr3_right_context_len", "Length of context features to the right of the window on ftr3_file (frames)", QN_ARG_INT, &(config.ftr3_right_context_len) },
 	{ "ftr3_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr3_extract_seg_ftr) },
 	{ "ftr3_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr3_use_boundary_delta_ftr) },
+	{ "ftr3_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr3_use_kl_ftr) },
 
 	{ "window_extent", "Extent of all windows (frames)", QN_ARG_INT, &(config.window_extent) },
 	{ "hardtarget_file", "Target Label File", QN_ARG_STR, &(config.hardtarget_file) },
@@ -225,6 +249,7 @@ QN_ArgEntry argtab[] =
 	{ "crf_trans_bias_value", "Function value for transition bias functions", QN_ARG_FLOAT, &(config.crf_trans_bias_value) },
 	{ "crf_lm_bin", "Language model file name (in OpenFST binary format)", QN_ARG_STR, &(config.crf_lm_bin) },
 	{ "crf_lm_arpa", "Language model file name (in ARPA text format)", QN_ARG_STR, &(config.crf_lm_arpa) },
+	{ "crf_static_graph", "Compiled decoding graph file name (from CRFGraphCompile), decoded by token passing instead of crf_lm_bin", QN_ARG_STR, &(config.crf_static_graph) },
 
 	// Added by Ryan
 	{ "crf_conf_bin", "Confusion model file name (in OpenFST binary format)", QN_ARG_STR, &(config.crf_conf_bin) },
@@ -238,11 +263,23 @@ QN_ArgEntry argtab[] =
 	// Added by Ryan
 	{ "crf_if_output_full_lat", "If output the full lattice (comparing to only a few best paths)", QN_ARG_BOOL, &(config.crf_if_output_full_lat) },
 	{ "htk_lat_outdir", "Output directory for lattice files in HTK SLF format", QN_ARG_STR, &(config.htk_lat_outdir) },
+	{ "crf_lat_archive", "Output lattice archive for all lattices (in OpenFST binary format), keyed by olist name", QN_ARG_STR, &(config.crf_lat_archive) },
+	{ "htk_lat_archive", "Output lattice archive for all lattices in HTK SLF format, keyed by olist name", QN_ARG_STR, &(config.htk_lat_archive) },
+	{ "crf_lat_archive_compress", "Compress the lattices in crf_lat_archive and htk_lat_archive", QN_ARG_BOOL, &(config.crf_lat_archive_compress) },
 
 	{ "crf_decode_beam", "Beam width for pruning", QN_ARG_FLOAT, &(config.crf_decode_beam) },
 	{ "crf_decode_max_hyp", "Maximum hypotheses to keep in beam", QN_ARG_INT, &(config.crf_decode_max_hyp) },
 	{ "crf_decode_min_hyp", "Minimum hypotheses to keep in beam", QN_ARG_INT, &(config.crf_decode_min_hyp) },
 	{ "crf_decode_hyp_inc", "Increment for hypothesis beam pruning", QN_ARG_FLOAT, &(config.crf_decode_hyp_inc) },
+	{ "crf_decode_target_hyp", "Target hypotheses per frame for the adaptive beam (0 for none)", QN_ARG_INT, &(config.crf_decode_target_hyp) },
+	{ "crf_decode_target_rtf", "Target real-time factor for the adaptive beam (0 for none)", QN_ARG_FLOAT, &(config.crf_decode_target_rtf) },
+	{ "crf_decode_search", "Viterbi search (std|prunetrans), prunetrans cuts transition arcs before expansion", QN_ARG_STR, &(config.crf_decode_search) },
+	{ "crf_decode_trans_beam", "Transition beam for crf_decode_search=prunetrans (0 for none)", QN_ARG_FLOAT, &(config.crf_decode_trans_beam) },
+	{ "crf_mem_estimate", "Estimate the peak memory before decoding (0=off, 1=estimate and decode, 2=estimate and exit)", QN_ARG_INT, &(config.crf_mem_estimate) },
+	{ "crf_mem_max_frames", "Frames of the longest utterance for crf_mem_estimate (0=read from the feature files)", QN_ARG_INT, &(config.crf_mem_max_frames) },
+	{ "crf_sparse_weights", "Skip the zero weights when scoring (for weights trained with crf_l1)", QN_ARG_BOOL, &(config.crf_sparse_weights) },
+	{ "crf_quant_bits", "Score with the feature weights quantized to 8 or 16 bits (0 = off); weights read from a quantized file are used quantized at their own size if this is 0", QN_ARG_INT, &(config.crf_quant_bits) },
+	{ "crf_quant_out", "Write the weights quantized to crf_quant_bits bits to this file and exit", QN_ARG_STR, &(config.crf_quant_out) },
 	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
 
 	//Added by Ryan, for segmental CRFs
@@ -272,6 +309,7 @@ static void set_defaults(void) {
 	config.ftr1_right_context_len=0;
 	config.ftr1_extract_seg_ftr=false;
 	config.ftr1_use_boundary_delta_ftr=false;
+	config.ftr1_use_kl_ftr=false;
 
 	config.ftr2_file="";
 	config.ftr2_format="pfile";
@@ -288,6 +326,7 @@ static void set_defaults(void) {
 	config.ftr2_right_context_len=0;
 	config.ftr2_extract_seg_ftr=false;
 	config.ftr2_use_boundary_delta_ftr=false;
+	config.ftr2_use_kl_ftr=false;
 
 	config.ftr3_file="";
 	config.ftr3_format="pfile";
@@ -304,6 +343,7 @@ static void set_defaults(void) {
 	config.ftr3_right_context_len=0;
 	config.ftr3_extract_seg_ftr=false;
 	config.ftr3_use_boundary_delta_ftr=false;
+	config.ftr3_use_kl_ftr=false;
 
 	config.window_extent=1;
 	config.hardtarget_file="";
@@ -331,6 +371,7 @@ static void set_defaults(void) {
 	config.crf_trans_bias_value=1.0;
 	config.crf_lm_bin=NULL;
 	config.crf_lm_arpa=NULL;
+	config.crf_static_graph=NULL;
 
 	// Added by Ryan
 	config.crf_conf_bin=NULL;
@@ -344,11 +385,23 @@ static void set_defaults(void) {
 	// Added by Ryan
 	config.crf_if_output_full_lat=false;
 	config.htk_lat_outdir=NULL;
+	config.crf_lat_archive=NULL;
+	config.htk_lat_archive=NULL;
+	config.crf_lat_archive_compress=0;
 
 	config.crf_decode_beam=0.0;
 	config.crf_decode_max_hyp=0;
 	config.crf_decode_min_hyp=0;
 	config.crf_decode_hyp_inc=0.05;
+	config.crf_decode_target_hyp=0;
+	config.crf_decode_target_rtf=0.0;
+	config.crf_decode_search="std";
+	config.crf_decode_trans_beam=0.0;
+	config.crf_mem_estimate=0;
+	config.crf_mem_max_frames=0;
+	config.crf_sparse_weights=0;
+	config.crf_quant_bits=0;
+	config.crf_quant_out=NULL;
 	config.verbose=0;
 
 	//Added by Ryan, for segmental CRFs
@@ -419,6 +472,24 @@ void log_msg(string outstr) {
 	}
 }
 
+/*
+ * Returns the number of frames of the longest utterance in str, 0 if the feature files do not
+ * tell it without being read
+ */
+static QNUInt32 find_max_frames(CRF_FeatureStream* str) {
+	QNUInt32 max_frames=0;
+	for (QNUInt32 seg=0; seg<str->num_segs(); seg++) {
+		size_t frames=str->num_frames(seg);
+		if (frames == QN_SIZET_BAD) {
+			return 0;
+		}
+		if (frames > max_frames) {
+			max_frames=frames;
+		}
+	}
+	return max_frames;
+}
+
 /*
  * logs an error message to standard error
  */
@@ -431,287 +502,303 @@ void log_errmsg(string errstr) {
 
 // The following FST2HTK_lat related stuff are added by Ryan
 /*
- * The class for storing the start and the end of an word arc with accumulated weights.
- * If it stores for a partial arc, just save the start node and leave the end node as -1.
+ * The start and the end of an HTK word arc with accumulated weights.
  */
-class HTK_word_arc {
-public:
+struct HTK_word_arc {
 	int start_htk_node;
 	int end_htk_node;
 	double ac_weight;
 	double lm_weight;
+};
 
-	HTK_word_arc(int s, double ac_w, double lm_w) : start_htk_node(s), end_htk_node(-1), ac_weight(ac_w), lm_weight(lm_w) {}
-	HTK_word_arc(int s, int e, double ac_w, double lm_w) : start_htk_node(s), end_htk_node(e), ac_weight(ac_w), lm_weight(lm_w) {}
-	HTK_word_arc(const HTK_word_arc& a) {
-		start_htk_node = a.start_htk_node;
-		end_htk_node = a.end_htk_node;
-		ac_weight = a.ac_weight;
-		lm_weight = a.lm_weight;
-	}
-	void add_weight(double ac, double lm) {
-		ac_weight += ac;
-		lm_weight += lm;
-	}
+/*
+ * A partial word arc that has not reached the end of its word yet.  The partial arcs going into
+ * an fst state are chained through next into a list, kept in the order they were added.
+ */
+struct HTK_partial_arc {
+	int start_htk_node;
+	double ac_weight;
+	double lm_weight;
+	int next;	// next partial arc going into the same fst state, -1 at the end of the list
 };
 
 /*
- * The FST lattice node that are constructed along the lattice expansion.
- * The in_paths collect all (partial) word arcs that go into this node.
- *
+ * The FST lattice node of an fst state, constructed along the lattice expansion.
+ * first_arc and last_arc delimit the list of all partial word arcs that go into this node.
  */
-class FST_lat_node {
-public:
-	StateId fst_node;
+struct FST_lat_node {
 	int word_lab;
 	int time_frame;
 	int mapped_htk_node;
-	vector<HTK_word_arc*> incoming_word_arcs;
+	int first_arc;
+	int last_arc;
+	int pending_arcs;	// incoming arcs from fst states that have not been expanded yet
+	bool reachable;
+	bool labelled;
 	bool finish_word_arcs;  // true if all the word arcs that end at this node have already been added to the htk lattice
+};
 
-	FST_lat_node(StateId s, int l = kNoLabel, int t = BAD_TIME_FRAME) :
-		fst_node(s), word_lab(l), time_frame(t), mapped_htk_node(kNoStateId), finish_word_arcs(false) {}
+/*
+ * The class for converting an FST lattice into an HTK lattice
+ *
+ * FST state ids are dense, so the nodes are kept in a vector indexed by StateId, and all partial
+ * arcs share one pool.  The states are expanded in topological order, so every partial arc going
+ * into a state is known before the state is expanded.
+ */
+class FST2HTK_lat {
 
-	~FST_lat_node() {
-		for (vector<HTK_word_arc*>::iterator it = incoming_word_arcs.begin(); it != incoming_word_arcs.end(); ++it) {
-			delete *it;
+protected:
+	static constexpr double sec_per_frame = 0.01;
+	vector<FST_lat_node> fst_nodes;
+	vector<HTK_partial_arc> partial_arcs;
+	vector<StateId> htk_nodes;	// the fst state of each htk node
+	vector<HTK_word_arc> htk_arcs;
+	vector<StateId> state_queue;
+
+	int mapHtkNode(StateId state_id) {
+		FST_lat_node& fst_node = fst_nodes[state_id];
+		if (fst_node.mapped_htk_node == kNoStateId) {
+			fst_node.mapped_htk_node = htk_nodes.size();
+			htk_nodes.push_back(state_id);
 		}
+		return fst_node.mapped_htk_node;
 	}
 
-	void add_word_beginning_arc(vector<FST_lat_node*>* htk_nodes, FST_lat_node* prev_node, double arc_ac_weight, double arc_lm_weight) {
-		// create an htk node if needed when adding an fst word beginning arc
-		if (prev_node->mapped_htk_node == kNoStateId) {
-			prev_node->mapped_htk_node = htk_nodes->size();
-			htk_nodes->push_back(prev_node);
-			//log_msg("FST_lat_node::add_word_beginning_arc() LOG: htk_nodes->push_back("
-			//		+ stringify(prev_node->fst_node) + ") = " + stringify(prev_node->mapped_htk_node));
+	void setNodeLabel(StateId state_id, int label, int time_frame) {
+		FST_lat_node& fst_node = fst_nodes[state_id];
+		if (!fst_node.labelled) {
+			fst_node.word_lab = label;
+			fst_node.time_frame = time_frame;
+			fst_node.labelled = true;
+		} else {
+			if (fst_node.word_lab != label) {
+				cerr << "FST2HTK_lat::setNodeLabel() ERROR: two incoming arcs going through the fst state " << state_id
+						<< " with different word labels: " << fst_node.word_lab << " and " << label << endl;
+				exit(-1);
+			}
+			if (fst_node.time_frame != time_frame) {
+				cerr << "FST2HTK_lat::setNodeLabel() ERROR: two paths reach the fst state " << state_id
+						<< " at different time frame: " << fst_node.time_frame << " and " << time_frame << endl;
+				exit(-1);
+			}
 		}
-		// add a partial htk word arc
-		HTK_word_arc* htk_word_arc = new HTK_word_arc(prev_node->mapped_htk_node, arc_ac_weight, arc_lm_weight);
-		incoming_word_arcs.push_back(htk_word_arc);
 	}
 
-	void add_word_internal_arc(const FST_lat_node& prev_node, double arc_ac_weight, double arc_lm_weight) {
-		// no need to create an htk node for adding an fst word internal arc
-		// accumulate all partial word arcs from previous node and extend them by adding the current weights
-		for (uint i = 0; i < prev_node.incoming_word_arcs.size(); i++) {
-			HTK_word_arc* htk_word_arc = new HTK_word_arc(*(prev_node.incoming_word_arcs[i]));  // copy from previous node
-			htk_word_arc->add_weight(arc_ac_weight, arc_lm_weight);  // add weights
-			incoming_word_arcs.push_back(htk_word_arc);  // add to current node
+	void addPartialArc(StateId state_id, int start_htk_node, double ac_weight, double lm_weight) {
+		HTK_partial_arc arc;
+		arc.start_htk_node = start_htk_node;
+		arc.ac_weight = ac_weight;
+		arc.lm_weight = lm_weight;
+		arc.next = -1;
+		int idx = partial_arcs.size();
+		partial_arcs.push_back(arc);
+		FST_lat_node& fst_node = fst_nodes[state_id];
+		if (fst_node.last_arc == -1) {
+			fst_node.first_arc = idx;
+		} else {
+			partial_arcs[fst_node.last_arc].next = idx;
 		}
+		fst_node.last_arc = idx;
 	}
 
-	void add_word_arcs_to_htk_lat(vector<FST_lat_node*>* htk_nodes, vector<HTK_word_arc*>* htk_arcs) {
-		if (!finish_word_arcs) {
-			if (mapped_htk_node == kNoStateId) {
-				mapped_htk_node = htk_nodes->size();
-				htk_nodes->push_back(this);
-				//log_msg("FST_lat_node::add_word_arcs_to_htk_lat() LOG: htk_nodes->push_back("
-				//		+ stringify(fst_node) + ") = " + stringify(mapped_htk_node));
-			}
-			for (uint i = 0; i < incoming_word_arcs.size(); ++i) {
-				HTK_word_arc* htk_word_arc = new HTK_word_arc(*incoming_word_arcs[i]);
-				htk_word_arc->end_htk_node = mapped_htk_node;
-				htk_arcs->push_back(htk_word_arc);
-				//log_msg("FST_lat_node::add_word_arcs_to_htk_lat() LOG: htk_arcs->push_back("
-				//		+ stringify(htk_word_arc->start_htk_node) + ", "
-				//		+ stringify(htk_word_arc->end_htk_node) + ", "
-				//		+ stringify(htk_word_arc->ac_weight) + ", "
-				//		+ stringify(htk_word_arc->lm_weight) + ") = "
-				//		+ stringify(htk_arcs->size() - 1));
-			}
-			finish_word_arcs = true;
-		}
+	void addWordBeginningArc(StateId state_id, StateId prev_state_id, double arc_ac_weight, double arc_lm_weight) {
+		// create an htk node if needed when adding an fst word beginning arc
+		int start_htk_node = mapHtkNode(prev_state_id);
+		addPartialArc(state_id, start_htk_node, arc_ac_weight, arc_lm_weight);
 	}
-};
 
-/*
- * The class for converting an FST lattice into an HTK lattice
- */
-class FST2HTK_lat {
-
-protected:
-	static constexpr double sec_per_frame = 0.01;
-	vector<FST_lat_node*> htk_nodes;
-	vector<HTK_word_arc*> htk_arcs;
-	map<StateId, FST_lat_node*> fst_node_map;
-	set<StateId> queued_fst_nodes;
-
-public:
-//	~FST2HTK_lat();
-//	FST_lat_node* findFstNode(StateId state_id);
-//	FST_lat_node* insertFstNode(StateId state_id);
-//	void convert(const VectorFst<StdArc>& fst_lat);
-//	void Write(const string &filename, const SymbolTable& oSymTab) const;
-
-	~FST2HTK_lat() {
-		// the FST_lat_node objects in htk_nodes are a subject of those in fst_node_map.
-		// so just need to delete those in fst_node_map.
-		for (map<StateId, FST_lat_node*>::iterator nodeIt = fst_node_map.begin(); nodeIt != fst_node_map.end(); ++nodeIt) {
-			delete nodeIt->second;
+	void addWordInternalArc(StateId state_id, StateId prev_state_id, double arc_ac_weight, double arc_lm_weight) {
+		// no need to create an htk node for adding an fst word internal arc
+		// extend all partial word arcs from previous node by adding the current weights
+		for (int i = fst_nodes[prev_state_id].first_arc; i != -1; i = partial_arcs[i].next) {
+			const HTK_partial_arc arc = partial_arcs[i];	// copy, addPartialArc() may grow the pool
+			addPartialArc(state_id, arc.start_htk_node, arc.ac_weight + arc_ac_weight, arc.lm_weight + arc_lm_weight);
 		}
-		for (uint i = 0; i < htk_arcs.size(); ++i) {
-			delete htk_arcs[i];
+	}
+
+	void addWordArcsToHtkLat(StateId state_id) {
+		if (fst_nodes[state_id].finish_word_arcs) return;
+		int end_htk_node = mapHtkNode(state_id);
+		for (int i = fst_nodes[state_id].first_arc; i != -1; i = partial_arcs[i].next) {
+			HTK_word_arc htk_word_arc;
+			htk_word_arc.start_htk_node = partial_arcs[i].start_htk_node;
+			htk_word_arc.end_htk_node = end_htk_node;
+			htk_word_arc.ac_weight = partial_arcs[i].ac_weight;
+			htk_word_arc.lm_weight = partial_arcs[i].lm_weight;
+			htk_arcs.push_back(htk_word_arc);
 		}
+		fst_nodes[state_id].finish_word_arcs = true;
 	}
 
-	FST_lat_node* findFstNode(StateId state_id) {
-		map<StateId, FST_lat_node*>::iterator nodeIt = fst_node_map.find(state_id);
-		if (nodeIt == fst_node_map.end()) return NULL;
-		return nodeIt->second;
+	static void appendInt(string& buf, long value) {
+		char digits[24];
+		int n = 0;
+		unsigned long v = (value < 0) ? -(unsigned long)value : value;
+		do {
+			digits[n++] = '0' + v % 10;
+			v /= 10;
+		} while (v > 0);
+		if (value < 0) buf += '-';
+		while (n > 0) buf += digits[--n];
 	}
 
-	FST_lat_node* insertFstNode(StateId state_id) {
-		if (findFstNode(state_id)) {
-			cerr << "FST2HTK_lat::insertFstNode() ERROR: state " << state_id << " is already in the fst_node_map." << endl;
-			exit(-1);
-		}
-		fst_node_map[state_id] = new FST_lat_node(state_id);
-		return fst_node_map[state_id];
+	static void appendDouble(string& buf, double value) {
+		// same digits as the default ostream formatting
+		char digits[32];
+		int n = snprintf(digits, sizeof(digits), "%g", value);
+		buf.append(digits, n);
 	}
 
-	FST_lat_node* findOrInsertFstNode(StateId state_id, int label, int time_frame) {
-		FST_lat_node* fst_node = findFstNode(state_id);
-		if (!fst_node) {
-			fst_node = insertFstNode(state_id);
-			fst_node->word_lab = label;
-			fst_node->time_frame = time_frame;
-		} else {
-			if (fst_node->word_lab != label) {
-				cerr << "FST2HTK_lat::findOrInsertFstNode() ERROR: two incoming arcs going through the fst state " << state_id
-						<< " with different word labels: " << fst_node->word_lab << " and " << label << endl;
-				exit(-1);
-			}
-			if (fst_node->time_frame != time_frame) {
-				cerr << "FST2HTK_lat::findOrInsertFstNode() ERROR: two paths reach the fst state " << state_id
-						<< " at different time frame: " << fst_node->time_frame << " and " << time_frame << endl;
+	void format(string& buf, const string &uttname, SymbolTable* oSymTab) const {
+		buf.reserve(buf.size() + 128 + 40 * htk_nodes.size() + 64 * htk_arcs.size());
+
+		// print the header
+		buf += "VERSION=1.0\n";
+		buf += "UTTERANCE="; buf += uttname; buf += '\n';
+		buf += "lmscale=1.00  wdpenalty=0.00\n";
+		buf += "prscale=1.00\n";
+		buf += "acscale=1.00\n";
+		buf += "N="; appendInt(buf, htk_nodes.size());
+		buf += " L="; appendInt(buf, htk_arcs.size()); buf += '\n';
+
+		// print the nodes
+		// I=0    t=0.00  W=!NULL
+		// I=1    t=0.05  W=<s>                 v=1
+		for (uint i = 0; i < htk_nodes.size(); ++i) {
+			const FST_lat_node& fst_node = fst_nodes[htk_nodes[i]];
+			buf += "I="; appendInt(buf, i);
+			buf += " t="; appendDouble(buf, sec_per_frame * (fst_node.time_frame + 1));
+			buf += " W=";
+			if (fst_node.word_lab == kNoLabel) {
+				buf += "!NULL";
+			} else if (oSymTab != NULL) {
+				buf += oSymTab->Find(fst_node.word_lab);
+				buf += " v=1";
+			} else {
+				cerr << "CRFDecode ERROR: output symbol table has not been set." << endl;
 				exit(-1);
 			}
+			buf += '\n';
+		}
+
+		// print the arcs
+		// J=0     S=0    E=1    a=-263.35   l=0.000   r=0.00
+		// J=1     S=0    E=2    a=-321.15   l=0.000   r=0.00
+		for (uint j = 0; j < htk_arcs.size(); ++j) {
+			buf += "J="; appendInt(buf, j);
+			buf += " S="; appendInt(buf, htk_arcs[j].start_htk_node);
+			buf += " E="; appendInt(buf, htk_arcs[j].end_htk_node);
+			buf += " a="; appendDouble(buf, htk_arcs[j].ac_weight);
+			buf += " l="; appendDouble(buf, htk_arcs[j].lm_weight);
+			buf += " r=0.00\n";
 		}
-		return fst_node;
 	}
 
+public:
+
 	void convert(const VectorFst<StdArc>& fst_lat) {
-		deque<StateId> state_list;
-		StateId state_id = fst_lat.Start();
-		if (state_id == kNoStateId) // empty fst
+		fst_nodes.clear();
+		partial_arcs.clear();
+		htk_nodes.clear();
+		htk_arcs.clear();
+		state_queue.clear();
+
+		StateId start_id = fst_lat.Start();
+		if (start_id == kNoStateId) // empty fst
 			return;
-		state_list.push_back(state_id);
-		// insert the start fst node to the map with the time frame as BAD_TIME_FRAME = -1
-		FST_lat_node* start_node = insertFstNode(state_id);
-		//start_node->in_queue = true;
-		while (!state_list.empty()) {
-			StateId state_id = state_list.front(); state_list.pop_front();
-			//log_msg("FST2HTK_lat::convert() LOG: pop_front state_id " + stringify(state_id));
-			FST_lat_node* fst_node = findFstNode(state_id);
-			assert(fst_node);
-			bool has_subsequent_non_eps_ilabels = false;
+		FST_lat_node init_node;
+		init_node.word_lab = kNoLabel;
+		init_node.time_frame = BAD_TIME_FRAME;
+		init_node.mapped_htk_node = kNoStateId;
+		init_node.first_arc = -1;
+		init_node.last_arc = -1;
+		init_node.pending_arcs = 0;
+		init_node.reachable = false;
+		init_node.labelled = false;
+		init_node.finish_word_arcs = false;
+		fst_nodes.assign(fst_lat.NumStates(), init_node);
+
+		// count the incoming arcs of every state reachable from the start state
+		state_queue.push_back(start_id);
+		fst_nodes[start_id].reachable = true;
+		for (size_t head = 0; head < state_queue.size(); ++head) {
+			for (ArcIterator<StdFst> aiter(fst_lat, state_queue[head]); !aiter.Done(); aiter.Next()) {
+				StateId next_state_id = aiter.Value().nextstate;
+				fst_nodes[next_state_id].pending_arcs++;
+				if (!fst_nodes[next_state_id].reachable) {
+					fst_nodes[next_state_id].reachable = true;
+					state_queue.push_back(next_state_id);
+				}
+			}
+		}
+		size_t num_reachable = state_queue.size();
+
+		// the start fst node has the time frame BAD_TIME_FRAME = -1
+		fst_nodes[start_id].labelled = true;
+		state_queue.clear();
+		if (fst_nodes[start_id].pending_arcs == 0) {
+			state_queue.push_back(start_id);
+		}
+		for (size_t head = 0; head < state_queue.size(); ++head) {
+			StateId state_id = state_queue[head];
+			bool has_subsequent_arcs = false;
 			for (ArcIterator<StdFst> aiter(fst_lat, state_id); !aiter.Done(); aiter.Next())
 			{
 				const StdArc &arc = aiter.Value();
-				//log_msg("FST2HTK_lat::convert() LOG: state_id=" + stringify(state_id) +
-				//		", arc.ilabel=" + stringify(arc.ilabel) +
-				//		", arc.olabel=" + stringify(arc.olabel) +
-				//		", arc.weight=" + stringify(arc.weight.Value()) +
-				//		", arc.nextstate=" + stringify(arc.nextstate));
-
-				// TODO: expand all nodes with epsilon labels
-				if (arc.ilabel == 0) {
-					cerr << "FST2HTK_lat::convert() ERROR: currently doesn't support epsilon input labels on any fst arc." << endl;
-					exit(-1);
+				has_subsequent_arcs = true;
+				StateId next_state_id = arc.nextstate;
+				// an epsilon input label does not consume a frame
+				int next_time_frame = fst_nodes[state_id].time_frame + (arc.ilabel == 0 ? 0 : 1);
+				if (arc.olabel == 0) {
+					// next_state_id is a word internal state
+					setNodeLabel(next_state_id, fst_nodes[state_id].word_lab, next_time_frame);
+
+					// Currently the FST only supports one type of weight, so all the weights are counted as acoustic weights as a hack
+					// FST uses negative log weight for the tropical semiring.
+					// But we need to use the regular log weight in HTK lattices. So we multiply the weights by -1.
+					// TODO: make the FST support acoustic weight and LM weight.
+					addWordInternalArc(next_state_id, state_id, -1 * arc.weight.Value(), -1 * 0.0);
 				} else {
-					has_subsequent_non_eps_ilabels = true;
-					StateId next_state_id = arc.nextstate;
-					// avoid pushing duplicate fst nodes into the queue
-					if (queued_fst_nodes.find(next_state_id) == queued_fst_nodes.end()) {
-						state_list.push_back(next_state_id);
-						queued_fst_nodes.insert(next_state_id);
-						//log_msg("FST2HTK_lat::convert() LOG: push_back state_id " + stringify(next_state_id));
-					}
-					FST_lat_node* next_fst_node;
-					if (arc.olabel == 0) {
-						// next_fst_node is a word internal state
-						next_fst_node = findOrInsertFstNode(next_state_id, fst_node->word_lab, fst_node->time_frame + 1);
-
-						// Currently the FST only supports one type of weight, so all the weights are counted as acoustic weights as a hack
-						// FST uses negative log weight for the tropical semiring.
-						// But we need to use the regular log weight in HTK lattices. So we multiply the weights by -1.
-						// TODO: make the FST support acoustic weight and LM weight.
-						next_fst_node->add_word_internal_arc(*fst_node, -1 * arc.weight.Value(), -1 * 0.0);
-					} else {
-						// next_fst_node is a word beginning state, create an HTK arc for the previous word
-						next_fst_node = findOrInsertFstNode(next_state_id, arc.olabel, fst_node->time_frame + 1);
-
-						// currently the FST only supports one type of weight, so all the weights are counted as acoustic weights as a hack
-						// FST uses negative log weight for the tropical semiring.
-						// But we need to use the regular log weight in HTK lattices. So we multiply the weights by -1.
-						// TODO: make the FST support acoustic weight and LM weight.
-						next_fst_node->add_word_beginning_arc(&htk_nodes, fst_node, -1 * arc.weight.Value(), -1 * 0.0);
-
-						// since the new word already starts from next_fst_node, all the partial word arcs in
-						// the previous node fst_node can be all finished as full arcs at the time of fst_node.
-						fst_node->add_word_arcs_to_htk_lat(&htk_nodes, &htk_arcs);
-					}
+					// next_state_id is a word beginning state, create an HTK arc for the previous word
+					setNodeLabel(next_state_id, arc.olabel, next_time_frame);
+					addWordBeginningArc(next_state_id, state_id, -1 * arc.weight.Value(), -1 * 0.0);
+
+					// since the new word already starts from next_state_id, all the partial word arcs in
+					// the previous node state_id can be all finished as full arcs at the time of state_id.
+					addWordArcsToHtkLat(state_id);
+				}
+				if (--fst_nodes[next_state_id].pending_arcs == 0) {
+					state_queue.push_back(next_state_id);
 				}
 			}
-			if (!has_subsequent_non_eps_ilabels) {
-				// That means this fst_node does not have subsequent non-epsilon input labels
-				// Then all the word arcs in it end at this node. Add them to the HTK lattice.
-				fst_node->add_word_arcs_to_htk_lat(&htk_nodes, &htk_arcs);
+			if (!has_subsequent_arcs || fst_lat.Final(state_id) != StdArc::Weight::Zero()) {
+				// all the word arcs in this node end here. Add them to the HTK lattice.
+				addWordArcsToHtkLat(state_id);
 			}
 		}
+		if (state_queue.size() != num_reachable) {
+			cerr << "FST2HTK_lat::convert() ERROR: the fst lattice has a cycle, only "
+					<< state_queue.size() << " of " << num_reachable << " reachable states can be converted." << endl;
+			exit(-1);
+		}
 	}
 
 	void Write(const string &filename, const string &uttname, SymbolTable* oSymTab) const {
-		try {
-			ofstream htk_lat_stream;
-			htk_lat_stream.open(filename.c_str());
-
-			// print the header
-			htk_lat_stream << "VERSION=1.0" << endl;
-			htk_lat_stream << "UTTERANCE=" << uttname << endl;
-			htk_lat_stream << "lmscale=1.00  wdpenalty=0.00" << endl;
-			htk_lat_stream << "prscale=1.00" << endl;
-			htk_lat_stream << "acscale=1.00" << endl;
-			htk_lat_stream << "N=" << htk_nodes.size() << " L=" << htk_arcs.size() << endl;
-
-			// print the nodes
-			// I=0    t=0.00  W=!NULL
-			// I=1    t=0.05  W=<s>                 v=1
-			for (uint i = 0; i < htk_nodes.size(); ++i) {
-				string label;
-				if (htk_nodes[i]->word_lab == kNoLabel) {
-					label = "!NULL";
-				} else if (oSymTab != NULL && htk_lat_stream.is_open()) {
-					label = oSymTab->Find(htk_nodes[i]->word_lab);
-				} else {
-					cerr << "CRFDecode ERROR: output symbol table has not been set or htk_lat_stream is already closed." << endl;
-					exit(-1);
-				}
-				htk_lat_stream << "I=" << i
-						<< " t=" << sec_per_frame * (htk_nodes[i]->time_frame + 1)
-						<< " W=" << label;
-				if (htk_nodes[i]->word_lab != kNoLabel) {
-					htk_lat_stream << " v=1";
-				}
-				htk_lat_stream << endl;
-			}
-
-			// print the arcs
-			// J=0     S=0    E=1    a=-263.35   l=0.000   r=0.00
-			// J=1     S=0    E=2    a=-321.15   l=0.000   r=0.00
-			for (uint j = 0; j < htk_arcs.size(); ++j) {
-				htk_lat_stream << "J=" << j
-						<< " S=" << htk_arcs[j]->start_htk_node
-						<< " E=" << htk_arcs[j]->end_htk_node
-						<< " a=" << htk_arcs[j]->ac_weight
-						<< " l=" << htk_arcs[j]->lm_weight
-						<< " r=0.00" << endl;
-			}
-		} catch (exception &e) {
-			cerr << "Exception: " << e.what() << endl;
-			exit(0);
+		string buf;
+		format(buf, uttname, oSymTab);
+		FILE* htk_lat_file = fopen(filename.c_str(), "w");
+		if (htk_lat_file == NULL || fwrite(buf.data(), 1, buf.size(), htk_lat_file) != buf.size()) {
+			cerr << "CRFDecode ERROR: cannot write the HTK lattice " << filename << endl;
+			exit(-1);
 		}
+		fclose(htk_lat_file);
+	}
+
+	// writes the lattice in HTK SLF format to htk_lat_stream, e.g. an ostringstream for a lattice archive
+	void Write(ostream &htk_lat_stream, const string &uttname, SymbolTable* oSymTab) const {
+		string buf;
+		format(buf, uttname, oSymTab);
+		htk_lat_stream.write(buf.data(), buf.size());
 	}
 };
 
@@ -909,6 +996,23 @@ int main(int argc, const char* argv[]) {
 
 	}
 
+	// the static graph replaces lm_fst for the token passing decoder
+	CRF_StaticGraph* static_graph = NULL;
+	if (config.crf_static_graph != NULL && strcmp(config.crf_static_graph, "") != 0) {
+		if (config.crf_if_output_full_lat) {
+			cerr << "ERROR: crf_if_output_full_lat is not supported with crf_static_graph" << endl;
+			exit(-1);
+		}
+		cout << "Reading in static decoding graph from file: " << config.crf_static_graph << endl;
+		static_graph = new CRF_StaticGraph();
+		if (!static_graph->Read(config.crf_static_graph)) {
+			cerr << "ERROR: Failed opening file: " << config.crf_static_graph << endl;
+			exit(-1);
+		}
+		log_msg("Static graph: "+stringify(static_graph->getNumStates())+" states, "+
+				stringify(static_graph->getNumArcs())+" arcs");
+	}
+
     ftrmaptype trn_ftrmap = STDSTATE;
 
 	if (strcmp(config.crf_featuremap,"stdtrans")==0) { trn_ftrmap=STDTRANS;}
@@ -929,7 +1033,7 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr1_width, (size_t) config.ftr1_ftr_start, (size_t) config.ftr1_ftr_count,
 							config.window_extent, config.ftr1_window_offset, config.ftr1_window_len,
 							config.ftr1_left_context_len, config.ftr1_right_context_len, config.ftr1_extract_seg_ftr,
-							config.ftr1_use_boundary_delta_ftr,
+							config.ftr1_use_boundary_delta_ftr, config.ftr1_use_kl_ftr,
 							config.ftr1_delta_order, config.ftr1_delta_win,
 							config.crf_eval_range, 0,
 							NULL,0,0,0,SEQUENTIAL);
@@ -938,7 +1042,7 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr2_width, (size_t) config.ftr2_ftr_start, (size_t) config.ftr2_ftr_count,
 							config.window_extent, config.ftr2_window_offset, config.ftr2_window_len,
 							config.ftr2_left_context_len, config.ftr2_right_context_len, config.ftr2_extract_seg_ftr,
-							config.ftr2_use_boundary_delta_ftr,
+							config.ftr2_use_boundary_delta_ftr, config.ftr2_use_kl_ftr,
 							config.ftr2_delta_order, config.ftr2_delta_win,
 							config.crf_eval_range, 0,
 							NULL,0,0,0,SEQUENTIAL);
@@ -949,7 +1053,7 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr3_width, (size_t) config.ftr3_ftr_start, (size_t) config.ftr3_ftr_count,
 							config.window_extent, config.ftr3_window_offset, config.ftr3_window_len,
 							config.ftr3_left_context_len, config.ftr3_right_context_len, config.ftr3_extract_seg_ftr,
-							config.ftr3_use_boundary_delta_ftr,
+							config.ftr3_use_boundary_delta_ftr, config.ftr3_use_kl_ftr,
 							config.ftr3_delta_order, config.ftr3_delta_win,
 							config.crf_eval_range, 0,
 							NULL,0,0,0,SEQUENTIAL);
@@ -1013,6 +1117,59 @@ int main(int argc, const char* argv[]) {
 		cerr << "ERROR: Failed opening file: " << config.weight_file << endl;
 		exit(-1);
 	}
+	if (config.crf_sparse_weights && !my_crf.setSparseScoring()) {
+		cerr << "WARNING: crf_sparse_weights is not supported by feature map " << config.crf_featuremap
+				<< ", scoring with all the weights" << endl;
+	}
+	if (config.crf_quant_bits != 0 && config.crf_quant_bits != 8 && config.crf_quant_bits != 16) {
+		cerr << "ERROR: crf_quant_bits must be 0, 8 or 16" << endl;
+		exit(-1);
+	}
+	if (config.crf_quant_out != NULL) {
+		if (config.crf_quant_bits == 0) {
+			cerr << "ERROR: crf_quant_out needs crf_quant_bits set to 8 or 16" << endl;
+			exit(-1);
+		}
+		if (!my_crf.writeQuantizedToFile(config.crf_quant_out,config.crf_quant_bits)) {
+			cerr << "ERROR: feature map " << config.crf_featuremap << " does not support quantized weights" << endl;
+			exit(-1);
+		}
+		cout << "Quantized weights written to " << config.crf_quant_out << endl;
+		exit(0);
+	}
+	// weights read from a quantized file are scored quantized at their own size by default
+	int quant_bits=config.crf_quant_bits;
+	if (quant_bits == 0) {
+		quant_bits=my_crf.getFileQuantBits();
+	}
+	if (quant_bits != 0) {
+		if (my_crf.setQuantizedScoring(quant_bits)) {
+			CRF_QuantizedWeights* qw=my_crf.getQuantizedWeights();
+			cout << "Scoring with " << quant_bits << " bit weights: " << qw->getBytes()
+					<< " bytes, largest weight error " << qw->getMaxError(my_crf.getLambda()) << endl;
+		}
+		else {
+			cerr << "WARNING: crf_quant_bits is not supported by feature map " << config.crf_featuremap
+					<< ", scoring with the double weights" << endl;
+		}
+	}
+
+	if (config.crf_mem_estimate) {
+		QNUInt32 max_frames=config.crf_mem_max_frames;
+		if (max_frames == 0) {
+			max_frames=find_max_frames(crf_ftr_str);
+		}
+		if (max_frames == 0) {
+			cerr << "ERROR: the length of the utterances cannot be read from the feature files, set crf_mem_max_frames" << endl;
+			exit(-1);
+		}
+		CRF_MemEstimator estimator(&my_crf,str1.getNumFtrs(),max_frames);
+		cout << "Memory estimate: threads=1 longest=" << max_frames << " frames "
+				<< CRF_MemEstimator::format(estimator.estimateDecoding(1)) << endl;
+		if (config.crf_mem_estimate == 2) {
+			return 0;
+		}
+	}
 
 	// just for debugging
 	//cout << "Before processing segments..." << endl;
@@ -1030,6 +1187,86 @@ int main(int argc, const char* argv[]) {
 	int count=0;
 	QN_Range eval_sent_range(config.crf_eval_range);
 	QN_Range::iterator eval_sent_range_iter = eval_sent_range.begin();
+
+	// per-thread decode context, holding the node list and the output lattices
+	// of the decoder across utterances.
+	CRF_DecodeContext* decode_ctx = new CRF_DecodeContext();
+
+	// Changed by Ryan, for segmental CRFs
+	////////////////////////////////////
+	// the frame-level viterbi decoder
+	////////////////////////////////////
+////	CRF_ViterbiDecoder* vd = new CRF_ViterbiDecoder(crf_ftr_str,&my_crf);
+	////////////////////////////////////
+	// the segmental viterbi decoder
+	////////////////////////////////////
+	if (my_crf.getModelType() != STDFRAME &&
+			my_crf.getModelType() != STDSEG_NO_DUR_NO_SEGTRANSFTR)
+	{
+		string errstr="main() in CRFFstDecode caught exception: "
+				"CRF_ViterbiDecoder for CRF models other than \"stdframe\" "
+				"and \"stdseg_no_dur_no_segtransftr\" have not been implmented.";
+		throw runtime_error(errstr);
+	}
+	// the node class of the decoder depends on crf_decode_search.
+	CRF_StdSegViterbiDecoder* vd = NULL;
+	if (strcmp(config.crf_decode_search,"prunetrans")==0) {
+		/////////////////////////////////////////////////////////////
+		// the segmental viterbi decoder with transition arc pruned
+		/////////////////////////////////////////////////////////////
+		vd = new CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode_PruneTrans>(crf_ftr_str,&my_crf,decode_ctx);
+		vd->setTransBeam(config.crf_decode_trans_beam);
+		vd->setIfOutputFullFst(config.crf_if_output_full_lat);
+	}
+	else if (strcmp(config.crf_decode_search,"std")==0) {
+		if (config.crf_decode_trans_beam > 0.0) {
+			cerr << "ERROR: crf_decode_trans_beam requires crf_decode_search=prunetrans" << endl;
+			exit(-1);
+		}
+		vd = new CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>(crf_ftr_str,&my_crf,decode_ctx);
+		vd->setIfOutputFullFst(config.crf_if_output_full_lat);
+	}
+	else {
+		cerr << "ERROR: unknown crf_decode_search: " << config.crf_decode_search << endl;
+		exit(-1);
+	}
+
+
+	// adaptive beam, steered by crf_decode_hyp_inc towards the hypothesis count and/or
+	// real-time factor targets
+	CRF_BeamController* beam_ctrl = NULL;
+	if (config.crf_decode_target_hyp > 0 || config.crf_decode_target_rtf > 0.0) {
+		if (config.crf_decode_beam <= 0.0) {
+			cerr << "ERROR: crf_decode_beam must be > 0 when an adaptive beam target is set" << endl;
+			exit(-1);
+		}
+		beam_ctrl = new CRF_BeamController(config.crf_decode_beam, config.crf_decode_target_hyp,
+				config.crf_decode_target_rtf, config.crf_decode_hyp_inc);
+		vd->setBeamController(beam_ctrl);
+	}
+
+	// the token passing decoder over the static graph, if one is given
+	CRF_TokenPassDecoder* td = NULL;
+	if (static_graph != NULL) {
+		td = new CRF_TokenPassDecoder(crf_ftr_str,&my_crf,static_graph,decode_ctx);
+	}
+
+	// lattice archives, one file for the lattices of all utterances
+	CRF_LatticeArchiveWriter* fst_archive = NULL;
+	CRF_LatticeArchiveWriter* htk_archive = NULL;
+	if (config.crf_lat_archive != NULL) {
+		fst_archive = new CRF_LatticeArchiveWriter();
+		fst_archive->open(config.crf_lat_archive, config.crf_lat_archive_compress);
+	}
+	if (config.htk_lat_archive != NULL) {
+		htk_archive = new CRF_LatticeArchiveWriter();
+		htk_archive->open(config.htk_lat_archive, config.crf_lat_archive_compress);
+	}
+
+	// search totals over the test set, for comparing beam settings
+	double search_secs = 0.0;
+	double search_frames = 0.0, search_kept = 0.0, search_trans_pruned = 0.0;
+
 	while (segid != QN_SEGID_BAD) {
 		if (count %100 == 0) {
 			cout << "Processing segment " << count << endl;
@@ -1053,51 +1290,16 @@ int main(int argc, const char* argv[]) {
 			time1[strlen(time1)-1]='\0';
 			log_msg(time1);
 
-			// Changed by Ryan, for segmental CRFs
-			////////////////////////////////////
-			// the frame-level viterbi decoder
-			////////////////////////////////////
-////			CRF_ViterbiDecoder* vd = new CRF_ViterbiDecoder(crf_ftr_str,&my_crf);
-			////////////////////////////////////
-			// the segmental viterbi decoder
-			////////////////////////////////////
-			CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>* vd;
-			if (my_crf.getModelType() == STDFRAME ||
-					my_crf.getModelType() == STDSEG_NO_DUR_NO_SEGTRANSFTR)
-			{
-				vd = new CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode>(crf_ftr_str,&my_crf);
-			}
-			else
-			{
-				string errstr="main() in CRFFstDecode caught exception: "
-						"CRF_ViterbiDecoder for CRF models other than \"stdframe\" "
-						"and \"stdseg_no_dur_no_segtransftr\" have not been implmented.";
-				throw runtime_error(errstr);
-			}
-			/////////////////////////////////////////////////////////////
-			// the segmental viterbi decoder with transition arc pruned
-			/////////////////////////////////////////////////////////////
-//			CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode_PruneTrans>* vd;
-//			if (my_crf.getModelType() == STDFRAME ||
-//					my_crf.getModelType() == STDSEG_NO_DUR_NO_SEGTRANSFTR)
-//			{
-//				vd = new CRF_ViterbiDecoder_StdSeg_NoSegTransFtr<CRF_ViterbiNode_PruneTrans>(crf_ftr_str,&my_crf);
-//			}
-//			else
-//			{
-//				string errstr="main() in CRFFstDecode caught exception: "
-//						"CRF_ViterbiDecoder for CRF models other than \"stdframe\" "
-//						"and \"stdseg_no_dur_no_segtransftr\" have not been implmented.";
-//				throw runtime_error(errstr);
-//			}
-
-			vd->setIfOutputFullFst(config.crf_if_output_full_lat);
-
-			VectorFst<StdArc>* best_lat=new VectorFst<StdArc>();
+			// the decoder and its decode context are created once before the loop and
+			// reused for every utterance, reset() keeps their buffers.
+			decode_ctx->reset();
+			CRF_MemStats::startUtterance();
+
+			VectorFst<StdArc>* best_lat=decode_ctx->getBestLat();
 
 			// Added by Ryan
 			// the fully composed lattice, including acoustic model, dictionary, and language model.
-			VectorFst<StdArc>* out_full_lat = new VectorFst<StdArc>();
+			VectorFst<StdArc>* out_full_lat = decode_ctx->getFullLat();
 
 			// just for debugging
 			//cout << "Before nStateDecode ..." << endl;
@@ -1107,14 +1309,48 @@ int main(int argc, const char* argv[]) {
 //			int nodeCnt=vd->nStateDecode(best_lat,lm_fst,config.crf_decode_beam,config.crf_decode_min_hyp,
 //					config.crf_decode_max_hyp,config.crf_decode_hyp_inc);
 			// for CRF_ViterbiDecoder_StdSeg_NoSegTransFtr
-			int nodeCnt=vd->nStateDecode(best_lat,lm_fst,out_full_lat,
-					config.crf_decode_beam,config.crf_decode_min_hyp,
-					config.crf_decode_max_hyp,config.crf_decode_hyp_inc);
+			int nodeCnt;
+			if (td != NULL) {
+				nodeCnt=td->decode(best_lat,config.crf_decode_beam);
+			}
+			else {
+				struct timeval search_start, search_end;
+				gettimeofday(&search_start, NULL);
+				nodeCnt=vd->nStateDecode(best_lat,lm_fst,out_full_lat,
+						config.crf_decode_beam,config.crf_decode_min_hyp,
+						config.crf_decode_max_hyp,config.crf_decode_hyp_inc);
+				gettimeofday(&search_end, NULL);
+				search_secs += (search_end.tv_sec - search_start.tv_sec) +
+						(search_end.tv_usec - search_start.tv_usec) / 1e6;
+
+				const vector<CRF_FrameStats>& frame_stats = vd->getFrameStats();
+				if (frame_stats.size() > 0) {
+					double sum_active = 0.0, sum_kept = 0.0, sum_trans_pruned = 0.0;
+					uint max_kept = 0;
+					for (uint i = 0; i < frame_stats.size(); i++) {
+						sum_active += frame_stats[i].numActive;
+						sum_kept += frame_stats[i].numKept;
+						sum_trans_pruned += frame_stats[i].numTransPruned;
+						if (frame_stats[i].numKept > max_kept) { max_kept = frame_stats[i].numKept; }
+					}
+					log_msg("*	*Active hypotheses per frame: "+stringify(sum_active / frame_stats.size())+
+							" before pruning, "+stringify(sum_kept / frame_stats.size())+" kept (max "+
+							stringify(max_kept)+"), "+stringify(sum_trans_pruned / frame_stats.size())+
+							" transition arcs pruned");
+					search_frames += frame_stats.size();
+					search_kept += sum_kept;
+					search_trans_pruned += sum_trans_pruned;
+				}
+			}
 
 			// just for debugging
 			//cout << "After nStateDecode ..." << endl;
 
-			if (config.crf_lat_outdir != NULL) {
+			// Changed by Ryan
+			// output the fully-composed lattice, or only the best lattice
+			VectorFst<StdArc>* out_lat = config.crf_if_output_full_lat ? out_full_lat : best_lat;
+
+			if (config.crf_lat_outdir != NULL || fst_archive != NULL) {
 				// Put code here to dump the lattice file out to the latdir in
 				// OpenFst format
 				//string fst_fname = string(config.crf_lat_outdir) + "/" + olist.at(count) + ".fst";
@@ -1123,53 +1359,46 @@ int main(int argc, const char* argv[]) {
 							"eval sentence range goes out of the olist size.";
 					throw runtime_error(errstr);
 				}
-				string fst_fname = string(config.crf_lat_outdir) + "/" + olist.at(*eval_sent_range_iter) + ".fst";
-				log_msg("*	*Writing FST lattice to "+fst_fname);
-
-				// Changed by Ryan
-				// output the fully-composed lattice
-				if (config.crf_if_output_full_lat)
-				{
-					out_full_lat->Write(fst_fname);
+				string utt_name = olist.at(*eval_sent_range_iter);
+				if (config.crf_lat_outdir != NULL) {
+					string fst_fname = string(config.crf_lat_outdir) + "/" + utt_name + ".fst";
+					log_msg("*	*Writing FST lattice to "+fst_fname);
+					out_lat->Write(fst_fname);
 				}
-				// only output the best lattice
-				else
-				{
-					best_lat->Write(fst_fname);
+				if (fst_archive != NULL) {
+					log_msg("*	*Adding FST lattice "+utt_name+" to "+config.crf_lat_archive);
+					fst_archive->addFst(utt_name, *out_lat);
 				}
 			}
 
 			// Added by Ryan
 			// dump the lattice file out to the htk_lat_outdir in HTK SLF format
-			if (config.htk_lat_outdir != NULL) {
+			if (config.htk_lat_outdir != NULL || htk_archive != NULL) {
 				if (*eval_sent_range_iter >= olist.size()) {
 					string errstr="main() in CRFDecode caught exception: "
 							"eval sentence range goes out of the olist size.";
 					throw runtime_error(errstr);
 				}
 				string utt_name = olist.at(*eval_sent_range_iter);
-				//string slf_fname = string(config.htk_lat_outdir) + "/" + olist.at(count) + ".slf";
-				string slf_fname = string(config.htk_lat_outdir) + "/" + utt_name + ".slf";
-				log_msg("*	*Writing HTK lattice to " + slf_fname);
-
-				// output the fully-composed lattice
-				if (config.crf_if_output_full_lat)
-				{
-					FST2HTK_lat fst2htk_lat_converter;
-					fst2htk_lat_converter.convert(*out_full_lat);
+				FST2HTK_lat fst2htk_lat_converter;
+				fst2htk_lat_converter.convert(*out_lat);
+				if (config.htk_lat_outdir != NULL) {
+					//string slf_fname = string(config.htk_lat_outdir) + "/" + olist.at(count) + ".slf";
+					string slf_fname = string(config.htk_lat_outdir) + "/" + utt_name + ".slf";
+					log_msg("*	*Writing HTK lattice to " + slf_fname);
 					fst2htk_lat_converter.Write(slf_fname, utt_name, oSymTab);
 				}
-				// only output the best lattice
-				else
-				{
-					FST2HTK_lat fst2htk_lat_converter;
-					fst2htk_lat_converter.convert(*best_lat);
-					fst2htk_lat_converter.Write(slf_fname, utt_name, oSymTab);
+				if (htk_archive != NULL) {
+					log_msg("*	*Adding HTK lattice "+utt_name+" to "+config.htk_lat_archive);
+					ostringstream slf_stream;
+					fst2htk_lat_converter.Write(slf_stream, utt_name, oSymTab);
+					string slf = slf_stream.str();
+					htk_archive->add(utt_name, slf.data(), slf.size());
 				}
 			}
 
 			if (config.crf_output_mlffile != NULL) {
-				VectorFst<StdArc>* shortest_fst = new VectorFst<StdArc>();
+				VectorFst<StdArc>* shortest_fst = decode_ctx->getShortestLat();
 				log_msg("Finding Shortest Path");
 
 				// Changed by Ryan
@@ -1354,7 +1583,6 @@ int main(int argc, const char* argv[]) {
 					mlfstream << "." << endl;
 					cout << "." << endl;
 				}
-				delete shortest_fst;
 			}
 
 			time(&rawtime);
@@ -1362,11 +1590,11 @@ int main(int argc, const char* argv[]) {
 			time2[strlen(time2)-1]='\0';
 			log_msg(time2);
 
-			delete best_lat;
-			delete vd;
-
-			// Added by Ryan
-			delete out_full_lat;
+			if (count > 0 && decode_ctx->getAllocsSinceReset() > 0) {
+				log_msg("*	*Decode context node list grew by "+stringify(decode_ctx->getAllocsSinceReset())+" allocations");
+			}
+			decode_ctx->trackLatticeMem();
+			log_msg("*	*Memory high-water mark of the utterance: "+stringify(CRF_MemStats::getUtterancePeak()/1048576.0)+" MB");
 		}
 		catch (exception &e) {
 			cerr << "Exception: " << e.what() << endl;
@@ -1376,6 +1604,33 @@ int main(int argc, const char* argv[]) {
 		count++;
 		++eval_sent_range_iter;
 	}
+	cout << "Decode context: " << decode_ctx->getNumResets() << " utterances, "
+			<< decode_ctx->getSteadyStateAllocs() << " node list allocations after the first utterance"
+			<< " (lattices and backtrack tables not counted)" << endl;
+	cout << "Memory: " << CRF_MemStats::report() << endl;
+	if (search_frames > 0) {
+		// one line per run, collected by demo/scrf-scripts/sweep_decode_beams.sh
+		cout << "Search summary: search=" << config.crf_decode_search << " beam=" << config.crf_decode_beam
+				<< " trans_beam=" << config.crf_decode_trans_beam << " frames=" << search_frames
+				<< " secs=" << search_secs << " frames_per_sec=" << (search_frames / search_secs)
+				<< " kept_per_frame=" << (search_kept / search_frames)
+				<< " trans_pruned_per_frame=" << (search_trans_pruned / search_frames) << endl;
+	}
+	if (fst_archive != NULL) {
+		fst_archive->close();
+		cout << "Wrote " << fst_archive->getNumEntries() << " lattices to " << config.crf_lat_archive << endl;
+	}
+	if (htk_archive != NULL) {
+		htk_archive->close();
+		cout << "Wrote " << htk_archive->getNumEntries() << " lattices to " << config.htk_lat_archive << endl;
+	}
+	delete fst_archive;
+	delete htk_archive;
+	delete vd;
+	delete beam_ctrl;
+	delete td;
+	delete static_graph;
+	delete decode_ctx;
 	delete lm_fst;
 
 };
@@ -13,6 +13,10 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <deque>
+#include <sstream>
+#include <pthread.h>
+#include <sys/time.h>
 #include "CRF.h"
 #include "CRF_Model.h"
 #include "io/CRF_FeatureStream.h"
@@ -20,10 +24,11 @@
 #include "ftrmaps/CRF_StdFeatureMap.h"
 #include "ftrmaps/CRF_StdSparseFeatureMap.h"
 #include "decoders/CRF_LatticeBuilder.h"
-#include "decoders/CRF_LatticeBuilder_StdSeg.h"
-#include "decoders/CRF_LatticeBuilder_StdSeg_WithoutDurLab.h"
-#include "decoders/CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr.h"
+#include "decoders/CRF_DecodeContext.h"
+#include "decoders/CRF_StaticGraph.h"
+#include "decoders/CRF_TokenPassDecoder.h"
 #include "io/CRF_MLFManager.h"
+#include "io/CRF_LatticeArchive.h"
 
 
 using namespace std;
@@ -51,6 +56,7 @@ static struct {
 	int ftr1_right_context_len;
 	bool ftr1_extract_seg_ftr;
 	bool ftr1_use_boundary_delta_ftr;
+	bool ftr1_use_kl_ftr;
 
 	char* ftr2_file;
 	char* ftr2_format;
@@ -67,6 +73,7 @@ static struct {
 	int ftr2_right_context_len;
 	bool ftr2_extract_seg_ftr;
 	bool ftr2_use_boundary_delta_ftr;
+	bool ftr2_use_kl_ftr;
 
 	char* ftr3_file;
 	char* ftr3_format;
@@ -83,6 +90,7 @@ static struct {
 	int ftr3_right_context_len;
 	bool ftr3_extract_seg_ftr;
 	bool ftr3_use_boundary_delta_ftr;
+	bool ftr3_use_kl_ftr;
 
 	int train_sent_start;
 	int train_sent_count;
@@ -99,6 +107,7 @@ static struct {
 	int crf_mlf_output_frames;
 	int crf_mlf_output_states;
 	char* crf_align_mlffile;
+	char* crf_align_mlf_store_out;
 	char* crf_eval_range;
 	char* crf_decode_mode;
 	char* crf_featuremap;
@@ -122,6 +131,8 @@ static struct {
 	char* crf_osymbols;
 	char* crf_olist;
 	char* crf_lat_outdir;
+	char* crf_lat_archive;
+	int crf_lat_archive_compress;
 	float crf_pre_phn_wt;
 	float crf_phn_wt;
 	float crf_dict_wt;
@@ -129,6 +140,15 @@ static struct {
 	float crf_trans_thresh;
 	float crf_pruning_thresh;
 	int crf_self_window;
+	int crf_lat_threads;
+	int crf_fst_threads;
+	int crf_decode_integrated;
+	char* crf_static_graph;
+	float crf_decode_beam;
+	int crf_decode_max_tokens;
+	int crf_sparse_weights;
+	int crf_quant_bits;
+	char* crf_quant_out;
 	int verbose;
 	int dummy;
 
@@ -160,6 +180,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr1_right_context_len", "Length of context features to the right of the window on ftr1_file (frames)", QN_ARG_INT, &(config.ftr1_right_context_len) },
 	{ "ftr1_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr1_extract_seg_ftr) },
 	{ "ftr1_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr1_use_boundary_delta_ftr) },
+	{ "ftr1_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr1_use_kl_ftr) },
 
 	{ "ftr2_file", "Input feature file", QN_ARG_STR, &(config.ftr2_file) },
 	{ "ftr2_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr2_format) },
@@ -176,6 +197,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr2_right_context_len", "Length of context features to the right of the window on ftr2_file (frames)", QN_ARG_INT, &(config.ftr2_right_context_len) },
 	{ "ftr2_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr2_extract_seg_ftr) },
 	{ "ftr2_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr2_use_boundary_delta_ftr) },
+	{ "ftr2_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr2_use_kl_ftr) },
 
 	{ "ftr3_file", "Input feature file", QN_ARG_STR, &(config.ftr3_file) },
 	{ "ftr3_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr3_format) },
@@ -192,6 +214,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr3_right_context_len", "Length of context features to the right of the window on ftr3_file (frames)", QN_ARG_INT, &(config.ftr3_right_context_len) },
 	{ "ftr3_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr3_extract_seg_ftr) },
 	{ "ftr3_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr3_use_boundary_delta_ftr) },
+	{ "ftr3_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr3_use_kl_ftr) },
 
 	{ "window_extent", "Extent of all windows (frames)", QN_ARG_INT, &(config.window_extent) },
 	{ "hardtarget_file", "Target Label File", QN_ARG_STR, &(config.hardtarget_file) },
@@ -204,6 +227,7 @@ QN_ArgEntry argtab[] =
 	{ "crf_output_labelfile", "Output label file name", QN_ARG_STR, &(config.crf_output_labelfile) },
 	{ "crf_output_mlffile", "Output MLF file name", QN_ARG_STR, &(config.crf_output_mlffile) },
 	{ "crf_align_mlffile", "Target MLF filename for word alignment", QN_ARG_STR, &(config.crf_align_mlffile) },
+	{ "crf_align_mlf_store_out", "Write the alignment MLF to this file as a compiled transcript store", QN_ARG_STR, &(config.crf_align_mlf_store_out) },
 	{ "crf_mlf_output_frames", "Output frame timings to MLF", QN_ARG_BOOL, &(config.crf_mlf_output_frames) },
 	{ "crf_mlf_output_states", "Output state labels to MLF", QN_ARG_BOOL, &(config.crf_mlf_output_states) },
 	{ "crf_eval_range", "Range of utterances to evaluate", QN_ARG_STR, &(config.crf_eval_range), QN_ARG_REQ },
@@ -227,6 +251,8 @@ QN_ArgEntry argtab[] =
 	{ "crf_osymbols", "Output symbols file name (in OpenFST format)", QN_ARG_STR, &(config.crf_osymbols) },
     { "crf_olist", "Ordered list of output labels (for MLF)", QN_ARG_STR, &(config.crf_olist) },
 	{ "crf_lat_outdir", "Output directory for lattice files (in OpenFST binary format)", QN_ARG_STR, &(config.crf_lat_outdir) },
+	{ "crf_lat_archive", "Output lattice archive for all lattices (in OpenFST binary format), keyed fst.<count>.final", QN_ARG_STR, &(config.crf_lat_archive) },
+	{ "crf_lat_archive_compress", "Compress the lattices in crf_lat_archive", QN_ARG_BOOL, &(config.crf_lat_archive_compress) },
 	{ "crf_pre_phn_wt", "Pruning weight for pre-phone lattice processing", QN_ARG_FLOAT, &(config.crf_pre_phn_wt) },
 	{ "crf_phn_wt", "Pruning weight for post phone lattice processing", QN_ARG_FLOAT, &(config.crf_phn_wt) },
 	{ "crf_dict_wt", "Pruning weight for post dictionary lattice processing", QN_ARG_FLOAT, &(config.crf_dict_wt) },
@@ -234,6 +260,15 @@ QN_ArgEntry argtab[] =
 	{ "crf_trans_thresh","Delta minimum to allow a transition", QN_ARG_FLOAT, &(config.crf_trans_thresh) },
 	{ "crf_self_window","Maximum window size to allow a self loop", QN_ARG_INT, &(config.crf_self_window) },
 	{ "crf_pruning_thresh","Delta minimum to allow a transition", QN_ARG_FLOAT, &(config.crf_pruning_thresh) },
+	{ "crf_lat_threads", "Number of threads building lattices (pipelined decoding if either thread count is above 1)", QN_ARG_INT, &(config.crf_lat_threads) },
+	{ "crf_decode_integrated", "Decode by token passing over the composed phone/dict/LM graph instead of building and composing lattices (stdseg_no_dur_no_segtransftr models with crf_states=1 only)", QN_ARG_BOOL, &(config.crf_decode_integrated) },
+	{ "crf_static_graph", "Compiled decoding graph file name (from CRFGraphCompile) for crf_decode_integrated, composed from crf_phn_bin/crf_dict_bin/crf_lm_bin if not given", QN_ARG_STR, &(config.crf_static_graph) },
+	{ "crf_decode_beam", "Beam width for pruning with crf_decode_integrated (0 for none)", QN_ARG_FLOAT, &(config.crf_decode_beam) },
+	{ "crf_decode_max_tokens", "Maximum number of tokens kept per frame with crf_decode_integrated (0 for no limit, the active tokens are then bounded by crf_decode_beam only)", QN_ARG_INT, &(config.crf_decode_max_tokens) },
+	{ "crf_fst_threads", "Number of threads composing and pruning lattices (pipelined decoding if either thread count is above 1)", QN_ARG_INT, &(config.crf_fst_threads) },
+	{ "crf_sparse_weights", "Skip the zero weights when scoring (for weights trained with crf_l1)", QN_ARG_BOOL, &(config.crf_sparse_weights) },
+	{ "crf_quant_bits", "Score with the feature weights quantized to 8 or 16 bits (0 = off); weights read from a quantized file are used quantized at their own size if this is 0", QN_ARG_INT, &(config.crf_quant_bits) },
+	{ "crf_quant_out", "Write the weights quantized to crf_quant_bits bits to this file and exit", QN_ARG_STR, &(config.crf_quant_out) },
 	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
 
 	//Added by Ryan, for segmental CRFs
@@ -263,6 +298,7 @@ static void set_defaults(void) {
 	config.ftr1_right_context_len=0;
 	config.ftr1_extract_seg_ftr=false;
 	config.ftr1_use_boundary_delta_ftr=false;
+	config.ftr1_use_kl_ftr=false;
 
 	config.ftr2_file="";
 	config.ftr2_format="pfile";
@@ -279,6 +315,7 @@ static void set_defaults(void) {
 	config.ftr2_right_context_len=0;
 	config.ftr2_extract_seg_ftr=false;
 	config.ftr2_use_boundary_delta_ftr=false;
+	config.ftr2_use_kl_ftr=false;
 
 	config.ftr3_file="";
 	config.ftr3_format="pfile";
@@ -295,6 +332,7 @@ static void set_defaults(void) {
 	config.ftr3_right_context_len=0;
 	config.ftr3_extract_seg_ftr=false;
 	config.ftr3_use_boundary_delta_ftr=false;
+	config.ftr3_use_kl_ftr=false;
 
 	config.window_extent=1;
 	config.hardtarget_file="";
@@ -305,6 +343,7 @@ static void set_defaults(void) {
 	config.crf_output_labelfile=NULL;
 	config.crf_output_mlffile=NULL;
 	config.crf_align_mlffile=NULL;
+	config.crf_align_mlf_store_out=NULL;
 	config.crf_mlf_output_frames=0;
 	config.crf_mlf_output_states=0;
 	config.crf_eval_range=NULL;
@@ -330,6 +369,8 @@ static void set_defaults(void) {
 	config.crf_osymbols=NULL;
 	config.crf_olist=NULL;
 	config.crf_lat_outdir=NULL;
+	config.crf_lat_archive=NULL;
+	config.crf_lat_archive_compress=0;
 	config.crf_phn_wt=0;
 	config.crf_pre_phn_wt=0;
 	config.crf_dict_wt=0;
@@ -337,6 +378,15 @@ static void set_defaults(void) {
 	config.crf_trans_thresh=0;
 	config.crf_pruning_thresh=0;
 	config.crf_self_window=0;
+	config.crf_lat_threads=1;
+	config.crf_fst_threads=1;
+	config.crf_decode_integrated=0;
+	config.crf_static_graph=NULL;
+	config.crf_decode_beam=0.0;
+	config.crf_decode_max_tokens=0;
+	config.crf_sparse_weights=0;
+	config.crf_quant_bits=0;
+	config.crf_quant_out=NULL;
 	config.verbose=0;
 
 	//Added by Ryan, for segmental CRFs
@@ -416,6 +466,717 @@ void log_errmsg(string errstr) {
 	}
 }
 
+/*
+ * Returns the number of seconds since start
+ */
+static double elapsed_seconds(const struct timeval& start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+/*
+ * Phone, dictionary and LM fsts the lattices are composed with.  Every post-processing
+ * thread has its own copies: the implementations of OpenFst fsts are reference counted
+ * without locking, so one fst must not be composed from several threads at once.
+ */
+struct decode_fsts {
+	VectorFst<StdArc>* phn_fst;
+	VectorFst<StdArc>* dict_fst;
+	VectorFst<StdArc>* lm_fst;
+};
+
+/*
+ * Read-only settings and tables used to post-process the lattices
+ */
+struct decode_env {
+	bool alignMode;
+	bool mlfOut;
+	vector<string>* olist;
+	SymbolTable* iSymTab;
+	SymbolTable* oSymTab;
+	CRF_MLFManager* mlfManager;
+	pthread_mutex_t* mlfLock;	// guards the transcript cache of mlfManager, NULL when single threaded
+};
+
+/*
+ * Output of one utterance, held until it can be written in utterance order
+ */
+struct decode_result {
+	int count;
+	QN_SegID segid;
+	bool hasLabs;
+	vector<QNUInt32> labs;
+	string mlf;
+	string words;
+};
+
+/*
+ * Returns a copy of fst that shares nothing with it, NULL if fst is NULL
+ */
+static VectorFst<StdArc>* copy_fst(VectorFst<StdArc>* fst) {
+	if (fst == NULL) {
+		return NULL;
+	}
+	return new VectorFst<StdArc>(static_cast<const Fst<StdArc>&>(*fst));
+}
+
+/*
+ * Post-processes the lattice of utterance count: finds the label sequence for the ilab
+ * output and runs the phone/dictionary/LM composition and pruning chain for the MLF
+ * output.  Nothing is written; the output is left in res.
+ */
+static void process_lattice(int count, VectorFst<StdArc>* phn_lat, VectorFst<StdArc>* lab_lat,
+		decode_fsts* fsts, decode_env* env, decode_result* res) {
+	res->hasLabs=false;
+	if (config.crf_output_labelfile != NULL) {
+		// Write the output to an ilab file in Quicknet format
+		VectorFst<StdArc>* shortest_fst = new VectorFst<StdArc>();
+		if (env->alignMode) {
+			ComposeFst<StdArc>* result=new ComposeFst<StdArc>(*phn_lat,*lab_lat);
+			ShortestPath(*result,shortest_fst,1);
+			delete result;
+			Project(shortest_fst,PROJECT_OUTPUT);
+			RmEpsilon(shortest_fst);
+			TopSort(shortest_fst);
+		}
+		else {
+			ShortestPath(*phn_lat,shortest_fst,1);
+			Project(shortest_fst,PROJECT_OUTPUT);
+			RmEpsilon(shortest_fst);
+			TopSort(shortest_fst);
+		}
+
+		// Commented by Ryan
+		// since the label of the arc linking the last frame node to
+		// the final state node is epsilon, the final state is removed
+		// after the epsilon removal above, "RmEpsilon(shortest_fst);".
+		// So num_labels = shortest_fst->NumStates() - 1,
+		// instead of shortest_fst->NumStates() - 2.
+		QNUInt32 num_labels = shortest_fst->NumStates() - 1;
+		res->labs.resize(num_labels);
+		//	Iterates over the FSTs states.
+		QNUInt32 frm_no=0;
+		for (StateIterator<StdFst> siter(*shortest_fst); !siter.Done(); siter.Next())
+		{
+			StateId state_id = siter.Value();
+
+			//Iterates over state state_id's arcs.
+			for (ArcIterator<StdFst> aiter(*shortest_fst, state_id); !aiter.Done(); aiter.Next())
+			{
+				const StdArc &arc = aiter.Value();
+				res->labs[frm_no]=arc.olabel-1;
+				frm_no++;
+			}
+		}
+		res->hasLabs=true;
+		delete shortest_fst;
+	}
+
+	if (config.crf_output_mlffile != NULL) {
+		//Write the output to an HTK style MLF file
+		//Note that this code is currently experimental, and the ilab output above
+		// is generally preferred for output
+		ostringstream mlfstream;
+		ostringstream words;
+		bool findShortest=true;
+		Fst<StdArc>* working_fst=phn_lat;
+		log_msg("States in pre-phn lattice: "+stringify(((VectorFst<StdArc>*)working_fst)->NumStates()));
+		if (fsts->phn_fst != NULL ) {
+			log_msg("Lazily composing with phone penalty lattice...");
+			ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(*working_fst,*fsts->phn_fst);
+			if (working_fst!=phn_lat) { delete working_fst;}
+			working_fst=composed_fst;
+			log_msg("Mapping to log ring");
+			VectorFst<LogArc>* mapped_fst = new VectorFst<LogArc>();
+			Map(*working_fst,mapped_fst,StdToLogMapper());
+			log_msg("Removing epsilons");
+			RmEpsilon(mapped_fst);
+			log_msg("States in phn lattice: "+stringify(mapped_fst->NumStates()));
+			log_msg("Mapping back to tropic ring");
+			VectorFst<StdArc>* unmapped_fst = new VectorFst<StdArc>();
+			Map(*mapped_fst,unmapped_fst,LogToStdMapper());
+			if (working_fst!=phn_lat) { delete working_fst;}
+			working_fst=unmapped_fst;
+			delete mapped_fst;
+			if (config.crf_phn_wt != 0) {
+				log_msg("Initial pass of pruning with weight "+stringify(config.crf_phn_wt));
+				VectorFst<StdArc>* pruned_fst = new VectorFst<StdArc>();
+				Prune(*working_fst,pruned_fst,config.crf_phn_wt);
+				if (working_fst != phn_lat) { delete working_fst; }
+				working_fst=pruned_fst;
+
+				log_msg("States in phn lattice following pruning: "+stringify(pruned_fst->NumStates()));
+
+				log_msg("Minimizing phn lattice");
+				Minimize(pruned_fst);
+				log_msg("States in phn lattice following pruning: "+stringify(pruned_fst->NumStates()));
+			}
+		}
+
+		if (fsts->dict_fst != NULL ) {
+			log_msg("Lazily composing with dictionary lattice...");
+			ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(*working_fst,*fsts->dict_fst);
+			if (working_fst!=phn_lat) { delete working_fst;}
+			working_fst=composed_fst;
+			if (config.crf_dict_wt != 0) {
+				log_msg("Pruning word lattice with weight "+stringify(config.crf_dict_wt));
+				VectorFst<StdArc>* pruned_fst = new StdVectorFst();
+				Prune(*composed_fst,pruned_fst,config.crf_dict_wt);
+				if (working_fst != phn_lat) { delete working_fst; }
+				working_fst=pruned_fst;
+				log_msg("States in pruned word lattice: "+stringify(((VectorFst<StdArc>*)working_fst)->NumStates()));
+			}
+		}
+		if (config.crf_align_mlffile != NULL) {
+			log_msg("Building FST for utterance "+env->olist->at(count));
+			VectorFst<StdArc>* composed_fst = new VectorFst<StdArc>();
+			if (env->mlfLock != NULL) {
+				// the transcript cache is filled on first use, take a private copy under the lock
+				pthread_mutex_lock(env->mlfLock);
+				VectorFst<StdArc>* align_fst = copy_fst((VectorFst<StdArc>*)env->mlfManager->getCachedFst(env->olist->at(count)));
+				pthread_mutex_unlock(env->mlfLock);
+				Compose(*working_fst,*align_fst,composed_fst);
+				delete align_fst;
+			}
+			else {
+				const VectorFst<StdArc>* align_fst = env->mlfManager->getCachedFst(env->olist->at(count));
+				Compose(*working_fst,*align_fst,composed_fst);
+			}
+			if (working_fst!=phn_lat) { delete working_fst;}
+			working_fst=composed_fst;
+		}
+		if (fsts->lm_fst != NULL ) {
+			time_t rawtime;
+			time(&rawtime);
+			char time1[26];
+			ctime_r(&rawtime,time1);
+			time1[strlen(time1)-1]='\0';
+			log_msg(time1);
+
+			log_msg("Composing with LM lattice...");
+			ComposeFstOptions<StdArc> options;
+			options.gc_limit = 0;
+			ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(ArcSortFst<StdArc, OLabelCompare<StdArc> >(*working_fst,OLabelCompare<StdArc>()),*fsts->lm_fst,options);
+			if (working_fst != phn_lat) { delete working_fst; }
+			working_fst=composed_fst;
+
+			VectorFst<StdArc>* shortest_fst = new StdVectorFst();
+			log_msg("Finding shortest path...");
+			ShortestPath(*working_fst,shortest_fst,1);
+
+			if (working_fst!=phn_lat) { delete working_fst;}
+			log_msg("Removing epsilons");
+			RmEpsilon(shortest_fst);
+			log_msg("Top sorting");
+			TopSort(shortest_fst);
+			working_fst=shortest_fst;
+			findShortest=false;
+		}
+		if (findShortest) {
+			VectorFst<StdArc>* shortest_fst = new VectorFst<StdArc>();
+			log_msg("Finding Shortest Path");
+			ShortestPath(*working_fst,shortest_fst,1);
+			log_msg("Removing epsilons");
+			RmEpsilon(shortest_fst);
+			log_msg("Top sorting");
+			TopSort(shortest_fst);
+			if (working_fst != phn_lat) { delete working_fst;}
+			working_fst=shortest_fst;
+		}
+
+		//	Iterates over the FSTs states.
+		if (env->mlfOut) {
+			 mlfstream << "\"" << env->olist->at(count) << "\"" << endl;
+			 words << "\"" << env->olist->at(count) << "\" : ";
+		}
+		int start=0;
+		int current=0;
+		int lastId=-1;
+		for (StateIterator<StdFst> siter(*working_fst); !siter.Done(); siter.Next())
+		{
+			StateId state_id = siter.Value();
+			//Iterates over state state_id's arcs.
+			for (ArcIterator<StdFst> aiter(*working_fst, state_id); !aiter.Done(); aiter.Next())
+			{
+				const StdArc &arc = aiter.Value();
+				if (arc.olabel == 0) {
+					if (config.crf_mlf_output_states) {
+					if (arc.ilabel != lastId) {
+						if (lastId != -1) {
+							if (config.crf_mlf_output_frames) {
+								mlfstream << start << "\t" << (current-1) << "\t";
+							}
+							mlfstream << env->iSymTab->Find(lastId) << endl;
+						}
+						lastId=arc.ilabel;
+						start=current;
+					}
+					}
+					current++;
+				}
+				else {
+				if (env->mlfOut) {
+					if (config.crf_mlf_output_frames) {
+					mlfstream << start << "\t" << (current-1) << "\t";
+					}
+					if (config.crf_mlf_output_states) {
+					mlfstream << env->iSymTab->Find(lastId) << "\t";
+					}
+					mlfstream  << env->oSymTab->Find(arc.olabel) << endl;
+					words << env->oSymTab->Find(arc.olabel) << " ";
+					start=current;
+					lastId=-1;
+				}
+				}
+			}
+		}
+		if (env->mlfOut) {
+			mlfstream << "." << endl;
+			words << "." << endl;
+		}
+		if (working_fst != phn_lat && working_fst != NULL) {
+			delete working_fst;
+		}
+		res->mlf=mlfstream.str();
+		res->words=words.str();
+	}
+}
+
+/*
+ * Writes the output of one utterance to the label and MLF files
+ */
+static void write_result(decode_result* res, QN_OutLabStream* labout, ofstream& mlfstream) {
+	if (res->hasLabs && labout != NULL) {
+		labout->write_labs(res->labs.size(),res->labs.empty()?NULL:&(res->labs[0]));
+		labout->doneseg(res->segid);
+	}
+	if (!res->mlf.empty()) {
+		mlfstream << res->mlf;
+		cout << res->words;
+	}
+}
+
+/*
+ * the lattice archive of crf_lat_archive, NULL if it is not set.  Lattice producer threads
+ * encode their lattices themselves and append them under latArchiveLock.
+ */
+static CRF_LatticeArchiveWriter* latArchive=NULL;
+static pthread_mutex_t latArchiveLock=PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Writes the lattice of utterance count to crf_lat_outdir and crf_lat_archive, if they are set
+ */
+static void write_lattice(int count, VectorFst<StdArc>* phn_lat) {
+	if (config.crf_lat_outdir != NULL) {
+		// Dump the lattice to a file in openfst format
+		string fst_fname=string(config.crf_lat_outdir)+"/fst."+stringify(count)+".final.fst";
+		log_msg("*	*Writing lattice to "+fst_fname);
+		phn_lat->Write(fst_fname);
+	}
+	if (latArchive != NULL) {
+		// same name as in crf_lat_outdir, without the .fst suffix
+		string key="fst."+stringify(count)+".final";
+		log_msg("*	*Adding lattice "+key+" to "+config.crf_lat_archive);
+		// serialize and compress in this thread, lock only to append the record
+		string data, stored;
+		QNUInt32 flags;
+		CRF_LatticeArchiveWriter::serializeFst(key,*phn_lat,data);
+		CRF_LatticeArchiveWriter::encode(key,data.data(),data.size(),latArchive->getCompress(),stored,flags);
+		pthread_mutex_lock(&latArchiveLock);
+		try {
+			latArchive->addEncoded(key,stored.data(),stored.size(),data.size(),flags);
+		}
+		catch (exception &e) {
+			pthread_mutex_unlock(&latArchiveLock);
+			throw;
+		}
+		pthread_mutex_unlock(&latArchiveLock);
+	}
+}
+
+/*
+ * Composes the phone, dictionary and LM fsts (each may be NULL) into a decoding graph for
+ * CRF_TokenPassDecoder, in the same order the lattices are composed with them.  The fsts
+ * are arc-sorted in place.
+ */
+static CRF_StaticGraph* compile_static_graph(VectorFst<StdArc>* phn_fst, VectorFst<StdArc>* dict_fst,
+		VectorFst<StdArc>* lm_fst) {
+	VectorFst<StdArc>* parts[3] = { phn_fst, dict_fst, lm_fst };
+	VectorFst<StdArc>* graph_fst=NULL;
+	for (int i=0; i<3; i++) {
+		if (parts[i] == NULL) {
+			continue;
+		}
+		if (graph_fst == NULL) {
+			graph_fst=copy_fst(parts[i]);
+			continue;
+		}
+		ArcSort(graph_fst,OLabelCompare<StdArc>());
+		ArcSort(parts[i],ILabelCompare<StdArc>());
+		VectorFst<StdArc>* composed_fst=new VectorFst<StdArc>();
+		Compose(*graph_fst,*parts[i],composed_fst);
+		Connect(composed_fst);
+		delete graph_fst;
+		graph_fst=composed_fst;
+		log_msg("States in composed graph: "+stringify(graph_fst->NumStates()));
+	}
+	if (graph_fst == NULL) {
+		cerr << "ERROR: crf_decode_integrated requires at least one of crf_phn_bin, crf_dict_bin and crf_lm_bin" << endl;
+		exit(-1);
+	}
+	CRF_StaticGraph* static_graph=new CRF_StaticGraph();
+	static_graph->compile(*graph_fst);
+	delete graph_fst;
+	return static_graph;
+}
+
+/*
+ * Turns the best path found by td for utterance count into label and MLF output.
+ *
+ * Every segment of the path gives its label to each of its frames.  An output label that
+ * the static graph moved onto a segment ends the word before that segment, and the output
+ * label on the final weight ends the last word, as for a dictionary that puts the word at
+ * the end of its pronunciation (the same assumption as the MLF output of CRFDecode).
+ */
+static void process_best_path(int count, CRF_TokenPassDecoder* td, decode_env* env, decode_result* res) {
+	const vector<CRF_TokenTrace>& path=td->getBestPath();
+	res->hasLabs=false;
+	if (config.crf_output_labelfile != NULL) {
+		res->labs.clear();
+		for (QNUInt32 i=0; i<path.size(); i++) {
+			for (QNUInt32 frm=path[i].start; frm<=path[i].end; frm++) {
+				res->labs.push_back(path[i].phn-1);
+			}
+		}
+		res->hasLabs=true;
+	}
+	if (config.crf_output_mlffile != NULL && env->mlfOut) {
+		ostringstream mlfstream;
+		ostringstream words;
+		mlfstream << "\"" << env->olist->at(count) << "\"" << endl;
+		words << "\"" << env->olist->at(count) << "\" : ";
+		int wrdStart=0;
+		for (QNUInt32 i=0; !path.empty() && i<=path.size(); i++) {
+			QNUInt32 wrd=(i < path.size())?path[i].wrd:td->getBestFinalOlabel();
+			if (wrd != 0) {
+				int wrdEnd=(i < path.size())?(int)path[i].start-1:(int)path.back().end;
+				if (config.crf_mlf_output_frames) {
+					mlfstream << wrdStart << "\t" << wrdEnd << "\t";
+				}
+				mlfstream << env->oSymTab->Find(wrd) << endl;
+				words << env->oSymTab->Find(wrd) << " ";
+				wrdStart=wrdEnd+1;
+			}
+			if (i < path.size() && config.crf_mlf_output_states) {
+				if (config.crf_mlf_output_frames) {
+					mlfstream << path[i].start << "\t" << path[i].end << "\t";
+				}
+				mlfstream << env->iSymTab->Find(path[i].phn) << endl;
+			}
+		}
+		mlfstream << "." << endl;
+		words << "." << endl;
+		res->mlf=mlfstream.str();
+		res->words=words.str();
+	}
+}
+
+/*
+ * Lattice of one utterance, passed from the lattice threads to the post-processing threads
+ */
+struct lattice_job {
+	int count;
+	QN_SegID segid;
+	VectorFst<StdArc>* phn_lat;	// NULL if the lattice could not be built
+	VectorFst<StdArc>* lab_lat;
+};
+
+/*
+ * State shared by the stages of the pipelined decoder (crf_lat_threads / crf_fst_threads).
+ *
+ * Stage 1 builds lattices on crf_lat_threads threads, each reading its own contiguous part
+ * of the utterances through a child of the feature stream manager, with its own lattice
+ * builder and decode context.  The lattices are put on a bounded queue.  Stage 2 takes
+ * them from the queue on crf_fst_threads threads and runs process_lattice().  The results
+ * go into a reorder buffer keyed by utterance number, from which the main thread writes
+ * them in utterance order, so the output files are the same as those of the serial decoder.
+ */
+struct decode_pipeline {
+	decode_env* env;
+	pthread_mutex_t lock;
+	pthread_cond_t jobReady;
+	pthread_cond_t jobTaken;
+	pthread_cond_t resultReady;
+	deque<lattice_job> jobs;
+	size_t maxJobs;
+	size_t latThreadsRunning;
+	size_t fstThreadsRunning;
+	map<int, decode_result*> results;
+	double latSeconds;	// busy time summed over the stage threads
+	double fstSeconds;
+	int latUtts;
+	int fstUtts;
+};
+
+struct lattice_thread_arg {
+	decode_pipeline* pipe;
+	CRF_FeatureStream* ftr_str;
+	CRF_Model* crf;
+	modeltype mtype;
+	int first;	// utterance number of the first segment of ftr_str
+	pthread_t threadId;
+};
+
+struct fst_thread_arg {
+	decode_pipeline* pipe;
+	decode_fsts fsts;
+	pthread_t threadId;
+};
+
+/*
+ * Stage 1 thread: builds the lattices of the segments of its feature stream
+ */
+static void* lattice_thread(void* arg_in) {
+	lattice_thread_arg* arg=(lattice_thread_arg*)arg_in;
+	decode_pipeline* pipe=arg->pipe;
+	CRF_DecodeContext ctx;
+	CRF_LatticeBuilder* lb=CRF_LatticeBuilder::createLatticeBuilder(arg->mtype,arg->ftr_str,arg->crf,&ctx);
+	double busy=0;
+	int utts=0;
+	arg->ftr_str->rewind();
+	QN_SegID segid=arg->ftr_str->nextseg();
+	int count=arg->first;
+	while (segid != QN_SEGID_BAD) {
+		lattice_job job;
+		job.count=count;
+		job.segid=segid;
+		job.phn_lat=new VectorFst<StdArc>();
+		job.lab_lat=new VectorFst<StdArc>();
+		struct timeval start;
+		gettimeofday(&start, NULL);
+		try {
+			ctx.reset();
+			CRF_LatticeBuilder::buildStdLattice(lb,job.phn_lat,config.crf_states,pipe->env->alignMode,job.lab_lat,false);
+			write_lattice(count,job.phn_lat);
+		}
+		catch (exception &e) {
+			cerr << "Exception: " << e.what() << endl;
+			delete job.phn_lat;
+			delete job.lab_lat;
+			job.phn_lat=NULL;
+			job.lab_lat=NULL;
+		}
+		busy+=elapsed_seconds(start);
+		utts++;
+		pthread_mutex_lock(&pipe->lock);
+		while (pipe->jobs.size() >= pipe->maxJobs) {
+			pthread_cond_wait(&pipe->jobTaken,&pipe->lock);
+		}
+		pipe->jobs.push_back(job);
+		pthread_cond_signal(&pipe->jobReady);
+		pthread_mutex_unlock(&pipe->lock);
+		segid=arg->ftr_str->nextseg();
+		count++;
+	}
+	delete lb;
+	pthread_mutex_lock(&pipe->lock);
+	pipe->latThreadsRunning--;
+	pipe->latSeconds+=busy;
+	pipe->latUtts+=utts;
+	pthread_cond_broadcast(&pipe->jobReady);
+	pthread_mutex_unlock(&pipe->lock);
+	return NULL;
+}
+
+/*
+ * Stage 2 thread: post-processes lattices until the queue is empty and stage 1 is done
+ */
+static void* fst_thread(void* arg_in) {
+	fst_thread_arg* arg=(fst_thread_arg*)arg_in;
+	decode_pipeline* pipe=arg->pipe;
+	double busy=0;
+	int utts=0;
+	while (true) {
+		pthread_mutex_lock(&pipe->lock);
+		while (pipe->jobs.empty() && pipe->latThreadsRunning > 0) {
+			pthread_cond_wait(&pipe->jobReady,&pipe->lock);
+		}
+		if (pipe->jobs.empty()) {
+			pthread_mutex_unlock(&pipe->lock);
+			break;
+		}
+		lattice_job job=pipe->jobs.front();
+		pipe->jobs.pop_front();
+		pthread_cond_signal(&pipe->jobTaken);
+		pthread_mutex_unlock(&pipe->lock);
+
+		decode_result* res=new decode_result();
+		res->count=job.count;
+		res->segid=job.segid;
+		res->hasLabs=false;
+		if (job.phn_lat != NULL) {
+			struct timeval start;
+			gettimeofday(&start, NULL);
+			try {
+				process_lattice(job.count,job.phn_lat,job.lab_lat,&arg->fsts,pipe->env,res);
+			}
+			catch (exception &e) {
+				cerr << "Exception: " << e.what() << endl;
+				res->hasLabs=false;
+				res->mlf.clear();
+			}
+			busy+=elapsed_seconds(start);
+			utts++;
+			delete job.phn_lat;
+			delete job.lab_lat;
+		}
+		pthread_mutex_lock(&pipe->lock);
+		pipe->results[res->count]=res;
+		pthread_cond_signal(&pipe->resultReady);
+		pthread_mutex_unlock(&pipe->lock);
+	}
+	pthread_mutex_lock(&pipe->lock);
+	pipe->fstThreadsRunning--;
+	pipe->fstSeconds+=busy;
+	pipe->fstUtts+=utts;
+	pthread_cond_signal(&pipe->resultReady);
+	pthread_mutex_unlock(&pipe->lock);
+	return NULL;
+}
+
+/*
+ * Returns utts/seconds, 0 if no time was measured
+ */
+static double throughput(int utts, double seconds) {
+	return (seconds > 0)?utts/seconds:0;
+}
+
+/*
+ * Pipelined decoding of all utterances of str (see decode_pipeline)
+ *
+ * Returns: number of utterances written
+ */
+static int decode_pipelined(CRF_FeatureStreamManager* str, CRF_Model* crf, modeltype mtype,
+		decode_env* env, decode_fsts* fsts, QN_OutLabStream* labout, ofstream& mlfstream) {
+	size_t nlat=(config.crf_lat_threads > 1)?config.crf_lat_threads:1;
+	size_t nfst=(config.crf_fst_threads > 1)?config.crf_fst_threads:1;
+	cout << "Pipelined decoding with " << nlat << " lattice threads and "
+			<< nfst << " post-processing threads" << endl;
+
+	pthread_mutex_t mlfLock;
+	pthread_mutex_init(&mlfLock, NULL);
+	env->mlfLock=&mlfLock;
+
+	decode_pipeline pipe;
+	pipe.env=env;
+	pthread_mutex_init(&pipe.lock, NULL);
+	pthread_cond_init(&pipe.jobReady, NULL);
+	pthread_cond_init(&pipe.jobTaken, NULL);
+	pthread_cond_init(&pipe.resultReady, NULL);
+	pipe.maxJobs=2*nfst;
+	pipe.latThreadsRunning=nlat;
+	pipe.fstThreadsRunning=nfst;
+	pipe.latSeconds=0;
+	pipe.fstSeconds=0;
+	pipe.latUtts=0;
+	pipe.fstUtts=0;
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+
+	// the children of the feature stream manager cover consecutive blocks of nseg/nlat
+	// utterances, the last one taking the remainder (see CRF_FeatureStreamManager::create())
+	QNUInt32 nseg_per_child=str->trn_stream->num_segs()/nlat;
+	lattice_thread_arg* lat_args=new lattice_thread_arg[nlat];
+	for (size_t i=0; i<nlat; i++) {
+		lat_args[i].pipe=&pipe;
+		lat_args[i].ftr_str=(nlat > 1)?str->getChild(i)->trn_stream:str->trn_stream;
+		lat_args[i].crf=crf;
+		lat_args[i].mtype=mtype;
+		lat_args[i].first=i*nseg_per_child;
+		if (pthread_create(&(lat_args[i].threadId),NULL,lattice_thread,&(lat_args[i])) != 0) {
+			cerr << "ERROR: Failed creating lattice thread " << i << endl;
+			exit(-1);
+		}
+	}
+	fst_thread_arg* fst_args=new fst_thread_arg[nfst];
+	for (size_t i=0; i<nfst; i++) {
+		fst_args[i].pipe=&pipe;
+		fst_args[i].fsts.phn_fst=copy_fst(fsts->phn_fst);
+		fst_args[i].fsts.dict_fst=copy_fst(fsts->dict_fst);
+		fst_args[i].fsts.lm_fst=copy_fst(fsts->lm_fst);
+		if (pthread_create(&(fst_args[i].threadId),NULL,fst_thread,&(fst_args[i])) != 0) {
+			cerr << "ERROR: Failed creating post-processing thread " << i << endl;
+			exit(-1);
+		}
+	}
+
+	// ordered writer
+	int next=0;
+	int written=0;
+	pthread_mutex_lock(&pipe.lock);
+	while (true) {
+		if (pipe.fstThreadsRunning == 0 && !pipe.results.empty()) {
+			// only reached if an utterance number was never produced
+			next=pipe.results.begin()->first;
+		}
+		map<int, decode_result*>::iterator it=pipe.results.find(next);
+		if (it != pipe.results.end()) {
+			decode_result* res=it->second;
+			pipe.results.erase(it);
+			pthread_mutex_unlock(&pipe.lock);
+			if (next %10 == 0) {
+				cout << "Processing segment " << next << endl;
+			}
+			if (config.crf_olist != NULL) {
+				cout << "Processing file: " << env->olist->at(next);
+				cout << " (" << next << ")" << endl;
+			}
+			write_result(res,labout,mlfstream);
+			delete res;
+			next++;
+			written++;
+			pthread_mutex_lock(&pipe.lock);
+			continue;
+		}
+		if (pipe.fstThreadsRunning == 0) {
+			break;
+		}
+		pthread_cond_wait(&pipe.resultReady,&pipe.lock);
+	}
+	pthread_mutex_unlock(&pipe.lock);
+
+	for (size_t i=0; i<nlat; i++) {
+		pthread_join(lat_args[i].threadId,NULL);
+	}
+	for (size_t i=0; i<nfst; i++) {
+		pthread_join(fst_args[i].threadId,NULL);
+		delete fst_args[i].fsts.phn_fst;
+		delete fst_args[i].fsts.dict_fst;
+		delete fst_args[i].fsts.lm_fst;
+	}
+	double wall=elapsed_seconds(start);
+
+	// per stage throughput: utterances per second of busy time, times the number of threads
+	cout << "Lattice stage: " << pipe.latUtts << " utterances, " << pipe.latSeconds << " s on "
+			<< nlat << " threads, " << throughput(pipe.latUtts,pipe.latSeconds/nlat) << " utterances/s" << endl;
+	cout << "Post-processing stage: " << pipe.fstUtts << " utterances, " << pipe.fstSeconds << " s on "
+			<< nfst << " threads, " << throughput(pipe.fstUtts,pipe.fstSeconds/nfst) << " utterances/s" << endl;
+	cout << "Pipeline: " << written << " utterances in " << wall << " s, "
+			<< throughput(written,wall) << " utterances/s" << endl;
+
+	delete [] lat_args;
+	delete [] fst_args;
+	pthread_cond_destroy(&pipe.jobReady);
+	pthread_cond_destroy(&pipe.jobTaken);
+	pthread_cond_destroy(&pipe.resultReady);
+	pthread_mutex_destroy(&pipe.lock);
+	env->mlfLock=NULL;
+	pthread_mutex_destroy(&mlfLock);
+	return written;
+}
+
 /*
  * Main decoding block
  *
@@ -437,6 +1198,11 @@ int main(int argc, const char* argv[]) {
 
 	cout << "IN LABELS: " << config.crf_label_size << endl;
 
+	if (config.crf_lat_archive != NULL) {
+		latArchive=new CRF_LatticeArchiveWriter();
+		latArchive->open(config.crf_lat_archive,config.crf_lat_archive_compress);
+	}
+
 	// Added by Ryan, for segmental CRFs
 	if (config.label_maximum_duration <= 0)
 	{
@@ -525,6 +1291,10 @@ int main(int argc, const char* argv[]) {
         if (config.crf_align_mlffile != NULL) {
         	try {
         	mlfManager=new CRF_MLFManager(config.crf_align_mlffile, config.crf_olist, oSymTab);
+        	if (config.crf_align_mlf_store_out != NULL) {
+        		mlfManager->writeStore(config.crf_align_mlf_store_out);
+        		log_msg("Wrote transcript store to "+string(config.crf_align_mlf_store_out));
+        	}
         	}
     		catch (exception &e) {
     			cerr << "Exception: " << e.what() << endl;
@@ -646,19 +1416,19 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr1_width, (size_t) config.ftr1_ftr_start, (size_t) config.ftr1_ftr_count,
 							config.window_extent, config.ftr1_window_offset, config.ftr1_window_len,
 							config.ftr1_left_context_len, config.ftr1_right_context_len, config.ftr1_extract_seg_ftr,
-							config.ftr1_use_boundary_delta_ftr,
+							config.ftr1_use_boundary_delta_ftr, config.ftr1_use_kl_ftr,
 							config.ftr1_delta_order, config.ftr1_delta_win,
 							config.crf_eval_range, 0,
-							NULL,0,0,0,SEQUENTIAL);
+							NULL,0,0,0,SEQUENTIAL,0,(config.crf_lat_threads > 1)?config.crf_lat_threads:1);
 	if (strcmp(config.ftr2_file,"") != 0) {
 		str2=new CRF_FeatureStreamManager(1,"ftr2_file",config.ftr2_file,config.ftr2_format,config.hardtarget_file,config.hardtarget_window_offset,
 							(size_t) config.ftr2_width, (size_t) config.ftr2_ftr_start, (size_t) config.ftr2_ftr_count,
 							config.window_extent, config.ftr2_window_offset, config.ftr2_window_len,
 							config.ftr2_left_context_len, config.ftr2_right_context_len, config.ftr2_extract_seg_ftr,
-							config.ftr2_use_boundary_delta_ftr,
+							config.ftr2_use_boundary_delta_ftr, config.ftr2_use_kl_ftr,
 							config.ftr2_delta_order, config.ftr2_delta_win,
 							config.crf_eval_range, 0,
-							NULL,0,0,0,SEQUENTIAL);
+							NULL,0,0,0,SEQUENTIAL,0,(config.crf_lat_threads > 1)?config.crf_lat_threads:1);
 		str1.join(str2);
 	}
 	if (strcmp(config.ftr3_file,"") != 0) {
@@ -666,10 +1436,10 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr3_width, (size_t) config.ftr3_ftr_start, (size_t) config.ftr3_ftr_count,
 							config.window_extent, config.ftr3_window_offset, config.ftr3_window_len,
 							config.ftr3_left_context_len, config.ftr3_right_context_len, config.ftr3_extract_seg_ftr,
-							config.ftr3_use_boundary_delta_ftr,
+							config.ftr3_use_boundary_delta_ftr, config.ftr3_use_kl_ftr,
 							config.ftr3_delta_order, config.ftr3_delta_win,
 							config.crf_eval_range, 0,
-							NULL,0,0,0,SEQUENTIAL);
+							NULL,0,0,0,SEQUENTIAL,0,(config.crf_lat_threads > 1)?config.crf_lat_threads:1);
 		str1.join(str3);
 
 	}
@@ -729,385 +1499,242 @@ int main(int argc, const char* argv[]) {
 		cerr << "ERROR: Failed opening file: " << config.weight_file << endl;
 		exit(-1);
 	}
-
-
-	// changed by Ryan
-//	CRF_LatticeBuilder lb(crf_ftr_str,&my_crf);
-	CRF_LatticeBuilder* lb = NULL;
-	if (mtype == STDFRAME)
-	{
-		lb = new CRF_LatticeBuilder(crf_ftr_str,&my_crf);
+	if (config.crf_sparse_weights && !my_crf.setSparseScoring()) {
+		cerr << "WARNING: crf_sparse_weights is not supported by feature map " << config.crf_featuremap
+				<< ", scoring with all the weights" << endl;
 	}
-	else if (mtype == STDSEG)
-	{
-		lb = new CRF_LatticeBuilder_StdSeg(crf_ftr_str,&my_crf);
+	if (config.crf_quant_bits != 0 && config.crf_quant_bits != 8 && config.crf_quant_bits != 16) {
+		cerr << "ERROR: crf_quant_bits must be 0, 8 or 16" << endl;
+		exit(-1);
 	}
-	else if (mtype == STDSEG_NO_DUR)
-	{
-		lb = new CRF_LatticeBuilder_StdSeg_WithoutDurLab(crf_ftr_str,&my_crf);
+	if (config.crf_quant_out != NULL) {
+		if (config.crf_quant_bits == 0) {
+			cerr << "ERROR: crf_quant_out needs crf_quant_bits set to 8 or 16" << endl;
+			exit(-1);
+		}
+		if (!my_crf.writeQuantizedToFile(config.crf_quant_out,config.crf_quant_bits)) {
+			cerr << "ERROR: feature map " << config.crf_featuremap << " does not support quantized weights" << endl;
+			exit(-1);
+		}
+		cout << "Quantized weights written to " << config.crf_quant_out << endl;
+		exit(0);
 	}
-	else if (mtype == STDSEG_NO_DUR_NO_TRANSFTR)
-	{
-		lb = new CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(crf_ftr_str,&my_crf);
+	// weights read from a quantized file are scored quantized at their own size by default
+	int quant_bits=config.crf_quant_bits;
+	if (quant_bits == 0) {
+		quant_bits=my_crf.getFileQuantBits();
 	}
-	else if (mtype == STDSEG_NO_DUR_NO_SEGTRANSFTR)
-	{
-		lb = new CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr(crf_ftr_str,&my_crf);
-	}
-	else
-	{
-		// it should be the default class: stdframe
-
-		cerr << "The model type is not assigned." << endl;
-		exit(-1);
+	if (quant_bits != 0) {
+		if (my_crf.setQuantizedScoring(quant_bits)) {
+			CRF_QuantizedWeights* qw=my_crf.getQuantizedWeights();
+			cout << "Scoring with " << quant_bits << " bit weights: " << qw->getBytes()
+					<< " bytes, largest weight error " << qw->getMaxError(my_crf.getLambda()) << endl;
+		}
+		else {
+			cerr << "WARNING: crf_quant_bits is not supported by feature map " << config.crf_featuremap
+					<< ", scoring with the double weights" << endl;
+		}
 	}
 
-//	CRF_LatticeBuilder_StdSeg_WithoutDurLab<StdArc>* lb = new CRF_LatticeBuilder_StdSeg_WithoutDurLab<StdArc>(crf_ftr_str,&my_crf);
 
-//	CRF_LatticeBuilder<StdArc> lb(crf_ftr_str,&my_crf);
+	decode_env env;
+	env.alignMode=alignMode;
+	env.mlfOut=(oSymTab != NULL && mlfstream.is_open());
+	env.olist=&olist;
+	env.iSymTab=iSymTab;
+	env.oSymTab=oSymTab;
+	env.mlfManager=mlfManager;
+	env.mlfLock=NULL;
+	decode_fsts fsts;
+	fsts.phn_fst=phn_fst;
+	fsts.dict_fst=dict_fst;
+	fsts.lm_fst=lm_fst;
 
-	crf_ftr_str->rewind();
-	QN_SegID segid = crf_ftr_str->nextseg();
 	int count=0;
-	typedef StdArc::StateId StateId;
-	StdVectorFst final_result;
-	while (segid != QN_SEGID_BAD) {
-#ifndef NEWLAT
-		// Changed by Ryan
-//		if (count %100 == 0) {
-		if (count %10 == 0) {
-			cout << "Processing segment " << count << endl;
+	if (config.crf_decode_integrated) {
+		// frame-synchronous search over the composed graph, beam pruned on the composed
+		// states, so neither the lattice nor its composition with the LM is built
+		if (alignMode || config.crf_align_mlffile != NULL) {
+			cerr << "ERROR: crf_decode_integrated does not support alignment" << endl;
+			exit(-1);
 		}
-		if (config.crf_olist != NULL) {
-			cout << "Processing file: " << olist.at(count);
-			cout << " (" << count << ")" << endl;
+		if (config.crf_lat_threads > 1 || config.crf_fst_threads > 1) {
+			cerr << "ERROR: crf_decode_integrated does not support crf_lat_threads or crf_fst_threads" << endl;
+			exit(-1);
+		}
+		if (config.crf_decode_max_tokens < 0) {
+			cerr << "ERROR: crf_decode_max_tokens cannot be negative" << endl;
+			exit(-1);
+		}
+		if (mtype != STDSEG_NO_DUR_NO_SEGTRANSFTR || config.crf_states != 1) {
+			cerr << "ERROR: crf_decode_integrated only supports crf_model_type=stdseg_no_dur_no_segtransftr with crf_states=1" << endl;
+			exit(-1);
 		}
+		CRF_StaticGraph* static_graph=NULL;
+		CRF_DecodeContext decode_ctx;
+		CRF_TokenPassDecoder* td=NULL;
 		try {
-			time_t rawtime;
-			time(&rawtime);
-			char* time1 = ctime(&rawtime);
-			time1[strlen(time1)-1]='\0';
-			VectorFst<StdArc>* phn_lat=new VectorFst<StdArc>();
-			VectorFst<StdArc>* lab_lat=new VectorFst<StdArc>();
-			int nodeCnt=0;
-			if (config.crf_states == 1) {
-
-				// Changed by Ryan
-				//lb.buildLattice(phn_lat,alignMode,lab_lat);
-//				lb.buildLattice(phn_lat,alignMode,lab_lat, false);
-
-//				lb->buildLattice(phn_lat,alignMode,lab_lat, false);
-
-				// Commented by Ryan
-				// Important: the order of the following "if else" cannot be changed
-				// due to the heritance relationships!
-				if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*>(lb))
-				{
-					((CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*)lb)->buildLattice(phn_lat,alignMode,lab_lat, false);
-				}
-				else if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab*>(lb))
-				{
-					((CRF_LatticeBuilder_StdSeg_WithoutDurLab*)lb)->buildLattice(phn_lat,alignMode,lab_lat, false);
-				}
-				else if (dynamic_cast<CRF_LatticeBuilder_StdSeg*>(lb))
-				{
-					((CRF_LatticeBuilder_StdSeg*)lb)->buildLattice(phn_lat,alignMode,lab_lat, false);
-				}
-				else
-				{
-					lb->buildLattice(phn_lat,alignMode,lab_lat, false);
+			if (config.crf_static_graph != NULL && strcmp(config.crf_static_graph, "") != 0) {
+				cout << "Reading in static decoding graph from file: " << config.crf_static_graph << endl;
+				static_graph=new CRF_StaticGraph();
+				if (!static_graph->Read(config.crf_static_graph)) {
+					cerr << "ERROR: Failed opening file: " << config.crf_static_graph << endl;
+					exit(-1);
 				}
 			}
 			else {
-				if (dynamic_cast<CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*>(lb))
-				{
-					nodeCnt=((CRF_LatticeBuilder_StdSeg_WithoutDurLab_WithoutSegTransFtr*)lb)->nStateBuildLattice(phn_lat,alignMode,lab_lat, false);
-				}
-				else {
-					// Changed by Ryan
-//					nodeCnt=lb.nStateBuildLattice(phn_lat,alignMode,lab_lat);
-					nodeCnt=lb->nStateBuildLattice(phn_lat,alignMode,lab_lat, false);
-				}
+				log_msg("Composing the phone, dict and LM fsts into a static decoding graph...");
+				static_graph=compile_static_graph(phn_fst,dict_fst,lm_fst);
 			}
-			if (config.crf_lat_outdir != NULL) {
-				// Dump the lattice to a file in openfst format
-				string fst_fname=string(config.crf_lat_outdir)+"/fst."+stringify(count)+".final.fst";
-				log_msg("*	*Writing lattice to "+fst_fname);
-				phn_lat->Write(fst_fname);
+			log_msg("Static graph: "+stringify(static_graph->getNumStates())+" states, "+
+					stringify(static_graph->getNumArcs())+" arcs");
+			td=new CRF_TokenPassDecoder(crf_ftr_str,&my_crf,static_graph,&decode_ctx);
+		}
+		catch (exception &e) {
+			cerr << "ERROR: Cannot set up the static decoding graph: " << e.what() << endl;
+			exit(-1);
+		}
+		td->setMaxTokens(config.crf_decode_max_tokens);
+		crf_ftr_str->rewind();
+		QN_SegID segid = crf_ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+			if (count %10 == 0) {
+				cout << "Processing segment " << count << endl;
 			}
-			if (config.crf_output_labelfile != NULL) {
-				// Write the output to an ilab file in Quicknet format
-				VectorFst<StdArc>* shortest_fst = new VectorFst<StdArc>();
-				if (alignMode) {
-					ComposeFst<StdArc>* result=new ComposeFst<StdArc>(*phn_lat,*lab_lat);
-					ShortestPath(*result,shortest_fst,1);
-					delete result;
-					Project(shortest_fst,PROJECT_OUTPUT);
-					RmEpsilon(shortest_fst);
-					TopSort(shortest_fst);
-				}
-				else {
-					ShortestPath(*phn_lat,shortest_fst,1);
-					Project(shortest_fst,PROJECT_OUTPUT);
-					RmEpsilon(shortest_fst);
-					TopSort(shortest_fst);
-				}
-
-				// Commented by Ryan
-				// since the label of the arc linking the last frame node to
-				// the final state node is epsilon, the final state is removed
-				// after the epsilon removal above, "RmEpsilon(shortest_fst);".
-				// So num_labels = shortest_fst->NumStates() - 1,
-				// instead of shortest_fst->NumStates() - 2.
-				QNUInt32 num_labels = shortest_fst->NumStates() - 1;
-
-				// just for debugging
-//				cout << "segid: " << segid << ", num_labels: " << num_labels << endl;
-
-				QNUInt32* labarr = new QNUInt32[num_labels];
-				//Gets the initial state; if kNoState => empty FST.
-				StateId initial_state = shortest_fst->Start();
-				//	Iterates over the FSTs states.
-				QNUInt32 frm_no=0;
-				for (StateIterator<StdFst> siter(*shortest_fst); !siter.Done(); siter.Next())
-				{
-	  				StateId state_id = siter.Value();
-
-	  				//Iterates over state state_id's arcs.
-	  				for (ArcIterator<StdFst> aiter(*shortest_fst, state_id); !aiter.Done(); aiter.Next())
-					{
-	  					const StdArc &arc = aiter.Value();
-	  					labarr[frm_no]=arc.olabel-1;
-	  					frm_no++;
-					}
-				}
-
-				labout->write_labs(num_labels,labarr);
-				labout->doneseg(segid);
-				delete [] labarr;
-				delete shortest_fst;
+			if (config.crf_olist != NULL) {
+				cout << "Processing file: " << olist.at(count);
+				cout << " (" << count << ")" << endl;
 			}
+			try {
+				decode_ctx.reset();
+				VectorFst<StdArc>* best_lat=decode_ctx.getBestLat();
+				td->decode(best_lat,config.crf_decode_beam);
+				write_lattice(count,best_lat);
+				decode_result res;
+				res.count=count;
+				res.segid=segid;
+				process_best_path(count,td,&env,&res);
+				write_result(&res,labout,mlfstream);
+			}
+			catch (exception &e) {
+				cerr << "Exception: " << e.what() << endl;
+			}
+			segid=crf_ftr_str->nextseg();
+			count++;
+		}
+		delete td;
+		delete static_graph;
+	}
+	else if (config.crf_lat_threads > 1 || config.crf_fst_threads > 1) {
+		count=decode_pipelined(&str1,&my_crf,mtype,&env,&fsts,labout,mlfstream);
+	}
+	else {
+		// changed by Ryan
+//		CRF_LatticeBuilder lb(crf_ftr_str,&my_crf);
+		CRF_LatticeBuilder* lb = CRF_LatticeBuilder::createLatticeBuilder(mtype,crf_ftr_str,&my_crf,NULL);
+		if (lb == NULL)
+		{
+			// it should be the default class: stdframe
+
+			cerr << "The model type is not assigned." << endl;
+			exit(-1);
+		}
 
-			if (config.crf_output_mlffile != NULL) {
-				//Write the output to an HTK style MLF file
-				//Note that this code is currently experimental, and the ilab output above
-				// is generally preferred for output
-				bool findShortest=true;
-				Fst<StdArc>* working_fst=phn_lat;
-				log_msg("States in pre-phn lattice: "+stringify(((VectorFst<StdArc>*)working_fst)->NumStates()));
-				if (phn_fst != NULL ) {
-					log_msg("Lazily composing with phone penalty lattice...");
-					ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(*working_fst,*phn_fst);
-					if (working_fst!=phn_lat) { delete working_fst;}
-					working_fst=composed_fst;
-					log_msg("Mapping to log ring");
-					VectorFst<LogArc>* mapped_fst = new VectorFst<LogArc>();
-					Map(*working_fst,mapped_fst,StdToLogMapper());
-					log_msg("Removing epsilons");
-					RmEpsilon(mapped_fst);
-					log_msg("States in phn lattice: "+stringify(mapped_fst->NumStates()));
-					log_msg("Mapping back to tropic ring");
-					VectorFst<StdArc>* unmapped_fst = new VectorFst<StdArc>();
-					Map(*mapped_fst,unmapped_fst,LogToStdMapper());
-					if (working_fst!=phn_lat) { delete working_fst;}
-					working_fst=unmapped_fst;
-					delete mapped_fst;
-					if (config.crf_phn_wt != 0) {
-						log_msg("Initial pass of pruning with weight "+stringify(config.crf_phn_wt));
-						VectorFst<StdArc>* pruned_fst = new VectorFst<StdArc>();
-						Prune(*working_fst,pruned_fst,config.crf_phn_wt);
-						if (working_fst != phn_lat) { delete working_fst; }
-						working_fst=pruned_fst;
-
-						log_msg("States in phn lattice following pruning: "+stringify(pruned_fst->NumStates()));
-
-						log_msg("Minimizing phn lattice");
-						Minimize(pruned_fst);
-						log_msg("States in phn lattice following pruning: "+stringify(pruned_fst->NumStates()));
+		crf_ftr_str->rewind();
+		QN_SegID segid = crf_ftr_str->nextseg();
+		while (segid != QN_SEGID_BAD) {
+#ifndef NEWLAT
+			// Changed by Ryan
+//			if (count %100 == 0) {
+			if (count %10 == 0) {
+				cout << "Processing segment " << count << endl;
+			}
+			if (config.crf_olist != NULL) {
+				cout << "Processing file: " << olist.at(count);
+				cout << " (" << count << ")" << endl;
+			}
+			try {
+				VectorFst<StdArc>* phn_lat=new VectorFst<StdArc>();
+				VectorFst<StdArc>* lab_lat=new VectorFst<StdArc>();
+				CRF_LatticeBuilder::buildStdLattice(lb,phn_lat,config.crf_states,alignMode,lab_lat,false);
+				write_lattice(count,phn_lat);
+				decode_result res;
+				res.count=count;
+				res.segid=segid;
+				process_lattice(count,phn_lat,lab_lat,&fsts,&env,&res);
+				write_result(&res,labout,mlfstream);
+
+				delete phn_lat;
+				delete lab_lat;
+			}
+			catch (exception &e) {
+				cerr << "Exception: " << e.what() << endl;
+			}
+#else
+			if (count %100 == 0) {
+			cout << "Processing segment " << count << endl;
+			}
+			try {
+				if (lm_fst != NULL) {
+					if (config.crf_states==1) {
+						fst=lb.LMBestPath(alignMode,lm_fst);
 					}
-				}
-
-				if (dict_fst != NULL ) {
-					log_msg("Lazily composing with dictionary lattice...");
-					ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(*working_fst,*dict_fst);
-					if (working_fst!=phn_lat) { delete working_fst;}
-					working_fst=composed_fst;
-					if (config.crf_dict_wt != 0) {
-						log_msg("Pruning word lattice with weight "+stringify(config.crf_dict_wt));
-						VectorFst<StdArc>* pruned_fst = new StdVectorFst();
-						Prune(*composed_fst,pruned_fst,config.crf_dict_wt);
-						if (working_fst != phn_lat) { delete working_fst; }
-						working_fst=pruned_fst;
-						log_msg("States in pruned word lattice: "+stringify(((VectorFst<StdArc>*)working_fst)->NumStates()));
+					else {
+						fst=lb.nStateLMBestPath(alignMode,lm_fst);
 					}
 				}
-				if (config.crf_align_mlffile != NULL) {
-					log_msg("Building FST for utterance "+olist.at(count));
-					VectorFst<StdArc>* align_fst = mlfManager->getFst(olist.at(count));
-					VectorFst<StdArc>* composed_fst = new VectorFst<StdArc>();
-					Compose(*working_fst,*align_fst,composed_fst);
-					if (working_fst!=phn_lat) { delete working_fst;}
-					delete align_fst;
-					working_fst=composed_fst;
-				}
-				if (lm_fst != NULL ) {
-					time_t rawtime;
-					time(&rawtime);
-					char* time1 = ctime(&rawtime);
-					time1[strlen(time1)-1]='\0';
-					log_msg(time1);
-
-					log_msg("Composing with LM lattice...");
-					ComposeFstOptions<StdArc> options;
-					options.gc_limit = 0;
-					ComposeFst<StdArc>* composed_fst = new ComposeFst<StdArc>(ArcSortFst<StdArc, OLabelCompare<StdArc> >(*working_fst,OLabelCompare<StdArc>()),*lm_fst,options);
-					if (working_fst != phn_lat) { delete working_fst; }
-					working_fst=composed_fst;
-
-					VectorFst<StdArc>* shortest_fst = new StdVectorFst();
-					log_msg("Finding shortest path...");
-					ShortestPath(*working_fst,shortest_fst,1);
-
-					if (working_fst!=phn_lat) { delete working_fst;}
-					log_msg("Removing epsilons");
-					RmEpsilon(shortest_fst);
-					log_msg("Top sorting");
-					TopSort(shortest_fst);
-					working_fst=shortest_fst;
-					findShortest=false;
+				else {
+				if (config.crf_states == 1) {
+					fst=lb.bestPath(alignMode);
 				}
-				if (findShortest) {
-					VectorFst<StdArc>* shortest_fst = new VectorFst<StdArc>();
-					log_msg("Finding Shortest Path");
-					ShortestPath(*working_fst,shortest_fst,1);
-					log_msg("Removing epsilons");
-					RmEpsilon(shortest_fst);
-					log_msg("Top sorting");
-					TopSort(shortest_fst);
-					if (working_fst != phn_lat) { delete working_fst;}
-					working_fst=shortest_fst;
+				else {
+					fst=lb.nStateBestPath(alignMode);
 				}
-
-				//	Iterates over the FSTs states.
-				if (oSymTab != NULL && mlfstream.is_open()) {
-					 mlfstream << "\"" << olist.at(count) << "\"" << endl;
-					 cout << "\"" << olist.at(count) << "\" : ";
 				}
-				int start=0;
-				int current=0;
-				int lastId=-1;
-				for (StateIterator<StdFst> siter(*working_fst); !siter.Done(); siter.Next())
-				{
-  					StateId state_id = siter.Value();
-  					//Iterates over state state_id's arcs.
-  					for (ArcIterator<StdFst> aiter(*working_fst, state_id); !aiter.Done(); aiter.Next())
+				//Get total number of labels - with a single path this is number of states - 1
+				if (config.crf_output_labelfile != NULL) {
+					QNUInt32 num_labels = fst->NumStates() - 1;
+					QNUInt32* labarr = new QNUInt32[num_labels];
+					//Gets the initial state; if kNoState => empty FST.
+					StateId initial_state = fst->Start();
+					//	Iterates over the FSTs states.
+					QNUInt32 frm_no=0;
+					for (StateIterator<StdFst> siter(*fst); !siter.Done(); siter.Next())
 					{
-  						const StdArc &arc = aiter.Value();
-  						if (arc.olabel == 0) {
-  							if (config.crf_mlf_output_states) {
-  							if (arc.ilabel != lastId) {
-  								if (lastId != -1) {
-  									if (config.crf_mlf_output_frames) {
-  										mlfstream << start << "\t" << (current-1) << "\t";
-  									}
-  									mlfstream << iSymTab->Find(lastId) << endl;
-  								}
-  								lastId=arc.ilabel;
-  								start=current;
-  							}
-  							}
-  							current++;
-  						}
-  						else {
- 						if (oSymTab != NULL && mlfstream.is_open()) {
- 							if (config.crf_mlf_output_frames) {
- 							mlfstream << start << "\t" << (current-1) << "\t";
- 							}
- 							if (config.crf_mlf_output_states) {
- 							mlfstream << iSymTab->Find(lastId) << "\t";
- 							}
-  							mlfstream  << oSymTab->Find(arc.olabel) << endl;
-  							cout << oSymTab->Find(arc.olabel) << " ";
-  							start=current;
-  							lastId=-1;
-  						}
-  						}
+	  					StateId state_id = siter.Value();
+	  					//Iterates over state state_id's arcs.
+	  					for (ArcIterator<StdFst> aiter(*fst, state_id); !aiter.Done(); aiter.Next())
+						{
+	  						const StdArc &arc = aiter.Value();
+	  						//cout << count << "\t" << frm_no << "\t" << arc.olabel-1 << endl;
+	  						labarr[frm_no]=arc.olabel-1;
+	  						if (oSymTab != NULL ) {
+	  							cout << oSymTab->Find(arc.olabel) << endl;
+	  						}
+	  						frm_no++;
+						}
 					}
+					labout->write_labs(num_labels,labarr);
+					labout->doneseg(segid);
+					delete labarr;
 				}
-				if (oSymTab != NULL && mlfstream.is_open()) {
-					mlfstream << "." << endl;
-					cout << "." << endl;
-				}
-				if (working_fst != phn_lat && working_fst != NULL) {
-					delete working_fst;
-				}
-			}
-			time(&rawtime);
-			char* time2 = ctime(&rawtime);
-			time2[strlen(time2)-1]='\0';
-
-			delete phn_lat;
-			delete lab_lat;
-		}
-		catch (exception &e) {
-			cerr << "Exception: " << e.what() << endl;
-		}
-#else
-		if (count %100 == 0) {
-		cout << "Processing segment " << count << endl;
-		}
-		try {
-			if (lm_fst != NULL) {
-				if (config.crf_states==1) {
-					fst=lb.LMBestPath(alignMode,lm_fst);
-				}
-				else {
-					fst=lb.nStateLMBestPath(alignMode,lm_fst);
-				}
-			}
-			else {
-			if (config.crf_states == 1) {
-				fst=lb.bestPath(alignMode);
-			}
-			else {
-				fst=lb.nStateBestPath(alignMode);
+				delete fst;
 			}
+			catch (exception &e) {
+				cerr << "Exception: " << e.what() << endl;
 			}
-			//Get total number of labels - with a single path this is number of states - 1
-			if (config.crf_output_labelfile != NULL) {
-				QNUInt32 num_labels = fst->NumStates() - 1;
-				QNUInt32* labarr = new QNUInt32[num_labels];
-				//Gets the initial state; if kNoState => empty FST.
-				StateId initial_state = fst->Start();
-				//	Iterates over the FSTs states.
-				QNUInt32 frm_no=0;
-				for (StateIterator<StdFst> siter(*fst); !siter.Done(); siter.Next())
-				{
-  					StateId state_id = siter.Value();
-  					//Iterates over state state_id's arcs.
-  					for (ArcIterator<StdFst> aiter(*fst, state_id); !aiter.Done(); aiter.Next())
-					{
-  						const StdArc &arc = aiter.Value();
-  						//cout << count << "\t" << frm_no << "\t" << arc.olabel-1 << endl;
-  						labarr[frm_no]=arc.olabel-1;
-  						if (oSymTab != NULL ) {
-  							cout << oSymTab->Find(arc.olabel) << endl;
-  						}
-  						frm_no++;
-					}
-				}
-				labout->write_labs(num_labels,labarr);
-				labout->doneseg(segid);
-				delete labarr;
-			}
-			delete fst;
-		}
-		catch (exception &e) {
-			cerr << "Exception: " << e.what() << endl;
-		}
 #endif
-		segid=crf_ftr_str->nextseg();
-		count++;
+			segid=crf_ftr_str->nextseg();
+			count++;
+		}
+
+		// added by Ryan
+		delete lb;
+	}
+	if (latArchive != NULL) {
+		latArchive->close();
+		cout << "Wrote " << latArchive->getNumEntries() << " lattices to " << config.crf_lat_archive << endl;
+		delete latArchive;
 	}
 	if (labout!=NULL) {delete labout;} // explicitly delete the labelstream to flush contents to disk.
 	if (outl != NULL) {fclose(outl);}
@@ -1115,7 +1742,4 @@ int main(int argc, const char* argv[]) {
 	if (dict_fst != NULL) {delete dict_fst; }
 	if (phn_fst != NULL) {delete phn_fst; }
 	if (mlfstream.is_open()) { mlfstream.close(); }
-
-	// added by Ryan
-	delete lb;
 }
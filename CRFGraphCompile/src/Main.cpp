@@ -0,0 +1,192 @@
+/*
+ * CRFGraphCompile.cpp
+ *
+ * Command line interface for compiling the phone, dictionary and language
+ * model fsts used by CRFFstDecode into a static decoding graph for the
+ * token passing decoder (see CRF_StaticGraph and CRF_TokenPassDecoder).
+ * Follows command line interface model for ICSI Quicknet.
+ * Requires the OpenFst finite state library.
+ */
+#include "quicknet3/QN_config.h"
+#include "fst/fstlib.h"
+#include <vector>
+#include <string>
+#include "CRF.h"
+#include "utils/CRF_Utils.h"
+#include "decoders/CRF_StaticGraph.h"
+
+using namespace std;
+
+/*
+ * command line options
+ */
+static struct {
+	char* crf_phn_bin;
+	char* crf_dict_bin;
+	char* crf_lm_bin;
+	char* crf_disambig;
+	char* crf_graph_out;
+	int crf_graph_determinize;
+	int crf_graph_minimize;
+	int verbose;
+} config;
+
+/*
+ * Command line options to be presented to the screen
+ */
+QN_ArgEntry argtab[] =
+{
+	{ NULL, "ASR CRaFT CRF decoding graph compilation program version " CRF_VERSION, QN_ARG_DESC },
+	{ "crf_phn_bin", "Phone model file name (in OpenFST binary format)", QN_ARG_STR, &(config.crf_phn_bin) },
+	{ "crf_dict_bin", "Dictionary model file name (in OpenFST binary format)", QN_ARG_STR, &(config.crf_dict_bin) },
+	{ "crf_lm_bin", "Language model file name (in OpenFST binary format)", QN_ARG_STR, &(config.crf_lm_bin) },
+	{ "crf_disambig", "Disambiguation symbol IDs file name (one ID per line)", QN_ARG_STR, &(config.crf_disambig) },
+	{ "crf_graph_out", "Output file name for the compiled decoding graph", QN_ARG_STR, &(config.crf_graph_out), QN_ARG_REQ },
+	{ "crf_graph_determinize", "Determinize the composed graph", QN_ARG_BOOL, &(config.crf_graph_determinize) },
+	{ "crf_graph_minimize", "Minimize the composed graph (requires crf_graph_determinize)", QN_ARG_BOOL, &(config.crf_graph_minimize) },
+	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
+	{ NULL, NULL, QN_ARG_NOMOREARGS }
+};
+
+/*
+ * Default values for command line options
+ */
+static void set_defaults(void) {
+	config.crf_phn_bin=NULL;
+	config.crf_dict_bin=NULL;
+	config.crf_lm_bin=NULL;
+	config.crf_disambig=NULL;
+	config.crf_graph_out=NULL;
+	config.crf_graph_determinize=1;
+	config.crf_graph_minimize=1;
+	config.verbose=1;
+};
+
+/*
+ * logs an error message to standard output
+ */
+void log_msg(string outstr) {
+	if (config.verbose) {
+		cout << outstr << endl;
+	}
+}
+
+/*
+ * Reads an fst in the log semiring and maps it to the tropical semiring.
+ * Returns NULL if fname is NULL or empty.
+ */
+static VectorFst<StdArc>* read_std_fst(const char* fname, const char* desc) {
+	if (fname == NULL || strcmp(fname, "") == 0) {
+		return NULL;
+	}
+	cout << "Reading in " << desc << " fst from file: " << fname << endl;
+	VectorFst<LogArc>* log_fst=VectorFst<LogArc>::Read(fname);
+	if (log_fst == NULL) {
+		cerr << "ERROR: Failed opening file: " << fname << endl;
+		exit(-1);
+	}
+	VectorFst<StdArc>* std_fst=new VectorFst<StdArc>();
+	log_msg("Mapping to Tropical Ring...");
+	Map(*log_fst,std_fst,LogToStdMapper());
+	delete log_fst;
+	return std_fst;
+}
+
+/*
+ * Composes working_fst with next_fst and returns the connected result.  Both inputs are
+ * deleted.
+ */
+static VectorFst<StdArc>* compose_with(VectorFst<StdArc>* working_fst, VectorFst<StdArc>* next_fst) {
+	if (working_fst == NULL) {
+		return next_fst;
+	}
+	ArcSort(working_fst,OLabelCompare<StdArc>());
+	ArcSort(next_fst,ILabelCompare<StdArc>());
+	VectorFst<StdArc>* composed_fst=new VectorFst<StdArc>();
+	Compose(*working_fst,*next_fst,composed_fst);
+	Connect(composed_fst);
+	delete working_fst;
+	delete next_fst;
+	log_msg("States in composed graph: "+stringify(composed_fst->NumStates()));
+	return composed_fst;
+}
+
+/*
+ * Main graph compilation block
+ *
+ */
+int main(int argc, const char* argv[]) {
+	char* progname;
+
+	set_defaults();
+	QN_initargs(&argtab[0], &argc, &argv, &progname);
+	QN_printargs(NULL, progname, &argtab[0]);
+
+	// composed in the order the lattice of CRFFstDecode is composed with them
+	VectorFst<StdArc>* graph_fst=NULL;
+	graph_fst=compose_with(graph_fst,read_std_fst(config.crf_phn_bin,"phone"));
+	VectorFst<StdArc>* dict_fst=read_std_fst(config.crf_dict_bin,"dict");
+	if (dict_fst != NULL) { graph_fst=compose_with(graph_fst,dict_fst); }
+	VectorFst<StdArc>* lm_fst=read_std_fst(config.crf_lm_bin,"LM");
+	if (lm_fst != NULL) { graph_fst=compose_with(graph_fst,lm_fst); }
+	if (graph_fst == NULL) {
+		cerr << "ERROR: at least one of crf_phn_bin, crf_dict_bin and crf_lm_bin is required" << endl;
+		exit(-1);
+	}
+
+	if (config.crf_graph_determinize) {
+		// the graph is a transducer, determinize it as an acceptor over (ilabel, olabel) pairs
+		log_msg("Determinizing the composed graph...");
+		EncodeMapper<StdArc> encoder(kEncodeLabels, ENCODE);
+		Encode(graph_fst,&encoder);
+		VectorFst<StdArc>* det_fst=new VectorFst<StdArc>();
+		Determinize(*graph_fst,det_fst);
+		delete graph_fst;
+		graph_fst=det_fst;
+		log_msg("States in determinized graph: "+stringify(graph_fst->NumStates()));
+		if (config.crf_graph_minimize) {
+			log_msg("Minimizing the composed graph...");
+			Minimize(graph_fst);
+			log_msg("States in minimized graph: "+stringify(graph_fst->NumStates()));
+		}
+		Decode(graph_fst,encoder);
+	}
+
+	// disambiguation symbols are only needed for determinization
+	if (config.crf_disambig != NULL && strcmp(config.crf_disambig, "") != 0) {
+		ifstream disambig_file;
+		disambig_file.open(config.crf_disambig);
+		if (!disambig_file.is_open()) {
+			cerr << "ERROR: Failed opening file: " << config.crf_disambig << endl;
+			exit(-1);
+		}
+		vector<pair<StdArc::Label, StdArc::Label> > ipairs;
+		vector<pair<StdArc::Label, StdArc::Label> > opairs;
+		while (!disambig_file.eof()) {
+			string s;
+			getline(disambig_file, s);
+			if (s != "") {
+				int disambig_id = atoi(s.c_str());
+				if (disambig_id == 0) {
+					cerr << "ERROR: invalid disambiguation ID (" << s << ") from "
+							<< config.crf_disambig << endl;
+					exit(-1);
+				}
+				ipairs.push_back(pair<StdArc::Label, StdArc::Label>(disambig_id, 0));
+			}
+		}
+		disambig_file.close();
+		log_msg("Removing "+stringify(ipairs.size())+" disambiguation symbols");
+		Relabel(graph_fst,ipairs,opairs);
+	}
+
+	log_msg("Folding epsilon closures into the static graph...");
+	CRF_StaticGraph static_graph;
+	static_graph.compile(*graph_fst);
+	delete graph_fst;
+	cout << "Static graph: " << static_graph.getNumStates() << " states, "
+			<< static_graph.getNumArcs() << " arcs" << endl;
+	static_graph.Write(config.crf_graph_out);
+	cout << "Wrote decoding graph to " << config.crf_graph_out << endl;
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * CRFLatExtract.cpp
+ *
+ * Command line interface for listing and extracting the lattices of a lattice archive
+ * written by CRFDecode or CRFFstDecode (see CRF_LatticeArchiveWriter).
+ * Follows command line interface model for ICSI Quicknet.
+ */
+#include "quicknet3/QN_config.h"
+#include "fst/fstlib.h"
+#include <vector>
+#include <string>
+#include "CRF.h"
+#include "utils/CRF_Utils.h"
+#include "io/CRF_LatticeArchive.h"
+
+using namespace std;
+
+/*
+ * command line options
+ */
+static struct {
+	char* crf_lat_archive;
+	int crf_lat_list;
+	char* crf_lat_key;
+	char* crf_lat_out;
+	char* crf_lat_outdir;
+	char* crf_lat_suffix;
+	int verbose;
+} config;
+
+/*
+ * Command line options to be presented to the screen
+ */
+QN_ArgEntry argtab[] =
+{
+	{ NULL, "ASR CRaFT CRF lattice archive extraction program version " CRF_VERSION, QN_ARG_DESC },
+	{ "crf_lat_archive", "Lattice archive file name", QN_ARG_STR, &(config.crf_lat_archive), QN_ARG_REQ },
+	{ "crf_lat_list", "List the utterance names and sizes of the archive", QN_ARG_BOOL, &(config.crf_lat_list) },
+	{ "crf_lat_key", "Utterance name of the lattice to extract", QN_ARG_STR, &(config.crf_lat_key) },
+	{ "crf_lat_out", "Output file name for the lattice of crf_lat_key (default: <crf_lat_key><crf_lat_suffix>)", QN_ARG_STR, &(config.crf_lat_out) },
+	{ "crf_lat_outdir", "Output directory to extract all lattices of the archive to", QN_ARG_STR, &(config.crf_lat_outdir) },
+	{ "crf_lat_suffix", "File name suffix of extracted lattices", QN_ARG_STR, &(config.crf_lat_suffix) },
+	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
+	{ NULL, NULL, QN_ARG_NOMOREARGS }
+};
+
+/*
+ * Default values for command line options
+ */
+static void set_defaults(void) {
+	config.crf_lat_archive=NULL;
+	config.crf_lat_list=0;
+	config.crf_lat_key=NULL;
+	config.crf_lat_out=NULL;
+	config.crf_lat_outdir=NULL;
+	config.crf_lat_suffix=".fst";
+	config.verbose=1;
+};
+
+/*
+ * logs an error message to standard output
+ */
+void log_msg(string outstr) {
+	if (config.verbose) {
+		cout << outstr << endl;
+	}
+}
+
+/*
+ * Writes the entry idx of the archive to fname, as it was added to the archive.
+ */
+static void extract_entry(CRF_LatticeArchiveReader& archive, QNUInt32 idx, const string& fname) {
+	string data;
+	archive.read(idx, data);
+	ofstream ofile(fname.c_str(), ios::out | ios::binary);
+	if (!ofile.is_open()) {
+		cerr << "ERROR: Failed opening file: " << fname << endl;
+		exit(-1);
+	}
+	ofile.write(data.data(), data.size());
+	if (ofile.bad() || ofile.fail()) {
+		cerr << "ERROR: Failed writing file: " << fname << endl;
+		exit(-1);
+	}
+	ofile.close();
+	log_msg("Extracted "+archive.getEntry(idx).key+" to "+fname);
+}
+
+/*
+ * Main lattice extraction block
+ *
+ */
+int main(int argc, const char* argv[]) {
+	char* progname;
+
+	set_defaults();
+	QN_initargs(&argtab[0], &argc, &argv, &progname);
+	QN_printargs(NULL, progname, &argtab[0]);
+
+	if (!config.crf_lat_list && config.crf_lat_key == NULL && config.crf_lat_outdir == NULL) {
+		cerr << "ERROR: one of crf_lat_list, crf_lat_key and crf_lat_outdir is required" << endl;
+		exit(-1);
+	}
+
+	CRF_LatticeArchiveReader archive;
+	try {
+		archive.open(config.crf_lat_archive);
+	}
+	catch (exception &e) {
+		cerr << "Exception: " << e.what() << endl;
+		exit(-1);
+	}
+	log_msg("Archive "+string(config.crf_lat_archive)+" holds "+stringify(archive.getNumEntries())+" lattices");
+
+	if (config.crf_lat_list) {
+		for (QNUInt32 i = 0; i < archive.getNumEntries(); i++) {
+			const CRF_LatticeArchiveEntry& entry = archive.getEntry(i);
+			cout << entry.key << "\t" << entry.rawSize << "\t" << entry.storedSize;
+			if (entry.flags & CRF_LATTICEARCHIVE_COMPRESSED) {
+				cout << "\tcompressed";
+			}
+			cout << endl;
+		}
+	}
+
+	try {
+		if (config.crf_lat_key != NULL) {
+			int idx = archive.find(config.crf_lat_key);
+			if (idx < 0) {
+				cerr << "ERROR: " << config.crf_lat_key << " is not in the archive " << config.crf_lat_archive << endl;
+				exit(-1);
+			}
+			string fname;
+			if (config.crf_lat_out != NULL) {
+				fname = config.crf_lat_out;
+			}
+			else {
+				fname = string(config.crf_lat_key) + config.crf_lat_suffix;
+			}
+			extract_entry(archive, idx, fname);
+		}
+
+		if (config.crf_lat_outdir != NULL) {
+			for (QNUInt32 i = 0; i < archive.getNumEntries(); i++) {
+				string fname = string(config.crf_lat_outdir) + "/" + archive.getEntry(i).key + config.crf_lat_suffix;
+				extract_entry(archive, i, fname);
+			}
+		}
+	}
+	catch (exception &e) {
+		cerr << "Exception: " << e.what() << endl;
+		exit(-1);
+	}
+	return 0;
+}
@@ -20,6 +20,7 @@
 
 // Commented by Ryan
 #include "trainers/CRF_AISTrainer.h"
+#include "utils/CRF_MemStats.h"
 
 #include "ftrmaps/CRF_StdFeatureMap.h"
 #include "ftrmaps/CRF_StdSparseFeatureMap.h"
@@ -46,6 +47,7 @@ static struct {
 	int ftr1_right_context_len;
 	bool ftr1_extract_seg_ftr;
 	bool ftr1_use_boundary_delta_ftr;
+	bool ftr1_use_kl_ftr;
 
 	char* ftr2_file;
 	char* ftr2_format;
@@ -63,6 +65,7 @@ static struct {
 	int ftr2_right_context_len;
 	bool ftr2_extract_seg_ftr;
 	bool ftr2_use_boundary_delta_ftr;
+	bool ftr2_use_kl_ftr;
 
 	char* ftr3_file;
 	char* ftr3_format;
@@ -80,6 +83,7 @@ static struct {
 	int ftr3_right_context_len;
 	bool ftr3_extract_seg_ftr;
 	bool ftr3_use_boundary_delta_ftr;
+	bool ftr3_use_kl_ftr;
 
 	int train_sent_start;
 	int train_sent_count;
@@ -111,6 +115,7 @@ static struct {
 	char* crf_train_method;
 	char* crf_objective_function;
 	char* crf_train_order;
+	int crf_shuffle_buffer;
 	float crf_lr;
 
 	// Added by Ryan, learning rate decaying rate
@@ -121,6 +126,8 @@ static struct {
 	float crf_adagrad_eta;
 	char* grad_sqr_acc_file;
 
+	int crf_ftr_slab;
+
 	int crf_random_seed;
 	char* crf_featuremap;
 	char* crf_featuremap_file;
@@ -135,7 +142,18 @@ static struct {
 	float crf_state_bias_value;
 	float crf_trans_bias_value;
 	float crf_ais_l1alpha;
+	int crf_ais_transitions;
 	int threads;
+	int crf_det_slots;
+	int crf_mem_estimate;
+	int crf_mem_max_frames;
+	int crf_cv_threads;
+	int crf_cv_interval;
+	int crf_cv_avg;
+	int crf_cv_patience;
+	int crf_cv_lr_decay;
+	float crf_l1;
+	int crf_sparse_export;
 	int verbose;
 	int dummy;
 } config;
@@ -162,6 +180,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr1_right_context_len", "Length of context features to the right of the window on ftr1_file (frames)", QN_ARG_INT, &(config.ftr1_right_context_len) },
 	{ "ftr1_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr1_extract_seg_ftr) },
 	{ "ftr1_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr1_use_boundary_delta_ftr) },
+	{ "ftr1_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr1_use_kl_ftr) },
 
 	{ "ftr2_file", "Input feature file", QN_ARG_STR, &(config.ftr2_file) },
 	{ "ftr2_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr2_format) },
@@ -179,6 +198,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr2_right_context_len", "Length of context features to the right of the window on ftr2_file (frames)", QN_ARG_INT, &(config.ftr2_right_context_len) },
 	{ "ftr2_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr2_extract_seg_ftr) },
 	{ "ftr2_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr2_use_boundary_delta_ftr) },
+	{ "ftr2_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr2_use_kl_ftr) },
 
 	{ "ftr3_file", "Input feature file", QN_ARG_STR, &(config.ftr3_file) },
 	{ "ftr3_format", "Input feature file format [pfile]", QN_ARG_STR, &(config.ftr3_format) },
@@ -196,6 +216,7 @@ QN_ArgEntry argtab[] =
 	{ "ftr3_right_context_len", "Length of context features to the right of the window on ftr3_file (frames)", QN_ARG_INT, &(config.ftr3_right_context_len) },
 	{ "ftr3_extract_seg_ftr", "Extract segment-level features (as opposed to frame-level features)", QN_ARG_BOOL, &(config.ftr3_extract_seg_ftr) },
 	{ "ftr3_use_boundary_delta_ftr", "Use boundary delta features", QN_ARG_BOOL, &(config.ftr3_use_boundary_delta_ftr) },
+	{ "ftr3_use_kl_ftr", "Add KL divergence features of the posterior frames", QN_ARG_BOOL, &(config.ftr3_use_kl_ftr) },
 
 	{ "window_extent", "Extent of all windows (frames)", QN_ARG_INT, &(config.window_extent) },
 
@@ -231,11 +252,13 @@ QN_ArgEntry argtab[] =
 	{ "crf_use_adagrad", "Whether to use AdaGrad", QN_ARG_BOOL, &(config.crf_use_adagrad) },
 	{ "crf_adagrad_eta", "The scaling factor (eta) for AdaGrad", QN_ARG_FLOAT, &(config.crf_adagrad_eta) },
 	{ "grad_sqr_acc_file", "Input Gradient Square Sum Accumulator File for AdaGrad", QN_ARG_STR, &(config.grad_sqr_acc_file) },
+	{ "crf_ftr_slab", "Read each utterance into one reusable feature buffer instead of one copy per node (SGD)", QN_ARG_BOOL, &(config.crf_ftr_slab) },
 
 	{ "crf_random_seed", "Presentation order random seed", QN_ARG_INT, &(config.crf_random_seed) },
 	{ "crf_train_method", "CRF training method (sg|lbfgs)", QN_ARG_STR, &(config.crf_train_method) },
 	{ "crf_objective_function", "Objective function for gradient training (expf|softexpf|ferr)", QN_ARG_STR, &(config.crf_objective_function) },
-	{ "crf_train_order", "Presentation order of samples for training (seq|random|noreplace)", QN_ARG_STR, &(config.crf_train_order) },
+	{ "crf_train_order", "Presentation order of samples for training (seq|random|noreplace|shuffle)", QN_ARG_STR, &(config.crf_train_order) },
+	{ "crf_shuffle_buffer", "Number of utterances held in memory for the shuffle presentation order", QN_ARG_INT, &(config.crf_shuffle_buffer) },
 	{ "crf_featuremap", "Association of inputs to feature functions (stdstate|stdtrans|stdsparse|stdsparsetrans|file)", QN_ARG_STR, &(config.crf_featuremap) },
 	{ "crf_featuremap_file", "File containing map of inputs to feature functions", QN_ARG_STR, &(config.crf_featuremap_file) },
 	{ "crf_stateftr_start", "Feature index to start computing state feature funcs", QN_ARG_INT, &(config.crf_stateftr_start) },
@@ -249,7 +272,18 @@ QN_ArgEntry argtab[] =
 	{ "crf_state_bias_value", "Function value for state bias functions", QN_ARG_FLOAT, &(config.crf_state_bias_value) },
 	{ "crf_trans_bias_value", "Function value for transition bias functions", QN_ARG_FLOAT, &(config.crf_trans_bias_value) },
 	{ "threads", "Number of threads to use for multithreaded trainers", QN_ARG_INT, &(config.threads) },
+	{ "crf_det_slots", "Deterministic SGD: split each minibatch into this many fixed slots, results do not depend on threads (0 = off)", QN_ARG_INT, &(config.crf_det_slots) },
+	{ "crf_mem_estimate", "Estimate the peak memory before training (0=off, 1=estimate and train, 2=estimate and exit)", QN_ARG_INT, &(config.crf_mem_estimate) },
+	{ "crf_mem_max_frames", "Frames of the longest utterance for crf_mem_estimate (0=read from the feature files)", QN_ARG_INT, &(config.crf_mem_max_frames) },
+	{ "crf_cv_threads", "Threads scoring cv_sent_range in the background during SGD training (0 = no cross-validation)", QN_ARG_INT, &(config.crf_cv_threads) },
+	{ "crf_cv_interval", "Minibatches between cross-validation snapshots (0 = at the end of each epoch only)", QN_ARG_INT, &(config.crf_cv_interval) },
+	{ "crf_cv_avg", "Also score the averaged weights of each cross-validation snapshot", QN_ARG_BOOL, &(config.crf_cv_avg) },
+	{ "crf_cv_patience", "Stop training after this many cross-validation results without improvement (0 = never)", QN_ARG_INT, &(config.crf_cv_patience) },
+	{ "crf_cv_lr_decay", "Apply crf_lr_decay_rate when cross-validation does not improve instead of after every epoch", QN_ARG_BOOL, &(config.crf_cv_lr_decay) },
+	{ "crf_l1", "L1 penalty for SGD and AdaGrad training, applied with the cumulative penalty (0 = off)", QN_ARG_FLOAT, &(config.crf_l1) },
+	{ "crf_sparse_export", "Also write the final weights with only their non-zero values, to <out_weight_file>.sparse.out and .avg.sparse.out", QN_ARG_BOOL, &(config.crf_sparse_export) },
 	{ "crf_ais_l1alpha", "l1 alpha threshold for AIS training", QN_ARG_FLOAT, &(config.crf_ais_l1alpha) },
+	{ "crf_ais_transitions", "Initialize AIS transition biases from the training labels", QN_ARG_BOOL, &(config.crf_ais_transitions) },
 	//	{ "dummy", "Output status messages", QN_ARG_INT, &(config.dummy) },
 	{ "verbose", "Output status messages", QN_ARG_INT, &(config.verbose) },
 	{ NULL, NULL, QN_ARG_NOMOREARGS }
@@ -276,6 +310,7 @@ static void set_defaults(void) {
 	config.ftr1_right_context_len=0;
 	config.ftr1_extract_seg_ftr=false;
 	config.ftr1_use_boundary_delta_ftr=false;
+	config.ftr1_use_kl_ftr=false;
 
 	config.ftr2_file="";
 	config.ftr2_format="pfile";
@@ -293,6 +328,7 @@ static void set_defaults(void) {
 	config.ftr2_right_context_len=0;
 	config.ftr2_extract_seg_ftr=false;
 	config.ftr2_use_boundary_delta_ftr=false;
+	config.ftr2_use_kl_ftr=false;
 
 	config.ftr3_file="";
 	config.ftr3_format="pfile";
@@ -310,6 +346,7 @@ static void set_defaults(void) {
 	config.ftr3_right_context_len=0;
 	config.ftr3_extract_seg_ftr=false;
 	config.ftr3_use_boundary_delta_ftr=false;
+	config.ftr3_use_kl_ftr=false;
 
 	config.window_extent=1;
 
@@ -344,11 +381,13 @@ static void set_defaults(void) {
 	config.crf_use_adagrad=false;
 	config.crf_adagrad_eta=1.0;
 	config.grad_sqr_acc_file=NULL;
+	config.crf_ftr_slab=1;
 
 	config.crf_random_seed=0;
 	config.crf_train_method="sg";
 	config.crf_objective_function="expf";
 	config.crf_train_order="random";
+	config.crf_shuffle_buffer=1000;
 	config.crf_featuremap="stdstate";
 	config.crf_featuremap_file=NULL;
 	config.crf_stateftr_start=0;
@@ -362,10 +401,39 @@ static void set_defaults(void) {
 	config.crf_state_bias_value=1.0;
 	config.crf_trans_bias_value=1.0;
 	config.crf_ais_l1alpha=0.0;
+	config.crf_ais_transitions=0;
 	config.threads=1;
+	config.crf_det_slots=0;
+	config.crf_mem_estimate=0;
+	config.crf_mem_max_frames=0;
+	config.crf_cv_threads=0;
+	config.crf_cv_interval=0;
+	config.crf_cv_avg=1;
+	config.crf_cv_patience=0;
+	config.crf_cv_lr_decay=0;
+	config.crf_l1=0.0;
+	config.crf_sparse_export=0;
 	config.verbose=0;
 };
 
+/*
+ * Returns the number of frames of the longest utterance in str, 0 if the feature files do not
+ * tell it without being read
+ */
+static QNUInt32 find_max_frames(CRF_FeatureStream* str) {
+	QNUInt32 max_frames=0;
+	for (QNUInt32 seg=0; seg<str->num_segs(); seg++) {
+		size_t frames=str->num_frames(seg);
+		if (frames == QN_SIZET_BAD) {
+			return 0;
+		}
+		if (frames > max_frames) {
+			max_frames=frames;
+		}
+	}
+	return max_frames;
+}
+
 /*
  * Sets initial values for the feature map object based on command line config object
  */
@@ -483,6 +551,11 @@ int main(int argc, const char* argv[]) {
 
 	if (strcmp(config.crf_train_order,"seq")==0) { trn_seq=SEQUENTIAL;}
 	if (strcmp(config.crf_train_order,"noreplace")==0) { trn_seq=RANDOM_NO_REPLACE;}
+	if (strcmp(config.crf_train_order,"shuffle")==0) { trn_seq=SHUFFLED;}
+	if ((trn_seq == SHUFFLED) && (config.crf_shuffle_buffer <= 0)) {
+		cerr << "ERROR: crf_shuffle_buffer must be positive when crf_train_order set to 'shuffle'" << endl;
+		exit(-1);
+	}
 
 	if (strcmp(config.crf_featuremap,"stdtrans")==0) { trn_ftrmap=STDTRANS;}
 	if (strcmp(config.crf_featuremap,"stdsparse")==0) { trn_ftrmap=STDSPARSE;}
@@ -501,6 +574,47 @@ int main(int argc, const char* argv[]) {
 		cerr << "ERROR: crf_featuremap_file must be non-NULL when crf_featuremap set to 'file'" << endl;
 		exit(-1);
 	}
+	// in deterministic mode the training streams are split into crf_det_slots slots instead of
+	// one per thread, and the threads share out the slots
+	if (config.crf_det_slots < 0) {
+		cerr << "ERROR: crf_det_slots must not be negative" << endl;
+		exit(-1);
+	}
+	if ((config.crf_det_slots > 0) && (trn_type != SGTRAIN)) {
+		cerr << "ERROR: crf_det_slots is only supported with crf_train_method set to 'sg'" << endl;
+		exit(-1);
+	}
+	int ftr_streams = (config.crf_det_slots > 0) ? config.crf_det_slots : config.threads;
+
+	// background cross-validation reads cv_sent_range through its own streams, one per thread
+	if (config.crf_cv_threads < 0 || config.crf_cv_interval < 0 || config.crf_cv_patience < 0) {
+		cerr << "ERROR: crf_cv_threads, crf_cv_interval and crf_cv_patience must not be negative" << endl;
+		exit(-1);
+	}
+	if (config.crf_cv_threads > 0) {
+		if (config.cv_sent_range == NULL) {
+			cerr << "ERROR: cv_sent_range must be set when crf_cv_threads is positive" << endl;
+			exit(-1);
+		}
+		if (trn_type != SGTRAIN) {
+			cerr << "ERROR: crf_cv_threads is only supported with crf_train_method set to 'sg'" << endl;
+			exit(-1);
+		}
+	}
+	else if (config.crf_cv_patience > 0 || config.crf_cv_lr_decay) {
+		cerr << "ERROR: crf_cv_patience and crf_cv_lr_decay need crf_cv_threads to be positive" << endl;
+		exit(-1);
+	}
+
+	if (config.crf_l1 < 0) {
+		cerr << "ERROR: crf_l1 must not be negative" << endl;
+		exit(-1);
+	}
+	if ((config.crf_l1 > 0 || config.crf_sparse_export) && trn_type != SGTRAIN) {
+		cerr << "ERROR: crf_l1 and crf_sparse_export are only supported with crf_train_method set to 'sg'" << endl;
+		exit(-1);
+	}
+
 	CRF_FeatureStreamManager* str2=NULL;
 	CRF_FeatureStreamManager* str3=NULL;
 
@@ -509,19 +623,19 @@ int main(int argc, const char* argv[]) {
 							(size_t) config.ftr1_width, (size_t) config.ftr1_ftr_start, (size_t) config.ftr1_ftr_count,
 							config.window_extent, config.ftr1_window_offset, config.ftr1_window_len,
 							config.ftr1_left_context_len, config.ftr1_right_context_len, config.ftr1_extract_seg_ftr,
-							config.ftr1_use_boundary_delta_ftr,
+							config.ftr1_use_boundary_delta_ftr, config.ftr1_use_kl_ftr,
 							config.ftr1_delta_order, config.ftr1_delta_win,
 							config.train_sent_range, config.cv_sent_range,
-							NULL,0,0,0,trn_seq,config.crf_random_seed,config.threads);
+							NULL,0,0,0,trn_seq,config.crf_random_seed,ftr_streams,config.crf_shuffle_buffer);
 	if (strcmp(config.ftr2_file,"") != 0) {
 		str2=new CRF_FeatureStreamManager(1,"ftr2_file",config.ftr2_file,config.ftr2_format,config.hardtarget_file, config.hardtarget_window_offset,
 				(size_t) config.ftr2_width, (size_t) config.ftr2_ftr_start, (size_t) config.ftr2_ftr_count,
 				config.window_extent, config.ftr2_window_offset, config.ftr2_window_len,
 				config.ftr2_left_context_len, config.ftr2_right_context_len, config.ftr2_extract_seg_ftr,
-				config.ftr2_use_boundary_delta_ftr,
+				config.ftr2_use_boundary_delta_ftr, config.ftr2_use_kl_ftr,
 				config.ftr2_delta_order, config.ftr2_delta_win,
 				config.train_sent_range, config.cv_sent_range,
-				NULL,0,0,0,trn_seq,config.crf_random_seed,config.threads);
+				NULL,0,0,0,trn_seq,config.crf_random_seed,ftr_streams,config.crf_shuffle_buffer);
 		str1.join(str2);
 	}
 	if (strcmp(config.ftr3_file,"") != 0) {
@@ -529,13 +643,50 @@ int main(int argc, const char* argv[]) {
 									(size_t) config.ftr3_width, (size_t) config.ftr3_ftr_start, (size_t) config.ftr3_ftr_count,
 									config.window_extent, config.ftr3_window_offset, config.ftr3_window_len,
 									config.ftr3_left_context_len, config.ftr3_right_context_len, config.ftr3_extract_seg_ftr,
-									config.ftr3_use_boundary_delta_ftr,
+									config.ftr3_use_boundary_delta_ftr, config.ftr3_use_kl_ftr,
 									config.ftr3_delta_order, config.ftr3_delta_win,
 									config.train_sent_range, config.cv_sent_range,
-									NULL,0,0,0,trn_seq,config.crf_random_seed,config.threads);
+									NULL,0,0,0,trn_seq,config.crf_random_seed,ftr_streams,config.crf_shuffle_buffer);
 		str1.join(str3);
 	}
 
+	// the cross-validation utterances are the training range of these managers, read in order
+	CRF_FeatureStreamManager* cv_str1=NULL;
+	if (config.crf_cv_threads > 0) {
+		cv_str1=new CRF_FeatureStreamManager(1,"cv_ftr1_file",config.ftr1_file,config.ftr1_format,config.hardtarget_file, config.hardtarget_window_offset,
+				(size_t) config.ftr1_width, (size_t) config.ftr1_ftr_start, (size_t) config.ftr1_ftr_count,
+				config.window_extent, config.ftr1_window_offset, config.ftr1_window_len,
+				config.ftr1_left_context_len, config.ftr1_right_context_len, config.ftr1_extract_seg_ftr,
+				config.ftr1_use_boundary_delta_ftr, config.ftr1_use_kl_ftr,
+				config.ftr1_delta_order, config.ftr1_delta_win,
+				config.cv_sent_range, NULL,
+				NULL,0,0,0,SEQUENTIAL,config.crf_random_seed,config.crf_cv_threads,config.crf_shuffle_buffer);
+		if (str2 != NULL) {
+			cv_str1->join(new CRF_FeatureStreamManager(1,"cv_ftr2_file",config.ftr2_file,config.ftr2_format,config.hardtarget_file, config.hardtarget_window_offset,
+					(size_t) config.ftr2_width, (size_t) config.ftr2_ftr_start, (size_t) config.ftr2_ftr_count,
+					config.window_extent, config.ftr2_window_offset, config.ftr2_window_len,
+					config.ftr2_left_context_len, config.ftr2_right_context_len, config.ftr2_extract_seg_ftr,
+					config.ftr2_use_boundary_delta_ftr, config.ftr2_use_kl_ftr,
+					config.ftr2_delta_order, config.ftr2_delta_win,
+					config.cv_sent_range, NULL,
+					NULL,0,0,0,SEQUENTIAL,config.crf_random_seed,config.crf_cv_threads,config.crf_shuffle_buffer));
+		}
+		if (str3 != NULL) {
+			cv_str1->join(new CRF_FeatureStreamManager(1,"cv_ftr3_file",config.ftr3_file,config.ftr3_format,config.hardtarget_file, config.hardtarget_window_offset,
+					(size_t) config.ftr3_width, (size_t) config.ftr3_ftr_start, (size_t) config.ftr3_ftr_count,
+					config.window_extent, config.ftr3_window_offset, config.ftr3_window_len,
+					config.ftr3_left_context_len, config.ftr3_right_context_len, config.ftr3_extract_seg_ftr,
+					config.ftr3_use_boundary_delta_ftr, config.ftr3_use_kl_ftr,
+					config.ftr3_delta_order, config.ftr3_delta_win,
+					config.cv_sent_range, NULL,
+					NULL,0,0,0,SEQUENTIAL,config.crf_random_seed,config.crf_cv_threads,config.crf_shuffle_buffer));
+		}
+		if (cv_str1->trn_stream->num_segs() < (QNUInt32) config.crf_cv_threads) {
+			cerr << "ERROR: cv_sent_range has fewer utterances than crf_cv_threads" << endl;
+			exit(-1);
+		}
+	}
+
 	CRF_Model my_crf(config.crf_label_size);
 	cout << "LABELS: " << my_crf.getNLabs() << endl;
 
@@ -640,6 +791,7 @@ int main(int argc, const char* argv[]) {
 	case AISTRAIN :
 		my_trainer = new CRF_AISTrainer(&my_crf,&str1,config.out_weight_file);
 		((CRF_AISTrainer *)my_trainer)->setl1alpha(config.crf_ais_l1alpha);
+		((CRF_AISTrainer *)my_trainer)->setComputeTransitions(config.crf_ais_transitions);
 		break;
 
 	case SGTRAIN :
@@ -652,8 +804,21 @@ int main(int argc, const char* argv[]) {
 		((CRF_SGTrainer *)my_trainer)->setEta(config.crf_adagrad_eta);
 		((CRF_SGTrainer *)my_trainer)->setNThreads(config.threads);
 		((CRF_SGTrainer *)my_trainer)->setMinibatch(config.crf_bunch_size);
+		((CRF_SGTrainer *)my_trainer)->setUseFtrSlab(config.crf_ftr_slab);
+		((CRF_SGTrainer *)my_trainer)->setLogChecksum(config.crf_det_slots > 0);
+		((CRF_SGTrainer *)my_trainer)->setCV(cv_str1,config.crf_cv_interval,config.crf_cv_avg);
+		((CRF_SGTrainer *)my_trainer)->setCVPatience(config.crf_cv_patience);
+		((CRF_SGTrainer *)my_trainer)->setCVLRDecay(config.crf_cv_lr_decay);
+		((CRF_SGTrainer *)my_trainer)->setL1(config.crf_l1);
+		((CRF_SGTrainer *)my_trainer)->setSparseExport(config.crf_sparse_export);
 		cout << "MINIBATCH SIZE: " << config.crf_bunch_size << endl;
 		cout << "NUMBER OF THREADS: " << config.threads << endl;
+		if (config.crf_det_slots > 0) {
+			cout << "DETERMINISTIC SLOTS: " << config.crf_det_slots << endl;
+		}
+		if (config.crf_cv_threads > 0) {
+			cout << "CV THREADS: " << config.crf_cv_threads << endl;
+		}
 
 		break;
 	}
@@ -669,6 +834,28 @@ int main(int argc, const char* argv[]) {
 		my_trainer->setGaussVar(config.crf_gauss_var);
 	}
 
+	if (config.crf_mem_estimate) {
+		QNUInt32 max_frames=config.crf_mem_max_frames;
+		if (max_frames == 0) {
+			max_frames=find_max_frames(str1.trn_stream);
+		}
+		if (max_frames == 0) {
+			cerr << "ERROR: the length of the utterances cannot be read from the feature files, set crf_mem_max_frames" << endl;
+			exit(-1);
+		}
+		CRF_MemEstimator estimator(&my_crf,str1.getNumFtrs(),max_frames);
+		if (trn_type == LBFGSTRAIN) {
+			// the weights, gradient and the two vectors of each of the 6 corrections kept by lbfgs
+			estimator.setNumWeightCopies(16);
+		}
+		CRF_MemEstimate est=estimator.estimateTraining(ftr_streams);
+		cout << "Memory estimate: threads=" << ftr_streams << " longest=" << max_frames << " frames "
+				<< CRF_MemEstimator::format(est) << endl;
+		if (config.crf_mem_estimate == 2) {
+			return 0;
+		}
+	}
+
 	try {
 
 		// Added by Ryan, supporting auto-resume
@@ -682,6 +869,7 @@ int main(int argc, const char* argv[]) {
 		}
 
 		my_trainer->train();
+		cout << "Memory: " << CRF_MemStats::report() << endl;
 	}
 	catch (exception &e) {
 		cerr << "Exception: " << e.what() << endl;
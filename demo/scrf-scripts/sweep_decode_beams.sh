@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+
+# Decodes the same test set with CRFDecode for every combination of state beam and
+# transition beam, and prints the search speed against the error rate of each run.
+# A transition beam of 0 runs the standard search (crf_decode_search=std), any other
+# value runs the transition-pruning search (crf_decode_search=prunetrans).
+
+set -e
+set -o pipefail
+
+beams=
+trans_beams=
+score_cmd=
+outdir=
+
+USAGE="Usage:
+
+$0 [options] -- <CRFDecode arguments, without crf_decode_beam/crf_output_mlffile>
+  --beams=[state beams, e.g. \"4 8 12\"]
+  --trans_beams=[transition beams, default=\"0\"]
+  --score_cmd=[scoring command, called with the output MLF as its last argument;
+               the last number it prints is taken as the error rate]
+  --outdir=[directory for the MLFs and logs of each run]
+  -h  [print this help message]
+"
+
+parsed_opts=`getopt -o h --long beams:,trans_beams:,score_cmd:,outdir: -n "$0" -- "$@"`
+eval set -- "$parsed_opts"
+
+while true; do
+    case "$1" in
+	-h)
+	    echo "$USAGE"
+	    exit ;;
+	--beams)
+	    beams=$2; shift 2 ;;
+	--trans_beams)
+	    trans_beams=$2; shift 2 ;;
+	--score_cmd)
+	    score_cmd=$2; shift 2 ;;
+	--outdir)
+	    outdir=$2; shift 2 ;;
+	--)
+	    shift; break;;
+	*)
+	    echo "Unknown option $1"; exit 1 ;;
+    esac
+done
+
+if [ -z "$beams" ] || [ -z "$score_cmd" ] || [ -z "$outdir" ] || [ $# -eq 0 ]; then
+  echo "$USAGE"
+  exit 1
+fi
+
+if [ -z "$trans_beams" ]; then
+  trans_beams=0
+fi
+
+mkdir -p $outdir
+
+printf "%-8s %-8s %-10s %-10s %-12s %-10s %s\n" beam trans search secs frames/sec kept/frame error
+for beam in $beams; do
+  for trans_beam in $trans_beams; do
+    if [ "$trans_beam" == "0" ]; then
+      search=std
+    else
+      search=prunetrans
+    fi
+    run=$outdir/beam$beam.trans$trans_beam
+    CRFDecode "$@" \
+      crf_decode_beam=$beam \
+      crf_decode_search=$search \
+      crf_decode_trans_beam=$trans_beam \
+      crf_output_mlffile=$run.mlf > $run.log 2>&1
+
+    summary=`grep "^Search summary:" $run.log | tail -1`
+    if [ -z "$summary" ]; then
+      echo "Error: no search summary in $run.log" 1>&2
+      exit 1
+    fi
+    secs=`echo $summary | sed -e 's/.* secs=\([^ ]*\).*/\1/'`
+    fps=`echo $summary | sed -e 's/.* frames_per_sec=\([^ ]*\).*/\1/'`
+    kept=`echo $summary | sed -e 's/.* kept_per_frame=\([^ ]*\).*/\1/'`
+
+    $score_cmd $run.mlf > $run.score 2>&1
+    error=`grep -o "[0-9][0-9]*\(\.[0-9]*\)\?" $run.score | tail -1`
+
+    printf "%-8s %-8s %-10s %-10s %-12s %-10s %s\n" $beam $trans_beam $search $secs $fps $kept $error
+  done
+done